@@ -0,0 +1,47 @@
+#include "ble_addr_set.h"
+
+#include <string.h>
+
+
+/* FNV-1a of the address */
+static uint32_t ble_addr_hash (const uint8_t addr[BLE_ADDR_LEN]) {
+    uint32_t hash = 2166136261u;
+
+    for (int i = 0; i < BLE_ADDR_LEN; i++) {
+        hash ^= addr[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+void ble_addr_set_clear (ble_addr_set_t *set) {
+    memset(set->used, 0, sizeof(set->used));
+    set->count = 0;
+    set->dropped = 0;
+}
+
+bool ble_addr_set_add (ble_addr_set_t *set, const uint8_t addr[BLE_ADDR_LEN]) {
+    uint32_t slot = ble_addr_hash(addr) % BLE_ADDR_SET_SLOTS;
+
+    /* Linear probing, the table is never more than half full */
+    while (set->used[slot]) {
+        if (memcmp(set->addr[slot], addr, BLE_ADDR_LEN) == 0) return false;
+        slot = (slot + 1) % BLE_ADDR_SET_SLOTS;
+    }
+
+    if (set->count >= CONFIG_MAX_BLE_DEVICES) {
+        if (set->dropped < UINT16_MAX) set->dropped++;
+        return false;
+    }
+
+    memcpy(set->addr[slot], addr, BLE_ADDR_LEN);
+    set->used[slot] = true;
+    set->count++;
+
+    return true;
+}
+
+uint16_t ble_addr_set_count (const ble_addr_set_t *set) {
+    return set->count;
+}
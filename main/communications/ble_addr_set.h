@@ -0,0 +1,41 @@
+#ifndef BLE_ADDR_SET_H_ 
+#define BLE_ADDR_SET_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+/**
+ *  Set of the BLE addresses found during a scan
+ *  Open addressing hash table in static memory, sized for CONFIG_MAX_BLE_DEVICES
+ *  at a load factor of 1/2 at most. Adding an address costs O(1) and nothing is
+ *  allocated during the scan
+ */
+
+#define BLE_ADDR_LEN            6
+#define BLE_ADDR_SET_SLOTS      (2 * CONFIG_MAX_BLE_DEVICES + 1)
+
+typedef struct {
+    uint8_t addr[BLE_ADDR_SET_SLOTS][BLE_ADDR_LEN];
+    bool used[BLE_ADDR_SET_SLOTS];
+    uint16_t count;
+    uint16_t dropped;       // New addresses not stored because the set was full
+} ble_addr_set_t;
+
+/* Empties the set */
+void ble_addr_set_clear (ble_addr_set_t *set);
+
+/**
+ * @brief   Adds an address to the set
+ *
+ * @return
+ *  - true  if the address was not in the set
+ *  - false if it was already there or the set is full
+ */
+bool ble_addr_set_add (ble_addr_set_t *set, const uint8_t addr[BLE_ADDR_LEN]);
+
+/* Number of different addresses in the set */
+uint16_t ble_addr_set_count (const ble_addr_set_t *set);
+
+#endif
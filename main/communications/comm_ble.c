@@ -12,92 +12,34 @@
 #include "esp_bt_main.h"
 
 #include "globals.h"
+#include "ble_addr_set.h"
 
 
 /* RSSI thresold to estimate if a found device is in range of the area */
 #define BLE_RSSI_THRESOLD	-80
 
-/* Dummy element to ease the storage algorithm of the found devices */
-MAC_BLE_ELEM_t zero_addr = {{0,0,0,0,0,0}, NULL};
-
-/* Array to store the addresses of the found device */
-MAC_BLE_ELEM_t* ble_dev_found;
+/* Addresses of the devices found in the current scan */
+static ble_addr_set_t ble_dev_found;
 
 /* Last estimation done */
 static uint8_t ble_last_estimation;
 
 
-/**
- * @brief   Compares two BLE device addresses
- *
- * @param[in] op1   The first address to compare
- * @param[in] op2	The second address to compare
- * @return
- *	- 1 if they are the same
- *	- 0 if they are different
- */
-static int cmp_addr(MAC_BLE_ELEM_t* op1, MAC_BLE_ELEM_t* op2) {
-	return op1->addr[0] == op2->addr[0] 
-        && op1->addr[1] == op2->addr[1] 
-        && op1->addr[2] == op2->addr[2] 
-        && op1->addr[3] == op2->addr[3] 
-        && op1->addr[4] == op2->addr[4] 
-        && op1->addr[5] == op2->addr[5];
-}
-
-/**
- * @brief   Searchs if an address has been found previously
- *
- * @param[in] actual_addr   The address to check if it exists
- * @return
- *	- 1 if they are the same
- *	- 0 if they are different
- */
-static int repeted_addr(MAC_BLE_ELEM_t* actual_addr) {
-	if(ble_dev_found->prev == NULL) return 0;
-	
-	MAC_BLE_ELEM_t* ble_dev_aux = ble_dev_found;
-	int encontrado = 0;
-
-	while(ble_dev_aux->prev != NULL){
-		encontrado |= cmp_addr(actual_addr, ble_dev_aux);
-		ble_dev_aux = ble_dev_aux->prev;
-	}
-
-	return encontrado;
-}
-
-/* Adds a new address to the array */
+/* Adds the address of a device in range to the current scan */
 static void add_device_to_array (esp_ble_gap_cb_param_t *param) {
-	MAC_BLE_ELEM_t* actual_addr;
-	actual_addr = (MAC_BLE_ELEM_t*)malloc(sizeof(MAC_BLE_ELEM_t));
-	
-	actual_addr->addr[0] = param->scan_rst.bda[0];
-	actual_addr->addr[1] = param->scan_rst.bda[1];
-	actual_addr->addr[2] = param->scan_rst.bda[2];
-	actual_addr->addr[3] = param->scan_rst.bda[3];
-	actual_addr->addr[4] = param->scan_rst.bda[4];
-	actual_addr->addr[5] = param->scan_rst.bda[5];
-	
-	if (!repeted_addr(actual_addr)) {
-		actual_addr->prev = ble_dev_found;
-		ble_dev_found = actual_addr;
-	}
+	ble_addr_set_add(&ble_dev_found, param->scan_rst.bda);
 }
 
-/* Clears the array */
+/* Updates the estimation with the devices found and clears them */
 static void clear_array (void) {
-	uint8_t total_dev = 0;
-	MAC_BLE_ELEM_t* ble_dev_aux = ble_dev_found;
-
-	while(ble_dev_found->prev != NULL){
-		total_dev++;
-		ble_dev_aux = ble_dev_found;
-		ble_dev_found = ble_dev_found->prev;
-		free(ble_dev_aux);
+	uint16_t total_dev = ble_addr_set_count(&ble_dev_found);
+
+	if (ble_dev_found.dropped) {
+		ESP_LOGW(TAG_BLE, "Scan set full, %d new addresses not counted (max %d)", ble_dev_found.dropped, CONFIG_MAX_BLE_DEVICES);
 	}
 
-	ble_last_estimation = total_dev;
+	ble_last_estimation = total_dev > UINT8_MAX ? UINT8_MAX : total_dev;
+	ble_addr_set_clear(&ble_dev_found);
 	ESP_LOGI(TAG_BLE,"Number of devices in the room -> %d", ble_last_estimation);
 }
 
@@ -206,9 +148,8 @@ esp_err_t esp_ble_init(void) {
 }
 
 void scan_BLE_devices(int duration) {   
-	/* Allocate memory to store the scanned devices */
-	ble_dev_found = (MAC_BLE_ELEM_t*)malloc(sizeof(MAC_BLE_ELEM_t) * CONFIG_MAX_BLE_DEVICES);
-	ble_dev_found = &zero_addr;
+	/* Devices of an interrupted scan are not counted */
+	ble_addr_set_clear(&ble_dev_found);
 
 	ESP_LOGI(TAG_BLE, "Device scanning started (duration %ds)", duration);
 	esp_ble_gap_start_scanning(duration);  
@@ -5,12 +5,6 @@
 #include "esp_err.h"
 
 
-/* Type definition for storing a BLE device address */
-typedef struct MAC_BLE_ELEM{
-	uint8_t addr[6];
-	struct MAC_BLE_ELEM* prev;
-} MAC_BLE_ELEM_t;
-
 /* Initializes BLE */
 esp_err_t esp_ble_init(void);
 
@@ -0,0 +1,144 @@
+#include "comm_coalesce.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "globals.h"
+#include "node_config.h"
+#include "comm_publisher.h"
+#include "../telemetry/telemetry.h"
+
+
+/* Results waiting to be published, protected by "coalesce_mutex" */
+static telemetry_batch_t batch;
+static int64_t batch_first_us;          // When the oldest result was added
+static int64_t batch_added_us;          // Sum of the times the results were added
+static bool batch_urgent;
+static SemaphoreHandle_t coalesce_mutex;
+static TaskHandle_t coalesce_task_handle;
+
+/* Counters, also protected by "coalesce_mutex" */
+static coalesce_stats_t stats;
+static uint64_t stats_delay_us;
+
+
+static size_t coalesce_items (void) {
+    return batch.co2_count + batch.ble_count;
+}
+
+/* Called with the mutex taken after adding a result */
+static void coalesce_added (bool urgent) {
+    int64_t now_us = esp_timer_get_time();
+
+    if (coalesce_items() == 1) batch_first_us = now_us;
+    batch_added_us += now_us;
+    batch_urgent |= urgent;
+
+    /* The task only has to be woken up when the flush cannot wait for the deadline */
+    bool full = batch.co2_count == TELEMETRY_BATCH_MAX || batch.ble_count == TELEMETRY_BATCH_MAX ||
+                telemetry_batch_len(&batch) >= CONFIG_COALESCE_MAX_PAYLOAD;
+    if (coalesce_items() == 1 || full || urgent) xTaskNotifyGive(coalesce_task_handle);
+}
+
+void coalesce_co2 (uint32_t ts, const window_stats_result_t *co2, bool urgent) {
+    xSemaphoreTake(coalesce_mutex, portMAX_DELAY);
+    if (telemetry_batch_add_co2(&batch, ts, co2)) coalesce_added(urgent);
+    else if (ts == 0) ESP_LOGW(TAG_COALESCE, "Time not set, CO2 window dropped");
+    else ESP_LOGW(TAG_COALESCE, "Batch full, CO2 window dropped");
+    xSemaphoreGive(coalesce_mutex);
+}
+
+void coalesce_ble (uint32_t ts, uint8_t people, bool urgent) {
+    xSemaphoreTake(coalesce_mutex, portMAX_DELAY);
+    if (telemetry_batch_add_ble(&batch, ts, people)) coalesce_added(urgent);
+    else if (ts == 0) ESP_LOGW(TAG_COALESCE, "Time not set, people estimation dropped");
+    else ESP_LOGW(TAG_COALESCE, "Batch full, people estimation dropped");
+    xSemaphoreGive(coalesce_mutex);
+}
+
+void coalesce_get_stats (coalesce_stats_t *out) {
+    if (coalesce_mutex == NULL) {
+        *out = (coalesce_stats_t){ 0 };
+        return;
+    }
+
+    xSemaphoreTake(coalesce_mutex, portMAX_DELAY);
+    *out = stats;
+    out->delay_avg_ms = stats.items ? stats_delay_us / stats.items / 1000 : 0;
+    xSemaphoreGive(coalesce_mutex);
+}
+
+/* Publishes the batch if it is due, returns the ticks to wait until the next deadline */
+static TickType_t coalesce_flush (void) {
+    static uint8_t buf[TELEMETRY_BATCH_LEN];
+
+    xSemaphoreTake(coalesce_mutex, portMAX_DELAY);
+
+    size_t items = coalesce_items();
+    if (items == 0) {
+        xSemaphoreGive(coalesce_mutex);
+        return portMAX_DELAY;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    int64_t waited_ms = (now_us - batch_first_us) / 1000;
+    bool full = batch.co2_count == TELEMETRY_BATCH_MAX || batch.ble_count == TELEMETRY_BATCH_MAX ||
+                telemetry_batch_len(&batch) >= CONFIG_COALESCE_MAX_PAYLOAD;
+    if (!full && !batch_urgent && waited_ms < CONFIG_COALESCE_MAX_LATENCY_MS) {
+        xSemaphoreGive(coalesce_mutex);
+        return pdMS_TO_TICKS(CONFIG_COALESCE_MAX_LATENCY_MS - waited_ms) + 1;
+    }
+
+    const node_config_t *config = node_config_acquire();
+    size_t len = telemetry_encode_batch(buf, sizeof(buf), &config->id_cbor, &batch);
+    node_config_release(config);
+    publisher_class_t class = batch_urgent ? PUBLISHER_ALERT : PUBLISHER_TELEMETRY;
+    int64_t delay_us = items * now_us - batch_added_us;
+
+    telemetry_batch_reset(&batch);
+    batch_added_us = 0;
+    batch_urgent = false;
+
+    xSemaphoreGive(coalesce_mutex);
+
+    /* Queued out of the lock, the sampling tasks keep adding results meanwhile */
+    if (len == 0 || publisher_send(class, buf, len) != ESP_OK) {
+        ESP_LOGW(TAG_COALESCE, "Batch of %d results not published", (int)items);
+        return portMAX_DELAY;
+    }
+
+    /* Only the batches handed to the publisher are counted */
+    xSemaphoreTake(coalesce_mutex, portMAX_DELAY);
+    stats.messages++;
+    stats.items += items;
+    stats.saved = stats.items - stats.messages;
+    stats_delay_us += delay_us;
+    if (waited_ms > stats.delay_max_ms) stats.delay_max_ms = waited_ms;
+    xSemaphoreGive(coalesce_mutex);
+
+    return portMAX_DELAY;
+}
+
+static void coalesce_task (void *pvParameter) {
+    TickType_t wait = portMAX_DELAY;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, wait);
+        wait = coalesce_flush();
+    }
+}
+
+esp_err_t coalesce_start (void) {
+    coalesce_mutex = xSemaphoreCreateMutex();
+    telemetry_batch_reset(&batch);
+
+    if (xTaskCreate(&coalesce_task, "Coalesce task", 4096, NULL, 5, &coalesce_task_handle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,39 @@
+#ifndef COMM_COALESCE_H_
+#define COMM_COALESCE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "../processing/window_stats.h"
+
+/**
+ *  Publish coalescing
+ *  CO2 windows and people estimations are kept in a single batch (see telemetry.h)
+ *  and published together, so several results share the MQTT/TLS overhead and the
+ *  radio wake-up. The batch is flushed when its oldest result has waited
+ *  CONFIG_COALESCE_MAX_LATENCY_MS, when it reaches CONFIG_COALESCE_MAX_PAYLOAD bytes,
+ *  or right away when an urgent result is added
+ */
+
+typedef struct {
+    uint32_t messages;          // Batches published
+    uint32_t items;             // Results sent in them
+    uint32_t saved;             // Messages saved (items - messages)
+    uint32_t delay_avg_ms;      // Mean time waited by a result before being sent
+    uint32_t delay_max_ms;
+} coalesce_stats_t;
+
+/* Starts the flush task */
+esp_err_t coalesce_start (void);
+
+/* Adds a CO2 window measured at "ts" (epoch secs) */
+void coalesce_co2 (uint32_t ts, const window_stats_result_t *co2, bool urgent);
+
+/* Adds a people estimation measured at "ts" (epoch secs) */
+void coalesce_ble (uint32_t ts, uint8_t people, bool urgent);
+
+/* Counters since boot */
+void coalesce_get_stats (coalesce_stats_t *stats);
+
+#endif
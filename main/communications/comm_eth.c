@@ -0,0 +1,46 @@
+#include "comm_eth.h"
+
+#include "esp_log.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_eth.h"
+
+#include "globals.h"
+
+
+#ifdef CONFIG_ETH_USE_OPENETH
+static void eth_got_ip_handler (void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
+    ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
+    ESP_LOGI(TAG_ETH, "Got IP " IPSTR, IP2STR(&event->ip_info.ip));
+}
+
+esp_err_t eth_openeth_start (void) {
+    esp_netif_config_t netif_config = ESP_NETIF_DEFAULT_ETH();
+    esp_netif_t *netif = esp_netif_new(&netif_config);
+    esp_err_t err;
+
+    if ((err = esp_eth_set_default_handlers(netif)) != ESP_OK) return err;
+    if ((err = esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, &eth_got_ip_handler, NULL)) != ESP_OK) return err;
+
+    /* The PHY of the emulator answers as a DP83848, there is no real link to negotiate */
+    eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
+    eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
+    phy_config.autonego_timeout_ms = 100;
+    esp_eth_mac_t *mac = esp_eth_mac_new_openeth(&mac_config);
+    esp_eth_phy_t *phy = esp_eth_phy_new_dp83848(&phy_config);
+
+    esp_eth_config_t config = ETH_DEFAULT_CONFIG(mac, phy);
+    esp_eth_handle_t eth_handle = NULL;
+    if ((err = esp_eth_driver_install(&config, &eth_handle)) != ESP_OK) return err;
+    if ((err = esp_netif_attach(netif, esp_eth_new_netif_glue(eth_handle))) != ESP_OK) return err;
+
+    ESP_LOGI(TAG_ETH, "Starting emulated Ethernet");
+    return esp_eth_start(eth_handle);
+}
+
+#else
+esp_err_t eth_openeth_start (void) {
+    /* The MAC driver is only built with "Support OpenCores Ethernet MAC" (ETH_USE_OPENETH) */
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif
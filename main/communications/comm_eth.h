@@ -0,0 +1,16 @@
+#ifndef COMM_ETH_H_ 
+#define COMM_ETH_H_
+
+#include "esp_err.h"
+
+/**
+ *  Emulated Ethernet
+ *  Brings up the OpenCores Ethernet MAC of the ESP32 QEMU machine with DHCP,
+ *  instead of the Wi-Fi provisioning (there is no Wi-Fi in the emulator). With
+ *  the user networking of QEMU the host is reachable at 10.0.2.2
+ */
+
+/* Starts the interface, the IP is got in the background as with Wi-Fi */
+esp_err_t eth_openeth_start (void);
+
+#endif
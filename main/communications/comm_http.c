@@ -1,17 +1,29 @@
 #include "comm_http.h"
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "esp_https_server.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "esp_log.h"
-#include "cJSON.h"
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
 
 #include "globals.h"
-#include "../sensors/sensor_sgp30.h"
+#include "node_config.h"
+#include "../sensors/sensors.h"
+#include "../storage/history.h"
 #include "comm_ble.h"
+#include "comm_mqtt.h"
+#include "comm_coalesce.h"
+#include "comm_publisher.h"
+#include "rest_writer.h"
+#include "../telemetry/telemetry.h"
 
 
 #define REST_CHECK(a, str, ...)                                                        \
@@ -25,57 +37,335 @@
     } while (0)
 
 
-/* Handler for getting system info */
-static esp_err_t system_info_get_handler(httpd_req_t *req) {
-    httpd_resp_set_type(req, "application/json");
+/* Requests handled since the server started (the server runs in a single task) */
+static uint32_t http_requests;
+
+/* Handlers registered in start_rest_server (8), with room for a few more */
+#define HTTP_MAX_URI_HANDLERS   12
+
+/**
+ *  Sessions that made a request, with the request count at their last one. The
+ *  LRU purge of the server is disabled: it only counts requests, so a stream
+ *  client (no requests after subscribing) would always be the session closed.
+ *  Instead, when a request takes the last socket, the session used least recently
+ *  that is not a stream is closed, so a new client always finds a socket
+ */
+typedef struct {
+    int fd;                     // -1 if the slot is free
+    uint32_t used;
+} http_session_t;
+static http_session_t http_sessions[CONFIG_HTTP_MAX_OPEN_SOCKETS];
+
+#ifdef CONFIG_DEADBAND_REPORTING
+/* Deadbands of the sensor tasks, their counters are only read here */
+static const deadband_t *volatile http_deadbands[HTTP_DEADBANDS];
+#endif
+
+/* Room of a response, taken from the stack of the server task */
+#define HTTP_RESP_LEN           768
+
+/**
+ *  Responses that only change with the node config, built once per format
+ *  (single server task, so no locking is needed)
+ */
+#define HTTP_CACHE_LEN          192
+typedef struct {
+    bool valid;
+    size_t len;
+    uint8_t buf[HTTP_CACHE_LEN];
+} http_cache_t;
+static http_cache_t system_info_cache[REST_FORMATS];
+static http_cache_t node_info_cache[REST_FORMATS];
+
+/**
+ *  History responses are streamed in chunks, each one holding a page of samples
+ *  read from the store. The buffer is reused by every request (single server task),
+ *  so the memory used does not depend on the requested range
+ */
+#define HTTP_HISTORY_PAGE_LEN   16
+#define HTTP_HISTORY_ITEM_LEN   40      // Longest CSV line or CBOR map of a sample
+static ts_bucket_t history_page[HTTP_HISTORY_PAGE_LEN];
+static uint8_t history_chunk[HTTP_HISTORY_PAGE_LEN * HTTP_HISTORY_ITEM_LEN + 1];
+
+/**
+ *  Live stream: the last frame of each kind is kept in both formats, ready to be
+ *  sent. The producers only build it and queue a work item, the frames are sent to
+ *  the clients by the server task, so a slow client never stalls the sampling
+ */
+#define HTTP_STREAM_CO2         0
+#define HTTP_STREAM_BLE         1
+#define HTTP_STREAM_KINDS       2
+
+/* A frame is a chunk: size line ("%04x\r\n"), payload and "\r\n" */
+#define HTTP_STREAM_HEAD_LEN    6
+#define HTTP_STREAM_PAYLOAD_LEN 160
+#define HTTP_STREAM_FRAME_LEN   (HTTP_STREAM_HEAD_LEN + HTTP_STREAM_PAYLOAD_LEN + 2)
+
+typedef struct {
+    size_t len;                 // 0 if there is no frame yet
+    uint8_t buf[HTTP_STREAM_FRAME_LEN];
+} http_stream_frame_t;
+
+typedef struct {
+    int fd;                     // -1 if the slot is free
+    rest_format_t format;
+} http_stream_client_t;
+
+static httpd_handle_t http_server;
+
+/* Only used by the server task */
+static http_stream_client_t stream_clients[CONFIG_HTTP_STREAM_MAX_CLIENTS];
+static http_stream_frame_t stream_out[HTTP_STREAM_KINDS][REST_FORMATS];
+
+/* Read by the producers to skip the frames when nobody listens */
+static volatile uint8_t stream_client_count;
+
+/* Shared with the producers, guarded by the mutex */
+static SemaphoreHandle_t stream_mutex;
+static http_stream_frame_t stream_latest[HTTP_STREAM_KINDS][REST_FORMATS];
+static bool stream_fresh[HTTP_STREAM_KINDS];
+static bool stream_queued;
+
+/* Streams may not take every socket, the requests would have none left */
+_Static_assert(CONFIG_HTTP_STREAM_MAX_CLIENTS < CONFIG_HTTP_MAX_OPEN_SOCKETS, "HTTP_STREAM_MAX_CLIENTS must be below HTTP_MAX_OPEN_SOCKETS");
+
+
+static bool http_stream_subscribed (int fd) {
+    for (int i = 0; i < CONFIG_HTTP_STREAM_MAX_CLIENTS; i++) {
+        if (stream_clients[i].fd == fd) return true;
+    }
+    return false;
+}
+
+/* Counts a request of a session, closing the least recently used one if it takes the last socket */
+static void http_request_begin (httpd_req_t *req) {
+    int fd = httpd_req_to_sockfd(req);
+    int slot = -1;
+
+    http_requests++;
+
+    for (int i = 0; i < CONFIG_HTTP_MAX_OPEN_SOCKETS && slot < 0; i++) {
+        if (http_sessions[i].fd == fd) slot = i;
+    }
+    for (int i = 0; i < CONFIG_HTTP_MAX_OPEN_SOCKETS && slot < 0; i++) {
+        if (http_sessions[i].fd < 0) slot = i;
+    }
+    if (slot < 0) return;
+
+    http_sessions[slot].fd = fd;
+    http_sessions[slot].used = http_requests;
+
+    int lru = -1;
+    for (int i = 0; i < CONFIG_HTTP_MAX_OPEN_SOCKETS; i++) {
+        if (http_sessions[i].fd < 0) return;
+        if (i == slot || http_stream_subscribed(http_sessions[i].fd)) continue;
+        if (lru < 0 || http_sessions[i].used < http_sessions[lru].used) lru = i;
+    }
+    if (lru < 0) return;
+
+    /* The session leaves the table now, it is closed later by the server task */
+    ESP_LOGD(TAG_HTTP, "Session %d closed, every socket in use", http_sessions[lru].fd);
+    httpd_sess_trigger_close(http_server, http_sessions[lru].fd);
+    http_sessions[lru].fd = -1;
+}
+
+/* Format asked in the Accept header, JSON if there is none or it is not supported */
+static rest_format_t http_format (httpd_req_t *req) {
+    char accept[64] = "";
+
+    /* A truncated header is still searched, its beginning is copied */
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept", accept, sizeof(accept));
+    if ((err == ESP_OK || err == ESP_ERR_HTTPD_RESULT_TRUNC) && strstr(accept, "application/cbor")) {
+        return REST_FORMAT_CBOR;
+    }
+
+    return REST_FORMAT_JSON;
+}
+
+static esp_err_t http_send (httpd_req_t *req, rest_format_t format, const uint8_t *buf, size_t len) {
+    if (len == 0) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "response too long");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, rest_format_type(format));
+    httpd_resp_set_hdr(req, "Vary", "Accept");
+
+    return httpd_resp_send(req, (const char *)buf, len);
+}
+
+/* Builds a response in the negotiated format and sends it */
+static esp_err_t http_send_built (httpd_req_t *req, void (*build)(rest_writer_t *writer)) {
+    uint8_t buf[HTTP_RESP_LEN];
+    rest_writer_t writer;
+    rest_format_t format = http_format(req);
+
+    rest_writer_init(&writer, format, buf, sizeof(buf));
+    build(&writer);
 
-    cJSON *root = cJSON_CreateObject();
+    return http_send(req, format, buf, rest_writer_finish(&writer));
+}
+
+/* As http_send_built, the response is only built the first time */
+static esp_err_t http_send_cached (httpd_req_t *req, http_cache_t *cache, void (*build)(rest_writer_t *writer)) {
+    rest_format_t format = http_format(req);
+    http_cache_t *entry = &cache[format];
+
+    if (!entry->valid) {
+        rest_writer_t writer;
+        rest_writer_init(&writer, format, entry->buf, sizeof(entry->buf));
+        build(&writer);
+        entry->len = rest_writer_finish(&writer);
+        entry->valid = entry->len != 0;
+    }
+
+    return http_send(req, format, entry->buf, entry->len);
+}
+
+static void http_cache_invalidate (http_cache_t *cache) {
+    for (int i = 0; i < REST_FORMATS; i++) cache[i].valid = false;
+}
+
+static void system_info_build (rest_writer_t *writer) {
     esp_chip_info_t chip_info;
     esp_chip_info(&chip_info);
-    cJSON_AddStringToObject(root, "version", IDF_VER);
-    cJSON_AddNumberToObject(root, "cores", chip_info.cores);
-    
-    const char *sys_info = cJSON_Print(root);
-    httpd_resp_sendstr(req, sys_info);
 
-    free((void *)sys_info);
-    cJSON_Delete(root);
+    rest_writer_map_begin(writer, NULL);
+    rest_writer_string(writer, "version", IDF_VER);
+    rest_writer_uint(writer, "cores", chip_info.cores);
+    rest_writer_map_end(writer);
+}
+
+/* Handler for getting system info */
+static esp_err_t system_info_get_handler(httpd_req_t *req) {
+    http_request_begin(req);
 
-    return ESP_OK;
+    return http_send_cached(req, system_info_cache, system_info_build);
+}
+
+static void node_info_build (rest_writer_t *writer) {
+    const node_config_t *config = node_config_acquire();
+
+    rest_writer_map_begin(writer, NULL);
+    rest_writer_string(writer, "ESP_LOCATION", config->location);
+    rest_writer_string(writer, "ESP_ID", config->id);
+    rest_writer_map_end(writer);
+
+    node_config_release(config);
 }
 
 /* Handler for getting node info */
 static esp_err_t node_info_get_handler(httpd_req_t *req) {
-    httpd_resp_set_type(req, "application/json");
+    http_request_begin(req);
 
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "ESP_LOCATION", ESP_LOCATION);
-    cJSON_AddStringToObject(root, "ESP_ID", ESP_ID);
-    
-    const char *node_info = cJSON_Print(root);
-    httpd_resp_sendstr(req, node_info);
+    return http_send_cached(req, node_info_cache, node_info_build);
+}
 
-    free((void *)node_info);
-    cJSON_Delete(root);
+static void system_stats_build (rest_writer_t *writer) {
+    rest_writer_map_begin(writer, NULL);
+    rest_writer_uint(writer, "uptime_ms", esp_timer_get_time() / 1000);
+    rest_writer_uint(writer, "requests", http_requests);
+    rest_writer_uint(writer, "heap_free", esp_get_free_heap_size());
+    rest_writer_uint(writer, "heap_min_free", esp_get_minimum_free_heap_size());
+    rest_writer_uint(writer, "heap_largest_block", heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+#ifdef CONFIG_COALESCE_ENABLE
+    coalesce_stats_t coalesce;
+    coalesce_get_stats(&coalesce);
+    rest_writer_map_begin(writer, "coalescing");
+    rest_writer_uint(writer, "messages", coalesce.messages);
+    rest_writer_uint(writer, "items", coalesce.items);
+    rest_writer_uint(writer, "saved", coalesce.saved);
+    rest_writer_uint(writer, "delay_avg_ms", coalesce.delay_avg_ms);
+    rest_writer_uint(writer, "delay_max_ms", coalesce.delay_max_ms);
+    rest_writer_map_end(writer);
+#endif
+
+#ifdef CONFIG_DEADBAND_REPORTING
+    static const char *const reports[HTTP_DEADBANDS] = {"co2", "people"};
+    rest_writer_map_begin(writer, "deadband");
+    for (int i = 0; i < HTTP_DEADBANDS; i++) {
+        const deadband_t *deadband = http_deadbands[i];
+        if (deadband == NULL) continue;
+        rest_writer_map_begin(writer, reports[i]);
+        rest_writer_uint(writer, "reported", deadband->reported);
+        rest_writer_uint(writer, "suppressed", deadband->suppressed);
+        rest_writer_map_end(writer);
+    }
+    rest_writer_map_end(writer);
+#endif
+
+    static const char *const classes[PUBLISHER_CLASSES] = {"alert", "telemetry", "bulk"};
+    publisher_stats_t publisher;
+    publisher_get_stats(&publisher);
+    rest_writer_map_begin(writer, "publisher");
+    rest_writer_uint(writer, "published", publisher.published);
+    rest_writer_uint(writer, "failed", publisher.failed);
+    for (int i = 0; i < PUBLISHER_CLASSES; i++) {
+        rest_writer_map_begin(writer, classes[i]);
+        rest_writer_uint(writer, "depth", publisher.classes[i].depth);
+        rest_writer_uint(writer, "high_water", publisher.classes[i].high_water);
+        rest_writer_uint(writer, "queued", publisher.classes[i].queued);
+        rest_writer_uint(writer, "dropped", publisher.classes[i].dropped);
+        rest_writer_map_end(writer);
+    }
+    rest_writer_map_end(writer);
 
-    return ESP_OK;
+    rest_writer_map_end(writer);
+}
+
+/* Handler for getting runtime stats (e.g. heap low-water during a load test) */
+static esp_err_t system_stats_get_handler(httpd_req_t *req) {
+    http_request_begin(req);
+
+    return http_send_built(req, system_stats_build);
+}
+
+#ifdef CONFIG_DEADBAND_REPORTING
+void http_stats_deadband (http_deadband_t report, const deadband_t *deadband) {
+    if (report < HTTP_DEADBANDS) http_deadbands[report] = deadband;
+}
+#endif
+
+/**
+ *  Receives the whole body of a POST request in "buf" (not NUL-terminated). Bodies
+ *  longer than "len" (or CONFIG_HTTP_MAX_POST_LEN) are answered with 413 and not read
+ *
+ *  @return bytes received, -1 if an error was answered
+ */
+static int http_recv_body (httpd_req_t *req, char *buf, size_t len) {
+    if (req->content_len > len || req->content_len >= CONFIG_HTTP_MAX_POST_LEN) {
+        httpd_resp_set_status(req, "413 Payload Too Large");
+        httpd_resp_sendstr(req, "content too long");
+        return -1;
+    }
+
+    size_t received = 0;
+    while (received < req->content_len) {
+        int ret = httpd_req_recv(req, buf + received, req->content_len - received);
+        if (ret <= 0) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "unknown error");
+            return -1;
+        }
+        received += ret;
+    }
+
+    return received;
 }
 
 /* Handler for modifying ESP_LOCATION */
 static esp_err_t esp_location_post_handler(httpd_req_t *req) {
-    int req_len = req->content_len;
-    if (req_len >= CONFIG_HTTP_MAX_POST_LEN) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "content too long");
-        return ESP_FAIL;
-    }
+    http_request_begin(req);
+
+    char buf[NODE_LOCATION_MAX];
+    int received = http_recv_body(req, buf, sizeof(buf));
+    if (received < 0) return ESP_FAIL;
 
-    char buf[req_len];
-    if (httpd_req_recv(req, buf, req_len) <= 0) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "unknown error");
+    if (node_config_set_location(buf, received) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "invalid ESP_LOCATION");
         return ESP_FAIL;
     }
-
-    strcpy(ESP_LOCATION, buf);
+    http_cache_invalidate(node_info_cache);
     
     httpd_resp_sendstr(req, "ESP_LOCATION modified successfully");
 
@@ -84,42 +374,404 @@ static esp_err_t esp_location_post_handler(httpd_req_t *req) {
 
 /* Handler for modifying ESP_ID */
 static esp_err_t esp_id_post_handler(httpd_req_t *req) {
-    int req_len = req->content_len;
-    if (req_len >= CONFIG_HTTP_MAX_POST_LEN) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "content too long");
-        return ESP_FAIL;
-    }
+    http_request_begin(req);
 
-    char buf[req_len];
-    if (httpd_req_recv(req, buf, req_len) <= 0) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "unknown error");
+    char buf[NODE_ID_MAX];
+    int received = http_recv_body(req, buf, sizeof(buf));
+    if (received < 0) return ESP_FAIL;
+
+    if (node_config_set_id(buf, received) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "invalid ESP_ID");
         return ESP_FAIL;
     }
-
-    strcpy(ESP_ID, buf);
+    http_cache_invalidate(node_info_cache);
     
     httpd_resp_sendstr(req, "ESP_ID modified successfully");
 
     return ESP_OK;
 }
 
+static void capture_build (rest_writer_t *writer) {
+    sensor_reading_t reading;
+    sensors_get_last_reading(SENSORS_PRIMARY, &reading);
+
+    rest_writer_map_begin(writer, NULL);
+    rest_writer_uint(writer, "CO2", reading.co2_ppm);
+    rest_writer_uint(writer, "TVOC", reading.tvoc_ppb);
+    rest_writer_uint(writer, "BLE_people", (uint8_t)get_people_estimation());
+
+    /* Every sensor on the bus */
+    rest_writer_array_begin(writer, "sensors");
+    for (size_t i = 0; i < sensors_count(); i++) {
+        if (sensors_get_last_reading(i, &reading) != ESP_OK) continue;
+
+        rest_writer_map_begin(writer, NULL);
+        rest_writer_string(writer, "name", sensors_name(i));
+        if (reading.fields & SENSOR_FIELD_CO2) rest_writer_uint(writer, "CO2", reading.co2_ppm);
+        if (reading.fields & SENSOR_FIELD_TVOC) rest_writer_uint(writer, "TVOC", reading.tvoc_ppb);
+        if (reading.fields & SENSOR_FIELD_TEMP) rest_writer_fixed(writer, "temp", reading.temp_cdeg, 2);
+        if (reading.fields & SENSOR_FIELD_RH) rest_writer_fixed(writer, "RH", reading.rh_cpct, 2);
+        rest_writer_map_end(writer);
+    }
+    rest_writer_array_end(writer);
+
+    rest_writer_map_end(writer);
+}
+
 /* Handler for capturing sensor data */
 static esp_err_t capture_get_handler(httpd_req_t *req) {
-    httpd_resp_set_type(req, "application/json");
+    http_request_begin(req);
+
+    /* The last readings of the sampling task are served, the I2C bus is not accessed */
+    sensor_reading_t reading;
+    if (sensors_get_last_reading(SENSORS_PRIMARY, &reading) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no reading available yet");
+        return ESP_FAIL;
+    }
+
+    return http_send_built(req, capture_build);
+}
 
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "CO2", (uint32_t)sgp30_co2_reading());
-    cJSON_AddNumberToObject(root, "BLE_people", (uint8_t)get_people_estimation());
-    
-    const char *captured_data = cJSON_Print(root);
-    httpd_resp_sendstr(req, captured_data);
 
-    free((void *)captured_data);
-    cJSON_Delete(root);
+/* Encodes a page of samples as CSV lines, returns the length (0 if it does not fit) */
+static size_t history_encode_csv (const ts_bucket_t *page, size_t n, uint8_t *buf, size_t len) {
+    rest_writer_t writer;
+
+    rest_writer_init(&writer, REST_FORMAT_JSON, buf, len);
+    for (size_t i = 0; i < n; i++) {
+        rest_writer_raw_uint(&writer, page[i].ts);
+        rest_writer_raw(&writer, ",");
+        rest_writer_raw_uint(&writer, page[i].min);
+        rest_writer_raw(&writer, ",");
+        rest_writer_raw_uint(&writer, page[i].max);
+        rest_writer_raw(&writer, ",");
+        rest_writer_raw_uint(&writer, page[i].mean);
+        rest_writer_raw(&writer, ",");
+        rest_writer_raw_uint(&writer, page[i].count);
+        rest_writer_raw(&writer, "\n");
+    }
+
+    return rest_writer_finish(&writer);
+}
+
+/* Encodes a page of samples as CBOR maps (items of an indefinite-length array), returns the length */
+static size_t history_encode_cbor (const ts_bucket_t *page, size_t n, uint8_t *buf, size_t len) {
+    cbor_writer_t writer;
+
+    cbor_writer_init(&writer, buf, len);
+    for (size_t i = 0; i < n; i++) {
+        cbor_writer_byte(&writer, CBOR_MAP(5));
+        cbor_writer_text(&writer, "ts");
+        cbor_writer_head(&writer, CBOR_MAJOR_UINT, page[i].ts);
+        cbor_writer_text(&writer, "min");
+        cbor_writer_head(&writer, CBOR_MAJOR_UINT, page[i].min);
+        cbor_writer_text(&writer, "max");
+        cbor_writer_head(&writer, CBOR_MAJOR_UINT, page[i].max);
+        cbor_writer_text(&writer, "mean");
+        cbor_writer_head(&writer, CBOR_MAJOR_UINT, page[i].mean);
+        cbor_writer_text(&writer, "count");
+        cbor_writer_head(&writer, CBOR_MAJOR_UINT, page[i].count);
+    }
+
+    return cbor_writer_finish(&writer);
+}
+
+/**
+ *  Handler for streaming the history of the node
+ *  Query: series=co2|ble, res=raw|minute|quarter, from/to (epoch secs), format=csv|cbor (else the Accept header)
+ */
+static esp_err_t history_get_handler(httpd_req_t *req) {
+    http_request_begin(req);
+
+    char query[100] = "";
+    char value[16];
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+
+    uint8_t series = TS_SERIES_CO2;
+    if (httpd_query_key_value(query, "series", value, sizeof(value)) == ESP_OK) {
+        if (strcmp(value, "co2") == 0) series = TS_SERIES_CO2;
+        else if (strcmp(value, "ble") == 0) series = TS_SERIES_BLE;
+        else {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "series must be co2 or ble");
+            return ESP_FAIL;
+        }
+    }
+
+    ts_res_t res = TS_RES_MINUTE;
+    if (httpd_query_key_value(query, "res", value, sizeof(value)) == ESP_OK) {
+        if (strcmp(value, "raw") == 0) res = TS_RES_RAW;
+        else if (strcmp(value, "minute") == 0) res = TS_RES_MINUTE;
+        else if (strcmp(value, "quarter") == 0) res = TS_RES_QUARTER;
+        else {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "res must be raw, minute or quarter");
+            return ESP_FAIL;
+        }
+    }
+
+    ts_cursor_t cursor = { .ts = 0, .skip = 0 };
+    uint32_t to_ts = UINT32_MAX;
+    if (httpd_query_key_value(query, "from", value, sizeof(value)) == ESP_OK) cursor.ts = strtoul(value, NULL, 10);
+    if (httpd_query_key_value(query, "to", value, sizeof(value)) == ESP_OK) to_ts = strtoul(value, NULL, 10);
+
+    /* CBOR when asked in the Accept header, unless the query says otherwise */
+    bool cbor = http_format(req) == REST_FORMAT_CBOR;
+    if (httpd_query_key_value(query, "format", value, sizeof(value)) == ESP_OK) cbor = strcmp(value, "cbor") == 0;
+
+    size_t used;
+    httpd_resp_set_hdr(req, "Vary", "Accept");
+    if (cbor) {
+        httpd_resp_set_type(req, "application/cbor");
+        history_chunk[0] = CBOR_ARRAY_INDEFINITE;
+        used = 1;
+    } else {
+        httpd_resp_set_type(req, "text/csv");
+        static const char header[] = "ts,min,max,mean,count\n";
+        memcpy(history_chunk, header, sizeof(header) - 1);
+        used = sizeof(header) - 1;
+    }
+
+    /* Page by page, the cursor moves past the samples sent (even those sharing a timestamp) */
+    size_t n;
+    do {
+        n = history_read(series, res, &cursor, history_page, HTTP_HISTORY_PAGE_LEN);
+
+        size_t in_range = 0;
+        while (in_range < n && history_page[in_range].ts <= to_ts) in_range++;
+
+        /* The header (or array start) fits together with the first page */
+        used += cbor ? history_encode_cbor(history_page, in_range, history_chunk + used, sizeof(history_chunk) - used)
+                     : history_encode_csv(history_page, in_range, history_chunk + used, sizeof(history_chunk) - used);
+        if (used && httpd_resp_send_chunk(req, (const char *)history_chunk, used) != ESP_OK) {
+            ESP_LOGW(TAG_HTTP, "History request aborted by the client");
+            return ESP_FAIL;
+        }
+        used = 0;
+
+        if (in_range < n) break;
+    } while (n == HTTP_HISTORY_PAGE_LEN);
+
+    if (cbor) {
+        history_chunk[0] = CBOR_BREAK;
+        httpd_resp_send_chunk(req, (const char *)history_chunk, 1);
+    }
+
+    /* Zero-length chunk, end of the response */
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/* ----- Live stream ----- */
+
+/* Writes the chunk framing around a payload of "len" bytes (0 leaves the frame empty) */
+static void http_stream_seal (http_stream_frame_t *frame, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+
+    if (len == 0) {
+        frame->len = 0;
+        return;
+    }
+
+    for (int i = 0; i < 4; i++) frame->buf[i] = hex[(len >> (12 - 4 * i)) & 0xf];
+    memcpy(frame->buf + 4, "\r\n", 2);
+    memcpy(frame->buf + HTTP_STREAM_HEAD_LEN + len, "\r\n", 2);
+    frame->len = HTTP_STREAM_HEAD_LEN + len + 2;
+}
+
+/* Starts a server-sent event, its JSON data is written next with "writer" */
+static void http_stream_event (http_stream_frame_t *frame, rest_writer_t *writer, const char *event) {
+    /* Room is left for the blank line that ends the event */
+    rest_writer_init(writer, REST_FORMAT_JSON, frame->buf + HTTP_STREAM_HEAD_LEN, HTTP_STREAM_PAYLOAD_LEN - 2);
+    rest_writer_raw(writer, "event: ");
+    rest_writer_raw(writer, event);
+    rest_writer_raw(writer, "\ndata: ");
+}
+
+/* Ends the event started by http_stream_event */
+static void http_stream_event_end (http_stream_frame_t *frame, rest_writer_t *writer) {
+    uint8_t *payload = frame->buf + HTTP_STREAM_HEAD_LEN;
+    size_t len = rest_writer_finish(writer);
+
+    if (len == 0) {
+        frame->len = 0;
+        return;
+    }
+
+    memcpy(payload + len, "\n\n", 2);
+    http_stream_seal(frame, len + 2);
+}
+
+/* Closes the stream of a client (e.g. after a send timeout) */
+static void http_stream_drop (int slot) {
+    int fd = stream_clients[slot].fd;
+
+    ESP_LOGW(TAG_HTTP, "Stream client %d dropped", fd);
+    stream_clients[slot].fd = -1;
+    stream_client_count--;
+    httpd_sess_trigger_close(http_server, fd);
+}
+
+static bool http_stream_send (int fd, const http_stream_frame_t *frame) {
+    if (frame->len == 0) return true;
+
+    /* The socket has a send timeout, a short write leaves the stream broken too */
+    return httpd_socket_send(http_server, fd, (const char *)frame->buf, frame->len, 0) == (int)frame->len;
+}
+
+/* Work item run by the server task: sends the fresh frames to every client */
+static void http_stream_work (void *arg) {
+    bool fresh[HTTP_STREAM_KINDS];
+
+    /* Frames made fresh from now on queue a new work item */
+    xSemaphoreTake(stream_mutex, portMAX_DELAY);
+    for (int kind = 0; kind < HTTP_STREAM_KINDS; kind++) {
+        fresh[kind] = stream_fresh[kind];
+        stream_fresh[kind] = false;
+        if (fresh[kind]) memcpy(stream_out[kind], stream_latest[kind], sizeof(stream_out[kind]));
+    }
+    stream_queued = false;
+    xSemaphoreGive(stream_mutex);
+
+    for (int kind = 0; kind < HTTP_STREAM_KINDS; kind++) {
+        if (!fresh[kind]) continue;
+
+        for (int i = 0; i < CONFIG_HTTP_STREAM_MAX_CLIENTS; i++) {
+            if (stream_clients[i].fd < 0) continue;
+            if (!http_stream_send(stream_clients[i].fd, &stream_out[kind][stream_clients[i].format])) http_stream_drop(i);
+        }
+    }
+}
+
+/* Marks the frames of "kind" as fresh and gives the mutex, taken by the caller */
+static void http_stream_publish (int kind) {
+    bool queue = !stream_queued;
+
+    stream_fresh[kind] = true;
+    stream_queued = true;
+    xSemaphoreGive(stream_mutex);
+
+    if (queue && httpd_queue_work(http_server, http_stream_work, NULL) != ESP_OK) {
+        xSemaphoreTake(stream_mutex, portMAX_DELAY);
+        stream_queued = false;
+        xSemaphoreGive(stream_mutex);
+    }
+}
+
+void http_stream_co2 (uint32_t ts, const window_stats_result_t *co2) {
+    if (stream_client_count == 0) return;
+
+    xSemaphoreTake(stream_mutex, portMAX_DELAY);
+
+    const node_config_t *config = node_config_acquire();
+    http_stream_frame_t *frame = &stream_latest[HTTP_STREAM_CO2][REST_FORMAT_CBOR];
+    http_stream_seal(frame, telemetry_encode_co2(frame->buf + HTTP_STREAM_HEAD_LEN, HTTP_STREAM_PAYLOAD_LEN, &config->id_cbor, co2, ts));
+    node_config_release(config);
+
+    rest_writer_t writer;
+    frame = &stream_latest[HTTP_STREAM_CO2][REST_FORMAT_JSON];
+    http_stream_event(frame, &writer, "co2");
+    rest_writer_map_begin(&writer, NULL);
+    rest_writer_uint(&writer, "TS", ts);
+    rest_writer_uint(&writer, "CO2", co2->mean);
+    rest_writer_uint(&writer, "CO2_min", co2->min);
+    rest_writer_uint(&writer, "CO2_max", co2->max);
+    rest_writer_uint(&writer, "CO2_std", co2->stddev);
+    rest_writer_uint(&writer, "CO2_p95", co2->quantile);
+    rest_writer_map_end(&writer);
+    http_stream_event_end(frame, &writer);
+
+    http_stream_publish(HTTP_STREAM_CO2);
+}
+
+void http_stream_ble (uint32_t ts, uint8_t people) {
+    if (stream_client_count == 0) return;
+
+    xSemaphoreTake(stream_mutex, portMAX_DELAY);
+
+    const node_config_t *config = node_config_acquire();
+    http_stream_frame_t *frame = &stream_latest[HTTP_STREAM_BLE][REST_FORMAT_CBOR];
+    http_stream_seal(frame, telemetry_encode_ble(frame->buf + HTTP_STREAM_HEAD_LEN, HTTP_STREAM_PAYLOAD_LEN, &config->id_cbor, people, ts));
+    node_config_release(config);
+
+    rest_writer_t writer;
+    frame = &stream_latest[HTTP_STREAM_BLE][REST_FORMAT_JSON];
+    http_stream_event(frame, &writer, "ble");
+    rest_writer_map_begin(&writer, NULL);
+    rest_writer_uint(&writer, "TS", ts);
+    rest_writer_uint(&writer, "BLE_people", people);
+    rest_writer_map_end(&writer);
+    http_stream_event_end(frame, &writer);
+
+    http_stream_publish(HTTP_STREAM_BLE);
+}
+
+/**
+ *  Handler for subscribing to the live stream
+ *  The response never ends: its header is sent here and the frames follow as chunks,
+ *  server-sent events (JSON data) or CBOR items as in MQTT if "application/cbor" is
+ *  accepted. The last frame of each kind is sent right away
+ */
+static esp_err_t stream_get_handler(httpd_req_t *req) {
+    http_request_begin(req);
+
+    int slot;
+    for (slot = 0; slot < CONFIG_HTTP_STREAM_MAX_CLIENTS && stream_clients[slot].fd >= 0; slot++);
+    if (slot == CONFIG_HTTP_STREAM_MAX_CLIENTS) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_sendstr(req, "too many stream clients");
+        return ESP_OK;
+    }
+
+    /**
+     *  The head is written raw, as the response API only sends it along with a first
+     *  chunk and there may be no frame yet (an empty chunk ends the response).
+     *  From here the session belongs to the stream: the handler returns without a
+     *  response, the server keeps the socket open and the frames are written to it by
+     *  the work items of the server task. Anything the client sends would be read as
+     *  a new request, which stream clients do not do. The session ends when a send
+     *  fails (http_stream_drop) or the client closes it (http_session_close)
+     */
+    rest_format_t format = http_format(req);
+    const char *header = format == REST_FORMAT_CBOR ?
+        "HTTP/1.1 200 OK\r\nContent-Type: application/cbor-seq\r\nTransfer-Encoding: chunked\r\nVary: Accept\r\n\r\n" :
+        "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\nTransfer-Encoding: chunked\r\nVary: Accept\r\n\r\n";
+    if (httpd_send(req, header, strlen(header)) != (int)strlen(header)) return ESP_FAIL;
+
+    int fd = httpd_req_to_sockfd(req);
+    stream_clients[slot].fd = fd;
+    stream_clients[slot].format = format;
+    stream_client_count++;
+    ESP_LOGI(TAG_HTTP, "Stream client %d subscribed", fd);
+
+    for (int kind = 0; kind < HTTP_STREAM_KINDS; kind++) {
+        /* A fresh frame is sent by the queued work item */
+        xSemaphoreTake(stream_mutex, portMAX_DELAY);
+        bool fresh = stream_fresh[kind];
+        stream_out[kind][format] = stream_latest[kind][format];
+        xSemaphoreGive(stream_mutex);
+
+        if (!fresh && !http_stream_send(fd, &stream_out[kind][format])) {
+            http_stream_drop(slot);
+            break;
+        }
+    }
 
     return ESP_OK;
 }
 
+/* Called by the server when a session is closed, the socket is closed here */
+static void http_session_close (httpd_handle_t hd, int sockfd) {
+    for (int i = 0; i < CONFIG_HTTP_MAX_OPEN_SOCKETS; i++) {
+        if (http_sessions[i].fd == sockfd) http_sessions[i].fd = -1;
+    }
+    for (int i = 0; i < CONFIG_HTTP_STREAM_MAX_CLIENTS; i++) {
+        if (stream_clients[i].fd == sockfd) {
+            stream_clients[i].fd = -1;
+            stream_client_count--;
+        }
+    }
+
+    close(sockfd);
+}
+
 
 esp_err_t start_rest_server(void) {
 
@@ -141,9 +793,26 @@ esp_err_t start_rest_server(void) {
     conf.prvtkey_pem = prvtkey_pem_start;
     conf.prvtkey_len = prvtkey_pem_end - prvtkey_pem_start;
 
+    /**
+     *  Each TLS session takes a few tens of KB of heap, so the number of open sockets
+     *  is bounded. A socket is kept free for a new client by http_request_begin, which
+     *  unlike the LRU purge of the server never closes a stream
+     */
+    conf.httpd.max_open_sockets = CONFIG_HTTP_MAX_OPEN_SOCKETS;
+    conf.httpd.lru_purge_enable = false;
+    conf.httpd.max_uri_handlers = HTTP_MAX_URI_HANDLERS;
+
+    /* Bounds the time a slow client may hold the server task, e.g. a stream client */
+    conf.httpd.send_wait_timeout = CONFIG_HTTP_SEND_TIMEOUT_SEC;
+    conf.httpd.close_fn = http_session_close;
+
+    stream_mutex = xSemaphoreCreateMutex();
+    for (int i = 0; i < CONFIG_HTTP_STREAM_MAX_CLIENTS; i++) stream_clients[i].fd = -1;
+    for (int i = 0; i < CONFIG_HTTP_MAX_OPEN_SOCKETS; i++) http_sessions[i].fd = -1;
 
     ESP_LOGI(TAG_HTTP, "Starting HTTPS Server");
     REST_CHECK(httpd_ssl_start(&server, &conf) == ESP_OK, "Start server failed");
+    http_server = server;
 
     /**
      *  URI handler for fetching system info
@@ -158,6 +827,15 @@ esp_err_t start_rest_server(void) {
     };
     httpd_register_uri_handler(server, &system_info_get_uri);
 
+    /* URI handler for fetching runtime stats */
+    httpd_uri_t system_stats_get_uri = {
+        .uri = "/system/stats",
+        .method = HTTP_GET,
+        .handler = system_stats_get_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &system_stats_get_uri);
+
     /* URI handler for fetching node info */
     httpd_uri_t node_info_get_uri = {
         .uri = "/node/info",
@@ -198,6 +876,33 @@ esp_err_t start_rest_server(void) {
     };
     httpd_register_uri_handler(server, &capture_get_uri);
 
+    /**
+     *  URI handler for streaming the history (chunked response)
+     *  Usage example:
+     *   curl "https://{IP}/node/history?series=co2&res=minute&from={EPOCH}" --cacert {CERT_NAME}.pem
+     */
+    httpd_uri_t history_get_uri = {
+        .uri = "/node/history",
+        .method = HTTP_GET,
+        .handler = history_get_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &history_get_uri);
+
+    /**
+     *  URI handler for the live stream of results (server-sent events, or CBOR
+     *  with "Accept: application/cbor")
+     *  Usage example:
+     *   curl -N https://{IP}/node/stream --cacert {CERT_NAME}.pem
+     */
+    httpd_uri_t stream_get_uri = {
+        .uri = "/node/stream",
+        .method = HTTP_GET,
+        .handler = stream_get_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &stream_get_uri);
+
 
     return ESP_OK;
     
@@ -1,9 +1,37 @@
 #ifndef COMM_HTTP_H_ 
 #define COMM_HTTP_H_
 
+#include <stdint.h>
 #include "esp_system.h"
 
+#include "../processing/window_stats.h"
+#include "../processing/deadband.h"
+
 /* Starts HTTP server */
 esp_err_t start_rest_server(void);
 
+/**
+ *  Live stream (/node/stream)
+ *  Each new result is pushed to the subscribed clients. These calls never wait for
+ *  the clients, the frames are sent by the server task
+ */
+
+/* Pushes a CO2 window measured at "ts" (epoch secs) */
+void http_stream_co2 (uint32_t ts, const window_stats_result_t *co2);
+
+/* Pushes a people estimation measured at "ts" (epoch secs) */
+void http_stream_ble (uint32_t ts, uint8_t people);
+
+#ifdef CONFIG_DEADBAND_REPORTING
+/* Reports decided by a deadband, shown in /system/stats */
+typedef enum {
+    HTTP_DEADBAND_CO2,
+    HTTP_DEADBAND_BLE,
+    HTTP_DEADBANDS
+} http_deadband_t;
+
+/* Registers the deadband of a report, its counters are read when the stats are built */
+void http_stats_deadband (http_deadband_t report, const deadband_t *deadband);
+#endif
+
 #endif
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include "comm_journal.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+
+#include "globals.h"
+#include "comm_mqtt.h"
+#include "comm_publisher.h"
+#include "../storage/journal_esp.h"
+
+
+#define JOURNAL_PARTITION_LABEL     "journal"
+
+static journal_t journal;
+static SemaphoreHandle_t journal_mutex;
+static TaskHandle_t journal_task_handle;
+
+
+bool journal_store (const uint8_t *data, size_t len) {
+    if (journal_mutex == NULL) return false;
+
+    xSemaphoreTake(journal_mutex, portMAX_DELAY);
+    uint32_t dropped = journal.dropped;
+    esp_err_t err = journal_append(&journal, data, len);
+    if (journal.dropped != dropped) {
+        ESP_LOGW(TAG_JOURNAL, "Journal full, %d oldest messages dropped", (int)(journal.dropped - dropped));
+    }
+    xSemaphoreGive(journal_mutex);
+
+    if (err != ESP_OK) ESP_LOGE(TAG_JOURNAL, "Message not stored: %s", esp_err_to_name(err));
+
+    return err == ESP_OK;
+}
+
+void journal_replay_notify (void) {
+    if (journal_task_handle) xTaskNotifyGive(journal_task_handle);
+}
+
+/* Publishes the pending messages, oldest first. Stops when the client disconnects */
+static void journal_replay (void) {
+    static uint8_t buf[JOURNAL_MAX_RECORD];
+    uint32_t sent = 0;
+
+    while (mqtt_wait_connected(0)) {
+        for (int i = 0; i < CONFIG_JOURNAL_REPLAY_BATCH; i++) {
+            journal_pos_t pos;
+            size_t len;
+
+            xSemaphoreTake(journal_mutex, portMAX_DELAY);
+            esp_err_t err = journal_peek(&journal, buf, sizeof(buf), &len, &pos);
+            xSemaphoreGive(journal_mutex);
+
+            if (err == ESP_ERR_NOT_FOUND) {
+                if (sent) ESP_LOGI(TAG_JOURNAL, "Replay completed, %d messages published", (int)sent);
+                return;
+            }
+
+            /**
+             *  A message that cannot be read is skipped, otherwise it would block the journal.
+             *  The other ones are sent by the publisher after the live messages, and only
+             *  consumed once published. Only that record is consumed: if the journal got
+             *  full while waiting, it has been dropped and the next pending one is kept
+             */
+            if (err == ESP_OK && !publisher_send_confirmed(buf, len)) break;     // Retried in the next batch
+
+            xSemaphoreTake(journal_mutex, portMAX_DELAY);
+            journal_consume(&journal, &pos);
+            xSemaphoreGive(journal_mutex);
+            if (err == ESP_OK) sent++;
+        }
+
+        /* Rate limit, so the live messages are not delayed by the backlog */
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_JOURNAL_REPLAY_INTERVAL_MS));
+    }
+}
+
+static void journal_task (void *pvParameter) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (journal_pending(&journal)) {
+            ESP_LOGI(TAG_JOURNAL, "Replaying %d messages", (int)journal_pending(&journal));
+            journal_replay();
+        }
+    }
+}
+
+esp_err_t journal_start (void) {
+    esp_err_t err = journal_esp_mount(&journal, JOURNAL_PARTITION_LABEL);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_JOURNAL, "Journal partition not available: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    ESP_LOGI(TAG_JOURNAL, "%d messages pending in the journal", (int)journal_pending(&journal));
+
+    journal_mutex = xSemaphoreCreateMutex();
+    xTaskCreate(&journal_task, "Journal task", 4096, NULL, 4, &journal_task_handle);
+
+    return ESP_OK;
+}
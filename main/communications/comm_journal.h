@@ -0,0 +1,26 @@
+#ifndef COMM_JOURNAL_H_ 
+#define COMM_JOURNAL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ *  Store-and-forward of MQTT messages
+ *  Messages that cannot be published (client disconnected) are written to the
+ *  journal partition, and replayed in rate-limited batches once the client is
+ *  connected again. A replayed message is consumed only once the publisher has
+ *  published it (and the broker acknowledged it, with qos > 0)
+ */
+
+/* Mounts the journal and starts the replay task */
+esp_err_t journal_start (void);
+
+/* Writes a message to the journal, returns false if it could not be stored */
+bool journal_store (const uint8_t *data, size_t len);
+
+/* Wakes up the replay task (e.g. on MQTT_EVENT_CONNECTED) */
+void journal_replay_notify (void);
+
+#endif
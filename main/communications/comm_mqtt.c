@@ -2,10 +2,17 @@
 
 #include <string.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
 #include "esp_log.h"
 #include "mqtt_client.h"
 
 #include "globals.h"
+#include "node_config.h"
+#include "hal/hal.h"
+#include "comm_journal.h"
+#include "comm_publisher.h"
 
 
 /* Load the CA certificate to access the MQTT broker */
@@ -20,17 +27,84 @@ extern const uint8_t mqtt_test_broker_pem_end[]   asm("_binary_mqtt_test_broker_
 
 esp_mqtt_client_handle_t global_client;
 
+/* Connection state of the client */
+static EventGroupHandle_t mqtt_event_group;
+#define MQTT_CONNECTED_BIT  BIT0
+
+/* Messages (qos > 0) published and not acknowledged yet */
+static uint32_t mqtt_inflight;
+static portMUX_TYPE mqtt_inflight_mux = portMUX_INITIALIZER_UNLOCKED;
+
+#ifdef CONFIG_MQTT_TIMING_LOG
+/* Publish time of the last messages, matched with their ACK (qos > 0) */
+#define MQTT_TIMING_SLOTS   8
+static struct {
+    int msg_id;
+    int64_t publish_us;
+} mqtt_timing[MQTT_TIMING_SLOTS];
+static portMUX_TYPE mqtt_timing_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool mqtt_timing_published;
+
+/* Logs the time from publish to ACK of a message */
+static void mqtt_timing_ack (int msg_id) {
+    int64_t publish_us = -1;
+
+    portENTER_CRITICAL(&mqtt_timing_mux);
+    if (mqtt_timing[msg_id % MQTT_TIMING_SLOTS].msg_id == msg_id) {
+        publish_us = mqtt_timing[msg_id % MQTT_TIMING_SLOTS].publish_us;
+    }
+    portEXIT_CRITICAL(&mqtt_timing_mux);
+
+    if (publish_us >= 0) {
+        ESP_LOGI(TAG_MQTT, "TIMING ack msg_id=%d latency_us=%lld", msg_id, (long long)(hal_time_us() - publish_us));
+    }
+}
+
+/* Logs the first publish since boot and records the time of the message */
+static void mqtt_timing_publish (int msg_id, int64_t publish_us) {
+    if (!mqtt_timing_published) {
+        mqtt_timing_published = true;
+        ESP_LOGI(TAG_MQTT, "TIMING first_publish_ms=%lld", (long long)(publish_us / 1000));
+    }
+    if (msg_id <= 0) return;
+
+    portENTER_CRITICAL(&mqtt_timing_mux);
+    mqtt_timing[msg_id % MQTT_TIMING_SLOTS].msg_id = msg_id;
+    mqtt_timing[msg_id % MQTT_TIMING_SLOTS].publish_us = publish_us;
+    portEXIT_CRITICAL(&mqtt_timing_mux);
+}
+#endif
+
+
+/* Logs a change of the connection with the node ID */
+static void mqtt_log_node (const char *state) {
+    const node_config_t *config = node_config_acquire();
+    ESP_LOGI(TAG_MQTT, "Node %s %s", config->id, state);
+    node_config_release(config);
+}
 
 static esp_err_t mqtt_event_handler_cb(esp_mqtt_event_handle_t event) {
 
     switch (event->event_id) {
 
         case MQTT_EVENT_CONNECTED:
-            ESP_LOGI(TAG_MQTT, "Node %s connected", ESP_ID);
+            mqtt_log_node("connected");
+            xEventGroupSetBits(mqtt_event_group, MQTT_CONNECTED_BIT);
+#ifdef CONFIG_JOURNAL_ENABLE
+            journal_replay_notify();
+#endif
+#ifdef CONFIG_MQTT_TIMING_LOG
+            ESP_LOGI(TAG_MQTT, "TIMING connected_ms=%lld", (long long)(hal_time_us() / 1000));
+#endif
             break;
 
         case MQTT_EVENT_DISCONNECTED:
-            ESP_LOGI(TAG_MQTT, "Node %s disconnected", ESP_ID);
+            mqtt_log_node("disconnected");
+            xEventGroupClearBits(mqtt_event_group, MQTT_CONNECTED_BIT);
+            /* The client may drop its outbox (expired messages) without an event, so the count starts again */
+            portENTER_CRITICAL(&mqtt_inflight_mux);
+            mqtt_inflight = 0;
+            portEXIT_CRITICAL(&mqtt_inflight_mux);
             break;
 
         case MQTT_EVENT_SUBSCRIBED:
@@ -43,6 +117,13 @@ static esp_err_t mqtt_event_handler_cb(esp_mqtt_event_handle_t event) {
 
         case MQTT_EVENT_PUBLISHED:
             ESP_LOGI(TAG_MQTT, "ACK, only for qos=1 or 2");
+            portENTER_CRITICAL(&mqtt_inflight_mux);
+            if (mqtt_inflight) mqtt_inflight--;
+            portEXIT_CRITICAL(&mqtt_inflight_mux);
+            publisher_acked(event->msg_id);
+#ifdef CONFIG_MQTT_TIMING_LOG
+            mqtt_timing_ack(event->msg_id);
+#endif
             break;
 
         case MQTT_EVENT_DATA: {
@@ -74,6 +155,8 @@ esp_err_t mqtt_app_start(void) {
         .cert_pem = (const char *)mqtt_test_broker_pem_start,
     };
 
+    mqtt_event_group = xEventGroupCreate();
+
     global_client = esp_mqtt_client_init(&mqtt_cfg);
     esp_mqtt_client_register_event(global_client, ESP_EVENT_ANY_ID, mqtt_event_handler, global_client);
     esp_mqtt_client_start(global_client);
@@ -81,11 +164,83 @@ esp_err_t mqtt_app_start(void) {
     return ESP_OK;
 }
 
-void mqtt_publish (char *data) {
-    char topic[100];
-    strcpy(topic, ESP_LOCATION);
-    strcat(topic, ESP_ID);
+esp_err_t mqtt_app_pause(void) {
+    xEventGroupClearBits(mqtt_event_group, MQTT_CONNECTED_BIT);
+    return esp_mqtt_client_stop(global_client);
+}
+
+esp_err_t mqtt_app_resume(void) {
+    return esp_mqtt_client_start(global_client);
+}
+
+bool mqtt_wait_connected (TickType_t timeout) {
+    EventBits_t bits = xEventGroupWaitBits(mqtt_event_group, MQTT_CONNECTED_BIT, pdFALSE, pdTRUE, timeout);
+    return bits & MQTT_CONNECTED_BIT;
+}
+
+/* Publishes without falling back to the journal */
+static int mqtt_publish_now (const mqtt_topic_t *topic, const uint8_t *data, size_t len, int qos, int flags) {
+    if (!mqtt_wait_connected(0)) return MQTT_PUBLISH_ERR_FAIL;
+
+    /* Only messages with qos > 0 stay in the outbox of the client until their ACK */
+    if (qos > 0) {
+        bool full;
+        portENTER_CRITICAL(&mqtt_inflight_mux);
+        full = mqtt_inflight >= CONFIG_MQTT_MAX_INFLIGHT;
+        if (!full) mqtt_inflight++;
+        portEXIT_CRITICAL(&mqtt_inflight_mux);
+        if (full) return MQTT_PUBLISH_ERR_BACKPRESSURE;
+    }
+
+    /* Binary (CBOR) payloads may contain 0x00, so the length is always given */
+#ifdef CONFIG_MQTT_TIMING_LOG
+    int64_t publish_us = hal_time_us();
+#endif
+    int msg_id = esp_mqtt_client_publish(global_client, topic->name, (const char *)data, len, qos, flags & MQTT_PUBLISH_RETAIN);
+#ifdef CONFIG_MQTT_TIMING_LOG
+    if (msg_id >= 0) mqtt_timing_publish(msg_id, publish_us);
+#endif
+
+    if (msg_id < 0) {
+        if (qos > 0) {
+            portENTER_CRITICAL(&mqtt_inflight_mux);
+            mqtt_inflight--;
+            portEXIT_CRITICAL(&mqtt_inflight_mux);
+        }
+        return MQTT_PUBLISH_ERR_FAIL;
+    }
+
+    ESP_LOGD(TAG_MQTT, "Message published in %s (%d bytes)", topic->name, (int)len);
+
+    return msg_id;
+}
+
+int mqtt_publish_to (const mqtt_topic_t *topic, const uint8_t *data, size_t len, int qos, int flags) {
+    int msg_id = mqtt_publish_now(topic, data, len, qos, flags);
+
+#ifdef CONFIG_JOURNAL_ENABLE
+    /* Without connection the message is kept until the next one. Backpressure is left to
+     * the caller, a stored message would only be replayed after reconnecting */
+    if (msg_id == MQTT_PUBLISH_ERR_FAIL && !(flags & MQTT_PUBLISH_NO_JOURNAL) && !mqtt_wait_connected(0)) {
+        const node_config_t *config = node_config_acquire();
+        bool node_topic = strcmp(topic->name, config->topic.name) == 0;
+        node_config_release(config);
+
+        if (node_topic && journal_store(data, len)) return 0;
+    }
+#endif
+
+    return msg_id;
+}
+
+int mqtt_publish_node (const uint8_t *data, size_t len, int flags) {
+    const node_config_t *config = node_config_acquire();
+    int msg_id = mqtt_publish_to(&config->topic, data, len, CONFIG_MQTT_QOS, flags);
+    node_config_release(config);
+
+    return msg_id;
+}
 
-    esp_mqtt_client_publish(global_client, topic, data, 0, CONFIG_MQTT_QOS, 0);
-    ESP_LOGI(TAG_MQTT, "Message published in %s", topic);
+int mqtt_publish (const uint8_t *data, size_t len) {
+    return mqtt_publish_node(data, len, 0);
 }
@@ -1,12 +1,56 @@
 #ifndef COMM_MQTT_H_ 
 #define COMM_MQTT_H_
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
 #include "esp_system.h"
 
+#include "mqtt_topic.h"
+
 /* Starts a MQTT client */
 esp_err_t mqtt_app_start(void);
 
-/* Publish a new MQTT message */
-void mqtt_publish (char *data);
+/* Stops the MQTT client (e.g. before switching the radio off) */
+esp_err_t mqtt_app_pause(void);
+
+/* Starts again a paused MQTT client */
+esp_err_t mqtt_app_resume(void);
+
+/* Waits until the client is connected to the broker */
+bool mqtt_wait_connected (TickType_t timeout);
+
+/* Flags of mqtt_publish_to */
+#define MQTT_PUBLISH_RETAIN         (1 << 0)
+#define MQTT_PUBLISH_NO_JOURNAL     (1 << 1)   // Fail instead of storing the message in the journal
+
+/* Errors of mqtt_publish_to */
+#define MQTT_PUBLISH_ERR_FAIL           -1  // Not connected or rejected by the client
+#define MQTT_PUBLISH_ERR_BACKPRESSURE   -2  // Too many messages waiting for their ACK, try again later
+
+/**
+ * @brief   Publishes a binary message of "len" bytes, the payload is copied by the
+ *          client, so "data" can be reused as soon as it returns
+ *
+ *          With the journal enabled, messages to the node topic that cannot be sent
+ *          because there is no connection are stored and 0 is returned, unless
+ *          MQTT_PUBLISH_NO_JOURNAL is given. MQTT_PUBLISH_ERR_BACKPRESSURE is always
+ *          returned to the caller, which keeps the message and retries
+ *
+ * @return  Message id (0 for qos 0), or MQTT_PUBLISH_ERR_*
+ */
+int mqtt_publish_to (const mqtt_topic_t *topic, const uint8_t *data, size_t len, int qos, int flags);
+
+/**
+ *  Publishes a message in the topic of the node, where the telemetry goes, with the
+ *  configured qos. The config snapshot is held until the client has the message
+ *  (see node_config.h), see mqtt_publish_to
+ */
+int mqtt_publish_node (const uint8_t *data, size_t len, int flags);
+
+/* Same as mqtt_publish_node, without flags */
+int mqtt_publish (const uint8_t *data, size_t len);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,233 @@
+#include "comm_publisher.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+
+#include "globals.h"
+#include "comm_mqtt.h"
+#include "comm_journal.h"
+#include "../storage/msg_queue.h"
+#include "../storage/journal.h"
+#include "../telemetry/telemetry.h"
+
+
+/* Wait before trying again a message rejected for backpressure */
+#define PUBLISHER_BACKPRESSURE_DELAY_MS     100
+
+/* Max wait for a confirmed message to be published (and acknowledged with qos > 0) */
+#define PUBLISHER_CONFIRM_TIMEOUT_MS        30000
+
+_Static_assert(MSG_QUEUE_DATA_LEN >= TELEMETRY_BATCH_LEN, "A batch does not fit in a queued message");
+_Static_assert(MSG_QUEUE_DATA_LEN >= JOURNAL_MAX_RECORD, "A journal record does not fit in a queued message");
+
+#define PUBLISHER_POW2(n)   ((n) > 0 && ((n) & ((n) - 1)) == 0)
+_Static_assert(PUBLISHER_POW2(CONFIG_PUBLISHER_ALERT_SLOTS), "PUBLISHER_ALERT_SLOTS must be a power of two");
+_Static_assert(PUBLISHER_POW2(CONFIG_PUBLISHER_TELEMETRY_SLOTS), "PUBLISHER_TELEMETRY_SLOTS must be a power of two");
+_Static_assert(PUBLISHER_POW2(CONFIG_PUBLISHER_BULK_SLOTS), "PUBLISHER_BULK_SLOTS must be a power of two");
+
+
+/**
+ *  Each cell holds a whole message (MSG_QUEUE_DATA_LEN plus 8 bytes), so the queues
+ *  take the slots of Kconfig times about 1 KB of DRAM: 8 KB with the default 2 + 4 + 2,
+ *  plus the 1 KB buffer of the task
+ */
+static msg_queue_cell_t alert_cells[CONFIG_PUBLISHER_ALERT_SLOTS];
+static msg_queue_cell_t telemetry_cells[CONFIG_PUBLISHER_TELEMETRY_SLOTS];
+static msg_queue_cell_t bulk_cells[CONFIG_PUBLISHER_BULK_SLOTS];
+
+/* Queue of each class, by priority */
+static msg_queue_t queues[PUBLISHER_CLASSES];
+static TaskHandle_t publisher_task_handle;
+
+/* Only written by the publisher task */
+static uint32_t published;
+static uint32_t failed;
+
+/**
+ *  Bulk message whose sender waits for its outcome (see publisher_send_confirmed)
+ *  It is queued with a token (the flags of its cell, 0 for the other messages), so
+ *  the late outcome of a message given up before is not taken for the current one
+ */
+typedef enum {
+    CONFIRM_IDLE,
+    CONFIRM_QUEUED,             // Waiting in the queue
+    CONFIRM_INFLIGHT,           // Published with qos > 0, waiting for its ACK
+} confirm_state_t;
+
+static struct {
+    confirm_state_t state;
+    uint8_t token;
+    int msg_id;
+    int early_ack;              // ACK seen before the task reported the message id
+    bool published;
+} confirm;
+static portMUX_TYPE confirm_mux = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t confirm_done;
+static SemaphoreHandle_t confirm_mutex;     // A single sender waits at a time
+
+
+/**
+ *  Copies the oldest message of the highest class waiting, which stays queued until
+ *  it is done with: a message rejected for backpressure is left there, and the higher
+ *  classes are checked again before it is retried
+ */
+static bool publisher_next (uint8_t *buf, size_t *len, publisher_class_t *class, uint8_t *token) {
+    for (*class = 0; *class < PUBLISHER_CLASSES; (*class)++) {
+        if (msg_queue_peek(&queues[*class], buf, len, token)) return true;
+    }
+
+    return false;
+}
+
+/* Reports the outcome of a confirmed message: its id, 0 with qos 0, or MQTT_PUBLISH_ERR_* */
+static void publisher_confirm (uint8_t token, int msg_id) {
+    bool done = false;
+
+    portENTER_CRITICAL(&confirm_mux);
+    if (confirm.state == CONFIRM_QUEUED && confirm.token == token) {
+        if (msg_id <= 0 || msg_id == confirm.early_ack) {
+            confirm.published = msg_id >= 0;
+            confirm.state = CONFIRM_IDLE;
+            done = true;
+        } else {
+            confirm.msg_id = msg_id;
+            confirm.state = CONFIRM_INFLIGHT;
+        }
+    }
+    portEXIT_CRITICAL(&confirm_mux);
+
+    if (done) xSemaphoreGive(confirm_done);
+}
+
+static void publisher_task (void *pvParameter) {
+    static uint8_t buf[MSG_QUEUE_DATA_LEN];
+    publisher_class_t class;
+    uint8_t token;
+    size_t len;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while (publisher_next(buf, &len, &class, &token)) {
+            /**
+             *  Live messages that cannot be sent for lack of connection are stored in the
+             *  journal by mqtt_publish_to, backpressure is left to this loop for every class.
+             *  Bulk ones are kept by their sender (the journal, the RTC buffer) until published
+             */
+            int flags = class == PUBLISHER_BULK ? MQTT_PUBLISH_NO_JOURNAL : 0;
+            int msg_id = mqtt_publish_node(buf, len, flags);
+            if (msg_id == MQTT_PUBLISH_ERR_BACKPRESSURE) {
+                vTaskDelay(pdMS_TO_TICKS(PUBLISHER_BACKPRESSURE_DELAY_MS));
+                continue;
+            }
+
+            msg_queue_pop(&queues[class], NULL, NULL, NULL);
+            if (token) publisher_confirm(token, msg_id);
+
+            if (msg_id < 0) {
+                failed++;
+                ESP_LOGW(TAG_PUBLISHER, "Message of %d bytes not published", (int)len);
+            } else {
+                published++;
+            }
+        }
+    }
+}
+
+esp_err_t publisher_start (void) {
+    msg_queue_init(&queues[PUBLISHER_ALERT], alert_cells, CONFIG_PUBLISHER_ALERT_SLOTS);
+    msg_queue_init(&queues[PUBLISHER_TELEMETRY], telemetry_cells, CONFIG_PUBLISHER_TELEMETRY_SLOTS);
+    msg_queue_init(&queues[PUBLISHER_BULK], bulk_cells, CONFIG_PUBLISHER_BULK_SLOTS);
+
+    confirm_done = xSemaphoreCreateBinary();
+    confirm_mutex = xSemaphoreCreateMutex();
+    if (confirm_done == NULL || confirm_mutex == NULL) return ESP_ERR_NO_MEM;
+
+    if (xTaskCreate(&publisher_task, "Publisher task", 4096, NULL, 5, &publisher_task_handle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t publisher_send (publisher_class_t class, const uint8_t *data, size_t len) {
+    if (publisher_task_handle == NULL) return ESP_ERR_INVALID_STATE;
+
+    if (!msg_queue_push(&queues[class], data, len, 0)) {
+#ifdef CONFIG_JOURNAL_ENABLE
+        /* Live messages are kept for later, the bulk ones are still kept by their sender */
+        if (class != PUBLISHER_BULK && journal_store(data, len)) return ESP_OK;
+#endif
+        return ESP_ERR_NO_MEM;
+    }
+
+    xTaskNotifyGive(publisher_task_handle);
+
+    return ESP_OK;
+}
+
+bool publisher_send_confirmed (const uint8_t *data, size_t len) {
+    if (publisher_task_handle == NULL) return false;
+
+    xSemaphoreTake(confirm_mutex, portMAX_DELAY);
+    xSemaphoreTake(confirm_done, 0);    // Outcome of a message given up before
+
+    portENTER_CRITICAL(&confirm_mux);
+    confirm.token = confirm.token == UINT8_MAX ? 1 : confirm.token + 1;
+    confirm.state = CONFIRM_QUEUED;
+    confirm.early_ack = -1;
+    confirm.published = false;
+    uint8_t token = confirm.token;
+    portEXIT_CRITICAL(&confirm_mux);
+
+    bool done = false;
+    if (msg_queue_push(&queues[PUBLISHER_BULK], data, len, token)) {
+        xTaskNotifyGive(publisher_task_handle);
+        for (int waited_ms = 0; !done && waited_ms < PUBLISHER_CONFIRM_TIMEOUT_MS && mqtt_wait_connected(0); waited_ms += 1000) {
+            done = xSemaphoreTake(confirm_done, pdMS_TO_TICKS(1000));
+        }
+    }
+
+    /* Given up: a late outcome is ignored, the sender keeps the message to send it again */
+    if (!done) {
+        portENTER_CRITICAL(&confirm_mux);
+        confirm.state = CONFIRM_IDLE;
+        portEXIT_CRITICAL(&confirm_mux);
+        done = xSemaphoreTake(confirm_done, 0);
+    }
+
+    bool result = done && confirm.published;
+    xSemaphoreGive(confirm_mutex);
+
+    return result;
+}
+
+void publisher_acked (int msg_id) {
+    bool done = false;
+
+    portENTER_CRITICAL(&confirm_mux);
+    if (confirm.state == CONFIRM_INFLIGHT && confirm.msg_id == msg_id) {
+        confirm.published = true;
+        confirm.state = CONFIRM_IDLE;
+        done = true;
+    } else if (confirm.state == CONFIRM_QUEUED) {
+        confirm.early_ack = msg_id;
+    }
+    portEXIT_CRITICAL(&confirm_mux);
+
+    if (done) xSemaphoreGive(confirm_done);
+}
+
+void publisher_get_stats (publisher_stats_t *stats) {
+    for (int class = 0; class < PUBLISHER_CLASSES; class++) {
+        stats->classes[class].depth = msg_queue_depth(&queues[class]);
+        stats->classes[class].high_water = queues[class].high_water;
+        stats->classes[class].queued = queues[class].pushed;
+        stats->classes[class].dropped = queues[class].dropped;
+    }
+    stats->published = published;
+    stats->failed = failed;
+}
@@ -0,0 +1,69 @@
+#ifndef COMM_PUBLISHER_H_
+#define COMM_PUBLISHER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ *  Outbound publisher
+ *  A single task owns the publishing to the node topic. The other tasks only copy
+ *  their encoded messages into a lock-free queue (see msg_queue.h) and go on, so
+ *  sensing never waits for the network. There is a queue per priority class, the
+ *  task always sends the highest class first, even when a lower one is waiting for
+ *  backpressure to clear. When a class is full the new message
+ *  is not queued: alerts and telemetry fall back to the journal (if enabled), bulk
+ *  replay is left in the journal to be tried again
+ */
+
+typedef enum {
+    PUBLISHER_ALERT = 0,        // E.g. a high CO2 level, sent before anything else
+    PUBLISHER_TELEMETRY,
+    PUBLISHER_BULK,             // Replay of the journal, bursts of the RTC buffer
+    PUBLISHER_CLASSES
+} publisher_class_t;
+
+typedef struct {
+    uint32_t depth;             // Messages waiting now
+    uint32_t high_water;        // Max messages waiting at the same time
+    uint32_t queued;
+    uint32_t dropped;           // Not queued because the class was full
+} publisher_class_stats_t;
+
+typedef struct {
+    publisher_class_stats_t classes[PUBLISHER_CLASSES];
+    uint32_t published;
+    uint32_t failed;            // Not published (stored in the journal if enabled)
+} publisher_stats_t;
+
+/* Starts the publisher task */
+esp_err_t publisher_start (void);
+
+/**
+ * @brief   Queues a message for the node topic, never blocks on the network
+ *
+ * @return
+ *  - ESP_OK if the message has been queued (or stored in the journal)
+ *  - ESP_ERR_NO_MEM if the class is full and the message has been dropped
+ *  - ESP_ERR_INVALID_STATE if the publisher has not been started
+ */
+esp_err_t publisher_send (publisher_class_t class, const uint8_t *data, size_t len);
+
+/**
+ * @brief   Queues a bulk message and waits until it has been published (and the
+ *          broker acknowledged it, with qos > 0), so the sender can drop its copy.
+ *          Only one sender waits at a time, the others block until it is done
+ *
+ * @return  true if published; false if it could not be queued, the client
+ *          disconnected, or there was no outcome in 30 s
+ */
+bool publisher_send_confirmed (const uint8_t *data, size_t len);
+
+/* Reports the ACK of a message (MQTT_EVENT_PUBLISHED) */
+void publisher_acked (int msg_id);
+
+/* Counters since boot */
+void publisher_get_stats (publisher_stats_t *stats);
+
+#endif
@@ -0,0 +1,140 @@
+#include "comm_radio.h"
+
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_wifi.h"
+
+#include "globals.h"
+#include "node_config.h"
+#include "comm_mqtt.h"
+#include "comm_publisher.h"
+#include "../storage/rtc_ring.h"
+#include "../telemetry/telemetry.h"
+
+
+/* Samples sent in each MQTT message (batch) of a burst */
+#define RADIO_BURST_CHUNK           TELEMETRY_BATCH_MAX
+
+/* Max time to get connected to the broker once the radio is on */
+#define RADIO_CONNECT_TIMEOUT_MS    30000
+
+
+/* Samples pending to be uploaded, kept in RTC slow memory */
+static RTC_NOINIT_ATTR rtc_ring_t radio_ring;
+static SemaphoreHandle_t radio_ring_mutex;
+
+
+static void radio_buffer_push (uint8_t kind, uint16_t value) {
+    rtc_ring_sample_t sample = {
+        .timestamp = (uint32_t)time(NULL),
+        .value = value,
+        .kind = kind,
+    };
+
+    xSemaphoreTake(radio_ring_mutex, portMAX_DELAY);
+    rtc_ring_push(&radio_ring, &sample);
+    xSemaphoreGive(radio_ring_mutex);
+}
+
+void radio_buffer_co2 (uint16_t co2_ppm) {
+    radio_buffer_push(RTC_RING_CO2, co2_ppm);
+}
+
+void radio_buffer_ble (uint8_t people) {
+    radio_buffer_push(RTC_RING_BLE, people);
+}
+
+static void radio_on (void) {
+    ESP_LOGI(TAG_RADIO, "Radio on");
+    esp_wifi_start();
+    esp_wifi_connect();
+    mqtt_app_resume();
+}
+
+static void radio_off (void) {
+    mqtt_app_pause();
+    esp_wifi_stop();
+    ESP_LOGI(TAG_RADIO, "Radio off");
+}
+
+/* Uploads the whole buffer in a single connection */
+static void radio_burst_upload (void) {
+    static rtc_ring_sample_t samples[RADIO_BURST_CHUNK];
+    static telemetry_batch_t batch;
+    static uint8_t buf[TELEMETRY_BATCH_LEN];
+    size_t sent = 0;
+
+    while (1) {
+        xSemaphoreTake(radio_ring_mutex, portMAX_DELAY);
+        uint32_t seq = rtc_ring_head_seq(&radio_ring);
+        size_t n = rtc_ring_peek(&radio_ring, samples, RADIO_BURST_CHUNK);
+        xSemaphoreGive(radio_ring_mutex);
+
+        if (n == 0) break;
+
+        telemetry_batch_reset(&batch);
+        for (size_t i = 0; i < n; i++) {
+            if (samples[i].kind == RTC_RING_BLE) {
+                telemetry_batch_add_ble(&batch, samples[i].timestamp, samples[i].value);
+            } else {
+                telemetry_batch_add_co2_value(&batch, samples[i].timestamp, samples[i].value);
+            }
+        }
+
+        const node_config_t *config = node_config_acquire();
+        size_t len = telemetry_encode_batch(buf, sizeof(buf), &config->id_cbor, &batch);
+        node_config_release(config);
+        if (len == 0 || !publisher_send_confirmed(buf, len)) {
+            ESP_LOGW(TAG_RADIO, "Burst interrupted, %d samples kept", (int)rtc_ring_count(&radio_ring));
+            break;
+        }
+
+        /**
+         *  Only the samples already published (and acknowledged with qos > 0) leave the
+         *  buffer, so a burst cut by the radio going off does not lose them. They are
+         *  dropped by sequence number: if the ring was full, pushes done while publishing
+         *  have overwritten some of them, and dropping "n" would lose unsent samples
+         */
+        xSemaphoreTake(radio_ring_mutex, portMAX_DELAY);
+        rtc_ring_drop_until(&radio_ring, seq + n);
+        xSemaphoreGive(radio_ring_mutex);
+        sent += n;
+    }
+
+    ESP_LOGI(TAG_RADIO, "Burst upload: %d samples sent", (int)sent);
+}
+
+static void radio_burst_task (void *pvParameter) {
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_RADIO_BURST_PERIOD_MIN * 60 * 1000));
+
+        if (rtc_ring_count(&radio_ring) == 0) continue;
+
+        radio_on();
+        if (mqtt_wait_connected(pdMS_TO_TICKS(RADIO_CONNECT_TIMEOUT_MS))) {
+            radio_burst_upload();
+        } else {
+            ESP_LOGW(TAG_RADIO, "Broker not reachable, samples kept until the next burst");
+        }
+        radio_off();
+    }
+}
+
+esp_err_t radio_off_start (void) {
+    radio_ring_mutex = xSemaphoreCreateMutex();
+
+    if (rtc_ring_restore(&radio_ring)) {
+        ESP_LOGI(TAG_RADIO, "%d samples recovered from RTC memory", (int)rtc_ring_count(&radio_ring));
+    }
+
+    radio_off();
+    xTaskCreate(&radio_burst_task, "Radio burst task", 4096, NULL, 5, NULL);
+
+    return ESP_OK;
+}
@@ -0,0 +1,23 @@
+#ifndef COMM_RADIO_H_ 
+#define COMM_RADIO_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ *  Radio-off mode
+ *  The Wi-Fi radio stays off while the node keeps sampling. Results are kept in a
+ *  ring buffer in RTC memory (it survives resets and deep sleep) and the radio is
+ *  only switched on every CONFIG_RADIO_BURST_PERIOD_MIN to upload all of them
+ */
+
+/* Restores the buffer of the previous run and starts the burst upload task */
+esp_err_t radio_off_start (void);
+
+/* Buffers a CO2 window result until the next burst */
+void radio_buffer_co2 (uint16_t co2_ppm);
+
+/* Buffers a people estimation until the next burst */
+void radio_buffer_ble (uint8_t people);
+
+#endif
@@ -21,7 +21,7 @@ void time_sync_notification_cb(struct timeval *tv)
 static void initialize_sntp(void) {
     ESP_LOGI(TAG_SNTP, "Initializing SNTP");
     sntp_setoperatingmode(SNTP_OPMODE_POLL);
-    sntp_setservername(0, "es.pool.ntp.org");
+    sntp_setservername(0, CONFIG_SNTP_SERVER);
     sntp_setservername(1, "europe.pool.ntp.org");
     sntp_setservername(2, "europe.pool.ntp.org");
     sntp_set_time_sync_notification_cb(time_sync_notification_cb);
@@ -0,0 +1,15 @@
+#include "mqtt_topic.h"
+
+#include <string.h>
+
+
+esp_err_t mqtt_topic_init (mqtt_topic_t *topic, const char *location, const char *id) {
+    size_t location_len = strlen(location);
+    size_t id_len = strlen(id);
+    if (location_len + id_len >= sizeof(topic->name)) return ESP_ERR_INVALID_SIZE;
+
+    memcpy(topic->name, location, location_len);
+    memcpy(topic->name + location_len, id, id_len + 1);
+
+    return ESP_OK;
+}
@@ -0,0 +1,15 @@
+#ifndef MQTT_TOPIC_H_ 
+#define MQTT_TOPIC_H_
+
+#include "esp_err.h"
+
+/* Topic handle, built once instead of on every publish (room for the longest location plus ID) */
+#define MQTT_TOPIC_LEN  120
+typedef struct {
+    char name[MQTT_TOPIC_LEN];
+} mqtt_topic_t;
+
+/* Builds the topic "location" + "id" */
+esp_err_t mqtt_topic_init (mqtt_topic_t *topic, const char *location, const char *id);
+
+#endif
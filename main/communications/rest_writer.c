@@ -0,0 +1,147 @@
+#include "rest_writer.h"
+
+#include <string.h>
+
+
+static const char *rest_types[REST_FORMATS] = {
+    [REST_FORMAT_JSON] = "application/json",
+    [REST_FORMAT_CBOR] = "application/cbor",
+};
+
+const char *rest_format_type (rest_format_t format) {
+    return rest_types[format];
+}
+
+void rest_writer_init (rest_writer_t *writer, rest_format_t format, uint8_t *buf, size_t len) {
+    writer->format = format;
+    writer->comma = false;
+    cbor_writer_init(&writer->out, buf, len);
+}
+
+/* ----- JSON ----- */
+
+static void rest_json_text (rest_writer_t *writer, const char *str) {
+    cbor_writer_byte(&writer->out, '"');
+
+    for (; *str; str++) {
+        char c = *str;
+        if (c == '"' || c == '\\') {
+            cbor_writer_byte(&writer->out, '\\');
+            cbor_writer_byte(&writer->out, c);
+        } else if ((unsigned char)c < 0x20) {
+            static const char hex[] = "0123456789abcdef";
+            char escaped[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+            cbor_writer_put(&writer->out, escaped, sizeof(escaped));
+        } else {
+            cbor_writer_byte(&writer->out, c);
+        }
+    }
+
+    cbor_writer_byte(&writer->out, '"');
+}
+
+/* Writes an unsigned integer with at least "digits" digits */
+static void rest_json_uint (rest_writer_t *writer, uint64_t value, uint8_t digits) {
+    char text[20];
+    size_t n = 0;
+
+    do {
+        text[sizeof(text) - 1 - n++] = '0' + value % 10;
+        value /= 10;
+    } while (value || n < digits);
+
+    cbor_writer_put(&writer->out, text + sizeof(text) - n, n);
+}
+
+/* Separator and key of a new value */
+static void rest_json_key (rest_writer_t *writer, const char *key) {
+    if (writer->comma) cbor_writer_byte(&writer->out, ',');
+    writer->comma = true;
+
+    if (key) {
+        rest_json_text(writer, key);
+        cbor_writer_byte(&writer->out, ':');
+    }
+}
+
+/* ----- Both formats ----- */
+
+static void rest_key (rest_writer_t *writer, const char *key) {
+    if (writer->format == REST_FORMAT_JSON) rest_json_key(writer, key);
+    else if (key) cbor_writer_text(&writer->out, key);
+}
+
+static void rest_begin (rest_writer_t *writer, const char *key, char json, uint8_t cbor) {
+    rest_key(writer, key);
+    if (writer->format == REST_FORMAT_JSON) {
+        cbor_writer_byte(&writer->out, json);
+        writer->comma = false;
+    } else {
+        cbor_writer_byte(&writer->out, cbor);
+    }
+}
+
+static void rest_end (rest_writer_t *writer, char json) {
+    cbor_writer_byte(&writer->out, writer->format == REST_FORMAT_JSON ? json : CBOR_BREAK);
+    writer->comma = true;
+}
+
+void rest_writer_map_begin (rest_writer_t *writer, const char *key) {
+    rest_begin(writer, key, '{', CBOR_MAP_INDEFINITE);
+}
+
+void rest_writer_map_end (rest_writer_t *writer) {
+    rest_end(writer, '}');
+}
+
+void rest_writer_array_begin (rest_writer_t *writer, const char *key) {
+    rest_begin(writer, key, '[', CBOR_ARRAY_INDEFINITE);
+}
+
+void rest_writer_array_end (rest_writer_t *writer) {
+    rest_end(writer, ']');
+}
+
+void rest_writer_uint (rest_writer_t *writer, const char *key, uint64_t value) {
+    rest_key(writer, key);
+    if (writer->format == REST_FORMAT_JSON) rest_json_uint(writer, value, 1);
+    else cbor_writer_head(&writer->out, CBOR_MAJOR_UINT, value);
+}
+
+void rest_writer_string (rest_writer_t *writer, const char *key, const char *value) {
+    rest_key(writer, key);
+    if (writer->format == REST_FORMAT_JSON) rest_json_text(writer, value);
+    else cbor_writer_text(&writer->out, value);
+}
+
+void rest_writer_fixed (rest_writer_t *writer, const char *key, int32_t value, uint8_t decimals) {
+    uint32_t scale = 1;
+    for (uint8_t i = 0; i < decimals; i++) scale *= 10;
+
+    rest_key(writer, key);
+    if (writer->format == REST_FORMAT_CBOR) {
+        cbor_writer_float(&writer->out, (float)value / scale);
+        return;
+    }
+
+    /* No printf, newlib may allocate when formatting */
+    uint32_t magnitude = value < 0 ? -(int64_t)value : value;
+    if (value < 0) cbor_writer_byte(&writer->out, '-');
+    rest_json_uint(writer, magnitude / scale, 1);
+    if (decimals) {
+        cbor_writer_byte(&writer->out, '.');
+        rest_json_uint(writer, magnitude % scale, decimals);
+    }
+}
+
+void rest_writer_raw (rest_writer_t *writer, const char *text) {
+    cbor_writer_put(&writer->out, text, strlen(text));
+}
+
+void rest_writer_raw_uint (rest_writer_t *writer, uint64_t value) {
+    rest_json_uint(writer, value, 1);
+}
+
+size_t rest_writer_finish (const rest_writer_t *writer) {
+    return cbor_writer_finish(&writer->out);
+}
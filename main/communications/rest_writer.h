@@ -0,0 +1,56 @@
+#ifndef REST_WRITER_H_
+#define REST_WRITER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../telemetry/cbor_writer.h"
+
+/**
+ *  Serializer of the API REST responses
+ *  The same calls produce compact JSON or CBOR (indefinite-length maps and arrays)
+ *  into a caller-owned buffer, without allocations. Keys are NULL inside arrays
+ */
+
+typedef enum {
+    REST_FORMAT_JSON = 0,
+    REST_FORMAT_CBOR,
+} rest_format_t;
+
+#define REST_FORMATS    2
+
+typedef struct {
+    rest_format_t format;
+    cbor_writer_t out;          // Also used as byte sink for JSON
+    bool comma;                 // JSON: a value precedes in the current container
+} rest_writer_t;
+
+/* MIME type of a format */
+const char *rest_format_type (rest_format_t format);
+
+/* Starts a response in "buf" */
+void rest_writer_init (rest_writer_t *writer, rest_format_t format, uint8_t *buf, size_t len);
+
+void rest_writer_map_begin (rest_writer_t *writer, const char *key);
+void rest_writer_map_end (rest_writer_t *writer);
+void rest_writer_array_begin (rest_writer_t *writer, const char *key);
+void rest_writer_array_end (rest_writer_t *writer);
+
+void rest_writer_uint (rest_writer_t *writer, const char *key, uint64_t value);
+void rest_writer_string (rest_writer_t *writer, const char *key, const char *value);
+
+/* Writes value / 10^decimals (e.g. 2345 with 2 decimals is 23.45), CBOR uses a float */
+void rest_writer_fixed (rest_writer_t *writer, const char *key, int32_t value, uint8_t decimals);
+
+/**
+ *  Plain text written as is, outside of the JSON or CBOR structure (e.g. CSV lines,
+ *  the fields of a server-sent event). Integers are written in decimal
+ */
+void rest_writer_raw (rest_writer_t *writer, const char *text);
+void rest_writer_raw_uint (rest_writer_t *writer, uint64_t value);
+
+/* Length of the response, 0 if it did not fit */
+size_t rest_writer_finish (const rest_writer_t *writer);
+
+#endif
@@ -2,13 +2,19 @@
 #define GLOBALS_H_
 
 /* Tags of each module */
+#define TAG_SENSORS "SENSORS"
 #define TAG_SGP30   "SENSOR_SGP30"
 #define TAG_MQTT    "COMM_MQTTS"
+#define TAG_RADIO   "COMM_RADIO"
+#define TAG_JOURNAL "COMM_JOURNAL"
+#define TAG_COALESCE "COMM_COALESCE"
+#define TAG_PUBLISHER "COMM_PUBLISHER"
 #define TAG_HTTP    "COMM_HTTPS"
 #define TAG_SNTP    "COMM_SNTP"
 #define TAG_SLEEP   "PWR_SLEEP"
 #define TAG_BLE     "COMM_BLE"
 #define TAG_PROV    "ESP_PROV"
+#define TAG_ETH     "COMM_ETH"
 
 /**
  *  Time to wait between the provisioning process
@@ -16,8 +22,4 @@
  */
 #define WAITING_TIME_BW_PROV_HTTP   10
 
-/* Node information */ 
-char ESP_LOCATION [95];
-char ESP_ID [5];
-
 #endif
\ No newline at end of file
@@ -0,0 +1,34 @@
+#ifndef HAL_H_ 
+#define HAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *  Hardware abstraction layer
+ *  The sensing, aggregation and encoding code reaches the platform only through
+ *  these functions, so it can be linked against another backend (e.g. a trace
+ *  replay on a host). I2C is abstracted by sensor_bus_ops_t (sensors/sensor_bus.h).
+ *  hal_esp.c is the ESP-IDF backend
+ */
+
+/* Monotonic time since boot (usecs) */
+int64_t hal_time_us (void);
+
+/* Wall clock time (epoch secs), 0 if it has not been set yet */
+uint32_t hal_epoch_s (void);
+
+/* Blocks the calling task for at least "us" usecs */
+void hal_delay_us (int64_t us);
+
+/**
+ * @brief   Queues a telemetry message to be published, without waiting for the network
+ *
+ * @return  0, or -1 if the message has been dropped
+ */
+int hal_publish (const uint8_t *data, size_t len);
+
+/* Scans BLE devices for "duration_s" secs and returns the estimated number of people */
+uint8_t hal_ble_scan (int duration_s);
+
+#endif
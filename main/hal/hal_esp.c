@@ -0,0 +1,56 @@
+#include "hal.h"
+
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_timer.h"
+
+#include "communications/comm_mqtt.h"
+#include "communications/comm_publisher.h"
+#include "communications/comm_ble.h"
+
+
+/* Any earlier epoch means SNTP has not synchronised the clock yet */
+#define HAL_MIN_VALID_EPOCH     1451606400      // 2016-01-01
+
+
+int64_t hal_time_us (void) {
+    return esp_timer_get_time();
+}
+
+uint32_t hal_epoch_s (void) {
+    time_t now = time(NULL);
+    return now >= HAL_MIN_VALID_EPOCH ? (uint32_t)now : 0;
+}
+
+void hal_delay_us (int64_t us) {
+    /* Rounded up to the next tick, plus one since the current tick is partly over */
+    vTaskDelay(us > 0 ? pdMS_TO_TICKS((us + 999) / 1000) + 1 : 1);
+}
+
+int hal_publish (const uint8_t *data, size_t len) {
+    return publisher_send(PUBLISHER_TELEMETRY, data, len) == ESP_OK ? 0 : -1;
+}
+
+#ifdef CONFIG_BLE_STUB
+uint8_t hal_ble_scan (int duration_s) {
+    static uint8_t people;
+
+    /* Nobody is scanned, the count just cycles so every value reaches the broker */
+    vTaskDelay(pdMS_TO_TICKS(duration_s * 1000));
+    people = (people + 1) % (CONFIG_MAX_BLE_DEVICES + 1);
+
+    return people;
+}
+#else
+uint8_t hal_ble_scan (int duration_s) {
+    scan_BLE_devices(duration_s);
+
+    /* Wait for the scan to finish plus one sec to ensure BLE scanning has ended */
+    vTaskDelay(pdMS_TO_TICKS((duration_s + 1) * 1000));
+
+    return get_people_estimation();
+}
+#endif
@@ -15,23 +15,38 @@
 #include "nvs_flash.h"
 #include "esp_netif.h"
 //#include "cJSON.h"
-#include "cbor.h"
 
-#include "sensors/sensor_sgp30.h"
+#include "sensors/sensors.h"
+#include "processing/co2_pipeline.h"
+#include "processing/deadband.h"
+#include "storage/history.h"
 #include "communications/comm_mqtt.h"
 #include "communications/comm_http.h"
 #include "communications/comm_sntp.h"
 #include "communications/comm_ble.h"
+#include "communications/comm_radio.h"
+#include "communications/comm_journal.h"
+#include "communications/comm_coalesce.h"
+#include "communications/comm_publisher.h"
+#include "communications/comm_eth.h"
 #include "provisioning/prov.h"
+#include "hal/hal.h"
+#include "telemetry/telemetry.h"
 #include "globals.h"
+#include "node_config.h"
+#include "sleep_schedule.h"
 
 
 /**
  *  By default, the period used by the SGP30 sensor to take a reading
- *  is only 1 second
+ *  is only 1 second. With adaptive sampling, this is the full rate
  */
 #define SGP30_READING_PERIOD_SEC    1
 
+/* Quantile of the CO2 sent in each window along with its mean */
+#define SGP30_WINDOW_QUANTILE       0.95f
+
+
 /**
  *  Timers and semaphores used by the implemented tasks
  */
@@ -39,38 +54,6 @@ esp_timer_handle_t timer_sensor_sgp30, timer_deep_sleep, timer_ble;
 SemaphoreHandle_t sgp30_semphr, deep_sleep_semphr, ble_semphr;
 
 
-/* ----------------- AUXILIAR FUNCTIONS ---------------- */
-/**
- * @brief   Calculates the number of usecs between two times
- *
- * @param[in] node_time   A referece time represented as "struct tm"
- *                        It is assigned the current time in this code
- * @param[in] limit_hr    The time up to which the interval is calculated
- *                        It is assigned an exact hour of the day
- *
- * @return  The number of usecs that have elapsed between these timestamps
- */
-static uint64_t calculate_range_us (struct tm node_time, int limit_hr) {
-    int aux, hour = node_time.tm_hour, min = node_time.tm_min;
-    uint64_t result;
-
-    if (hour == limit_hr) {
-        result = 60 - min;
-        result = result * 60 * 1000000;
-        return result;
-    } 
-    else if (hour < limit_hr) aux = limit_hr;
-    else aux = limit_hr + 24;
-
-    result = (aux - hour - 1) * 60; // Full hours completed converted to mins
-    result = result + (60 - min);   // Mins left to reach "limit_hr"
-    result = result * 60 * 1000000; // Total mins converted to us
-
-    return result;
-
-}
-
-
 /* ------------------ TIMER CALLBACKS ------------------ */
 /** 
  *  SGP30 timer callback
@@ -96,54 +79,101 @@ static void timer_ble_callback(void* arg) {
 
 /* ----------------------- TASKS ----------------------- */
 /**
- *  This task reads the SGP30 sensor and sends data, in CBOR representation, over MQTT
+ *  This task samples every sensor on the I2C bus and sends the CO2 of the
+ *  primary one (SGP30), in CBOR representation, over MQTT
  */
 void sgp30_task(void *pvParameter) {
-    uint16_t num_readings = 0;
-    uint32_t sum_co2 = 0;
+    co2_pipeline_t pipeline;
+    sensor_reading_t reading;
+
+    /* Without adaptive sampling the rate stays at the full one */
+    uint32_t max_period_ms = SGP30_READING_PERIOD_SEC * 1000;
+#ifdef CONFIG_SAMPLING_ADAPTIVE
+    /* The slowest rate is bounded by the cadence required by the sensors */
+    uint32_t sensors_period_ms = sensors_max_period_ms();
+    max_period_ms = CONFIG_SAMPLING_MAX_PERIOD_SEC * 1000;
+    if (sensors_period_ms && sensors_period_ms < max_period_ms) max_period_ms = sensors_period_ms;
+#endif
+
+    const co2_pipeline_config_t pipeline_config = {
+        .rate = {
+            .min_period_ms = SGP30_READING_PERIOD_SEC * 1000,
+            .max_period_ms = max_period_ms,
+#ifdef CONFIG_SAMPLING_ADAPTIVE
+            .stable_delta = CONFIG_SAMPLING_STABLE_DELTA_PPM,
+            .slope_delta = CONFIG_SAMPLING_SLOPE_DELTA_PPM * 1000,
+            .stable_samples = CONFIG_SAMPLING_STABLE_SAMPLES,
+#endif
+        },
+        .window_ms = CONFIG_MQTT_SENDING_PERIOD_SEC * 1000,
+        .quantile = SGP30_WINDOW_QUANTILE,
+    };
+    co2_pipeline_init(&pipeline, &pipeline_config, hal_time_us());
+
+#ifdef CONFIG_DEADBAND_REPORTING
+    /* Windows whose mean barely moves are not sent (the history keeps every reading) */
+    deadband_t deadband;
+    const deadband_config_t deadband_config = {
+        .abs = CONFIG_DEADBAND_CO2_ABS_PPM,
+        .rel_pct = CONFIG_DEADBAND_CO2_REL_PCT,
+        .heartbeat_s = CONFIG_DEADBAND_HEARTBEAT_SEC,
+    };
+    deadband_init(&deadband, &deadband_config);
+    http_stats_deadband(HTTP_DEADBAND_CO2, &deadband);
+#endif
+#if !defined(CONFIG_RADIO_OFF_MODE) && defined(CONFIG_COALESCE_ENABLE)
+    bool co2_high = false;          // Last window reported was above the urgent level
+#endif
 
     while (1) {
         xSemaphoreTake(sgp30_semphr, portMAX_DELAY);
 
-        if(num_readings < CONFIG_MQTT_SENDING_PERIOD_SEC) {
-            sum_co2 += (uint32_t)sgp30_co2_reading();
-            num_readings++;
-        } else { 
-            /* Send result via MQTT */
-            uint16_t co2_ppm = sum_co2 / num_readings;
-            //ESP_LOGI(TAG_SGP30, "CO2(ppm) -> %d", co2_ppm);
-
-            // cJSON *data_json = cJSON_CreateObject();
-            // cJSON_AddNumberToObject(data_json, "CO2", co2_ppm);
-            // const char *data = cJSON_Print(data_json);
-            // mqtt_publish(data);
-
-            /* CBOR creation */
-            CborEncoder root_encoder;
-            uint8_t data_cbor[100];
-            cbor_encoder_init(&root_encoder, data_cbor, sizeof(data_cbor), 0);
-
-            CborEncoder array_encoder;
-            CborEncoder map_encoder;
-            cbor_encoder_create_array(&root_encoder, &array_encoder, 1); // 1-item length array -> [
-            cbor_encoder_create_map(&array_encoder, &map_encoder, 2);    // 2-item length map -> {
-
-            cbor_encode_text_stringz(&map_encoder, "ESP_ID");
-            cbor_encode_text_stringz(&map_encoder, ESP_ID);
-
-            cbor_encode_text_stringz(&map_encoder, "CO2");
-            cbor_encode_uint(&map_encoder, co2_ppm);
+        /* Schedule the next reading first, so the period does not drift with the cycle */
+        esp_timer_start_once(timer_sensor_sgp30, (uint64_t)co2_pipeline_period_ms(&pipeline) * 1000);
 
-            cbor_encoder_close_container(&array_encoder, &map_encoder);  // }
-            cbor_encoder_close_container(&root_encoder, &array_encoder); // ]
-
-            mqtt_publish((char*)data_cbor);
-            //ESP_LOGI(TAG_SGP30, "CBOR -> %s", (char*)data_cbor);
+        /* The conversions of all the sensors overlap, a cycle lasts about the longest one */
+        if (sensors_sample() != ESP_OK ||
+            sensors_get_last_reading(SENSORS_PRIMARY, &reading) != ESP_OK) {
+            co2_pipeline_missed(&pipeline);
+            continue;
+        }
 
-            num_readings = 0;
-            sum_co2 = 0;
+        uint16_t co2_filtered;
+        if (co2_pipeline_sample(&pipeline, reading.co2_ppm, &co2_filtered)) {
+            history_add_co2(co2_filtered);
+        } else {
+            ESP_LOGW(TAG_SGP30, "CO2 reading %d ppm rejected by the filter", reading.co2_ppm);
         }
 
+        window_stats_result_t co2;
+        if (!co2_pipeline_window(&pipeline, hal_time_us(), &co2)) continue;
+
+        /* Live clients get every window, whether it is reported or not */
+        http_stream_co2(hal_epoch_s(), &co2);
+
+#ifdef CONFIG_DEADBAND_REPORTING
+        if (!deadband_check(&deadband, co2.mean, hal_time_us() / 1000000)) continue;
+        ESP_LOGD(TAG_SGP30, "CO2 reported, %d windows suppressed so far", (int)deadband.suppressed);
+#endif
+
+#ifdef CONFIG_RADIO_OFF_MODE
+        /* Kept until the next burst upload */
+        radio_buffer_co2(co2.mean);
+#elif defined(CONFIG_COALESCE_ENABLE)
+        /* Sent together with the next results, unless the level has just become high */
+        bool co2_high_now = co2.mean >= CONFIG_COALESCE_URGENT_CO2_PPM;
+        coalesce_co2(hal_epoch_s(), &co2, co2_high_now && !co2_high);
+        co2_high = co2_high_now;
+#else
+        /* Send result via MQTT */
+        uint8_t data_cbor[TELEMETRY_WINDOW_LEN];
+        const node_config_t *config = node_config_acquire();
+        size_t len = telemetry_encode_co2(data_cbor, sizeof(data_cbor), &config->id_cbor, &co2, hal_epoch_s());
+        node_config_release(config);
+        if (len) hal_publish(data_cbor, len);
+        //ESP_LOGI(TAG_SGP30, "CBOR -> %s", (char*)data_cbor);
+#endif
+
     }
 
     vTaskDelete(NULL);
@@ -217,36 +247,46 @@ void deep_sleep_task(void *pvParameter) {
  */
 void ble_task(void *pvParameter) {
 
-    while (1) {
-
-        /* Start scan */
-        scan_BLE_devices(CONFIG_BLE_SCANNING_DURATION_SEC);
-
-        /* Wait for the scan to finish plus one sec to ensure BLE scanning has ended */
-        vTaskDelay(pdMS_TO_TICKS((CONFIG_BLE_SCANNING_DURATION_SEC + 1) * 1000));
-
-        /* CBOR creation */
-        CborEncoder root_encoder;
-        uint8_t data_cbor[100];
-        cbor_encoder_init(&root_encoder, data_cbor, sizeof(data_cbor), 0);
-
-        CborEncoder array_encoder;
-        CborEncoder map_encoder;
-        cbor_encoder_create_array(&root_encoder, &array_encoder, 1); // 1-item length array -> [
-        cbor_encoder_create_map(&array_encoder, &map_encoder, 2);    // 2-item length map -> {
-
-        cbor_encode_text_stringz(&map_encoder, "ESP_ID");
-        cbor_encode_text_stringz(&map_encoder, ESP_ID);
+#ifdef CONFIG_DEADBAND_REPORTING
+    /* Estimations that do not change are not sent (the history keeps every one) */
+    deadband_t deadband;
+    const deadband_config_t deadband_config = {
+        .abs = CONFIG_DEADBAND_BLE_ABS,
+        .heartbeat_s = CONFIG_DEADBAND_HEARTBEAT_SEC,
+    };
+    deadband_init(&deadband, &deadband_config);
+    http_stats_deadband(HTTP_DEADBAND_BLE, &deadband);
+#endif
 
-        uint8_t ble_last_estimation = get_people_estimation();
-        cbor_encode_text_stringz(&map_encoder, "BLE_people");
-        cbor_encode_uint(&map_encoder, ble_last_estimation);
+    while (1) {
 
-        cbor_encoder_close_container(&array_encoder, &map_encoder);  // }
-        cbor_encoder_close_container(&root_encoder, &array_encoder); // ]
+        uint8_t ble_last_estimation = hal_ble_scan(CONFIG_BLE_SCANNING_DURATION_SEC);
+        history_add_ble(ble_last_estimation);
+        http_stream_ble(hal_epoch_s(), ble_last_estimation);
 
-        mqtt_publish((char*)data_cbor);
+#ifdef CONFIG_DEADBAND_REPORTING
+        if (!deadband_check(&deadband, ble_last_estimation, hal_time_us() / 1000000)) {
+            xSemaphoreTake(ble_semphr, portMAX_DELAY);
+            continue;
+        }
+        ESP_LOGD(TAG_BLE, "People reported, %d estimations suppressed so far", (int)deadband.suppressed);
+#endif
+
+#ifdef CONFIG_RADIO_OFF_MODE
+        /* Kept until the next burst upload */
+        radio_buffer_ble(ble_last_estimation);
+#elif defined(CONFIG_COALESCE_ENABLE)
+        /* Sent together with the next results */
+        coalesce_ble(hal_epoch_s(), ble_last_estimation, false);
+#else
+        /* Send result via MQTT */
+        uint8_t data_cbor[TELEMETRY_WINDOW_LEN];
+        const node_config_t *config = node_config_acquire();
+        size_t len = telemetry_encode_ble(data_cbor, sizeof(data_cbor), &config->id_cbor, ble_last_estimation, hal_epoch_s());
+        node_config_release(config);
+        if (len) hal_publish(data_cbor, len);
         //ESP_LOGI(TAG_SGP30, "CBOR -> %s", (char*)data_cbor);
+#endif
         
         xSemaphoreTake(ble_semphr, portMAX_DELAY);
 
@@ -256,9 +296,8 @@ void ble_task(void *pvParameter) {
 
 void app_main(void)
 {
-    /* Update the node info */
-    strcpy(ESP_LOCATION, CONFIG_ESP_LOCATION);
-    strcpy(ESP_ID, CONFIG_ESP_ID);
+    /* Initial node info */
+    ESP_ERROR_CHECK(node_config_init(CONFIG_ESP_LOCATION, CONFIG_ESP_ID));
     
     /**
      *  Initialize the  Non-Volatile Storage, a layer over the TCP/IP stack 
@@ -269,9 +308,9 @@ void app_main(void)
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
 
-    /* -------------------- SGP30 SENSOR -------------------- */
-    ESP_ERROR_CHECK(sgp30_config());
-    ESP_ERROR_CHECK(sgp30_init());
+    /* ---------------------- SENSORS ----------------------- */
+    ESP_ERROR_CHECK(sensors_init());
+    ESP_ERROR_CHECK(history_init());
 
     const esp_timer_create_args_t timer_sensor_sgp30_args = {
         .callback = &timer_sensor_sgp30_callback,
@@ -300,7 +339,9 @@ void app_main(void)
 
 
     /* ---------------------- BLUETOOTH --------------------- */
+#ifndef CONFIG_BLE_STUB
     ESP_ERROR_CHECK(esp_ble_init());
+#endif
 
     const esp_timer_create_args_t timer_ble_args = {
         .callback = &timer_ble_callback,
@@ -312,20 +353,40 @@ void app_main(void)
 
 
     /* --------------------- DEPLOYMENT --------------------- */
+#ifdef CONFIG_NETWORK_OPENETH
+    /* Emulator: wired network instead of Wi-Fi */
+    ESP_ERROR_CHECK(eth_openeth_start());
+#else
     /* Provisioning process */
     ESP_ERROR_CHECK(start_esp_provisioning());
+#endif
 
     /* Set the current time in the system */
     ESP_ERROR_CHECK(set_sys_time());
     
-    /* Start MQTT client */
+#ifdef CONFIG_JOURNAL_ENABLE
+    /* Messages from a previous run are replayed once the client connects */
+    if (journal_start() != ESP_OK) ESP_LOGW(TAG_JOURNAL, "Messages will not be stored during outages");
+#endif
+
+    /* Start MQTT client and the task that publishes the queued messages */
     ESP_ERROR_CHECK(mqtt_app_start());
+    ESP_ERROR_CHECK(publisher_start());
 
     /* Start REST server */
     ESP_ERROR_CHECK(start_rest_server());
 
+#ifdef CONFIG_RADIO_OFF_MODE
+    /* From now on, the radio is only on during the burst uploads */
+    ESP_ERROR_CHECK(radio_off_start());
+#endif
+
+#ifdef CONFIG_COALESCE_ENABLE
+    ESP_ERROR_CHECK(coalesce_start());
+#endif
+
     /* Start timers */
-    esp_timer_start_periodic(timer_sensor_sgp30, SGP30_READING_PERIOD_SEC * 1000000);
+    esp_timer_start_once(timer_sensor_sgp30, SGP30_READING_PERIOD_SEC * 1000000);
     esp_timer_start_periodic(timer_ble, CONFIG_BLE_ESTIMATION_PERIOD_SEC * 1000000);
     
     /* Run tasks */
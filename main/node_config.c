@@ -0,0 +1,132 @@
+#include "node_config.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+
+/* Wait of an update while every other snapshot is being read */
+#define NODE_CONFIG_WAIT_MS     10
+
+
+static node_config_t snapshots[NODE_CONFIG_SNAPSHOTS];
+
+/* Readers holding each snapshot */
+static uint32_t readers[NODE_CONFIG_SNAPSHOTS];
+
+/* Snapshot seen by the readers, swapped atomically */
+static node_config_t *current;
+
+/* Serializes the updates (readers never take it) */
+static SemaphoreHandle_t node_config_mutex;
+static size_t next_snapshot;
+
+
+/**
+ *  Checks a value of the topic: printable and no MQTT wildcards. The ID is a single
+ *  level, so it has no '/'. The location is the levels before it: it ends with '/'
+ *  and has no empty level ("//")
+ */
+static esp_err_t node_config_check (const char *value, size_t len, size_t max, bool levels) {
+    if (len == 0 || len > max) return ESP_ERR_INVALID_SIZE;
+    if (levels && value[len - 1] != '/') return ESP_ERR_INVALID_ARG;
+
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = value[i];
+        if (c < 0x20 || c == 0x7f || c == '+' || c == '#') return ESP_ERR_INVALID_ARG;
+        if (c == '/' && (!levels || (i > 0 && value[i - 1] == '/'))) return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
+/* Copies "len" bytes of "value" into "field" as a NUL-terminated string, unless "value" is NULL */
+static void node_config_copy (char *field, size_t size, const char *value, size_t len) {
+    if (value == NULL) return;
+
+    memset(field, 0, size);
+    memcpy(field, value, len);
+}
+
+/* Builds a snapshot from the current one and the new values (NULL keeps one), then publishes it */
+static void node_config_update (const char *location, size_t location_len, const char *id, size_t id_len) {
+    xSemaphoreTake(node_config_mutex, portMAX_DELAY);
+
+    /* Not the current snapshot, nor one still read. The oldest first */
+    node_config_t *config = NULL;
+    while (config == NULL) {
+        for (size_t i = 0; i < NODE_CONFIG_SNAPSHOTS && config == NULL; i++) {
+            size_t slot = (next_snapshot + i) % NODE_CONFIG_SNAPSHOTS;
+            if (&snapshots[slot] == current || __atomic_load_n(&readers[slot], __ATOMIC_SEQ_CST)) continue;
+
+            config = &snapshots[slot];
+            next_snapshot = (slot + 1) % NODE_CONFIG_SNAPSHOTS;
+        }
+        if (config == NULL) vTaskDelay(pdMS_TO_TICKS(NODE_CONFIG_WAIT_MS));
+    }
+
+    if (current) *config = *current;
+    node_config_copy(config->location, sizeof(config->location), location, location_len);
+    node_config_copy(config->id, sizeof(config->id), id, id_len);
+
+    /* Both fit by the limits checked, MQTT_TOPIC_LEN has room for the longest values */
+    mqtt_topic_init(&config->topic, config->location, config->id);
+    telemetry_id_init(&config->id_cbor, config->id);
+
+    __atomic_store_n(&current, config, __ATOMIC_SEQ_CST);
+
+    xSemaphoreGive(node_config_mutex);
+}
+
+esp_err_t node_config_init (const char *location, const char *id) {
+    if (node_config_mutex == NULL) node_config_mutex = xSemaphoreCreateMutex();
+    if (node_config_mutex == NULL) return ESP_ERR_NO_MEM;
+
+    esp_err_t err = node_config_check(location, strlen(location), NODE_LOCATION_MAX, true);
+    if (err == ESP_OK) err = node_config_check(id, strlen(id), NODE_ID_MAX, false);
+    if (err != ESP_OK) return err;
+
+    node_config_update(location, strlen(location), id, strlen(id));
+
+    return ESP_OK;
+}
+
+const node_config_t *node_config_acquire (void) {
+    while (1) {
+        node_config_t *config = __atomic_load_n(&current, __ATOMIC_SEQ_CST);
+        uint32_t *count = &readers[config - snapshots];
+
+        /**
+         *  Counted before it is read. If it is still the current one, an update cannot
+         *  take it any more; otherwise an update may be rewriting it, so it is left
+         */
+        __atomic_fetch_add(count, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&current, __ATOMIC_SEQ_CST) == config) return config;
+        __atomic_fetch_sub(count, 1, __ATOMIC_RELEASE);
+    }
+}
+
+void node_config_release (const node_config_t *config) {
+    __atomic_fetch_sub(&readers[config - snapshots], 1, __ATOMIC_RELEASE);
+}
+
+esp_err_t node_config_set_location (const char *location, size_t len) {
+    esp_err_t err = node_config_check(location, len, NODE_LOCATION_MAX, true);
+    if (err != ESP_OK) return err;
+
+    node_config_update(location, len, NULL, 0);
+
+    return ESP_OK;
+}
+
+esp_err_t node_config_set_id (const char *id, size_t len) {
+    esp_err_t err = node_config_check(id, len, NODE_ID_MAX, false);
+    if (err != ESP_OK) return err;
+
+    node_config_update(NULL, 0, id, len);
+
+    return ESP_OK;
+}
@@ -0,0 +1,59 @@
+#ifndef NODE_CONFIG_H_
+#define NODE_CONFIG_H_
+
+#include <stddef.h>
+#include "esp_err.h"
+
+#include "communications/comm_mqtt.h"
+#include "telemetry/telemetry.h"
+
+/**
+ *  Node configuration (ESP_LOCATION and ESP_ID)
+ *  Readers get an immutable snapshot without locks nor copies. An update builds a
+ *  new snapshot, along with everything derived from the config (the MQTT topic and
+ *  the encoded ID of the telemetry), and publishes it by swapping the pointer, so
+ *  readers see either the old config or the new one, never a mix. The snapshots
+ *  come from a small pool and each one counts its readers: an update only reuses a
+ *  snapshot nobody reads, waiting if every other one is still held
+ */
+
+#define NODE_CONFIG_SNAPSHOTS   4
+
+/* Longest location and ID */
+#define NODE_LOCATION_MAX       94
+#define NODE_ID_MAX             TELEMETRY_ESP_ID_MAX
+
+typedef struct {
+    char location[NODE_LOCATION_MAX + 1];
+    char id[NODE_ID_MAX + 1];
+    mqtt_topic_t topic;             // Location + ID
+    telemetry_id_t id_cbor;         // ID as appended to the telemetry
+} node_config_t;
+
+/* Sets the initial config (e.g. from menuconfig) */
+esp_err_t node_config_init (const char *location, const char *id);
+
+/**
+ * @brief   Takes the current snapshot, it is not changed until it is released
+ *          Hold it only while building or sending a message (e.g. across a publish)
+ */
+const node_config_t *node_config_acquire (void);
+
+/* Releases a snapshot taken with node_config_acquire */
+void node_config_release (const node_config_t *config);
+
+/**
+ * @brief   Changes the location, "location" does not need to be NUL-terminated
+ *
+ * @return
+ *  - ESP_OK
+ *  - ESP_ERR_INVALID_SIZE if it is empty or longer than NODE_LOCATION_MAX
+ *  - ESP_ERR_INVALID_ARG if it holds characters not allowed in a MQTT topic, an
+ *    empty level ("//") or it does not end with '/'
+ */
+esp_err_t node_config_set_location (const char *location, size_t len);
+
+/* Changes the ID, as node_config_set_location (at most NODE_ID_MAX characters, no '/') */
+esp_err_t node_config_set_id (const char *id, size_t len);
+
+#endif
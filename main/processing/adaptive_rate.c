@@ -0,0 +1,52 @@
+#include "adaptive_rate.h"
+
+
+void adaptive_rate_init (adaptive_rate_t *rate, const adaptive_rate_config_t *config) {
+    rate->config = *config;
+    if (rate->config.max_period_ms < rate->config.min_period_ms) {
+        rate->config.max_period_ms = rate->config.min_period_ms;
+    }
+    adaptive_rate_reset(rate);
+}
+
+void adaptive_rate_reset (adaptive_rate_t *rate) {
+    rate->period_ms = rate->config.min_period_ms;
+    rate->stable_count = 0;
+    rate->has_last = false;
+}
+
+uint32_t adaptive_rate_update (adaptive_rate_t *rate, uint16_t value) {
+    const adaptive_rate_config_t *config = &rate->config;
+
+    if (!rate->has_last) {
+        rate->has_last = true;
+        rate->last_value = value;
+        rate->last_slope = 0;
+        return rate->period_ms;
+    }
+
+    int32_t delta = (int32_t)value - rate->last_value;
+    int32_t slope = (int32_t)((int64_t)delta * 1000000 / rate->period_ms);
+    int32_t slope_change = slope - rate->last_slope;
+
+    rate->last_value = value;
+    rate->last_slope = slope;
+
+    if (slope_change < 0) slope_change = -slope_change;
+    if (delta < 0) delta = -delta;
+
+    if ((uint32_t)slope_change >= config->slope_delta) {
+        /* Something is happening in the room: full rate */
+        rate->period_ms = config->min_period_ms;
+        rate->stable_count = 0;
+    } else if (delta <= config->stable_delta) {
+        if (++rate->stable_count >= config->stable_samples) {
+            rate->stable_count = 0;
+            rate->period_ms = rate->period_ms * 2 > config->max_period_ms ? config->max_period_ms : rate->period_ms * 2;
+        }
+    } else {
+        rate->stable_count = 0;
+    }
+
+    return rate->period_ms;
+}
@@ -0,0 +1,46 @@
+#ifndef ADAPTIVE_RATE_H_ 
+#define ADAPTIVE_RATE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ *  Adaptive sampling rate controller
+ *  The sampling period is doubled every time the signal stays stable for a number
+ *  of samples, up to a max period, and it jumps back to the full rate as soon as
+ *  the slope of the signal changes. It does not depend on ESP-IDF
+ */
+
+typedef struct {
+    uint32_t min_period_ms;     // Period at full rate
+    uint32_t max_period_ms;     // Slowest period (bounded by the cadence of the sensors)
+    uint16_t stable_delta;      // Max change between two samples of a stable signal
+    uint32_t slope_delta;       // Slope change (thousandths of unit per sec) that restores the full rate
+    uint8_t stable_samples;     // Consecutive stable samples needed to halve the rate
+} adaptive_rate_config_t;
+
+typedef struct {
+    adaptive_rate_config_t config;
+    uint32_t period_ms;         // Current sampling period
+    uint16_t last_value;
+    int32_t last_slope;         // Thousandths of unit per sec
+    uint8_t stable_count;
+    bool has_last;
+} adaptive_rate_t;
+
+/* Initializes the controller at full rate */
+void adaptive_rate_init (adaptive_rate_t *rate, const adaptive_rate_config_t *config);
+
+/**
+ * @brief   Updates the controller with a new sample
+ *
+ * @param[in] value     Sample taken after the current period
+ *
+ * @return  Period (msecs) until the next sample
+ */
+uint32_t adaptive_rate_update (adaptive_rate_t *rate, uint16_t value);
+
+/* Restores the full rate (e.g. after a failed sample) */
+void adaptive_rate_reset (adaptive_rate_t *rate);
+
+#endif
@@ -0,0 +1,98 @@
+#include "co2_filter.h"
+
+#include <string.h>
+
+
+void co2_filter_init (co2_filter_t *filter) {
+    memset(filter, 0, sizeof(*filter));
+}
+
+#ifdef CONFIG_CO2_FILTER_SLEW
+/**
+ *  Rejects samples that move faster than the max slew rate from the last accepted one.
+ *  A long run of rejections means the level really changed, so it is accepted
+ */
+static inline bool co2_filter_slew (co2_filter_t *filter, uint16_t value, uint32_t dt_ms) {
+    if (filter->slew_primed && filter->slew_rejected < CONFIG_CO2_FILTER_SLEW_MAX_REJECTED) {
+        uint32_t delta = value > filter->slew_last ? value - filter->slew_last : filter->slew_last - value;
+        uint32_t max_delta = CONFIG_CO2_FILTER_SLEW_MAX_PPM_S * dt_ms / 1000;
+
+        if (delta > max_delta) {
+            filter->slew_rejected++;
+            return false;
+        }
+    }
+
+    filter->slew_primed = true;
+    filter->slew_last = value;
+    filter->slew_rejected = 0;
+
+    return true;
+}
+#endif
+
+#ifdef CONFIG_CO2_FILTER_MEDIAN
+/* Median of the last N samples (insertion sort of a copy, N is tiny) */
+static inline uint16_t co2_filter_median (co2_filter_t *filter, uint16_t value) {
+    uint16_t sorted[CONFIG_CO2_FILTER_MEDIAN_LEN];
+
+    filter->median_window[filter->median_next] = value;
+    filter->median_next = (filter->median_next + 1) % CONFIG_CO2_FILTER_MEDIAN_LEN;
+    if (filter->median_count < CONFIG_CO2_FILTER_MEDIAN_LEN) filter->median_count++;
+
+    for (uint8_t i = 0; i < filter->median_count; i++) {
+        uint16_t item = filter->median_window[i];
+        int8_t j = i - 1;
+
+        while (j >= 0 && sorted[j] > item) {
+            sorted[j + 1] = sorted[j];
+            j--;
+        }
+        sorted[j + 1] = item;
+    }
+
+    return sorted[filter->median_count / 2];
+}
+#endif
+
+#ifdef CONFIG_CO2_FILTER_EMA
+/* y += (x - y) / 2^shift, computed in fixed point */
+static inline uint16_t co2_filter_ema (co2_filter_t *filter, uint16_t value) {
+    int32_t sample = (int32_t)value << CO2_FILTER_EMA_FRAC_BITS;
+
+    if (!filter->ema_primed) {
+        filter->ema_primed = true;
+        filter->ema_state = sample;
+    } else {
+        int32_t state = (int32_t)filter->ema_state;
+        filter->ema_state = state + ((sample - state) >> CONFIG_CO2_FILTER_EMA_SHIFT);
+    }
+
+    return (filter->ema_state + (1 << (CO2_FILTER_EMA_FRAC_BITS - 1))) >> CO2_FILTER_EMA_FRAC_BITS;
+}
+#endif
+
+bool co2_filter_apply (co2_filter_t *filter, uint16_t raw, uint32_t dt_ms, uint16_t *out) {
+    uint16_t value = raw;
+
+#if !defined(CONFIG_CO2_FILTER_SLEW) && !defined(CONFIG_CO2_FILTER_MEDIAN) && !defined(CONFIG_CO2_FILTER_EMA)
+    (void)filter;
+#endif
+
+    if (value > CO2_FILTER_MAX_VALID_PPM) return false;
+
+#ifdef CONFIG_CO2_FILTER_SLEW
+    if (!co2_filter_slew(filter, value, dt_ms)) return false;
+#else
+    (void)dt_ms;
+#endif
+#ifdef CONFIG_CO2_FILTER_MEDIAN
+    value = co2_filter_median(filter, value);
+#endif
+#ifdef CONFIG_CO2_FILTER_EMA
+    value = co2_filter_ema(filter, value);
+#endif
+
+    *out = value;
+    return true;
+}
@@ -0,0 +1,56 @@
+#ifndef CO2_FILTER_H_ 
+#define CO2_FILTER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+/**
+ *  Fixed-point filter chain for CO2 samples
+ *  Stages (in order): validity gate, slew-rate outlier rejection, median-of-N
+ *  and EMA. They are selected in menuconfig and compiled out when disabled,
+ *  so an unused stage costs neither code nor state. No allocations are done
+ */
+
+/* Any value above this one is a bus glitch (e.g. 0xFFFF), the SGP30 range is 400-60000 ppm */
+#define CO2_FILTER_MAX_VALID_PPM    60000
+
+/* Fractional bits of the EMA state */
+#define CO2_FILTER_EMA_FRAC_BITS    4
+
+typedef struct {
+#ifdef CONFIG_CO2_FILTER_SLEW
+    uint16_t slew_last;             // Last accepted sample
+    uint8_t slew_rejected;          // Consecutive rejected samples
+    bool slew_primed;
+#endif
+#ifdef CONFIG_CO2_FILTER_MEDIAN
+    uint16_t median_window[CONFIG_CO2_FILTER_MEDIAN_LEN];
+    uint8_t median_next;
+    uint8_t median_count;
+#endif
+#ifdef CONFIG_CO2_FILTER_EMA
+    uint32_t ema_state;             // Q(CO2_FILTER_EMA_FRAC_BITS)
+    bool ema_primed;
+#endif
+    uint8_t unused;                 // Keeps the struct non-empty when every stage is disabled
+} co2_filter_t;
+
+/* Clears the state of every stage */
+void co2_filter_init (co2_filter_t *filter);
+
+/**
+ * @brief   Runs a raw sample through the filter chain
+ *
+ * @param[in]  raw      Sample read from the sensor (ppm)
+ * @param[in]  dt_ms    Time since the last accepted sample (rejected ones included)
+ * @param[out] out      Filtered sample
+ *
+ * @return
+ *  - true  if a filtered sample is available
+ *  - false if the sample has been rejected
+ */
+bool co2_filter_apply (co2_filter_t *filter, uint16_t raw, uint32_t dt_ms, uint16_t *out);
+
+#endif
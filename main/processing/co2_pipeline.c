@@ -0,0 +1,60 @@
+#include "co2_pipeline.h"
+
+
+void co2_pipeline_init (co2_pipeline_t *pipeline, const co2_pipeline_config_t *config, int64_t now_us) {
+    co2_filter_init(&pipeline->filter);
+    adaptive_rate_init(&pipeline->rate, &config->rate);
+    window_stats_init(&pipeline->window, config->quantile);
+
+    pipeline->window_ms = config->window_ms;
+    pipeline->period_ms = pipeline->rate.period_ms;
+    pipeline->filter_dt_ms = 0;
+    pipeline->window_start_us = now_us;
+}
+
+uint32_t co2_pipeline_period_ms (const co2_pipeline_t *pipeline) {
+    return pipeline->period_ms;
+}
+
+bool co2_pipeline_sample (co2_pipeline_t *pipeline, uint16_t co2_ppm, uint16_t *filtered) {
+    uint16_t co2_filtered;
+
+    /**
+     *  Outliers are dropped, so they neither weigh on the mean nor speed up the rate.
+     *  The time of a rejected reading (a glitch too) goes on counting for the next one
+     */
+    pipeline->filter_dt_ms += pipeline->period_ms;
+    if (!co2_filter_apply(&pipeline->filter, co2_ppm, pipeline->filter_dt_ms, &co2_filtered)) return false;
+    pipeline->filter_dt_ms = 0;
+
+    /**
+     *  This reading stands for the time since the previous one (the period it was
+     *  taken after). Windows are closed right after a reading, so the weights of a
+     *  window add up to its length
+     */
+    window_stats_add(&pipeline->window, co2_filtered, pipeline->period_ms);
+    pipeline->period_ms = adaptive_rate_update(&pipeline->rate, co2_filtered);
+
+    if (filtered) *filtered = co2_filtered;
+
+    return true;
+}
+
+void co2_pipeline_missed (co2_pipeline_t *pipeline) {
+    pipeline->filter_dt_ms += pipeline->period_ms;
+    adaptive_rate_reset(&pipeline->rate);
+    pipeline->period_ms = pipeline->rate.period_ms;
+}
+
+bool co2_pipeline_window (co2_pipeline_t *pipeline, int64_t now_us, window_stats_result_t *result) {
+    if (!window_stats_count(&pipeline->window) ||
+        now_us - pipeline->window_start_us < (int64_t)pipeline->window_ms * 1000) {
+        return false;
+    }
+
+    window_stats_get(&pipeline->window, result);
+    window_stats_reset(&pipeline->window);
+    pipeline->window_start_us = now_us;
+
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef CO2_PIPELINE_H_ 
+#define CO2_PIPELINE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "adaptive_rate.h"
+#include "co2_filter.h"
+#include "window_stats.h"
+
+/**
+ *  CO2 sampling pipeline
+ *  Filter, adaptive sampling rate and window statistics chained together. The
+ *  caller reads the sensor when the pipeline asks for it and passes the time
+ *  in, so the pipeline can run off-target at any speed (e.g. replaying a trace)
+ */
+
+typedef struct {
+    adaptive_rate_config_t rate;    // min_period_ms == max_period_ms keeps a fixed rate
+    uint32_t window_ms;             // Length of a window
+    float quantile;                 // Quantile reported with each window (0-1)
+} co2_pipeline_config_t;
+
+typedef struct {
+    co2_filter_t filter;
+    adaptive_rate_t rate;
+    window_stats_t window;
+    uint32_t window_ms;
+    uint32_t period_ms;             // Period until the next reading
+    uint32_t filter_dt_ms;          // Time since the last reading accepted by the filter
+    int64_t window_start_us;
+} co2_pipeline_t;
+
+/* Initializes the pipeline, the first window starts at "now_us" */
+void co2_pipeline_init (co2_pipeline_t *pipeline, const co2_pipeline_config_t *config, int64_t now_us);
+
+/* Period (msecs) until the next reading */
+uint32_t co2_pipeline_period_ms (const co2_pipeline_t *pipeline);
+
+/**
+ * @brief   Feeds a reading taken one period after the previous one
+ *
+ * @param[out] filtered     Reading after the filter (may be NULL)
+ *
+ * @return
+ *  - true  if the reading has been added to the window
+ *  - false if the filter has rejected it
+ */
+bool co2_pipeline_sample (co2_pipeline_t *pipeline, uint16_t co2_ppm, uint16_t *filtered);
+
+/* Records a failed reading, the full sampling rate is restored */
+void co2_pipeline_missed (co2_pipeline_t *pipeline);
+
+/**
+ * @brief   Closes the window if it has lasted long enough and holds any reading
+ *
+ * @param[out] result   Statistics of the closed window
+ *
+ * @return  true if the window has been closed (a new one starts at "now_us")
+ */
+bool co2_pipeline_window (co2_pipeline_t *pipeline, int64_t now_us, window_stats_result_t *result);
+
+#endif
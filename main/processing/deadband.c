@@ -0,0 +1,39 @@
+#include "deadband.h"
+
+
+void deadband_init (deadband_t *deadband, const deadband_config_t *config) {
+    deadband->config = *config;
+    deadband->primed = false;
+    deadband->last_value = 0;
+    deadband->last_s = 0;
+    deadband->reported = 0;
+    deadband->suppressed = 0;
+    deadband->suppressed_run = 0;
+}
+
+bool deadband_check (deadband_t *deadband, uint16_t value, uint32_t now_s) {
+    const deadband_config_t *config = &deadband->config;
+
+    if (deadband->primed) {
+        uint32_t band = config->abs;
+        uint32_t rel = (uint32_t)deadband->last_value * config->rel_pct / 100;
+        if (rel > band) band = rel;
+
+        uint32_t change = value > deadband->last_value ? value - deadband->last_value : deadband->last_value - value;
+        bool heartbeat = config->heartbeat_s && now_s - deadband->last_s >= config->heartbeat_s;
+
+        if (change <= band && !heartbeat) {
+            deadband->suppressed++;
+            deadband->suppressed_run++;
+            return false;
+        }
+    }
+
+    deadband->primed = true;
+    deadband->last_value = value;
+    deadband->last_s = now_s;
+    deadband->reported++;
+    deadband->suppressed_run = 0;
+
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef DEADBAND_H_
+#define DEADBAND_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ *  Change-only reporting
+ *  A value is only reported when it leaves the deadband around the last reported
+ *  one, or when the heartbeat interval has passed since that report. The band is
+ *  the widest of the absolute and the relative one. It does not depend on ESP-IDF
+ */
+
+typedef struct {
+    uint16_t abs;               // Absolute band (units of the value), 0 to disable it
+    uint8_t rel_pct;            // Relative band (% of the last reported value), 0 to disable it
+    uint32_t heartbeat_s;       // Max secs between two reports, 0 for no heartbeat
+} deadband_config_t;
+
+typedef struct {
+    deadband_config_t config;
+    bool primed;                // A value has been reported
+    uint16_t last_value;        // Last reported value
+    uint32_t last_s;            // When it was reported
+    uint32_t reported;
+    uint32_t suppressed;        // Values not reported since boot
+    uint32_t suppressed_run;    // Values not reported since the last report
+} deadband_t;
+
+/* Initializes the policy, the first value is always reported */
+void deadband_init (deadband_t *deadband, const deadband_config_t *config);
+
+/**
+ * @brief   Decides whether a new value is reported
+ *
+ * @param[in]  value    New value
+ * @param[in]  now_s    Monotonic time in secs (e.g. uptime)
+ *
+ * @return
+ *  - true  if the value must be reported (it becomes the reference)
+ *  - false if it is suppressed
+ */
+bool deadband_check (deadband_t *deadband, uint16_t value, uint32_t now_s);
+
+#endif
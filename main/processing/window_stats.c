@@ -0,0 +1,139 @@
+#include "window_stats.h"
+
+#include <math.h>
+#include <string.h>
+
+
+void window_stats_init (window_stats_t *stats, float p) {
+    stats->p = p;
+    window_stats_reset(stats);
+}
+
+void window_stats_reset (window_stats_t *stats) {
+    float p = stats->p;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->p = p;
+
+    stats->np[0] = 0;
+    stats->np[1] = 2 * p;
+    stats->np[2] = 4 * p;
+    stats->np[3] = 2 + 2 * p;
+    stats->np[4] = 4;
+
+    stats->dn[0] = 0;
+    stats->dn[1] = p / 2;
+    stats->dn[2] = p;
+    stats->dn[3] = (1 + p) / 2;
+    stats->dn[4] = 1;
+}
+
+/* ----- P² QUANTILE ----- */
+
+static float window_stats_parabolic (const window_stats_t *stats, int i, int d) {
+    const float *q = stats->q;
+    const int32_t *n = stats->n;
+
+    return q[i] + (float)d / (n[i + 1] - n[i - 1]) *
+        ((n[i] - n[i - 1] + d) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+         (n[i + 1] - n[i] - d) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+}
+
+static float window_stats_linear (const window_stats_t *stats, int i, int d) {
+    return stats->q[i] + d * (stats->q[i + d] - stats->q[i]) / (stats->n[i + d] - stats->n[i]);
+}
+
+static void window_stats_quantile_add (window_stats_t *stats, float x) {
+    float *q = stats->q;
+    int32_t *n = stats->n;
+    int k;
+
+    /* The first samples are kept sorted in the markers */
+    if (stats->count <= WINDOW_STATS_MARKERS) {
+        int i = stats->count - 1;
+        while (i > 0 && q[i - 1] > x) {
+            q[i] = q[i - 1];
+            i--;
+        }
+        q[i] = x;
+        n[stats->count - 1] = stats->count - 1;
+        return;
+    }
+
+    /* Cell of the new sample */
+    if (x < q[0]) {
+        q[0] = x;
+        k = 0;
+    } else if (x >= q[4]) {
+        q[4] = x;
+        k = 3;
+    } else {
+        k = 0;
+        while (x >= q[k + 1]) k++;
+    }
+
+    for (int i = k + 1; i < WINDOW_STATS_MARKERS; i++) n[i]++;
+    for (int i = 0; i < WINDOW_STATS_MARKERS; i++) stats->np[i] += stats->dn[i];
+
+    /* Move the middle markers towards their desired positions */
+    for (int i = 1; i < WINDOW_STATS_MARKERS - 1; i++) {
+        float d = stats->np[i] - n[i];
+
+        if ((d >= 1 && n[i + 1] - n[i] > 1) || (d <= -1 && n[i - 1] - n[i] < -1)) {
+            int ds = d > 0 ? 1 : -1;
+            float qp = window_stats_parabolic(stats, i, ds);
+
+            if (q[i - 1] < qp && qp < q[i + 1]) {
+                q[i] = qp;
+            } else {
+                q[i] = window_stats_linear(stats, i, ds);
+            }
+            n[i] += ds;
+        }
+    }
+}
+
+static float window_stats_quantile (const window_stats_t *stats) {
+    if (stats->count > WINDOW_STATS_MARKERS) return stats->q[2];
+
+    /* Too few samples for P², nearest rank of the sorted ones */
+    uint32_t rank = (uint32_t)ceilf(stats->p * stats->count);
+    if (rank > 0) rank--;
+    return stats->q[rank];
+}
+
+/* ----- WINDOW ----- */
+
+void window_stats_add (window_stats_t *stats, uint16_t value, uint32_t weight_ms) {
+    float x = value;
+
+    stats->count++;
+    if (stats->count == 1 || value < stats->min) stats->min = value;
+    if (stats->count == 1 || value > stats->max) stats->max = value;
+
+    /* Weighted incremental mean and variance (West, 1979) */
+    if (weight_ms) {
+        float delta = x - stats->mean;
+        stats->weight_sum += weight_ms;
+        stats->mean += delta * weight_ms / stats->weight_sum;
+        stats->m2 += weight_ms * delta * (x - stats->mean);
+    }
+
+    window_stats_quantile_add(stats, x);
+}
+
+uint32_t window_stats_count (const window_stats_t *stats) {
+    return stats->count;
+}
+
+void window_stats_get (const window_stats_t *stats, window_stats_result_t *result) {
+    memset(result, 0, sizeof(*result));
+    if (!stats->count) return;
+
+    result->count = stats->count;
+    result->min = stats->min;
+    result->max = stats->max;
+    result->mean = (uint16_t)lroundf(stats->weight_sum ? stats->mean : stats->min);
+    result->stddev = stats->weight_sum ? (uint16_t)lroundf(sqrtf(stats->m2 / stats->weight_sum)) : 0;
+    result->quantile = (uint16_t)lroundf(window_stats_quantile(stats));
+}
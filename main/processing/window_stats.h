@@ -0,0 +1,67 @@
+#ifndef WINDOW_STATS_H_ 
+#define WINDOW_STATS_H_
+
+#include <stdint.h>
+
+/**
+ *  Streaming statistics of a sending window
+ *  Min, max, time-weighted mean and standard deviation (Welford/West) and a
+ *  quantile estimated with the P² algorithm (Jain & Chlamtac), which tracks it
+ *  with 5 markers instead of keeping the samples. The quantile is per sample, not
+ *  weighted: with an adaptive rate, the p95 is the level exceeded by 5% of the
+ *  readings (taken more often while CO2 changes), not during 5% of the time.
+ *  The memory used does not depend on the length of the window. It does not
+ *  depend on ESP-IDF
+ */
+
+#define WINDOW_STATS_MARKERS    5
+
+typedef struct {
+    uint16_t min;
+    uint16_t max;
+    uint16_t mean;
+    uint16_t stddev;
+    uint16_t quantile;
+    uint32_t count;
+} window_stats_result_t;
+
+typedef struct {
+    float p;                                    // Quantile tracked (0-1)
+    uint32_t count;
+    uint16_t min;
+    uint16_t max;
+
+    /* Weighted Welford */
+    float weight_sum;
+    float mean;
+    float m2;
+
+    /* P² markers */
+    float q[WINDOW_STATS_MARKERS];              // Heights
+    int32_t n[WINDOW_STATS_MARKERS];            // Actual positions
+    float np[WINDOW_STATS_MARKERS];             // Desired positions
+    float dn[WINDOW_STATS_MARKERS];             // Increments of the desired positions
+} window_stats_t;
+
+/* Initializes an empty window that tracks the p quantile (e.g. 0.95) */
+void window_stats_init (window_stats_t *stats, float p);
+
+/* Empties the window, keeping the quantile tracked */
+void window_stats_reset (window_stats_t *stats);
+
+/**
+ * @brief   Adds a sample to the window
+ *
+ * @param[in] value         Sample
+ * @param[in] weight_ms     Time the sample stands for (weight of the mean and stddev,
+ *                          the quantile counts every sample once)
+ */
+void window_stats_add (window_stats_t *stats, uint16_t value, uint32_t weight_ms);
+
+/* Number of samples in the window */
+uint32_t window_stats_count (const window_stats_t *stats);
+
+/* Fills the results of the window, all of them 0 if it is empty */
+void window_stats_get (const window_stats_t *stats, window_stats_result_t *result);
+
+#endif
@@ -0,0 +1,39 @@
+#include "sensirion_common.h"
+
+
+#define SENSIRION_CRC8_POLYNOMIAL   0x31
+#define SENSIRION_CRC8_INIT         0xFF
+
+
+uint8_t sensirion_crc8 (const uint8_t *data, size_t len) {
+    uint8_t crc = SENSIRION_CRC8_INIT;
+
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            if (crc & 0x80) crc = (uint8_t)((crc << 1) ^ SENSIRION_CRC8_POLYNOMIAL);
+            else crc = (uint8_t)(crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+void sensirion_pack_word (uint16_t word, uint8_t *frame) {
+    frame[0] = word >> 8;
+    frame[1] = word & 0xFF;
+    frame[2] = sensirion_crc8(frame, SENSIRION_WORD_SIZE);
+}
+
+bool sensirion_unpack_words (const uint8_t *buf, size_t num_words, uint16_t *words) {
+    for (size_t i = 0; i < num_words; i++) {
+        const uint8_t *frame = buf + i * SENSIRION_FRAME_SIZE;
+
+        if (sensirion_crc8(frame, SENSIRION_WORD_SIZE) != frame[SENSIRION_WORD_SIZE]) {
+            return false;
+        }
+        words[i] = (uint16_t)frame[0] << 8 | frame[1];
+    }
+
+    return true;
+}
@@ -0,0 +1,34 @@
+#ifndef SENSIRION_COMMON_H_ 
+#define SENSIRION_COMMON_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *  Sensirion sensors exchange data as 16-bit big-endian words,
+ *  each one followed by a CRC-8 of its two bytes
+ */
+#define SENSIRION_WORD_SIZE     2
+#define SENSIRION_FRAME_SIZE    (SENSIRION_WORD_SIZE + 1)
+
+/* Computes the Sensirion CRC-8 (poly 0x31, init 0xFF) of a buffer */
+uint8_t sensirion_crc8 (const uint8_t *data, size_t len);
+
+/* Writes a word followed by its CRC into a 3-byte frame */
+void sensirion_pack_word (uint16_t word, uint8_t *frame);
+
+/**
+ * @brief   Extracts the words of a received buffer checking their CRC
+ *
+ * @param[in]  buf        Received bytes (num_words * SENSIRION_FRAME_SIZE)
+ * @param[in]  num_words  Number of words contained in the buffer
+ * @param[out] words      Decoded words
+ *
+ * @return
+ *  - true  if every CRC matches
+ *  - false if any of the frames is corrupted
+ */
+bool sensirion_unpack_words (const uint8_t *buf, size_t num_words, uint16_t *words);
+
+#endif
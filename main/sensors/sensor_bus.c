@@ -0,0 +1,50 @@
+#include "sensor_bus.h"
+
+#include <string.h>
+
+
+/* Longest command sent by the drivers: 16-bit command plus two packed words */
+#define SENSOR_BUS_MAX_COMMAND_LEN  8
+
+
+/* Routes the bus to the channel of the device */
+static esp_err_t sensor_bus_select (sensor_dev_t *dev) {
+    sensor_bus_t *bus = dev->bus;
+
+    if (dev->mux_channel == SENSOR_BUS_NO_MUX || bus->mux_addr == 0) return ESP_OK;
+    if (bus->mux_channel == dev->mux_channel) return ESP_OK;
+
+    uint8_t mask = 1 << dev->mux_channel;
+    esp_err_t err = bus->ops->write(bus->ctx, bus->mux_addr, &mask, 1);
+
+    /* On error the mux state is unknown, so it is selected again next time */
+    bus->mux_channel = err == ESP_OK ? dev->mux_channel : SENSOR_BUS_NO_MUX;
+
+    return err;
+}
+
+esp_err_t sensor_dev_write (sensor_dev_t *dev, const uint8_t *data, size_t len) {
+    esp_err_t err = sensor_bus_select(dev);
+    if (err != ESP_OK) return err;
+
+    return dev->bus->ops->write(dev->bus->ctx, dev->addr, data, len);
+}
+
+esp_err_t sensor_dev_read (sensor_dev_t *dev, uint8_t *data, size_t len) {
+    esp_err_t err = sensor_bus_select(dev);
+    if (err != ESP_OK) return err;
+
+    return dev->bus->ops->read(dev->bus->ctx, dev->addr, data, len);
+}
+
+esp_err_t sensor_dev_command (sensor_dev_t *dev, uint16_t command, const uint8_t *args, size_t args_len) {
+    uint8_t buf[SENSOR_BUS_MAX_COMMAND_LEN];
+
+    if (args_len > sizeof(buf) - 2) return ESP_ERR_INVALID_SIZE;
+
+    buf[0] = command >> 8;
+    buf[1] = command & 0xFF;
+    if (args_len) memcpy(buf + 2, args, args_len);
+
+    return sensor_dev_write(dev, buf, args_len + 2);
+}
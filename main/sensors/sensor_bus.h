@@ -0,0 +1,44 @@
+#ifndef SENSOR_BUS_H_ 
+#define SENSOR_BUS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/* Sentinel used by devices attached directly to the bus (not behind the mux) */
+#define SENSOR_BUS_NO_MUX   (-1)
+
+/**
+ *  Operations of an I2C bus backend
+ *  Each call is a complete transaction (START, address, data, STOP)
+ */
+typedef struct {
+    esp_err_t (*write)(void *ctx, uint8_t addr, const uint8_t *data, size_t len);
+    esp_err_t (*read)(void *ctx, uint8_t addr, uint8_t *data, size_t len);
+} sensor_bus_ops_t;
+
+/* I2C bus, optionally with a TCA9548A-like multiplexer */
+typedef struct {
+    const sensor_bus_ops_t *ops;
+    void *ctx;                  // Backend data (e.g. I2C port)
+    uint8_t mux_addr;           // Multiplexer address, 0 if there is no mux
+    int8_t mux_channel;         // Channel currently selected, SENSOR_BUS_NO_MUX if unknown
+} sensor_bus_t;
+
+/* Device attached to a bus */
+typedef struct {
+    sensor_bus_t *bus;
+    uint8_t addr;               // 7-bit I2C address
+    int8_t mux_channel;         // Mux channel, SENSOR_BUS_NO_MUX if attached directly
+} sensor_dev_t;
+
+/* Writes to a device, selecting its mux channel first if needed */
+esp_err_t sensor_dev_write (sensor_dev_t *dev, const uint8_t *data, size_t len);
+
+/* Reads from a device, selecting its mux channel first if needed */
+esp_err_t sensor_dev_read (sensor_dev_t *dev, uint8_t *data, size_t len);
+
+/* Writes a 16-bit command followed by optional arguments (already packed) */
+esp_err_t sensor_dev_command (sensor_dev_t *dev, uint16_t command, const uint8_t *args, size_t args_len);
+
+#endif
@@ -0,0 +1,80 @@
+#include "sensor_bus_esp.h"
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_log.h"
+
+#include "globals.h"
+
+
+#define I2C_MASTER_TX_BUF_DISABLE   0                    
+#define I2C_MASTER_RX_BUF_DISABLE   0
+#define I2C_MASTER_READ             1
+#define I2C_MASTER_WRITE            0
+
+#define I2C_ACK_EN                  1  // ack request to slave 
+
+/* Max time a single I2C transaction may hold the bus */
+#define I2C_TIMEOUT_MS              50
+
+
+static esp_err_t sensor_bus_esp_write (void *ctx, uint8_t addr, const uint8_t *data, size_t len) {
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, addr << 1 | I2C_MASTER_WRITE, I2C_ACK_EN);
+    i2c_master_write(cmd, (uint8_t *)data, len, I2C_ACK_EN);
+    i2c_master_stop(cmd);
+
+    esp_err_t err = i2c_master_cmd_begin((i2c_port_t)(intptr_t)ctx, cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+    i2c_cmd_link_delete(cmd);
+
+    return err;
+}
+
+static esp_err_t sensor_bus_esp_read (void *ctx, uint8_t addr, uint8_t *data, size_t len) {
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, addr << 1 | I2C_MASTER_READ, I2C_ACK_EN);
+    i2c_master_read(cmd, data, len, I2C_MASTER_LAST_NACK); // nack for the last byte
+    i2c_master_stop(cmd);
+
+    esp_err_t err = i2c_master_cmd_begin((i2c_port_t)(intptr_t)ctx, cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+    i2c_cmd_link_delete(cmd);
+
+    return err;
+}
+
+static const sensor_bus_ops_t sensor_bus_esp_ops = {
+    .write = sensor_bus_esp_write,
+    .read = sensor_bus_esp_read,
+};
+
+esp_err_t sensor_bus_esp_init (sensor_bus_t *bus, i2c_port_t port, uint8_t mux_addr) {
+    i2c_config_t conf = {
+        .mode = I2C_MODE_MASTER, // ESP micro is master
+        .sda_io_num = CONFIG_I2C_MASTER_SDA_IO,
+        .sda_pullup_en = GPIO_PULLUP_ENABLE,
+        .scl_io_num = CONFIG_I2C_MASTER_SCL_IO,
+        .scl_pullup_en = GPIO_PULLUP_ENABLE,
+        .master.clk_speed = CONFIG_I2C_MASTER_FREQ_HZ,
+    };
+
+    if(i2c_param_config(port, &conf) != ESP_OK) {
+        ESP_LOGE(TAG_SENSORS, "Error I2C bus: i2c_param_config()");
+        return ESP_FAIL;
+    }
+
+    if(i2c_driver_install(port, conf.mode, I2C_MASTER_RX_BUF_DISABLE, I2C_MASTER_TX_BUF_DISABLE, 0) != ESP_OK) {
+        ESP_LOGE(TAG_SENSORS, "Error I2C bus: i2c_driver_install()");
+        return ESP_FAIL;
+    }
+
+    bus->ops = &sensor_bus_esp_ops;
+    bus->ctx = (void *)(intptr_t)port;
+    bus->mux_addr = mux_addr;
+    bus->mux_channel = SENSOR_BUS_NO_MUX;
+
+    return ESP_OK;
+}
@@ -0,0 +1,11 @@
+#ifndef SENSOR_BUS_ESP_H_ 
+#define SENSOR_BUS_ESP_H_
+
+#include "driver/i2c.h"
+
+#include "sensor_bus.h"
+
+/* Configures an I2C port as master and binds it to a sensor bus */
+esp_err_t sensor_bus_esp_init (sensor_bus_t *bus, i2c_port_t port, uint8_t mux_addr);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef SENSOR_DRIVER_H_ 
+#define SENSOR_DRIVER_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/* Fields filled in a sensor reading */
+#define SENSOR_FIELD_CO2    (1 << 0)
+#define SENSOR_FIELD_TVOC   (1 << 1)
+#define SENSOR_FIELD_TEMP   (1 << 2)
+#define SENSOR_FIELD_RH     (1 << 3)
+
+/* Values measured by any sensor, only the ones flagged in "fields" are valid */
+typedef struct {
+    uint8_t fields;
+    uint16_t co2_ppm;       // CO2 or CO2 equivalent (ppm)
+    uint16_t tvoc_ppb;      // Total volatile organic compounds (ppb)
+    int16_t temp_cdeg;      // Temperature (hundredths of Celsius degree)
+    uint16_t rh_cpct;       // Relative humidity (hundredths of %)
+} sensor_reading_t;
+
+/**
+ *  Interface implemented by every sensor driver
+ *  A conversion is triggered and collected "conversion_us" later. Drivers never
+ *  wait for the sensor, so the scheduler can interleave the conversions of
+ *  several sensors sharing the same bus
+ */
+typedef struct {
+    const char *name;
+
+    /* Initializes the sensor */
+    esp_err_t (*init)(void *ctx);
+
+    /* Starts a conversion */
+    esp_err_t (*trigger)(void *ctx);
+
+    /**
+     *  Collects the result of the conversion
+     *  Returns ESP_ERR_NOT_FINISHED to be called again "conversion_us" later
+     *  (e.g. to retry a corrupted frame or to complete a two-phase readout)
+     *  and ESP_ERR_NOT_FOUND when there is no new data in this cycle
+     */
+    esp_err_t (*collect)(void *ctx, sensor_reading_t *reading);
+
+    /* Time between a trigger and its collect */
+    uint32_t conversion_us;
+
+    /* Max sampling period allowed by the sensor (0 if it has no cadence constraint) */
+    uint32_t max_period_ms;
+} sensor_driver_t;
+
+#endif
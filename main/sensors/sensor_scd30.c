@@ -0,0 +1,109 @@
+#include "sensor_scd30.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "globals.h"
+#include "sensirion_common.h"
+
+
+/* SCD30 sensor commands */
+#define START_CONTINUOUS_MEASUREMENT    0x0010
+#define SET_MEASUREMENT_INTERVAL        0x4600
+#define GET_DATA_READY                  0x0202
+#define READ_MEASUREMENT                0x0300
+
+/* Min time between a command and the read of its response (datasheet) */
+#define SCD30_COMMAND_DELAY_US          3000
+
+/* Interval of the continuous measurement (min allowed by the sensor) */
+#define SCD30_MEASUREMENT_INTERVAL_S    2
+
+/* Measurement response: CO2, temperature and humidity as big-endian floats (2 words each) */
+#define SCD30_MEASURE_WORDS             6
+#define SCD30_MEASURE_LEN               (SCD30_MEASURE_WORDS * SENSIRION_FRAME_SIZE)
+
+
+/* Builds a float from its two big-endian words */
+static float scd30_words_to_float (const uint16_t *words) {
+    uint32_t raw = (uint32_t)words[0] << 16 | words[1];
+    float value;
+
+    memcpy(&value, &raw, sizeof(value));
+    return value;
+}
+
+static esp_err_t scd30_command_word (scd30_t *scd30, uint16_t command, uint16_t arg) {
+    uint8_t args[SENSIRION_FRAME_SIZE];
+
+    sensirion_pack_word(arg, args);
+    return sensor_dev_command(&scd30->dev, command, args, sizeof(args));
+}
+
+static esp_err_t scd30_driver_init (void *ctx) {
+    scd30_t *scd30 = (scd30_t *)ctx;
+
+    /* The sensor measures by itself, the driver only picks up the new samples */
+    esp_err_t err = scd30_command_word(scd30, SET_MEASUREMENT_INTERVAL, SCD30_MEASUREMENT_INTERVAL_S);
+    if (err == ESP_OK) err = scd30_command_word(scd30, START_CONTINUOUS_MEASUREMENT, 0); // no pressure compensation
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_SENSORS, "Error SCD30 sensor: continuous measurement not started");
+        return err;
+    }
+
+    scd30->phase = SCD30_PHASE_DATA_READY;
+
+    return ESP_OK;
+}
+
+static esp_err_t scd30_driver_trigger (void *ctx) {
+    scd30_t *scd30 = (scd30_t *)ctx;
+
+    scd30->phase = SCD30_PHASE_DATA_READY;
+    return sensor_dev_command(&scd30->dev, GET_DATA_READY, NULL, 0);
+}
+
+static esp_err_t scd30_driver_collect (void *ctx, sensor_reading_t *reading) {
+    scd30_t *scd30 = (scd30_t *)ctx;
+    uint8_t frame[SCD30_MEASURE_LEN];
+    uint16_t words[SCD30_MEASURE_WORDS];
+
+    if (scd30->phase == SCD30_PHASE_DATA_READY) {
+        if (sensor_dev_read(&scd30->dev, frame, SENSIRION_FRAME_SIZE) != ESP_OK) return ESP_FAIL;
+        if (!sensirion_unpack_words(frame, 1, words)) return ESP_ERR_INVALID_CRC;
+
+        /* No new sample since the last cycle */
+        if (words[0] != 1) return ESP_ERR_NOT_FOUND;
+
+        if (sensor_dev_command(&scd30->dev, READ_MEASUREMENT, NULL, 0) != ESP_OK) return ESP_FAIL;
+
+        scd30->phase = SCD30_PHASE_MEASUREMENT;
+        return ESP_ERR_NOT_FINISHED;
+    }
+
+    scd30->phase = SCD30_PHASE_DATA_READY;
+
+    if (sensor_dev_read(&scd30->dev, frame, sizeof(frame)) != ESP_OK) return ESP_FAIL;
+    if (!sensirion_unpack_words(frame, SCD30_MEASURE_WORDS, words)) return ESP_ERR_INVALID_CRC;
+
+    float co2 = scd30_words_to_float(&words[0]);
+    float temp = scd30_words_to_float(&words[2]);
+    float rh = scd30_words_to_float(&words[4]);
+
+    reading->fields = SENSOR_FIELD_CO2 | SENSOR_FIELD_TEMP | SENSOR_FIELD_RH;
+    reading->co2_ppm = co2 > 0 ? (uint16_t)(co2 + 0.5f) : 0;
+    reading->temp_cdeg = (int16_t)(temp * 100);
+    reading->rh_cpct = rh > 0 ? (uint16_t)(rh * 100) : 0;
+
+    return ESP_OK;
+}
+
+const sensor_driver_t scd30_driver = {
+    .name = "SCD30",
+    .init = scd30_driver_init,
+    .trigger = scd30_driver_trigger,
+    .collect = scd30_driver_collect,
+    .conversion_us = SCD30_COMMAND_DELAY_US,
+};
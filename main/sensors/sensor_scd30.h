@@ -0,0 +1,28 @@
+#ifndef SENSOR_SCD30_H_ 
+#define SENSOR_SCD30_H_
+
+#include <stdint.h>
+
+#include "sensor_bus.h"
+#include "sensor_driver.h"
+
+/* I2C address of the SCD30 sensor */
+#define SCD30_I2C_ADDR  0x61
+
+/* Readout phases, each one needs a command and a delayed read */
+typedef enum {
+    SCD30_PHASE_DATA_READY,
+    SCD30_PHASE_MEASUREMENT,
+} scd30_phase_t;
+
+/* SCD30 NDIR CO2 sensor instance, the fields after "dev" are private to the driver */
+typedef struct {
+    sensor_dev_t dev;
+
+    scd30_phase_t phase;
+} scd30_t;
+
+/* Sensor driver interface, its context is a "scd30_t" */
+extern const sensor_driver_t scd30_driver;
+
+#endif
@@ -0,0 +1,67 @@
+#include "sensor_sched.h"
+
+#include <string.h>
+
+
+esp_err_t sensor_sched_add (sensor_sched_t *sched, const sensor_driver_t *driver, void *ctx) {
+    if (sched->num_sensors >= SENSOR_SCHED_MAX_SENSORS) return ESP_ERR_NO_MEM;
+
+    sensor_slot_t *slot = &sched->slots[sched->num_sensors++];
+    memset(slot, 0, sizeof(*slot));
+    slot->driver = driver;
+    slot->ctx = ctx;
+    slot->result = ESP_ERR_INVALID_STATE;
+
+    return ESP_OK;
+}
+
+esp_err_t sensor_sched_init (sensor_sched_t *sched) {
+    esp_err_t first_err = ESP_OK;
+
+    for (size_t i = 0; i < sched->num_sensors; i++) {
+        sensor_slot_t *slot = &sched->slots[i];
+        esp_err_t err = slot->driver->init(slot->ctx);
+
+        if (err != ESP_OK && first_err == ESP_OK) first_err = err;
+    }
+
+    return first_err;
+}
+
+void sensor_sched_start_cycle (sensor_sched_t *sched, int64_t now_us) {
+    for (size_t i = 0; i < sched->num_sensors; i++) {
+        sensor_slot_t *slot = &sched->slots[i];
+
+        slot->collects = 0;
+        slot->result = slot->driver->trigger(slot->ctx);
+        slot->pending = slot->result == ESP_OK;
+        slot->deadline_us = now_us + slot->driver->conversion_us;
+    }
+}
+
+int64_t sensor_sched_poll (sensor_sched_t *sched, int64_t now_us) {
+    int64_t next_us = SENSOR_SCHED_DONE;
+
+    for (size_t i = 0; i < sched->num_sensors; i++) {
+        sensor_slot_t *slot = &sched->slots[i];
+
+        if (!slot->pending) continue;
+
+        if (slot->deadline_us <= now_us) {
+            slot->result = slot->driver->collect(slot->ctx, &slot->reading);
+            slot->collects++;
+
+            if (slot->result == ESP_ERR_NOT_FINISHED && slot->collects < SENSOR_SCHED_MAX_COLLECTS) {
+                slot->deadline_us = now_us + slot->driver->conversion_us;
+            } else {
+                if (slot->result == ESP_ERR_NOT_FINISHED) slot->result = ESP_ERR_TIMEOUT;
+                slot->pending = false;
+                continue;
+            }
+        }
+
+        if (next_us == SENSOR_SCHED_DONE || slot->deadline_us < next_us) next_us = slot->deadline_us;
+    }
+
+    return next_us;
+}
@@ -0,0 +1,60 @@
+#ifndef SENSOR_SCHED_H_ 
+#define SENSOR_SCHED_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "sensor_driver.h"
+
+/* Max sensors handled by a scheduler */
+#define SENSOR_SCHED_MAX_SENSORS    8
+
+/* Returned by sensor_sched_poll() when every sensor has been collected */
+#define SENSOR_SCHED_DONE           (-1)
+
+/* Max times a sensor may ask to be collected again in the same cycle */
+#define SENSOR_SCHED_MAX_COLLECTS   4
+
+/**
+ *  Sampling cycle scheduler
+ *  Every sensor is triggered back to back and then collected as soon as its own
+ *  conversion is completed, so a cycle costs about the longest conversion time
+ *  instead of the sum of all of them. It does not depend on any clock or RTOS:
+ *  the caller passes the current time and sleeps until the returned deadline
+ */
+typedef struct {
+    const sensor_driver_t *driver;
+    void *ctx;
+    int64_t deadline_us;            // When the conversion in progress is completed
+    uint8_t collects;               // Collects done in the current cycle
+    bool pending;                   // Waiting to be collected
+    esp_err_t result;               // Result of the last cycle
+    sensor_reading_t reading;       // Reading of the last cycle (if result is ESP_OK)
+} sensor_slot_t;
+
+typedef struct {
+    sensor_slot_t slots[SENSOR_SCHED_MAX_SENSORS];
+    size_t num_sensors;
+} sensor_sched_t;
+
+/* Adds a sensor (driver and its instance data) to the scheduler */
+esp_err_t sensor_sched_add (sensor_sched_t *sched, const sensor_driver_t *driver, void *ctx);
+
+/* Initializes every sensor, returns the first error (if any) */
+esp_err_t sensor_sched_init (sensor_sched_t *sched);
+
+/* Triggers every sensor */
+void sensor_sched_start_cycle (sensor_sched_t *sched, int64_t now_us);
+
+/**
+ * @brief   Collects every sensor whose conversion has been completed
+ *
+ * @return
+ *  - The time (usecs) when the next sensor will be ready
+ *  - SENSOR_SCHED_DONE if the cycle has been completed
+ */
+int64_t sensor_sched_poll (sensor_sched_t *sched, int64_t now_us);
+
+#endif
@@ -1,112 +1,334 @@
 #include "sensor_sgp30.h"
 
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
+#include <stdio.h>
 
 #include "esp_log.h"
-
-#include "driver/i2c.h"
-#include "hal/i2c_types.h"
+#include "nvs.h"
 
 #include "globals.h"
+#include "hal/hal.h"
+#include "sensirion_common.h"
 
 
-/* Parameters for the I2C interface */
-#define I2C_SLAVE_ADDR              0x58
+/* SGP30 sensor commands */
+#define INIT_AIR_QUALITY            0x2003  // init command
+#define MEASURE_AIR_QUALITY         0x2008  // measurement command
+#define GET_BASELINE                0x2015  // baseline readout command
+#define SET_BASELINE                0x201e  // baseline restore command
 
-#define I2C_MASTER_NUM              I2C_NUM_0
-#define I2C_MASTER_TX_BUF_DISABLE   0                    
-#define I2C_MASTER_RX_BUF_DISABLE   0
-#define I2C_MASTER_READ             1
-#define I2C_MASTER_WRITE            0
+/* Max duration of each command (datasheet) */
+#define SGP30_INIT_DURATION_US      10000
+#define SGP30_MEASURE_DURATION_US   12000
+#define SGP30_BASELINE_DURATION_US  10000
 
-#define I2C_ACK_EN                  1  // ack request to slave 
-#define I2C_ACK                     0  // ack for each byte read 
-#define I2C_NACK                    1  // nack for the last byte
+/* Measurement response: CO2eq and TVOC words, each one followed by its CRC */
+#define SGP30_MEASURE_WORDS         2
+#define SGP30_MEASURE_LEN           (SGP30_MEASURE_WORDS * SENSIRION_FRAME_SIZE)
 
+/* Baseline response: CO2eq and TVOC baselines, each one followed by its CRC */
+#define SGP30_BASELINE_WORDS        2
+#define SGP30_BASELINE_LEN          (SGP30_BASELINE_WORDS * SENSIRION_FRAME_SIZE)
 
-/* SGP30 sensor commands */
-static uint8_t INIT_AIR_QUALITY[2] = { 0x20, 0x03 };    // init command
-static uint8_t MEASURE_AIR_QUALITY[2] = { 0x20, 0x08 }; // measurement command
+/* Number of new measurements started when a corrupted frame is received */
+#define SGP30_MAX_RETRIES           2
 
+/* Period of the baseline readout done while sampling */
+#define SGP30_BASELINE_PERIOD_US    ((int64_t)CONFIG_SGP30_BASELINE_READ_PERIOD_MIN * 60 * 1000000)
 
-/* Master sends a 2-bytes command to slave */
-static void sgp30_i2c_command (i2c_cmd_handle_t* cmd, uint8_t* command) {
-    /* Master (ESP micro) sends the address and operation mode to slave (SGP30) */
-    i2c_master_start(*cmd);
-    i2c_master_write_byte(*cmd, I2C_SLAVE_ADDR << 1 | I2C_MASTER_WRITE, I2C_ACK_EN);
+/* NVS location of the stored baseline */
+#define SGP30_NVS_NAMESPACE         "sgp30"
+#define SGP30_NVS_KEY_BASELINE      "baseline"
 
-    /* Then, sends the command */
-    i2c_master_write_byte(*cmd, command[0], I2C_ACK_EN);
-    i2c_master_write_byte(*cmd, command[1], I2C_ACK_EN);
+/* Times used by the baseline write policy */
+#define SGP30_BASELINE_WARMUP_S     (12 * 3600)     // Learning period from scratch (datasheet)
+#define SGP30_BASELINE_REFRESH_S    (24 * 3600)     // Keeps the stored timestamp fresh
+#define SGP30_BASELINE_MAX_AGE_S    (CONFIG_SGP30_BASELINE_MAX_AGE_DAYS * 24 * 3600)
 
-    /* Finally, ends the operation */
-    i2c_master_stop(*cmd);
-}
 
-esp_err_t sgp30_config (void) {
+static const sgp30_baseline_policy_t sgp30_baseline_policy = {
+    .warmup_s = SGP30_BASELINE_WARMUP_S,
+    .min_interval_s = CONFIG_SGP30_BASELINE_WRITE_INTERVAL_MIN * 60,
+    .refresh_s = SGP30_BASELINE_REFRESH_S,
+    .min_delta = CONFIG_SGP30_BASELINE_WRITE_MIN_DELTA,
+};
 
-    int i2c_master_port = I2C_MASTER_NUM;
-    i2c_config_t conf = {
-        .mode = I2C_MODE_MASTER, // ESP micro is master
-        .sda_io_num = CONFIG_I2C_MASTER_SDA_IO,
-        .sda_pullup_en = GPIO_PULLUP_ENABLE,
-        .scl_io_num = CONFIG_I2C_MASTER_SCL_IO,
-        .scl_pullup_en = GPIO_PULLUP_ENABLE,
-        .master.clk_speed = CONFIG_I2C_MASTER_FREQ_HZ,
-    };
 
-    if(i2c_param_config(i2c_master_port, &conf) != ESP_OK) {
-        ESP_LOGE(TAG_SGP30, "Error SGP30 sensor: i2c_param_config()");
+/* Starts a command whose response will be ready after "duration_us" */
+static esp_err_t sgp30_command_start (sgp30_t *sgp30, uint16_t command, sgp30_state_t state, int64_t duration_us) {
+    if (sensor_dev_command(&sgp30->dev, command, NULL, 0) != ESP_OK) {
+        ESP_LOGW(TAG_SGP30, "[%d] Command 0x%04x not acknowledged", sgp30->index, command);
         return ESP_FAIL;
     }
 
-    if(i2c_driver_install(i2c_master_port, conf.mode, I2C_MASTER_RX_BUF_DISABLE, I2C_MASTER_TX_BUF_DISABLE, 0) != ESP_OK) {
-        ESP_LOGE(TAG_SGP30, "Error SGP30 sensor: i2c_driver_install()");
+    sgp30->command_start_us = hal_time_us();
+    sgp30->command_duration_us = duration_us;
+    sgp30->state = state;
+
+    return ESP_OK;
+}
+
+/* NVS key of the baseline of an instance (the first one keeps the original key) */
+static void sgp30_nvs_key (sgp30_t *sgp30, char *key, size_t len) {
+    if (sgp30->index == 0) snprintf(key, len, "%s", SGP30_NVS_KEY_BASELINE);
+    else snprintf(key, len, "%s%d", SGP30_NVS_KEY_BASELINE, sgp30->index);
+}
+
+/* Loads the stored baseline, it is sent to the sensor once its age can be checked */
+static void sgp30_baseline_load (sgp30_t *sgp30) {
+    nvs_handle_t nvs;
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint8_t blob[SGP30_BASELINE_BLOB_LEN];
+    size_t len = sizeof(blob);
+
+    sgp30->restore_pending = false;
+
+    if (nvs_open(SGP30_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        ESP_LOGI(TAG_SGP30, "[%d] No baseline stored, learning it from scratch", sgp30->index);
+        return;
+    }
+    sgp30_nvs_key(sgp30, key, sizeof(key));
+    esp_err_t err = nvs_get_blob(nvs, key, blob, &len);
+    nvs_close(nvs);
+
+    if (err != ESP_OK || !sgp30_baseline_decode(blob, len, &sgp30->stored_baseline)) {
+        ESP_LOGI(TAG_SGP30, "[%d] No valid baseline stored, learning it from scratch", sgp30->index);
+        return;
+    }
+
+    sgp30->restore_pending = true;
+}
+
+/**
+ *  Sends the loaded baseline to the sensor if it is still fresh. The time is
+ *  usually set by SNTP after the sensors are initialized, so this is done by the
+ *  first collect with a valid clock. Until then, the sensor keeps learning
+ */
+static void sgp30_baseline_restore (sgp30_t *sgp30) {
+    uint32_t now_s = hal_epoch_s();
+    if (now_s == 0) return;
+
+    sgp30->restore_pending = false;
+
+    const sgp30_baseline_t *baseline = &sgp30->stored_baseline;
+    if (!sgp30_baseline_is_fresh(baseline, now_s, SGP30_BASELINE_MAX_AGE_S)) {
+        ESP_LOGI(TAG_SGP30, "[%d] Stored baseline is too old, learning it from scratch", sgp30->index);
+        return;
+    }
+
+    /* The sensor expects the values in reverse order: TVOC first */
+    uint8_t args[SGP30_BASELINE_LEN];
+    sensirion_pack_word(baseline->tvoc, args);
+    sensirion_pack_word(baseline->co2_eq, args + SENSIRION_FRAME_SIZE);
+
+    if (sensor_dev_command(&sgp30->dev, SET_BASELINE, args, sizeof(args)) != ESP_OK) {
+        ESP_LOGW(TAG_SGP30, "[%d] Baseline could not be restored", sgp30->index);
+        return;
+    }
+    hal_delay_us(SGP30_BASELINE_DURATION_US);
+
+    sgp30_baseline_mark_restored(&sgp30->baseline_state, baseline);
+    ESP_LOGI(TAG_SGP30, "[%d] Baseline restored (CO2eq 0x%04x, TVOC 0x%04x)", 
+                                sgp30->index, baseline->co2_eq, baseline->tvoc);
+}
+
+esp_err_t sgp30_init (sgp30_t *sgp30) {
+    sgp30->state = SGP30_STATE_IDLE;
+    sgp30->retries = 0;
+    sgp30->next_baseline_us = hal_time_us() + SGP30_BASELINE_PERIOD_US;
+
+    /* Send the init command */
+    esp_err_t err = sensor_dev_command(&sgp30->dev, INIT_AIR_QUALITY, NULL, 0);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_SGP30, "[%d] Error SGP30 sensor: init command not acknowledged", sgp30->index);
+        return err;
+    }
+
+    hal_delay_us(SGP30_INIT_DURATION_US);
+
+    /* Warm start: skips the baseline learning period if a recent one was stored */
+    sgp30_baseline_load(sgp30);
+    sgp30_baseline_restore(sgp30);
+
+    return ESP_OK;
+}
+
+esp_err_t sgp30_measure_start (sgp30_t *sgp30) {
+    if (sgp30->state == SGP30_STATE_MEASURING) return ESP_OK;
+    if (sgp30->state != SGP30_STATE_IDLE) return ESP_ERR_INVALID_STATE;
+
+    return sgp30_command_start(sgp30, MEASURE_AIR_QUALITY, SGP30_STATE_MEASURING, SGP30_MEASURE_DURATION_US);
+}
+
+bool sgp30_ready (sgp30_t *sgp30) {
+    return sgp30->state != SGP30_STATE_IDLE
+        && hal_time_us() - sgp30->command_start_us >= sgp30->command_duration_us;
+}
+
+uint32_t sgp30_wait_ms (sgp30_t *sgp30) {
+    if (sgp30->state == SGP30_STATE_IDLE) return 0;
+
+    int64_t left_us = sgp30->command_duration_us - (hal_time_us() - sgp30->command_start_us);
+    return left_us > 0 ? (uint32_t)((left_us + 999) / 1000) : 0;
+}
+
+esp_err_t sgp30_measure_fetch (sgp30_t *sgp30, sgp30_reading_t *reading) {
+    uint8_t frame[SGP30_MEASURE_LEN];
+    uint16_t words[SGP30_MEASURE_WORDS];
+
+    if (sgp30->state != SGP30_STATE_MEASURING) return ESP_ERR_INVALID_STATE;
+    if (!sgp30_ready(sgp30)) return ESP_ERR_NOT_FINISHED;
+
+    sgp30->state = SGP30_STATE_IDLE;
+
+    if (sensor_dev_read(&sgp30->dev, frame, sizeof(frame)) != ESP_OK) {
+        ESP_LOGW(TAG_SGP30, "[%d] Measurement could not be read", sgp30->index);
+        sgp30->retries = 0;
         return ESP_FAIL;
     }
 
+    if (!sensirion_unpack_words(frame, SGP30_MEASURE_WORDS, words)) {
+        if (sgp30->retries < SGP30_MAX_RETRIES && sgp30_measure_start(sgp30) == ESP_OK) {
+            sgp30->retries++;
+            return ESP_ERR_NOT_FINISHED;
+        }
+
+        ESP_LOGW(TAG_SGP30, "[%d] Corrupted measurement (CRC mismatch)", sgp30->index);
+        sgp30->retries = 0;
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    sgp30->retries = 0;
+    reading->co2_eq_ppm = words[0];
+    reading->tvoc_ppb = words[1];
+
     return ESP_OK;
+}
+
+esp_err_t sgp30_baseline_start (sgp30_t *sgp30) {
+    if (sgp30->state != SGP30_STATE_IDLE) return ESP_ERR_INVALID_STATE;
 
+    return sgp30_command_start(sgp30, GET_BASELINE, SGP30_STATE_READING_BASELINE, SGP30_BASELINE_DURATION_US);
 }
 
-esp_err_t sgp30_init (void) {
-    /* Send the init command */
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    sgp30_i2c_command(&cmd, INIT_AIR_QUALITY);
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_cmd_begin(I2C_MASTER_NUM, cmd, 1000 / portTICK_RATE_MS));
-    i2c_cmd_link_delete(cmd);
+esp_err_t sgp30_baseline_fetch (sgp30_t *sgp30, uint16_t *co2_eq, uint16_t *tvoc) {
+    uint8_t frame[SGP30_BASELINE_LEN];
+    uint16_t words[SGP30_BASELINE_WORDS];
+
+    if (sgp30->state != SGP30_STATE_READING_BASELINE) return ESP_ERR_INVALID_STATE;
+    if (!sgp30_ready(sgp30)) return ESP_ERR_NOT_FINISHED;
+
+    sgp30->state = SGP30_STATE_IDLE;
 
-    vTaskDelay(pdMS_TO_TICKS(5));
+    if (sensor_dev_read(&sgp30->dev, frame, sizeof(frame)) != ESP_OK) return ESP_FAIL;
+    if (!sensirion_unpack_words(frame, SGP30_BASELINE_WORDS, words)) return ESP_ERR_INVALID_CRC;
+
+    *co2_eq = words[0];
+    *tvoc = words[1];
 
     return ESP_OK;
 }
 
-uint16_t sgp30_co2_reading (void) {
+esp_err_t sgp30_baseline_store (sgp30_t *sgp30, uint16_t co2_eq, uint16_t tvoc) {
+    uint32_t uptime_s = (uint32_t)(hal_time_us() / 1000000);
+    sgp30_baseline_t baseline = {
+        .co2_eq = co2_eq,
+        .tvoc = tvoc,
+        .timestamp = hal_epoch_s(),
+    };
 
-    uint8_t co2_ppm_h, co2_ppm_l, crc;
+    /* Without the time, the baseline could not be checked when restored: it waits for the next readout */
+    if (!sgp30_baseline_should_store(&sgp30_baseline_policy, &sgp30->baseline_state, &baseline, uptime_s)) {
+        return ESP_OK;
+    }
 
-    i2c_cmd_handle_t cmd;
-    
-    /* Send measurement command */
-    cmd = i2c_cmd_link_create();
-    sgp30_i2c_command(&cmd, MEASURE_AIR_QUALITY);
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_cmd_begin(I2C_MASTER_NUM, cmd, 1000 / portTICK_RATE_MS));
-    i2c_cmd_link_delete(cmd);
+    uint8_t blob[SGP30_BASELINE_BLOB_LEN];
+    sgp30_baseline_encode(&baseline, blob);
 
-    vTaskDelay(pdMS_TO_TICKS(20));
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(SGP30_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_SGP30, "Error SGP30 sensor: nvs_open() %s", esp_err_to_name(err));
+        return err;
+    }
+
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    sgp30_nvs_key(sgp30, key, sizeof(key));
+    err = nvs_set_blob(nvs, key, blob, sizeof(blob));
+    if (err == ESP_OK) err = nvs_commit(nvs);
+    nvs_close(nvs);
 
-    /* Receive the CO2 result split into two bytes */
-    cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, I2C_SLAVE_ADDR << 1 | I2C_MASTER_READ, I2C_ACK_EN);
-    i2c_master_read_byte(cmd, &co2_ppm_h, I2C_ACK); // CO2 MSB
-    i2c_master_read_byte(cmd, &co2_ppm_l, I2C_ACK); // CO2 LSB
-    i2c_master_read_byte(cmd, &crc, I2C_NACK);
-    i2c_master_stop(cmd);
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_cmd_begin(I2C_MASTER_NUM, cmd, 1000 / portTICK_RATE_MS));
-    i2c_cmd_link_delete(cmd);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_SGP30, "Error SGP30 sensor: baseline not stored %s", esp_err_to_name(err));
+        return err;
+    }
 
-    return co2_ppm_h << 8 | co2_ppm_l;
-    
+    sgp30_baseline_mark_stored(&sgp30->baseline_state, &baseline, uptime_s);
+    ESP_LOGI(TAG_SGP30, "[%d] Baseline stored (CO2eq 0x%04x, TVOC 0x%04x)", sgp30->index, co2_eq, tvoc);
+
+    return ESP_OK;
 }
+
+
+/* ------------------ DRIVER INTERFACE ----------------- */
+static esp_err_t sgp30_driver_init (void *ctx) {
+    return sgp30_init((sgp30_t *)ctx);
+}
+
+static esp_err_t sgp30_driver_trigger (void *ctx) {
+    return sgp30_measure_start((sgp30_t *)ctx);
+}
+
+static void sgp30_fill_reading (const sgp30_reading_t *sgp30_reading, sensor_reading_t *reading) {
+    reading->fields = SENSOR_FIELD_CO2 | SENSOR_FIELD_TVOC;
+    reading->co2_ppm = sgp30_reading->co2_eq_ppm;
+    reading->tvoc_ppb = sgp30_reading->tvoc_ppb;
+}
+
+/**
+ *  Collects the measurement. When the baseline readout is due, it is started right
+ *  after the measurement and the reading is returned once the baseline is stored
+ */
+static esp_err_t sgp30_driver_collect (void *ctx, sensor_reading_t *reading) {
+    sgp30_t *sgp30 = (sgp30_t *)ctx;
+    sgp30_reading_t sgp30_reading;
+
+    if (sgp30->state == SGP30_STATE_READING_BASELINE) {
+        uint16_t baseline_co2, baseline_tvoc;
+        esp_err_t err = sgp30_baseline_fetch(sgp30, &baseline_co2, &baseline_tvoc);
+
+        if (err == ESP_ERR_NOT_FINISHED) return err;
+        if (err == ESP_OK) sgp30_baseline_store(sgp30, baseline_co2, baseline_tvoc);
+
+        sgp30_fill_reading(&sgp30->pending_reading, reading);
+        return ESP_OK;
+    }
+
+    esp_err_t err = sgp30_measure_fetch(sgp30, &sgp30_reading);
+    if (err != ESP_OK) return err;
+
+    /* Idle now, the stored baseline can be sent if it was waiting for the time */
+    if (sgp30->restore_pending) sgp30_baseline_restore(sgp30);
+
+    /* Periodic baseline readout, stored in NVS for a warm start after reboot */
+    if (hal_time_us() >= sgp30->next_baseline_us) {
+        sgp30->next_baseline_us += SGP30_BASELINE_PERIOD_US;
+
+        if (sgp30_baseline_start(sgp30) == ESP_OK) {
+            sgp30->pending_reading = sgp30_reading;
+            return ESP_ERR_NOT_FINISHED;
+        }
+    }
+
+    sgp30_fill_reading(&sgp30_reading, reading);
+    return ESP_OK;
+}
+
+const sensor_driver_t sgp30_driver = {
+    .name = "SGP30",
+    .init = sgp30_driver_init,
+    .trigger = sgp30_driver_trigger,
+    .collect = sgp30_driver_collect,
+    .conversion_us = SGP30_MEASURE_DURATION_US,
+    /* The on-chip baseline compensation expects a measurement every second */
+    .max_period_ms = CONFIG_SGP30_MAX_MEASURE_PERIOD_SEC * 1000,
+};
@@ -1,16 +1,96 @@
 #ifndef SENSOR_SGP30_H_ 
 #define SENSOR_SGP30_H_
 
+#include <stdbool.h>
 #include "esp_err.h"
 #include "stdint.h"
 
-/* Configures the SGP30 sensor */
-esp_err_t  sgp30_config (void);
+#include "sensor_bus.h"
+#include "sensor_driver.h"
+#include "sgp30_baseline.h"
 
-/* Initializes the SGP30 sensor */
-esp_err_t sgp30_init(void);
+/* Default I2C address of the SGP30 sensor */
+#define SGP30_I2C_ADDR  0x58
 
-/* Returns a CO2 reading */
-uint16_t sgp30_co2_reading(void);
+/* Air quality values measured by the SGP30 sensor */
+typedef struct {
+    uint16_t co2_eq_ppm;    // CO2 equivalent (ppm)
+    uint16_t tvoc_ppb;      // Total volatile organic compounds (ppb)
+} sgp30_reading_t;
 
-#endif
\ No newline at end of file
+/* States of the command state machine */
+typedef enum {
+    SGP30_STATE_IDLE,
+    SGP30_STATE_MEASURING,
+    SGP30_STATE_READING_BASELINE,
+} sgp30_state_t;
+
+/* SGP30 instance, the fields after "index" are private to the driver */
+typedef struct {
+    sensor_dev_t dev;
+    uint8_t index;                          // Identifies its stored baseline
+
+    sgp30_state_t state;
+    int64_t command_start_us;
+    int64_t command_duration_us;
+    uint8_t retries;
+    int64_t next_baseline_us;
+    sgp30_reading_t pending_reading;        // Held while the baseline is read
+    sgp30_baseline_state_t baseline_state;
+    bool restore_pending;                   // Stored baseline waiting for the time to be set
+    sgp30_baseline_t stored_baseline;
+} sgp30_t;
+
+/* Sensor driver interface, its context is a "sgp30_t" */
+extern const sensor_driver_t sgp30_driver;
+
+/* Initializes the SGP30 sensor and restores its stored baseline (once the time is set) */
+esp_err_t sgp30_init(sgp30_t *sgp30);
+
+/**
+ *  Asynchronous command API
+ *  A command (measurement or baseline readout) is started, it is polled until
+ *  completed and then fetched. None of these calls waits for the sensor, so they
+ *  must only be used from the sampling task
+ */
+
+/* Starts an air quality measurement (no-op if one is already running) */
+esp_err_t sgp30_measure_start (sgp30_t *sgp30);
+
+/* Checks if the command in progress has been completed */
+bool sgp30_ready (sgp30_t *sgp30);
+
+/* Returns the msecs left until the command in progress is completed */
+uint32_t sgp30_wait_ms (sgp30_t *sgp30);
+
+/**
+ * @brief   Fetches the result of the measurement in progress
+ *
+ * @note    The full frame (CO2 and TVOC with their CRC) is read in a single
+ *          I2C transaction. Corrupted frames are retried by starting a new
+ *          measurement, so the caller has to poll again
+ *
+ * @param[out] reading  Measured values
+ *
+ * @return
+ *  - ESP_OK                : New reading available
+ *  - ESP_ERR_NOT_FINISHED  : Measurement (or retry) still in progress
+ *  - ESP_ERR_INVALID_STATE : No measurement was started
+ *  - ESP_ERR_INVALID_CRC   : Every retry was corrupted
+ *  - ESP_FAIL              : I2C error
+ */
+esp_err_t sgp30_measure_fetch (sgp30_t *sgp30, sgp30_reading_t *reading);
+
+/* Starts a readout of the IAQ baseline */
+esp_err_t sgp30_baseline_start (sgp30_t *sgp30);
+
+/* Fetches the IAQ baseline once the readout has been completed */
+esp_err_t sgp30_baseline_fetch (sgp30_t *sgp30, uint16_t *co2_eq, uint16_t *tvoc);
+
+/**
+ *  Stores the IAQ baseline in NVS so it is restored after a reboot or a deep sleep.
+ *  Writes are throttled to limit the flash wear, and skipped while the time is not set
+ */
+esp_err_t sgp30_baseline_store (sgp30_t *sgp30, uint16_t co2_eq, uint16_t tvoc);
+
+#endif
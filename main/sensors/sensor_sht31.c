@@ -0,0 +1,66 @@
+#include "sensor_sht31.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+
+#include "globals.h"
+#include "sensirion_common.h"
+
+
+/* SHT31 sensor commands */
+#define SOFT_RESET                  0x30A2
+#define SINGLE_SHOT_HIGH_REP        0x2400  // high repeatability, no clock stretching
+
+/* Max duration of each command (datasheet) */
+#define SHT31_RESET_DURATION_MS     2
+#define SHT31_MEASURE_DURATION_US   15500
+
+/* Measurement response: temperature and humidity words, each one followed by its CRC */
+#define SHT31_MEASURE_WORDS         2
+#define SHT31_MEASURE_LEN           (SHT31_MEASURE_WORDS * SENSIRION_FRAME_SIZE)
+
+
+static esp_err_t sht31_driver_init (void *ctx) {
+    sht31_t *sht31 = (sht31_t *)ctx;
+
+    esp_err_t err = sensor_dev_command(&sht31->dev, SOFT_RESET, NULL, 0);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_SENSORS, "Error SHT31 sensor: reset command not acknowledged");
+        return err;
+    }
+    vTaskDelay(pdMS_TO_TICKS(SHT31_RESET_DURATION_MS) + 1);
+
+    return ESP_OK;
+}
+
+static esp_err_t sht31_driver_trigger (void *ctx) {
+    sht31_t *sht31 = (sht31_t *)ctx;
+
+    return sensor_dev_command(&sht31->dev, SINGLE_SHOT_HIGH_REP, NULL, 0);
+}
+
+static esp_err_t sht31_driver_collect (void *ctx, sensor_reading_t *reading) {
+    sht31_t *sht31 = (sht31_t *)ctx;
+    uint8_t frame[SHT31_MEASURE_LEN];
+    uint16_t words[SHT31_MEASURE_WORDS];
+
+    if (sensor_dev_read(&sht31->dev, frame, sizeof(frame)) != ESP_OK) return ESP_FAIL;
+    if (!sensirion_unpack_words(frame, SHT31_MEASURE_WORDS, words)) return ESP_ERR_INVALID_CRC;
+
+    /* T = -45 + 175 * raw / (2^16 - 1) and RH = 100 * raw / (2^16 - 1) */
+    reading->fields = SENSOR_FIELD_TEMP | SENSOR_FIELD_RH;
+    reading->temp_cdeg = (int16_t)(-4500 + (int32_t)(17500 * (uint32_t)words[0] / 65535));
+    reading->rh_cpct = (uint16_t)(10000 * (uint32_t)words[1] / 65535);
+
+    return ESP_OK;
+}
+
+const sensor_driver_t sht31_driver = {
+    .name = "SHT31",
+    .init = sht31_driver_init,
+    .trigger = sht31_driver_trigger,
+    .collect = sht31_driver_collect,
+    .conversion_us = SHT31_MEASURE_DURATION_US,
+};
@@ -0,0 +1,18 @@
+#ifndef SENSOR_SHT31_H_ 
+#define SENSOR_SHT31_H_
+
+#include "sensor_bus.h"
+#include "sensor_driver.h"
+
+/* Default I2C address of the SHT31 sensor (ADDR pin low) */
+#define SHT31_I2C_ADDR  0x44
+
+/* SHT31 temperature and humidity sensor instance */
+typedef struct {
+    sensor_dev_t dev;
+} sht31_t;
+
+/* Sensor driver interface, its context is a "sht31_t" */
+extern const sensor_driver_t sht31_driver;
+
+#endif
@@ -0,0 +1,49 @@
+#include "sensor_stub.h"
+
+
+/* Shape of the trace: the room fills up and empties every period */
+#define STUB_CO2_BASE_PPM       420
+#define STUB_CO2_RISE_PPM       600
+#define STUB_PERIOD_STEPS       1200
+#define STUB_NOISE_PPM          8
+
+/* Same conversion time as the SGP30, so the scheduling is the real one */
+#define STUB_MEASURE_DURATION_US    12000
+
+
+static esp_err_t sensor_stub_init (void *ctx) {
+    sensor_stub_t *stub = (sensor_stub_t *)ctx;
+
+    stub->step = 0;
+    stub->noise = 1;
+
+    return ESP_OK;
+}
+
+static esp_err_t sensor_stub_trigger (void *ctx) {
+    return ESP_OK;
+}
+
+static esp_err_t sensor_stub_collect (void *ctx, sensor_reading_t *reading) {
+    sensor_stub_t *stub = (sensor_stub_t *)ctx;
+    uint32_t phase = stub->step++ % STUB_PERIOD_STEPS;
+    uint32_t half = STUB_PERIOD_STEPS / 2;
+
+    /* Triangle wave plus the low bits of a LCG */
+    uint32_t rise = phase < half ? phase : STUB_PERIOD_STEPS - phase;
+    stub->noise = stub->noise * 1103515245 + 12345;
+
+    reading->fields = SENSOR_FIELD_CO2 | SENSOR_FIELD_TVOC;
+    reading->co2_ppm = STUB_CO2_BASE_PPM + STUB_CO2_RISE_PPM * rise / half + (stub->noise >> 16) % STUB_NOISE_PPM;
+    reading->tvoc_ppb = reading->co2_ppm / 10;
+
+    return ESP_OK;
+}
+
+const sensor_driver_t sensor_stub_driver = {
+    .name = "STUB",
+    .init = sensor_stub_init,
+    .trigger = sensor_stub_trigger,
+    .collect = sensor_stub_collect,
+    .conversion_us = STUB_MEASURE_DURATION_US,
+};
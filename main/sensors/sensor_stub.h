@@ -0,0 +1,20 @@
+#ifndef SENSOR_STUB_H_ 
+#define SENSOR_STUB_H_
+
+#include <stdint.h>
+#include "sensor_driver.h"
+
+/**
+ *  Synthetic CO2 sensor for boards without sensors and emulators
+ *  It replays a deterministic trace (an occupancy ramp plus noise), so runs
+ *  with the same firmware can be compared
+ */
+typedef struct {
+    uint32_t step;      // Readings produced so far
+    uint32_t noise;     // State of the noise generator
+} sensor_stub_t;
+
+/* Sensor driver interface, its context is a "sensor_stub_t" */
+extern const sensor_driver_t sensor_stub_driver;
+
+#endif
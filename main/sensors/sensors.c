@@ -0,0 +1,148 @@
+#include "sensors.h"
+
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_log.h"
+
+#include "globals.h"
+#include "hal/hal.h"
+#include "sensor_bus_esp.h"
+#include "sensor_sched.h"
+#include "sensor_sgp30.h"
+#include "sensor_sht31.h"
+#include "sensor_scd30.h"
+#include "sensor_stub.h"
+
+
+#define I2C_MASTER_NUM  I2C_NUM_0
+
+#ifdef CONFIG_I2C_MUX_ENABLE
+#define I2C_MUX_ADDR            CONFIG_I2C_MUX_ADDR
+#define SGP30_MUX_CHANNEL       CONFIG_SGP30_MUX_CHANNEL
+#else
+#define I2C_MUX_ADDR            0
+#define SGP30_MUX_CHANNEL       SENSOR_BUS_NO_MUX
+#endif
+
+
+static sensor_sched_t sensors_sched;
+
+/* Sensor instances */
+#ifdef CONFIG_SENSORS_STUB
+static sensor_stub_t sensor_stub;
+#else
+static sensor_bus_t sensors_bus;
+
+static sgp30_t sgp30_primary = {
+    .dev = { .bus = &sensors_bus, .addr = SGP30_I2C_ADDR, .mux_channel = SGP30_MUX_CHANNEL },
+    .index = 0,
+};
+#ifdef CONFIG_SGP30_SECOND_ENABLE
+static sgp30_t sgp30_second = {
+    .dev = { .bus = &sensors_bus, .addr = SGP30_I2C_ADDR, .mux_channel = CONFIG_SGP30_SECOND_MUX_CHANNEL },
+    .index = 1,
+};
+#endif
+#ifdef CONFIG_SCD30_ENABLE
+static scd30_t scd30 = {
+    .dev = { .bus = &sensors_bus, .addr = SCD30_I2C_ADDR, .mux_channel = SENSOR_BUS_NO_MUX },
+};
+#endif
+#ifdef CONFIG_SHT31_ENABLE
+static sht31_t sht31 = {
+    .dev = { .bus = &sensors_bus, .addr = CONFIG_SHT31_I2C_ADDR, .mux_channel = SENSOR_BUS_NO_MUX },
+};
+#endif
+#endif
+
+/* Last valid reading of each sensor, shared with other tasks (e.g. HTTP server) */
+static portMUX_TYPE sensors_last_mux = portMUX_INITIALIZER_UNLOCKED;
+static sensor_reading_t sensors_last_reading[SENSOR_SCHED_MAX_SENSORS];
+static bool sensors_last_valid[SENSOR_SCHED_MAX_SENSORS];
+
+
+esp_err_t sensors_init (void) {
+#ifdef CONFIG_SENSORS_STUB
+    /* No I2C bus, the primary sensor replays a synthetic trace */
+    sensor_sched_add(&sensors_sched, &sensor_stub_driver, &sensor_stub);
+#else
+    if (sensor_bus_esp_init(&sensors_bus, I2C_MASTER_NUM, I2C_MUX_ADDR) != ESP_OK) return ESP_FAIL;
+
+    /* The primary sensor must be the first one (SENSORS_PRIMARY) */
+    sensor_sched_add(&sensors_sched, &sgp30_driver, &sgp30_primary);
+#ifdef CONFIG_SGP30_SECOND_ENABLE
+    sensor_sched_add(&sensors_sched, &sgp30_driver, &sgp30_second);
+#endif
+#ifdef CONFIG_SCD30_ENABLE
+    sensor_sched_add(&sensors_sched, &scd30_driver, &scd30);
+#endif
+#ifdef CONFIG_SHT31_ENABLE
+    sensor_sched_add(&sensors_sched, &sht31_driver, &sht31);
+#endif
+#endif
+
+    esp_err_t err = sensor_sched_init(&sensors_sched);
+    if (err != ESP_OK) ESP_LOGW(TAG_SENSORS, "Some sensors could not be initialized");
+
+    ESP_LOGI(TAG_SENSORS, "%d sensors on the I2C bus", (int)sensors_sched.num_sensors);
+
+    return ESP_OK;
+}
+
+size_t sensors_count (void) {
+    return sensors_sched.num_sensors;
+}
+
+const char *sensors_name (size_t idx) {
+    return idx < sensors_sched.num_sensors ? sensors_sched.slots[idx].driver->name : NULL;
+}
+
+uint32_t sensors_max_period_ms (void) {
+    uint32_t max_period_ms = 0;
+
+    for (size_t i = 0; i < sensors_sched.num_sensors; i++) {
+        uint32_t period_ms = sensors_sched.slots[i].driver->max_period_ms;
+
+        if (period_ms && (max_period_ms == 0 || period_ms < max_period_ms)) max_period_ms = period_ms;
+    }
+
+    return max_period_ms;
+}
+
+esp_err_t sensors_sample (void) {
+    int64_t next_us;
+
+    sensor_sched_start_cycle(&sensors_sched, hal_time_us());
+
+    while ((next_us = sensor_sched_poll(&sensors_sched, hal_time_us())) != SENSOR_SCHED_DONE) {
+        hal_delay_us(next_us - hal_time_us());
+    }
+
+    portENTER_CRITICAL(&sensors_last_mux);
+    for (size_t i = 0; i < sensors_sched.num_sensors; i++) {
+        if (sensors_sched.slots[i].result == ESP_OK) {
+            sensors_last_reading[i] = sensors_sched.slots[i].reading;
+            sensors_last_valid[i] = true;
+        }
+    }
+    portEXIT_CRITICAL(&sensors_last_mux);
+
+    return sensors_sched.slots[SENSORS_PRIMARY].result;
+}
+
+esp_err_t sensors_get_last_reading (size_t idx, sensor_reading_t *reading) {
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+
+    if (idx >= SENSOR_SCHED_MAX_SENSORS) return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&sensors_last_mux);
+    if (sensors_last_valid[idx]) {
+        *reading = sensors_last_reading[idx];
+        err = ESP_OK;
+    }
+    portEXIT_CRITICAL(&sensors_last_mux);
+
+    return err;
+}
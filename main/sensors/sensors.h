@@ -0,0 +1,33 @@
+#ifndef SENSORS_H_ 
+#define SENSORS_H_
+
+#include <stddef.h>
+#include "esp_err.h"
+
+#include "sensor_driver.h"
+
+/* Index of the sensor whose CO2 is sent over MQTT (first SGP30) */
+#define SENSORS_PRIMARY     0
+
+/* Configures the I2C bus and initializes every sensor enabled in the config */
+esp_err_t sensors_init (void);
+
+/* Number of sensors handled */
+size_t sensors_count (void);
+
+/* Name of a sensor */
+const char *sensors_name (size_t idx);
+
+/* Max sampling period allowed by the cadence constraints of every sensor (0 if none) */
+uint32_t sensors_max_period_ms (void);
+
+/**
+ *  Runs a sampling cycle over every sensor
+ *  The calling task only sleeps while the conversions are in progress
+ */
+esp_err_t sensors_sample (void);
+
+/* Copies the last valid reading of a sensor without accessing the bus (thread-safe) */
+esp_err_t sensors_get_last_reading (size_t idx, sensor_reading_t *reading);
+
+#endif
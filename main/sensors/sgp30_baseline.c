@@ -0,0 +1,93 @@
+#include "sgp30_baseline.h"
+
+#include <string.h>
+
+#include "sensirion_common.h"
+
+
+/* Version of the blob layout: version | CO2eq | TVOC | timestamp | CRC */
+#define SGP30_BASELINE_BLOB_VERSION 1
+
+
+static void put_u16 (uint8_t *buf, uint16_t value) {
+    buf[0] = value >> 8;
+    buf[1] = value & 0xFF;
+}
+
+static void put_u32 (uint8_t *buf, uint32_t value) {
+    put_u16(buf, value >> 16);
+    put_u16(buf + 2, value & 0xFFFF);
+}
+
+static uint16_t get_u16 (const uint8_t *buf) {
+    return (uint16_t)buf[0] << 8 | buf[1];
+}
+
+static uint32_t get_u32 (const uint8_t *buf) {
+    return (uint32_t)get_u16(buf) << 16 | get_u16(buf + 2);
+}
+
+static uint16_t abs_diff (uint16_t a, uint16_t b) {
+    return a > b ? a - b : b - a;
+}
+
+void sgp30_baseline_encode (const sgp30_baseline_t *baseline, uint8_t *blob) {
+    blob[0] = SGP30_BASELINE_BLOB_VERSION;
+    put_u16(blob + 1, baseline->co2_eq);
+    put_u16(blob + 3, baseline->tvoc);
+    put_u32(blob + 5, baseline->timestamp);
+    blob[9] = sensirion_crc8(blob, SGP30_BASELINE_BLOB_LEN - 1);
+}
+
+bool sgp30_baseline_decode (const uint8_t *blob, size_t len, sgp30_baseline_t *baseline) {
+    if (len != SGP30_BASELINE_BLOB_LEN) return false;
+    if (blob[0] != SGP30_BASELINE_BLOB_VERSION) return false;
+    if (sensirion_crc8(blob, SGP30_BASELINE_BLOB_LEN - 1) != blob[9]) return false;
+
+    baseline->co2_eq = get_u16(blob + 1);
+    baseline->tvoc = get_u16(blob + 3);
+    baseline->timestamp = get_u32(blob + 5);
+
+    return true;
+}
+
+bool sgp30_baseline_is_fresh (const sgp30_baseline_t *baseline, uint32_t now_s, uint32_t max_age_s) {
+    if (now_s == 0 || baseline->timestamp == 0) return false;
+    if (baseline->timestamp > now_s) return false;
+
+    return now_s - baseline->timestamp <= max_age_s;
+}
+
+void sgp30_baseline_mark_restored (sgp30_baseline_state_t *state, const sgp30_baseline_t *baseline) {
+    state->restored = true;
+    state->last = *baseline;
+}
+
+bool sgp30_baseline_should_store (const sgp30_baseline_policy_t *policy, const sgp30_baseline_state_t *state,
+                                  const sgp30_baseline_t *candidate, uint32_t uptime_s) {
+    /* Its age could not be checked when it is restored */
+    if (candidate->timestamp == 0) return false;
+
+    /* Learnt from scratch: not valid until the warm-up has been completed */
+    if (!state->restored && uptime_s < policy->warmup_s) return false;
+
+    /* First baseline learnt from scratch */
+    if (!state->restored && !state->stored) return true;
+
+    uint32_t elapsed_s = uptime_s - state->last_write_s;
+    if (elapsed_s < policy->min_interval_s) return false;
+
+    if (abs_diff(candidate->co2_eq, state->last.co2_eq) >= policy->min_delta ||
+        abs_diff(candidate->tvoc, state->last.tvoc) >= policy->min_delta) {
+        return true;
+    }
+
+    /* Unchanged, but its timestamp has to be kept fresh */
+    return elapsed_s >= policy->refresh_s;
+}
+
+void sgp30_baseline_mark_stored (sgp30_baseline_state_t *state, const sgp30_baseline_t *baseline, uint32_t uptime_s) {
+    state->stored = true;
+    state->last_write_s = uptime_s;
+    state->last = *baseline;
+}
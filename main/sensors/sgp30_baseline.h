@@ -0,0 +1,75 @@
+#ifndef SGP30_BASELINE_H_ 
+#define SGP30_BASELINE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *  IAQ baseline of the SGP30 sensor
+ *  Restoring it after a reboot skips the baseline learning period of the sensor.
+ *  This module is independent of ESP-IDF, the NVS access is done by the driver
+ */
+
+/* Size of the encoded baseline stored in NVS */
+#define SGP30_BASELINE_BLOB_LEN     10
+
+/* Baseline values and the time they were read */
+typedef struct {
+    uint16_t co2_eq;        // CO2eq baseline (raw sensor units)
+    uint16_t tvoc;          // TVOC baseline (raw sensor units)
+    uint32_t timestamp;     // Epoch (secs) when it was read
+} sgp30_baseline_t;
+
+/* Write-throttling policy, used to limit the flash wear */
+typedef struct {
+    uint32_t warmup_s;          // Operation time needed to learn a baseline from scratch
+    uint32_t min_interval_s;    // Min time between two writes
+    uint32_t refresh_s;         // An unchanged baseline is written again after this time
+    uint16_t min_delta;         // Min change of any value to be worth a write
+} sgp30_baseline_policy_t;
+
+/* Write history of the current boot */
+typedef struct {
+    bool restored;              // The sensor was started from a stored baseline
+    bool stored;                // A baseline has been written during this boot
+    uint32_t last_write_s;      // Uptime (secs) of the last write
+    sgp30_baseline_t last;      // Last baseline written or restored
+} sgp30_baseline_state_t;
+
+/* Serializes a baseline (versioned and CRC-protected) */
+void sgp30_baseline_encode (const sgp30_baseline_t *baseline, uint8_t *blob);
+
+/**
+ * @brief   Deserializes a baseline
+ *
+ * @return
+ *  - true  if the blob has a supported version and a valid CRC
+ *  - false otherwise
+ */
+bool sgp30_baseline_decode (const uint8_t *blob, size_t len, sgp30_baseline_t *baseline);
+
+/**
+ * @brief   Checks if a stored baseline can still be restored
+ *
+ * @note    Sensirion considers a baseline invalid after a week without operation.
+ *          A baseline without timestamp is never trusted, and the age can only be
+ *          checked against a valid clock: until the time is set, the caller has to
+ *          keep the baseline and check it again later
+ *
+ * @param[in] now_s     Current epoch (secs), must not be 0 (time not set)
+ * @param[in] max_age_s Max time since the baseline was read
+ */
+bool sgp30_baseline_is_fresh (const sgp30_baseline_t *baseline, uint32_t now_s, uint32_t max_age_s);
+
+/* Records a restored baseline in the write history */
+void sgp30_baseline_mark_restored (sgp30_baseline_state_t *state, const sgp30_baseline_t *baseline);
+
+/* Decides if a new baseline has to be written according to the policy (never without timestamp) */
+bool sgp30_baseline_should_store (const sgp30_baseline_policy_t *policy, const sgp30_baseline_state_t *state,
+                                  const sgp30_baseline_t *candidate, uint32_t uptime_s);
+
+/* Records a written baseline in the write history */
+void sgp30_baseline_mark_stored (sgp30_baseline_state_t *state, const sgp30_baseline_t *baseline, uint32_t uptime_s);
+
+#endif
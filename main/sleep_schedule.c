@@ -0,0 +1,22 @@
+#include "sleep_schedule.h"
+
+
+uint64_t calculate_range_us (struct tm node_time, int limit_hr) {
+    int aux, hour = node_time.tm_hour, min = node_time.tm_min;
+    uint64_t result;
+
+    if (hour == limit_hr) {
+        result = 60 - min;
+        result = result * 60 * 1000000;
+        return result;
+    } 
+    else if (hour < limit_hr) aux = limit_hr;
+    else aux = limit_hr + 24;
+
+    result = (aux - hour - 1) * 60; // Full hours completed converted to mins
+    result = result + (60 - min);   // Mins left to reach "limit_hr"
+    result = result * 60 * 1000000; // Total mins converted to us
+
+    return result;
+
+}
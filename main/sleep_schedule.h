@@ -0,0 +1,19 @@
+#ifndef SLEEP_SCHEDULE_H_
+#define SLEEP_SCHEDULE_H_
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * @brief   Calculates the number of usecs between two times
+ *
+ * @param[in] node_time   A referece time represented as "struct tm"
+ *                        It is assigned the current time in this code
+ * @param[in] limit_hr    The time up to which the interval is calculated
+ *                        It is assigned an exact hour of the day
+ *
+ * @return  The number of usecs that have elapsed between these timestamps
+ */
+uint64_t calculate_range_us (struct tm node_time, int limit_hr);
+
+#endif
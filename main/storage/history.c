@@ -0,0 +1,49 @@
+#include "history.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "hal/hal.h"
+
+
+static ts_store_t history_store;
+static SemaphoreHandle_t history_mutex;
+
+
+esp_err_t history_init (void) {
+    history_mutex = xSemaphoreCreateMutex();
+    if (history_mutex == NULL) return ESP_ERR_NO_MEM;
+
+    ts_store_init(&history_store);
+
+    return ESP_OK;
+}
+
+static void history_add (uint8_t series, uint16_t value) {
+    uint32_t now = hal_epoch_s();
+
+    /* Without a valid clock the samples could not be queried by time */
+    if (now == 0 || history_mutex == NULL) return;
+
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    ts_store_add(&history_store, series, now, value);
+    xSemaphoreGive(history_mutex);
+}
+
+void history_add_co2 (uint16_t co2_ppm) {
+    history_add(TS_SERIES_CO2, co2_ppm);
+}
+
+void history_add_ble (uint8_t people) {
+    history_add(TS_SERIES_BLE, people);
+}
+
+size_t history_read (uint8_t series, ts_res_t res, ts_cursor_t *cursor, ts_bucket_t *out, size_t max) {
+    if (history_mutex == NULL) return 0;
+
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    size_t n = ts_store_read(&history_store, series, res, cursor, out, max);
+    xSemaphoreGive(history_mutex);
+
+    return n;
+}
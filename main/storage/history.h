@@ -0,0 +1,28 @@
+#ifndef HISTORY_H_ 
+#define HISTORY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "ts_store.h"
+
+/**
+ *  Recent history of the node
+ *  Time-series store in RAM shared by the sampling tasks (writers) and the
+ *  API REST (reader). Samples are only stored once the system time is set
+ */
+
+/* Initializes the store */
+esp_err_t history_init (void);
+
+/* Adds a CO2 reading taken now */
+void history_add_co2 (uint16_t co2_ppm);
+
+/* Adds a people estimation taken now */
+void history_add_ble (uint8_t people);
+
+/* Reads a series, see ts_store_read */
+size_t history_read (uint8_t series, ts_res_t res, ts_cursor_t *cursor, ts_bucket_t *out, size_t max);
+
+#endif
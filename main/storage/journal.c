@@ -0,0 +1,287 @@
+#include "journal.h"
+
+#include <string.h>
+
+
+#define JOURNAL_MAGIC           0x4A524E4C  // "JRNL"
+
+/* Record states, a pending record is consumed by clearing its state byte */
+#define JOURNAL_PENDING         0xFF
+#define JOURNAL_CONSUMED        0x00
+
+#define JOURNAL_ERASED_LEN      0xFFFF
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+} journal_sector_t;
+
+typedef struct {
+    uint16_t len;
+    uint16_t crc;               // CRC-16/CCITT of the message
+    uint8_t state;
+    uint8_t reserved[3];
+} journal_record_t;
+
+#define JOURNAL_DATA_START      sizeof(journal_sector_t)
+#define JOURNAL_RECORD_SIZE(len)    (sizeof(journal_record_t) + (((len) + 3) & ~3u))
+
+
+static uint16_t journal_crc16 (uint16_t crc, const uint8_t *data, size_t len) {
+    while (len--) {
+        crc ^= (uint16_t)*data++ << 8;
+        for (int i = 0; i < 8; i++) crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+/* Sequence numbers wrap, "a" is newer than "b" if it is ahead by less than half the range */
+static inline bool journal_seq_newer (uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) > 0;
+}
+
+static inline uint32_t journal_next_sector (const journal_t *journal, uint32_t sector) {
+    return (sector + JOURNAL_SECTOR_SIZE) % journal->size;
+}
+
+/* Sequence number of a sector, counting back from the one being written */
+static inline uint32_t journal_sector_seq (const journal_t *journal, uint32_t sector) {
+    return journal->write_seq - (journal->write_sector + journal->size - sector) % journal->size / JOURNAL_SECTOR_SIZE;
+}
+
+static bool journal_sector_valid (journal_t *journal, uint32_t sector, uint32_t *seq) {
+    journal_sector_t header;
+
+    if (journal->ops->read(journal->ctx, sector, &header, sizeof(header)) != ESP_OK) return false;
+    if (header.magic != JOURNAL_MAGIC) return false;
+
+    if (seq) *seq = header.seq;
+    return true;
+}
+
+/**
+ *  Reads the record at "addr" and checks it
+ *  Returns false at the end of the records of the sector (erased or torn record)
+ */
+static bool journal_record_read (journal_t *journal, uint32_t addr, journal_record_t *record) {
+    uint32_t sector_end = addr - addr % JOURNAL_SECTOR_SIZE + JOURNAL_SECTOR_SIZE;
+    uint8_t chunk[64];
+
+    /* No record starts at a sector boundary: it is the end of a full sector */
+    if (addr % JOURNAL_SECTOR_SIZE == 0) return false;
+    if (addr + sizeof(*record) > sector_end) return false;
+    if (journal->ops->read(journal->ctx, addr, record, sizeof(*record)) != ESP_OK) return false;
+    if (record->len == JOURNAL_ERASED_LEN || record->len > JOURNAL_MAX_RECORD) return false;
+    if (addr + JOURNAL_RECORD_SIZE(record->len) > sector_end) return false;
+
+    uint16_t crc = 0xFFFF;
+    for (uint32_t off = 0; off < record->len; off += sizeof(chunk)) {
+        size_t n = record->len - off < sizeof(chunk) ? record->len - off : sizeof(chunk);
+        if (journal->ops->read(journal->ctx, addr + sizeof(*record) + off, chunk, n) != ESP_OK) return false;
+        crc = journal_crc16(crc, chunk, n);
+    }
+
+    return crc == record->crc;
+}
+
+/**
+ *  First pending record from "addr" (included) up to the write position,
+ *  following the sectors in the order they were written
+ */
+static uint32_t journal_find_pending (journal_t *journal, uint32_t addr) {
+    uint32_t write_addr = journal->write_sector + journal->write_off;
+
+    /* The end of a record that fills the last sector is the start of the area */
+    addr %= journal->size;
+    uint32_t sector = addr - addr % JOURNAL_SECTOR_SIZE;
+    journal_record_t record;
+
+    for (uint32_t i = 0; i <= journal->size / JOURNAL_SECTOR_SIZE; i++) {
+        if (journal_sector_valid(journal, sector, NULL)) {
+            if (addr < sector + JOURNAL_DATA_START) addr = sector + JOURNAL_DATA_START;
+
+            while ((sector != journal->write_sector || addr < write_addr) && journal_record_read(journal, addr, &record)) {
+                if (record.state == JOURNAL_PENDING) return addr;
+                addr += JOURNAL_RECORD_SIZE(record.len);
+            }
+        }
+
+        if (sector == journal->write_sector) break;
+        sector = journal_next_sector(journal, sector);
+        addr = sector;
+    }
+
+    return JOURNAL_NO_ADDR;
+}
+
+/* Counts the pending records of a sector from "addr" */
+static uint32_t journal_count_pending (journal_t *journal, uint32_t sector, uint32_t addr, uint32_t *end) {
+    journal_record_t record;
+    uint32_t count = 0;
+
+    if (addr < sector + JOURNAL_DATA_START) addr = sector + JOURNAL_DATA_START;
+
+    while (journal_record_read(journal, addr, &record)) {
+        if (record.state == JOURNAL_PENDING) count++;
+        addr += JOURNAL_RECORD_SIZE(record.len);
+    }
+
+    if (end) *end = addr;
+    return count;
+}
+
+esp_err_t journal_mount (journal_t *journal, const journal_flash_ops_t *ops, void *ctx, uint32_t size) {
+    uint32_t seq;
+    bool found = false;
+
+    size -= size % JOURNAL_SECTOR_SIZE;
+    if (size < 2 * JOURNAL_SECTOR_SIZE) return ESP_ERR_INVALID_SIZE;
+
+    journal->ops = ops;
+    journal->ctx = ctx;
+    journal->size = size;
+    journal->read_addr = JOURNAL_NO_ADDR;
+    journal->pending = 0;
+    journal->dropped = 0;
+
+    /* An empty journal starts writing at the first sector */
+    journal->write_sector = size - JOURNAL_SECTOR_SIZE;
+    journal->write_off = JOURNAL_SECTOR_SIZE;
+    journal->write_seq = 0;
+
+    /* The newest sector is the one being written */
+    for (uint32_t sector = 0; sector < size; sector += JOURNAL_SECTOR_SIZE) {
+        if (!journal_sector_valid(journal, sector, &seq)) continue;
+
+        if (!found || journal_seq_newer(seq, journal->write_seq)) {
+            journal->write_sector = sector;
+            journal->write_seq = seq;
+        }
+        found = true;
+    }
+    if (!found) return ESP_OK;
+
+    /* Sectors after the newest one are the oldest, walk them in the order they were written */
+    uint32_t sector = journal_next_sector(journal, journal->write_sector);
+    for (uint32_t i = 0; i < size / JOURNAL_SECTOR_SIZE; i++) {
+        if (journal_sector_valid(journal, sector, NULL)) {
+            uint32_t end;
+            uint32_t count = journal_count_pending(journal, sector, sector, &end);
+
+            if (count && journal->read_addr == JOURNAL_NO_ADDR) {
+                journal->read_addr = journal_find_pending(journal, sector);
+            }
+            journal->pending += count;
+
+            if (sector == journal->write_sector) {
+                /* Anything after the last valid record (e.g. a torn one) is not erased */
+                journal_record_t record;
+                uint32_t end_sector = sector + JOURNAL_SECTOR_SIZE;
+                bool erased = end + sizeof(record) > end_sector ||
+                    (ops->read(ctx, end, &record, sizeof(record)) == ESP_OK && record.len == JOURNAL_ERASED_LEN);
+                journal->write_off = erased ? end - sector : JOURNAL_SECTOR_SIZE;
+            }
+        }
+        sector = journal_next_sector(journal, sector);
+    }
+
+    return ESP_OK;
+}
+
+/* Erases the next sector and starts writing it, dropping its records if they are still pending */
+static esp_err_t journal_open_sector (journal_t *journal) {
+    uint32_t sector = journal_next_sector(journal, journal->write_sector);
+
+    if (journal->read_addr != JOURNAL_NO_ADDR && journal->read_addr - journal->read_addr % JOURNAL_SECTOR_SIZE == sector) {
+        uint32_t lost = journal_count_pending(journal, sector, journal->read_addr, NULL);
+
+        journal->pending -= lost < journal->pending ? lost : journal->pending;
+        journal->dropped += lost;
+        journal->read_addr = journal->pending ? journal_find_pending(journal, journal_next_sector(journal, sector)) : JOURNAL_NO_ADDR;
+    }
+
+    esp_err_t err = journal->ops->erase(journal->ctx, sector, JOURNAL_SECTOR_SIZE);
+    if (err != ESP_OK) return err;
+
+    journal_sector_t header = {
+        .magic = JOURNAL_MAGIC,
+        .seq = journal->write_seq + 1,
+    };
+    err = journal->ops->write(journal->ctx, sector, &header, sizeof(header));
+    if (err != ESP_OK) return err;
+
+    journal->write_sector = sector;
+    journal->write_off = JOURNAL_DATA_START;
+    journal->write_seq = header.seq;
+
+    return ESP_OK;
+}
+
+esp_err_t journal_append (journal_t *journal, const uint8_t *data, size_t len) {
+    if (len > JOURNAL_MAX_RECORD) return ESP_ERR_INVALID_SIZE;
+
+    if (journal->write_off + JOURNAL_RECORD_SIZE(len) > JOURNAL_SECTOR_SIZE) {
+        esp_err_t err = journal_open_sector(journal);
+        if (err != ESP_OK) return err;
+    }
+
+    uint32_t addr = journal->write_sector + journal->write_off;
+    journal_record_t record = {
+        .len = len,
+        .crc = journal_crc16(0xFFFF, data, len),
+        .state = JOURNAL_PENDING,
+        .reserved = { 0xFF, 0xFF, 0xFF },
+    };
+
+    /* Header first: if the message is torn by a reset, its CRC does not match */
+    esp_err_t err = journal->ops->write(journal->ctx, addr, &record, sizeof(record));
+    if (err == ESP_OK && len) err = journal->ops->write(journal->ctx, addr + sizeof(record), data, len);
+    if (err != ESP_OK) {
+        journal->write_off = JOURNAL_SECTOR_SIZE;
+        return err;
+    }
+
+    journal->write_off += JOURNAL_RECORD_SIZE(len);
+    journal->pending++;
+    if (journal->read_addr == JOURNAL_NO_ADDR) journal->read_addr = addr;
+
+    return ESP_OK;
+}
+
+esp_err_t journal_peek (journal_t *journal, uint8_t *data, size_t max, size_t *len, journal_pos_t *pos) {
+    journal_record_t record;
+
+    if (journal->read_addr == JOURNAL_NO_ADDR) return ESP_ERR_NOT_FOUND;
+
+    pos->addr = journal->read_addr;
+    pos->seq = journal_sector_seq(journal, journal->read_addr - journal->read_addr % JOURNAL_SECTOR_SIZE);
+
+    esp_err_t err = journal->ops->read(journal->ctx, journal->read_addr, &record, sizeof(record));
+    if (err != ESP_OK) return err;
+    if (record.len > max) return ESP_ERR_INVALID_SIZE;
+
+    *len = record.len;
+    return journal->ops->read(journal->ctx, journal->read_addr + sizeof(record), data, record.len);
+}
+
+esp_err_t journal_consume (journal_t *journal, const journal_pos_t *pos) {
+    journal_record_t record;
+    uint8_t state = JOURNAL_CONSUMED;
+
+    /* Records before the oldest pending one are consumed, or dropped with their sector */
+    if (journal->read_addr == JOURNAL_NO_ADDR || journal->read_addr != pos->addr) return ESP_ERR_NOT_FOUND;
+    if (journal_sector_seq(journal, pos->addr - pos->addr % JOURNAL_SECTOR_SIZE) != pos->seq) return ESP_ERR_NOT_FOUND;
+
+    esp_err_t err = journal->ops->read(journal->ctx, journal->read_addr, &record, sizeof(record));
+    if (err == ESP_OK) err = journal->ops->write(journal->ctx, journal->read_addr + offsetof(journal_record_t, state), &state, 1);
+    if (err != ESP_OK) return err;
+
+    journal->pending--;
+    journal->read_addr = journal->pending ? journal_find_pending(journal, journal->read_addr + JOURNAL_RECORD_SIZE(record.len)) : JOURNAL_NO_ADDR;
+
+    return ESP_OK;
+}
+
+uint32_t journal_pending (const journal_t *journal) {
+    return journal->pending;
+}
@@ -0,0 +1,108 @@
+#ifndef JOURNAL_H_ 
+#define JOURNAL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ *  Append-only journal of messages in flash
+ *  Sectors are used as a circular log, so erases are spread evenly over the
+ *  whole area. Each sector starts with a sequence number and each record carries
+ *  a CRC, so a record torn by a reset is detected and skipped. A record is marked
+ *  as consumed by clearing a byte in place, without erasing. When the log is full
+ *  the oldest sector is dropped. Flash is accessed through journal_flash_t, so it
+ *  does not depend on ESP-IDF
+ */
+
+#define JOURNAL_SECTOR_SIZE     4096
+
+#define JOURNAL_NO_ADDR         UINT32_MAX
+
+/* Max length of a message (a record must fit in a sector) */
+#define JOURNAL_MAX_RECORD      1024
+
+/**
+ *  Operations of a flash backend
+ *  Writes may only clear bits (NOR flash), erases take whole sectors
+ */
+typedef struct {
+    esp_err_t (*read)(void *ctx, uint32_t addr, void *data, size_t len);
+    esp_err_t (*write)(void *ctx, uint32_t addr, const void *data, size_t len);
+    esp_err_t (*erase)(void *ctx, uint32_t addr, size_t len);
+} journal_flash_ops_t;
+
+typedef struct {
+    const journal_flash_ops_t *ops;
+    void *ctx;                  // Backend data (e.g. partition)
+    uint32_t size;              // Size of the area, multiple of JOURNAL_SECTOR_SIZE
+
+    uint32_t write_sector;      // Sector being written
+    uint32_t write_off;         // Offset of the next record in it (sector size if it is full)
+    uint32_t write_seq;         // Sequence number of the sector being written
+    uint32_t read_addr;         // Oldest pending record (JOURNAL_NO_ADDR if none)
+    uint32_t pending;           // Records not consumed yet
+    uint32_t dropped;           // Records lost because the journal was full
+} journal_t;
+
+/**
+ *  Position of a record, given by journal_peek to consume that same record later.
+ *  The sequence number of its sector tells it apart from a newer record written at
+ *  the same address after a wrap
+ */
+typedef struct {
+    uint32_t addr;
+    uint32_t seq;
+} journal_pos_t;
+
+/**
+ * @brief   Scans the flash area and recovers the pending records
+ *          An area without any valid sector is taken as an empty journal
+ *
+ * @return
+ *  - ESP_OK
+ *  - ESP_ERR_INVALID_SIZE if the area is smaller than two sectors
+ *  - Errors of the flash backend
+ */
+esp_err_t journal_mount (journal_t *journal, const journal_flash_ops_t *ops, void *ctx, uint32_t size);
+
+/**
+ * @brief   Appends a message
+ *
+ * @return
+ *  - ESP_OK
+ *  - ESP_ERR_INVALID_SIZE if the message is longer than JOURNAL_MAX_RECORD
+ *  - Errors of the flash backend
+ */
+esp_err_t journal_append (journal_t *journal, const uint8_t *data, size_t len);
+
+/**
+ * @brief   Reads the oldest pending message without consuming it
+ *
+ * @param[out] len  Length of the message
+ * @param[out] pos  Position of the message, also given when it cannot be read
+ *
+ * @return
+ *  - ESP_OK
+ *  - ESP_ERR_NOT_FOUND if there is no pending message
+ *  - ESP_ERR_INVALID_SIZE if the message is longer than "max"
+ *  - Errors of the flash backend
+ */
+esp_err_t journal_peek (journal_t *journal, uint8_t *data, size_t max, size_t *len, journal_pos_t *pos);
+
+/**
+ * @brief   Marks the message peeked at "pos" as consumed (e.g. once it has been published)
+ *
+ * @return
+ *  - ESP_OK
+ *  - ESP_ERR_NOT_FOUND if it is no longer the oldest pending message: it has been
+ *    consumed already, or dropped because the journal got full in the meantime
+ *  - Errors of the flash backend
+ */
+esp_err_t journal_consume (journal_t *journal, const journal_pos_t *pos);
+
+/* Number of pending messages */
+uint32_t journal_pending (const journal_t *journal);
+
+#endif
@@ -0,0 +1,29 @@
+#include "journal_esp.h"
+
+#include "esp_partition.h"
+
+
+static esp_err_t journal_esp_read (void *ctx, uint32_t addr, void *data, size_t len) {
+    return esp_partition_read((const esp_partition_t *)ctx, addr, data, len);
+}
+
+static esp_err_t journal_esp_write (void *ctx, uint32_t addr, const void *data, size_t len) {
+    return esp_partition_write((const esp_partition_t *)ctx, addr, data, len);
+}
+
+static esp_err_t journal_esp_erase (void *ctx, uint32_t addr, size_t len) {
+    return esp_partition_erase_range((const esp_partition_t *)ctx, addr, len);
+}
+
+static const journal_flash_ops_t journal_esp_ops = {
+    .read = journal_esp_read,
+    .write = journal_esp_write,
+    .erase = journal_esp_erase,
+};
+
+esp_err_t journal_esp_mount (journal_t *journal, const char *label) {
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, JOURNAL_PARTITION_SUBTYPE, label);
+    if (partition == NULL) return ESP_ERR_NOT_FOUND;
+
+    return journal_mount(journal, &journal_esp_ops, (void *)partition, partition->size);
+}
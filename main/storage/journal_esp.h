@@ -0,0 +1,12 @@
+#ifndef JOURNAL_ESP_H_ 
+#define JOURNAL_ESP_H_
+
+#include "journal.h"
+
+/* Data subtype of the journal partition (custom) */
+#define JOURNAL_PARTITION_SUBTYPE   0x40
+
+/* Mounts the journal kept in a data partition (e.g. "journal" in partitions.csv) */
+esp_err_t journal_esp_mount (journal_t *journal, const char *label);
+
+#endif
@@ -0,0 +1,95 @@
+#include "msg_queue.h"
+
+#include <string.h>
+
+
+bool msg_queue_init (msg_queue_t *queue, msg_queue_cell_t *cells, size_t capacity) {
+    if (capacity == 0 || (capacity & (capacity - 1))) return false;
+
+    queue->cells = cells;
+    queue->mask = capacity - 1;
+    queue->tail = 0;
+    queue->head = 0;
+    queue->pushed = 0;
+    queue->dropped = 0;
+    queue->high_water = 0;
+
+    for (size_t i = 0; i < capacity; i++) cells[i].seq = i;
+
+    return true;
+}
+
+bool msg_queue_push (msg_queue_t *queue, const uint8_t *data, size_t len, uint8_t flags) {
+    if (len > MSG_QUEUE_DATA_LEN) {
+        __atomic_fetch_add(&queue->dropped, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    /* Claims the cell at the tail, unless another producer takes it first */
+    msg_queue_cell_t *cell;
+    uint32_t pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    while (1) {
+        cell = &queue->cells[pos & queue->mask];
+        int32_t diff = (int32_t)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&queue->tail, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if (diff < 0) {
+            /* The cell still holds the message pushed a lap ago: full */
+            __atomic_fetch_add(&queue->dropped, 1, __ATOMIC_RELAXED);
+            return false;
+        } else {
+            pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    memcpy(cell->data, data, len);
+    cell->len = len;
+    cell->flags = flags;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+    __atomic_fetch_add(&queue->pushed, 1, __ATOMIC_RELAXED);
+
+    /* Racy max, good enough for a counter */
+    uint32_t depth = pos + 1 - __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    if (depth > __atomic_load_n(&queue->high_water, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&queue->high_water, depth, __ATOMIC_RELAXED);
+    }
+
+    return true;
+}
+
+bool msg_queue_pop (msg_queue_t *queue, uint8_t *data, size_t *len, uint8_t *flags) {
+    uint32_t pos = queue->head;
+    msg_queue_cell_t *cell = &queue->cells[pos & queue->mask];
+
+    /* Not ready yet: empty, or its producer is still copying the message */
+    if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) return false;
+
+    if (data) memcpy(data, cell->data, cell->len);
+    if (len) *len = cell->len;
+    if (flags) *flags = cell->flags;
+
+    /* Frees the cell for the producers of the next lap */
+    __atomic_store_n(&cell->seq, pos + queue->mask + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&queue->head, pos + 1, __ATOMIC_RELAXED);
+
+    return true;
+}
+
+bool msg_queue_peek (const msg_queue_t *queue, uint8_t *data, size_t *len, uint8_t *flags) {
+    uint32_t pos = queue->head;
+    const msg_queue_cell_t *cell = &queue->cells[pos & queue->mask];
+
+    if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) return false;
+
+    memcpy(data, cell->data, cell->len);
+    *len = cell->len;
+    *flags = cell->flags;
+
+    return true;
+}
+
+size_t msg_queue_depth (const msg_queue_t *queue) {
+    return __atomic_load_n(&queue->tail, __ATOMIC_RELAXED) - __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+}
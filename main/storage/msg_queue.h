@@ -0,0 +1,71 @@
+#ifndef MSG_QUEUE_H_
+#define MSG_QUEUE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *  Bounded lock-free queue of messages, with many producers and a single consumer
+ *  Each cell holds a whole message and a sequence number telling whether it is
+ *  free or ready. A producer claims a cell with a compare-and-swap of the tail, so
+ *  pushing never blocks nor takes a lock (it can be called from any task), and a
+ *  full queue rejects the message right away. The cells are given by the caller.
+ *  It does not depend on ESP-IDF
+ */
+
+/* Longest message (a journal record, see JOURNAL_MAX_RECORD) */
+#define MSG_QUEUE_DATA_LEN  1024
+
+typedef struct {
+    uint32_t seq;               // Position for which the cell is free (pos) or ready (pos + 1)
+    uint16_t len;
+    uint8_t flags;
+    uint8_t data[MSG_QUEUE_DATA_LEN];
+} msg_queue_cell_t;
+
+typedef struct {
+    msg_queue_cell_t *cells;
+    uint32_t mask;              // Capacity - 1
+    uint32_t tail;              // Next position to push, shared by the producers
+    uint32_t head;              // Next position to pop, only used by the consumer
+    uint32_t pushed;
+    uint32_t dropped;           // Messages rejected because the queue was full
+    uint32_t high_water;        // Max messages held at the same time
+} msg_queue_t;
+
+/**
+ * @brief   Initializes a queue over "capacity" cells
+ *
+ * @return  false if "capacity" is not a power of two
+ */
+bool msg_queue_init (msg_queue_t *queue, msg_queue_cell_t *cells, size_t capacity);
+
+/**
+ * @brief   Copies a message into the queue, never blocks
+ *
+ * @return  false if the message is too long or the queue is full (counted as dropped)
+ */
+bool msg_queue_push (msg_queue_t *queue, const uint8_t *data, size_t len, uint8_t flags);
+
+/**
+ * @brief   Copies the oldest message out of the queue (single consumer)
+ *          "data" must hold MSG_QUEUE_DATA_LEN bytes. With "data", "len" and
+ *          "flags" NULL the message is only removed (e.g. after a peek)
+ *
+ * @return  false if the queue is empty
+ */
+bool msg_queue_pop (msg_queue_t *queue, uint8_t *data, size_t *len, uint8_t *flags);
+
+/**
+ * @brief   Copies the oldest message, leaving it in the queue (single consumer)
+ *          It stays the oldest one, and its cell stays taken, until it is popped
+ *
+ * @return  false if the queue is empty
+ */
+bool msg_queue_peek (const msg_queue_t *queue, uint8_t *data, size_t *len, uint8_t *flags);
+
+/* Messages held (approximate while producers are pushing) */
+size_t msg_queue_depth (const msg_queue_t *queue);
+
+#endif
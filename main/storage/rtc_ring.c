@@ -0,0 +1,147 @@
+#include "rtc_ring.h"
+
+
+#define RTC_RING_MAGIC  0x52494E32  // "RIN2"
+
+
+static uint32_t rtc_ring_header_check (const rtc_ring_t *ring) {
+    return ring->magic ^ ((uint32_t)ring->head << 16 | ring->count) ^ (ring->head_seq * 0x9E3779B1) ^
+           ring->base_ts ^ (ring->last_ts * 31);
+}
+
+static void rtc_ring_seal (rtc_ring_t *ring) {
+    ring->check = rtc_ring_header_check(ring);
+}
+
+static uint8_t rtc_ring_crc8_byte (uint8_t crc, uint8_t byte) {
+    crc ^= byte;
+    for (int bit = 0; bit < 8; bit++) {
+        crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+
+    return crc;
+}
+
+/* CRC-8 (poly 0x07) of the sequence number and the fields of the entry */
+static uint8_t rtc_ring_entry_crc (const rtc_ring_entry_t *entry, uint32_t seq) {
+    uint8_t crc = 0xFF;
+
+    for (int shift = 0; shift < 32; shift += 8) crc = rtc_ring_crc8_byte(crc, seq >> shift);
+    crc = rtc_ring_crc8_byte(crc, entry->dt_s);
+    crc = rtc_ring_crc8_byte(crc, entry->dt_s >> 8);
+    crc = rtc_ring_crc8_byte(crc, entry->value);
+    crc = rtc_ring_crc8_byte(crc, entry->value >> 8);
+    crc = rtc_ring_crc8_byte(crc, entry->kind);
+
+    return crc;
+}
+
+static const rtc_ring_entry_t *rtc_ring_entry (const rtc_ring_t *ring, size_t i) {
+    return &ring->entries[(ring->head + i) % RTC_RING_CAPACITY];
+}
+
+bool rtc_ring_restore (rtc_ring_t *ring) {
+    if (ring->magic != RTC_RING_MAGIC ||
+        ring->head >= RTC_RING_CAPACITY ||
+        ring->count > RTC_RING_CAPACITY ||
+        ring->check != rtc_ring_header_check(ring)) {
+        rtc_ring_reset(ring);
+        return false;
+    }
+
+    /* Kept up to the first corrupted entry, the timestamps of the next ones depend on it */
+    uint32_t last_ts = ring->base_ts;
+    for (size_t i = 0; i < ring->count; i++) {
+        const rtc_ring_entry_t *entry = rtc_ring_entry(ring, i);
+
+        if (entry->crc != rtc_ring_entry_crc(entry, ring->head_seq + i)) {
+            ring->count = i;
+            break;
+        }
+        if (i) last_ts += entry->dt_s;
+    }
+    ring->last_ts = last_ts;
+    rtc_ring_seal(ring);
+
+    return true;
+}
+
+void rtc_ring_reset (rtc_ring_t *ring) {
+    ring->magic = RTC_RING_MAGIC;
+    ring->head = 0;
+    ring->count = 0;
+    ring->head_seq = 0;
+    ring->base_ts = 0;
+    ring->last_ts = 0;
+    rtc_ring_seal(ring);
+}
+
+void rtc_ring_push (rtc_ring_t *ring, const rtc_ring_sample_t *sample) {
+    uint32_t dt_s = 0;
+
+    if (ring->count == RTC_RING_CAPACITY) rtc_ring_drop(ring, 1);
+
+    if (ring->count == 0) {
+        ring->base_ts = sample->timestamp;
+        ring->last_ts = sample->timestamp;
+    } else if (sample->timestamp > ring->last_ts) {
+        dt_s = sample->timestamp - ring->last_ts;
+        if (dt_s > UINT16_MAX) dt_s = UINT16_MAX;
+        ring->last_ts += dt_s;
+    }
+
+    rtc_ring_entry_t *entry = &ring->entries[(ring->head + ring->count) % RTC_RING_CAPACITY];
+    entry->dt_s = dt_s;
+    entry->value = sample->value;
+    entry->kind = sample->kind;
+    entry->crc = rtc_ring_entry_crc(entry, ring->head_seq + ring->count);
+
+    ring->count++;
+    rtc_ring_seal(ring);
+}
+
+size_t rtc_ring_count (const rtc_ring_t *ring) {
+    return ring->count;
+}
+
+uint32_t rtc_ring_head_seq (const rtc_ring_t *ring) {
+    return ring->head_seq;
+}
+
+size_t rtc_ring_peek (const rtc_ring_t *ring, rtc_ring_sample_t *samples, size_t max) {
+    uint32_t timestamp = ring->base_ts;
+    size_t n = max < ring->count ? max : ring->count;
+
+    for (size_t i = 0; i < n; i++) {
+        const rtc_ring_entry_t *entry = rtc_ring_entry(ring, i);
+
+        if (i) timestamp += entry->dt_s;
+        samples[i].timestamp = timestamp;
+        samples[i].value = entry->value;
+        samples[i].kind = entry->kind;
+    }
+
+    return n;
+}
+
+void rtc_ring_drop (rtc_ring_t *ring, size_t n) {
+    if (n > ring->count) n = ring->count;
+
+    for (size_t i = 0; i < n; i++) {
+        ring->head = (ring->head + 1) % RTC_RING_CAPACITY;
+        ring->head_seq++;
+        ring->count--;
+
+        /* The new oldest sample keeps its timestamp in the header */
+        if (ring->count) ring->base_ts += ring->entries[ring->head].dt_s;
+    }
+
+    if (ring->count == 0) ring->last_ts = ring->base_ts;
+    rtc_ring_seal(ring);
+}
+
+void rtc_ring_drop_until (rtc_ring_t *ring, uint32_t seq) {
+    int32_t n = (int32_t)(seq - ring->head_seq);
+
+    if (n > 0) rtc_ring_drop(ring, n);
+}
@@ -0,0 +1,87 @@
+#ifndef RTC_RING_H_ 
+#define RTC_RING_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *  Compact ring buffer of timestamped samples
+ *  It is meant to be placed in RTC slow memory (RTC_NOINIT_ATTR), so it survives
+ *  resets and deep sleep. Timestamps are stored as deltas from the previous sample,
+ *  the oldest one is kept in the header. Every sample gets a sequence number, and
+ *  each entry is sealed with a CRC-8 of its contents and its sequence number, so
+ *  stale entries (of another lap or of a previous run) are not taken as valid.
+ *  It does not depend on ESP-IDF
+ */
+
+/* Max samples held (6 bytes each) */
+#define RTC_RING_CAPACITY   800
+
+/* Kind of sample */
+#define RTC_RING_CO2        0   // CO2 window (ppm)
+#define RTC_RING_BLE        1   // People estimation
+
+typedef struct __attribute__((packed)) {
+    uint16_t dt_s;              // Secs since the previous sample (saturated)
+    uint16_t value;
+    uint8_t kind;
+    uint8_t crc;                // CRC-8 of the entry and its sequence number
+} rtc_ring_entry_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t head;              // Index of the oldest sample
+    uint16_t count;
+    uint32_t head_seq;          // Sequence number of the oldest sample
+    uint32_t base_ts;           // Timestamp of the oldest sample
+    uint32_t last_ts;           // Timestamp of the newest sample
+    uint32_t check;             // Integrity check of the header
+    rtc_ring_entry_t entries[RTC_RING_CAPACITY];
+} rtc_ring_t;
+
+/* Sample as pushed and read */
+typedef struct {
+    uint32_t timestamp;
+    uint16_t value;
+    uint8_t kind;
+} rtc_ring_sample_t;
+
+/**
+ * @brief   Validates the ring after a reset and clears it if it is corrupted
+ *
+ * @note    The samples are kept up to the first entry whose CRC does not match
+ *
+ * @return
+ *  - true  if the samples of the previous run have been preserved
+ *  - false if the ring has been cleared (e.g. after power-on)
+ */
+bool rtc_ring_restore (rtc_ring_t *ring);
+
+/* Clears the ring */
+void rtc_ring_reset (rtc_ring_t *ring);
+
+/* Appends a sample, overwriting the oldest one when the ring is full */
+void rtc_ring_push (rtc_ring_t *ring, const rtc_ring_sample_t *sample);
+
+/* Number of samples held */
+size_t rtc_ring_count (const rtc_ring_t *ring);
+
+/* Sequence number of the oldest sample (the one of the next sample if it is empty) */
+uint32_t rtc_ring_head_seq (const rtc_ring_t *ring);
+
+/* Copies up to "max" samples, oldest first, without removing them */
+size_t rtc_ring_peek (const rtc_ring_t *ring, rtc_ring_sample_t *samples, size_t max);
+
+/* Removes the "n" oldest samples */
+void rtc_ring_drop (rtc_ring_t *ring, size_t n);
+
+/**
+ *  Removes the samples older than the sequence number "seq". Samples read by
+ *  rtc_ring_peek() are dropped with rtc_ring_head_seq() + n once they have been
+ *  uploaded: any of them overwritten in between is not counted twice, and the
+ *  samples pushed in between are kept
+ */
+void rtc_ring_drop_until (rtc_ring_t *ring, uint32_t seq);
+
+#endif
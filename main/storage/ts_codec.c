@@ -0,0 +1,182 @@
+#include "ts_codec.h"
+
+#include <string.h>
+
+
+#define TS_BLOCK_BITS       (TS_BLOCK_BYTES * 8)
+
+/**
+ *  Prefix codes
+ *  Timestamp (zigzag delta-of-delta): 0 | 10 + 7 bits | 110 + 12 bits | 111 + 32 bits of raw delta
+ *  Value (zigzag delta):              0 | 10 + 2 bits | 110 + 6 bits  | 111 + 16 bits of raw value
+ */
+#define TS_DOD_BITS_1       7
+#define TS_DOD_BITS_2       12
+#define TS_VALUE_BITS_1     2
+#define TS_VALUE_BITS_2     6
+
+
+/* Computed in 64 bits: the difference of two int32_t deltas does not fit in 32 */
+static inline uint64_t zigzag_encode (int64_t n) {
+    return n >= 0 ? (uint64_t)n << 1 : (((uint64_t)-(n + 1)) << 1) + 1;
+}
+
+static inline int32_t zigzag_decode (uint32_t n) {
+    return n & 1 ? -(int32_t)(n >> 1) - 1 : (int32_t)(n >> 1);
+}
+
+/* ----- BIT STREAM ----- */
+
+static void ts_bits_write (uint8_t *data, uint32_t *bit, uint32_t value, uint8_t n) {
+    while (n--) {
+        uint32_t pos = (*bit)++;
+        if (value >> n & 1) data[pos >> 3] |= 0x80 >> (pos & 7);
+    }
+}
+
+static uint32_t ts_bits_read (const uint8_t *data, uint32_t *bit, uint8_t n) {
+    uint32_t value = 0;
+
+    while (n--) {
+        uint32_t pos = (*bit)++;
+        value = value << 1 | (data[pos >> 3] >> (7 - (pos & 7)) & 1);
+    }
+
+    return value;
+}
+
+/* ----- CODES ----- */
+
+static uint8_t ts_dod_len (uint64_t zz) {
+    if (zz == 0) return 1;
+    if (zz < (1u << TS_DOD_BITS_1)) return 2 + TS_DOD_BITS_1;
+    if (zz < (1u << TS_DOD_BITS_2)) return 3 + TS_DOD_BITS_2;
+    return 3 + 32;
+}
+
+static uint8_t ts_value_len (uint64_t zz) {
+    if (zz == 0) return 1;
+    if (zz < (1u << TS_VALUE_BITS_1)) return 2 + TS_VALUE_BITS_1;
+    if (zz < (1u << TS_VALUE_BITS_2)) return 3 + TS_VALUE_BITS_2;
+    return 3 + 16;
+}
+
+static void ts_dod_write (uint8_t *data, uint32_t *bit, uint64_t zz, int32_t dt) {
+    if (zz == 0) {
+        ts_bits_write(data, bit, 0, 1);
+    } else if (zz < (1u << TS_DOD_BITS_1)) {
+        ts_bits_write(data, bit, 0x2, 2);
+        ts_bits_write(data, bit, zz, TS_DOD_BITS_1);
+    } else if (zz < (1u << TS_DOD_BITS_2)) {
+        ts_bits_write(data, bit, 0x6, 3);
+        ts_bits_write(data, bit, zz, TS_DOD_BITS_2);
+    } else {
+        ts_bits_write(data, bit, 0x7, 3);
+        ts_bits_write(data, bit, (uint32_t)dt, 32);
+    }
+}
+
+static void ts_value_write (uint8_t *data, uint32_t *bit, uint64_t zz, uint16_t value) {
+    if (zz == 0) {
+        ts_bits_write(data, bit, 0, 1);
+    } else if (zz < (1u << TS_VALUE_BITS_1)) {
+        ts_bits_write(data, bit, 0x2, 2);
+        ts_bits_write(data, bit, zz, TS_VALUE_BITS_1);
+    } else if (zz < (1u << TS_VALUE_BITS_2)) {
+        ts_bits_write(data, bit, 0x6, 3);
+        ts_bits_write(data, bit, zz, TS_VALUE_BITS_2);
+    } else {
+        ts_bits_write(data, bit, 0x7, 3);
+        ts_bits_write(data, bit, value, 16);
+    }
+}
+
+/* Reads a prefix (0, 10, 110 or 111) and returns its number of 1s */
+static uint8_t ts_prefix_read (const uint8_t *data, uint32_t *bit) {
+    uint8_t ones = 0;
+
+    while (ones < 3 && ts_bits_read(data, bit, 1)) ones++;
+
+    return ones;
+}
+
+/* ----- BLOCK ----- */
+
+void ts_block_init (ts_block_t *block, uint8_t tag) {
+    memset(block, 0, sizeof(*block));
+    block->tag = tag;
+}
+
+bool ts_block_append (ts_block_t *block, uint32_t ts, uint16_t value) {
+    if (block->count == 0) {
+        block->first_ts = ts;
+        block->last_ts = ts;
+        block->last_dt = 0;
+        block->first_value = value;
+        block->last_value = value;
+        block->count = 1;
+        return true;
+    }
+
+    if (block->count == UINT16_MAX) return false;
+
+    /* A delta beyond int32_t (e.g. a clock set back by decades) starts a new block */
+    int64_t delta = (int64_t)ts - block->last_ts;
+    if (delta > INT32_MAX || delta < INT32_MIN) return false;
+
+    int32_t dt = (int32_t)delta;
+    uint64_t dod_zz = zigzag_encode((int64_t)dt - block->last_dt);
+    uint64_t value_zz = zigzag_encode((int64_t)value - block->last_value);
+
+    uint32_t bit = block->bits;
+    if (bit + ts_dod_len(dod_zz) + ts_value_len(value_zz) > TS_BLOCK_BITS) return false;
+
+    ts_dod_write(block->data, &bit, dod_zz, dt);
+    ts_value_write(block->data, &bit, value_zz, value);
+
+    block->bits = bit;
+    block->last_ts = ts;
+    block->last_dt = dt;
+    block->last_value = value;
+    block->count++;
+
+    return true;
+}
+
+void ts_block_iter_init (ts_block_iter_t *iter, const ts_block_t *block) {
+    iter->block = block;
+    iter->bit = 0;
+    iter->index = 0;
+    iter->ts = block->first_ts;
+    iter->dt = 0;
+    iter->value = block->first_value;
+}
+
+bool ts_block_iter_next (ts_block_iter_t *iter, uint32_t *ts, uint16_t *value) {
+    const ts_block_t *block = iter->block;
+
+    if (iter->index >= block->count) return false;
+
+    if (iter->index > 0) {
+        switch (ts_prefix_read(block->data, &iter->bit)) {
+            case 0: break;
+            case 1: iter->dt += zigzag_decode(ts_bits_read(block->data, &iter->bit, TS_DOD_BITS_1)); break;
+            case 2: iter->dt += zigzag_decode(ts_bits_read(block->data, &iter->bit, TS_DOD_BITS_2)); break;
+            default: iter->dt = (int32_t)ts_bits_read(block->data, &iter->bit, 32); break;
+        }
+        iter->ts += (uint32_t)iter->dt;
+
+        switch (ts_prefix_read(block->data, &iter->bit)) {
+            case 0: break;
+            case 1: iter->value += zigzag_decode(ts_bits_read(block->data, &iter->bit, TS_VALUE_BITS_1)); break;
+            case 2: iter->value += zigzag_decode(ts_bits_read(block->data, &iter->bit, TS_VALUE_BITS_2)); break;
+            default: iter->value = ts_bits_read(block->data, &iter->bit, 16); break;
+        }
+    }
+
+    iter->index++;
+    *ts = iter->ts;
+    *value = iter->value;
+
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef TS_CODEC_H_ 
+#define TS_CODEC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *  Lossless block codec for timestamped samples
+ *  The first sample of a block is kept in its header, the next ones are bit-packed
+ *  as the zigzag delta-of-delta of their timestamp and the zigzag delta of their
+ *  value, with short prefix codes for the usual small deltas (a steady 1 Hz CO2
+ *  series takes a few bits per sample). Blocks are independent, so any of them
+ *  can be decoded on its own. It does not depend on ESP-IDF
+ */
+
+/* Size of the packed data of a block */
+#define TS_BLOCK_BYTES      256
+
+typedef struct {
+    uint32_t first_ts;
+    uint32_t last_ts;
+    int32_t last_dt;        // Encoder state
+    uint16_t first_value;
+    uint16_t last_value;    // Encoder state
+    uint16_t count;         // Samples in the block
+    uint16_t bits;          // Bits of "data" in use
+    uint8_t tag;            // Free for the user (e.g. series of the samples)
+    uint8_t data[TS_BLOCK_BYTES];
+} ts_block_t;
+
+typedef struct {
+    const ts_block_t *block;
+    uint32_t bit;
+    uint16_t index;
+    uint32_t ts;
+    int32_t dt;
+    uint16_t value;
+} ts_block_iter_t;
+
+/* Initializes an empty block */
+void ts_block_init (ts_block_t *block, uint8_t tag);
+
+/**
+ * @brief   Appends a sample to a block
+ *
+ * @return
+ *  - true  if the sample has been appended
+ *  - false if the block is full, or the sample is more than INT32_MAX secs away
+ *    from the previous one (the sample goes to a new block)
+ */
+bool ts_block_append (ts_block_t *block, uint32_t ts, uint16_t value);
+
+/* Starts decoding a block from its first sample */
+void ts_block_iter_init (ts_block_iter_t *iter, const ts_block_t *block);
+
+/**
+ * @brief   Decodes the next sample of a block
+ *
+ * @return  false once every sample has been decoded
+ */
+bool ts_block_iter_next (ts_block_iter_t *iter, uint32_t *ts, uint16_t *value);
+
+#endif
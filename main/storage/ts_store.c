@@ -0,0 +1,217 @@
+#include "ts_store.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+
+#define TS_STORE_RAW_S          1
+#define TS_STORE_MINUTE_S       60
+#define TS_STORE_QUARTER_S      (15 * 60)
+
+
+static void ts_tier_init (ts_tier_t *tier, ts_bucket_t *buckets, uint16_t len, uint32_t span_s) {
+    memset(tier, 0, sizeof(*tier));
+    tier->buckets = buckets;
+    tier->len = len;
+    tier->span_s = span_s;
+}
+
+/* Moves the open bucket to the ring, overwriting the oldest one when it is full */
+static void ts_tier_close (ts_tier_t *tier) {
+    ts_bucket_t *bucket;
+
+    if (tier->count == tier->len) {
+        bucket = &tier->buckets[tier->head];
+        tier->head = (tier->head + 1) % tier->len;
+    } else {
+        bucket = &tier->buckets[(tier->head + tier->count) % tier->len];
+        tier->count++;
+    }
+
+    bucket->ts = tier->open_ts;
+    bucket->min = tier->open_min;
+    bucket->max = tier->open_max;
+    bucket->mean = tier->open_sum / tier->open_count;
+    bucket->count = tier->open_count;
+
+    tier->open_count = 0;
+}
+
+/* Adds a sample to the open bucket, opening it at "bucket_ts" if there is none */
+static void ts_tier_accumulate (ts_tier_t *tier, uint32_t bucket_ts, uint16_t value) {
+    if (tier->open_count == 0) {
+        tier->open_ts = bucket_ts;
+        tier->open_sum = 0;
+        tier->open_min = value;
+        tier->open_max = value;
+    }
+
+    tier->open_sum += value;
+    if (value < tier->open_min) tier->open_min = value;
+    if (value > tier->open_max) tier->open_max = value;
+    tier->open_count++;
+}
+
+static void ts_tier_add (ts_tier_t *tier, uint32_t ts, uint16_t value) {
+    uint32_t bucket_ts = ts - ts % tier->span_s;
+
+    /* A sample older than the open bucket (e.g. the clock went back) stays in it */
+    if (tier->open_count && bucket_ts > tier->open_ts) ts_tier_close(tier);
+
+    ts_tier_accumulate(tier, bucket_ts, value);
+
+    /* Keeps the mean exact, a bucket cannot hold more samples than this */
+    if (tier->open_count == UINT16_MAX) ts_tier_close(tier);
+}
+
+/* Whether a sample/bucket at "ts" comes before the cursor (it counts the ones at the cursor skipped) */
+static bool ts_cursor_skip (ts_cursor_t *from, uint32_t ts) {
+    if (ts < from->ts) return true;
+    if (ts == from->ts && from->skip) {
+        from->skip--;
+        return true;
+    }
+    return false;
+}
+
+/* Appends the open bucket to "out" if it is not before the cursor */
+static size_t ts_tier_read_open (const ts_tier_t *tier, ts_cursor_t *from, ts_bucket_t *out, size_t n, size_t max) {
+    if (tier->open_count && n < max && !ts_cursor_skip(from, tier->open_ts)) {
+        out[n].ts = tier->open_ts;
+        out[n].min = tier->open_min;
+        out[n].max = tier->open_max;
+        out[n].mean = tier->open_sum / tier->open_count;
+        out[n].count = tier->open_count;
+        n++;
+    }
+
+    return n;
+}
+
+static size_t ts_tier_read (const ts_tier_t *tier, ts_cursor_t *from, ts_bucket_t *out, size_t max) {
+    size_t n = 0;
+
+    for (uint16_t i = 0; i < tier->count && n < max; i++) {
+        const ts_bucket_t *bucket = &tier->buckets[(tier->head + i) % tier->len];
+        if (!ts_cursor_skip(from, bucket->ts)) out[n++] = *bucket;
+    }
+
+    return ts_tier_read_open(tier, from, out, n, max);
+}
+
+/* Takes a block for a series, recycling the oldest one when the pool is full */
+static ts_block_t *ts_store_new_block (ts_store_t *store, uint8_t series_idx) {
+    uint16_t idx;
+
+    if (store->raw_count == TS_STORE_RAW_BLOCKS) {
+        idx = store->raw_head;
+        store->raw_head = (store->raw_head + 1) % TS_STORE_RAW_BLOCKS;
+
+        /* A sparse series may still be filling the oldest block */
+        for (int i = 0; i < TS_STORE_SERIES; i++) {
+            if (store->series[i].raw_block == idx) store->series[i].raw_block = -1;
+        }
+    } else {
+        idx = (store->raw_head + store->raw_count) % TS_STORE_RAW_BLOCKS;
+        store->raw_count++;
+    }
+
+    ts_block_init(&store->raw[idx], series_idx);
+    store->series[series_idx].raw_block = idx;
+
+    return &store->raw[idx];
+}
+
+void ts_store_init (ts_store_t *store) {
+    store->raw_head = 0;
+    store->raw_count = 0;
+
+    for (int i = 0; i < TS_STORE_SERIES; i++) {
+        ts_series_t *series = &store->series[i];
+
+        series->raw_block = -1;
+        ts_tier_init(&series->raw_slot, NULL, 0, TS_STORE_RAW_S);    // Only its open bucket is used
+        ts_tier_init(&series->tiers[0], series->minute, TS_STORE_MINUTE_LEN, TS_STORE_MINUTE_S);
+        ts_tier_init(&series->tiers[1], series->quarter, TS_STORE_QUARTER_LEN, TS_STORE_QUARTER_S);
+    }
+}
+
+/* Writes the raw slot of a series to its blocks, as the mean of its samples */
+static void ts_store_flush_slot (ts_store_t *store, uint8_t series_idx) {
+    ts_series_t *series = &store->series[series_idx];
+    ts_tier_t *slot = &series->raw_slot;
+    uint16_t value = slot->open_sum / slot->open_count;
+
+    if (series->raw_block < 0 || !ts_block_append(&store->raw[series->raw_block], slot->open_ts, value)) {
+        ts_block_append(ts_store_new_block(store, series_idx), slot->open_ts, value);
+    }
+
+    slot->open_count = 0;
+}
+
+void ts_store_add (ts_store_t *store, uint8_t series_idx, uint32_t ts, uint16_t value) {
+    if (series_idx >= TS_STORE_SERIES) return;
+    ts_series_t *series = &store->series[series_idx];
+    ts_tier_t *slot = &series->raw_slot;
+
+    /* A new second (or a clock that went back) closes the slot */
+    if (slot->open_count && (ts != slot->open_ts || slot->open_count == UINT16_MAX)) {
+        ts_store_flush_slot(store, series_idx);
+    }
+    ts_tier_accumulate(slot, ts, value);
+
+    ts_tier_add(&series->tiers[0], ts, value);
+    ts_tier_add(&series->tiers[1], ts, value);
+}
+
+/* Decodes the raw samples of a series, whole blocks older than the cursor are skipped */
+static size_t ts_store_read_raw (const ts_store_t *store, uint8_t series_idx, ts_cursor_t *from, ts_bucket_t *out, size_t max) {
+    size_t n = 0;
+
+    for (uint16_t i = 0; i < store->raw_count && n < max; i++) {
+        const ts_block_t *block = &store->raw[(store->raw_head + i) % TS_STORE_RAW_BLOCKS];
+        if (block->tag != series_idx || block->count == 0 || block->last_ts < from->ts) continue;
+
+        ts_block_iter_t iter;
+        uint32_t ts;
+        uint16_t value;
+
+        ts_block_iter_init(&iter, block);
+        while (n < max && ts_block_iter_next(&iter, &ts, &value)) {
+            if (ts_cursor_skip(from, ts)) continue;
+
+            out[n].ts = ts;
+            out[n].min = value;
+            out[n].max = value;
+            out[n].mean = value;
+            out[n].count = 1;
+            n++;
+        }
+    }
+
+    return ts_tier_read_open(&store->series[series_idx].raw_slot, from, out, n, max);
+}
+
+size_t ts_store_read (const ts_store_t *store, uint8_t series_idx, ts_res_t res, ts_cursor_t *cursor, ts_bucket_t *out, size_t max) {
+    if (series_idx >= TS_STORE_SERIES) return 0;
+    const ts_series_t *series = &store->series[series_idx];
+    ts_cursor_t from = *cursor;
+    size_t n;
+
+    if (res == TS_RES_MINUTE) n = ts_tier_read(&series->tiers[0], &from, out, max);
+    else if (res == TS_RES_QUARTER) n = ts_tier_read(&series->tiers[1], &from, out, max);
+    else n = ts_store_read_raw(store, series_idx, &from, out, max);
+    if (n == 0) return 0;
+
+    /* Next page: after the last one copied and the others at its time */
+    size_t same = 0;
+    while (same < n && out[n - 1 - same].ts == out[n - 1].ts) same++;
+    if (out[n - 1].ts == cursor->ts) {
+        cursor->skip += same;
+    } else {
+        cursor->ts = out[n - 1].ts;
+        cursor->skip = same;
+    }
+
+    return n;
+}
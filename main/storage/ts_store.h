@@ -0,0 +1,111 @@
+#ifndef TS_STORE_H_ 
+#define TS_STORE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "ts_codec.h"
+
+/**
+ *  Multi-resolution time-series store
+ *  Raw samples are kept compressed (ts_codec) in a pool of blocks shared by all
+ *  the series, the oldest block is recycled when the pool is full. Raw samples have
+ *  a resolution of one second: those of the same second are averaged into a
+ *  single one (the raw slot), so each second has one raw sample. Every sample is
+ *  also rolled up into minute and quarter-hour buckets (min/max/mean). All the
+ *  memory is inside the store, nothing is allocated after init, and a query costs
+ *  O(buckets). It does not depend on ESP-IDF
+ */
+
+/* Series held */
+#define TS_SERIES_CO2           0   // CO2 readings (ppm)
+#define TS_SERIES_BLE           1   // People estimations
+#define TS_STORE_SERIES         2
+
+/* Horizon of each resolution */
+#ifdef CONFIG_HISTORY_RAW_BLOCKS
+#define TS_STORE_RAW_BLOCKS     CONFIG_HISTORY_RAW_BLOCKS
+#else
+#define TS_STORE_RAW_BLOCKS     128     // About 24 hours of CO2 at 1 Hz
+#endif
+#define TS_STORE_MINUTE_LEN     60      // 1 hour
+#define TS_STORE_QUARTER_LEN    96      // 24 hours
+
+/* Resolutions */
+typedef enum {
+    TS_RES_RAW = 0,
+    TS_RES_MINUTE,
+    TS_RES_QUARTER,
+} ts_res_t;
+
+/**
+ *  Result of a query. Raw samples have min = max = mean and count = 1, except the
+ *  one of the current second, which has the samples averaged into it so far
+ */
+typedef struct {
+    uint32_t ts;            // Epoch secs of the sample or start of the bucket
+    uint16_t min;
+    uint16_t max;
+    uint16_t mean;
+    uint16_t count;         // Samples in the bucket
+} ts_bucket_t;
+
+/**
+ *  Position of a paged read: the samples/buckets at "ts" or later, except the
+ *  first "skip" ones at "ts", which the previous pages already returned
+ */
+typedef struct {
+    uint32_t ts;
+    uint32_t skip;
+} ts_cursor_t;
+
+/* Rollup of a resolution: closed buckets plus the open one */
+typedef struct {
+    ts_bucket_t *buckets;
+    uint16_t len;
+    uint16_t head;          // Index of the oldest bucket
+    uint16_t count;
+    uint32_t span_s;
+    uint32_t open_ts;       // Start of the open bucket
+    uint32_t open_sum;
+    uint16_t open_min;
+    uint16_t open_max;
+    uint16_t open_count;    // 0 if there is no open bucket
+} ts_tier_t;
+
+typedef struct {
+    int16_t raw_block;      // Block being filled (-1 if none)
+    ts_tier_t raw_slot;     // Samples of the current second, not in the raw blocks yet
+    ts_bucket_t minute[TS_STORE_MINUTE_LEN];
+    ts_bucket_t quarter[TS_STORE_QUARTER_LEN];
+    ts_tier_t tiers[2];     // Minute and quarter-hour rollups
+} ts_series_t;
+
+typedef struct {
+    ts_block_t raw[TS_STORE_RAW_BLOCKS];    // Tagged with their series, oldest first from "raw_head"
+    uint16_t raw_head;
+    uint16_t raw_count;
+    ts_series_t series[TS_STORE_SERIES];
+} ts_store_t;
+
+/* Initializes an empty store */
+void ts_store_init (ts_store_t *store);
+
+/* Adds a sample taken at "ts" (epoch secs) to a series */
+void ts_store_add (ts_store_t *store, uint8_t series, uint32_t ts, uint16_t value);
+
+/**
+ * @brief   Reads the samples or buckets of a series from a cursor
+ *          The open bucket of a rollup is returned last, as it is so far
+ *
+ * @param[in,out] cursor   Where to start ({from_ts, 0} for a first page). It is
+ *                         moved past the samples/buckets copied, so the next page
+ *                         neither skips nor repeats the ones sharing a timestamp
+ * @param[out]    out      Up to "max" samples/buckets, oldest first
+ *
+ * @return  Number of samples/buckets copied
+ */
+size_t ts_store_read (const ts_store_t *store, uint8_t series, ts_res_t res, ts_cursor_t *cursor, ts_bucket_t *out, size_t max);
+
+#endif
@@ -0,0 +1,74 @@
+#include "cbor_writer.h"
+
+#include <string.h>
+
+
+void cbor_writer_init (cbor_writer_t *writer, uint8_t *buf, size_t len) {
+    writer->buf = buf;
+    writer->len = len;
+    writer->used = 0;
+    writer->overflow = false;
+}
+
+void cbor_writer_put (cbor_writer_t *writer, const void *data, size_t len) {
+    if (writer->overflow || writer->used + len > writer->len) {
+        writer->overflow = true;
+        return;
+    }
+
+    memcpy(writer->buf + writer->used, data, len);
+    writer->used += len;
+}
+
+void cbor_writer_byte (cbor_writer_t *writer, uint8_t byte) {
+    cbor_writer_put(writer, &byte, 1);
+}
+
+void cbor_writer_uint_be (cbor_writer_t *writer, uint32_t value, size_t width) {
+    uint8_t bytes[4];
+
+    for (size_t b = 0; b < width; b++) {
+        bytes[b] = value >> (8 * (width - 1 - b));
+    }
+    cbor_writer_put(writer, bytes, width);
+}
+
+void cbor_writer_head (cbor_writer_t *writer, uint8_t major, uint64_t value) {
+    uint8_t initial = major << 5;
+
+    if (value < 24) {
+        cbor_writer_byte(writer, initial | value);
+    } else if (value <= UINT8_MAX) {
+        cbor_writer_byte(writer, initial | 24);
+        cbor_writer_uint_be(writer, value, 1);
+    } else if (value <= UINT16_MAX) {
+        cbor_writer_byte(writer, initial | 25);
+        cbor_writer_uint_be(writer, value, 2);
+    } else if (value <= UINT32_MAX) {
+        cbor_writer_byte(writer, initial | 26);
+        cbor_writer_uint_be(writer, value, 4);
+    } else {
+        cbor_writer_byte(writer, initial | 27);
+        cbor_writer_uint_be(writer, value >> 32, 4);
+        cbor_writer_uint_be(writer, value, 4);
+    }
+}
+
+void cbor_writer_text (cbor_writer_t *writer, const char *str) {
+    size_t len = strlen(str);
+
+    cbor_writer_head(writer, CBOR_MAJOR_TEXT, len);
+    cbor_writer_put(writer, str, len);
+}
+
+void cbor_writer_float (cbor_writer_t *writer, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    cbor_writer_byte(writer, CBOR_FLOAT32);
+    cbor_writer_uint_be(writer, bits, 4);
+}
+
+size_t cbor_writer_finish (const cbor_writer_t *writer) {
+    return writer->overflow ? 0 : writer->used;
+}
@@ -0,0 +1,64 @@
+#ifndef CBOR_WRITER_H_
+#define CBOR_WRITER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *  Minimal CBOR (RFC 8949) writer over a caller-owned buffer
+ *  It never allocates: once the buffer is full it stops writing and the result
+ *  is reported as truncated. Shared by the telemetry payloads and the API REST
+ */
+
+/* Initial bytes */
+#define CBOR_UINT(v)            (0x00 | (v))    // Unsigned integer up to 23
+#define CBOR_UINT16             0x19            // Followed by 2 bytes (big endian)
+#define CBOR_UINT32             0x1a            // Followed by 4 bytes (big endian)
+#define CBOR_TEXT(len)          (0x60 | (len))  // Text string up to 23 bytes
+#define CBOR_MAP(n)             (0xa0 | (n))    // Map of up to 23 pairs
+#define CBOR_ARRAY_INDEFINITE   0x9f            // Items follow until CBOR_BREAK
+#define CBOR_MAP_INDEFINITE     0xbf            // Pairs follow until CBOR_BREAK
+#define CBOR_FLOAT32            0xfa            // Followed by 4 bytes (big endian)
+#define CBOR_BREAK              0xff
+
+/* Major types */
+#define CBOR_MAJOR_UINT         0
+#define CBOR_MAJOR_BYTES        2
+#define CBOR_MAJOR_TEXT         3
+#define CBOR_MAJOR_ARRAY        4
+#define CBOR_MAJOR_MAP          5
+#define CBOR_MAJOR_TAG          6
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    size_t used;
+    bool overflow;              // Something did not fit
+} cbor_writer_t;
+
+/* Starts writing at the beginning of "buf" */
+void cbor_writer_init (cbor_writer_t *writer, uint8_t *buf, size_t len);
+
+/* Appends raw bytes */
+void cbor_writer_put (cbor_writer_t *writer, const void *data, size_t len);
+
+/* Appends a single byte (e.g. one of the initial bytes above) */
+void cbor_writer_byte (cbor_writer_t *writer, uint8_t byte);
+
+/* Appends the head of an item in its shortest form */
+void cbor_writer_head (cbor_writer_t *writer, uint8_t major, uint64_t value);
+
+/* Appends "value" as "width" bytes in big endian (e.g. typed arrays) */
+void cbor_writer_uint_be (cbor_writer_t *writer, uint32_t value, size_t width);
+
+/* Appends a text string */
+void cbor_writer_text (cbor_writer_t *writer, const char *str);
+
+/* Appends a single-precision float */
+void cbor_writer_float (cbor_writer_t *writer, float value);
+
+/* Length written, 0 if it did not fit */
+size_t cbor_writer_finish (const cbor_writer_t *writer);
+
+#endif
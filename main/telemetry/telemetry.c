@@ -0,0 +1,251 @@
+#include "telemetry.h"
+
+#include <string.h>
+
+#include "cbor_writer.h"
+
+
+/* Typed arrays (RFC 8746), tags of a byte string */
+#define CBOR_TAG_UINT8      64
+#define CBOR_TAG_UINT16_BE  65
+#define CBOR_TAG_UINT32_BE  66
+
+/**
+ *  Values are always encoded with the same width (CBOR allows it, even if it is
+ *  not the shortest form), so their offsets in the templates are fixed
+ */
+#define TELEMETRY_U16(key)  CBOR_UINT(key), CBOR_UINT16, 0, 0
+#define TELEMETRY_U32(key)  CBOR_UINT(key), CBOR_UINT32, 0, 0, 0, 0
+
+
+/* ----- Templates ----- */
+
+static const uint8_t telemetry_co2_template[] = {
+    CBOR_MAP(8),
+    CBOR_UINT(TELEMETRY_KEY_VERSION), CBOR_UINT(TELEMETRY_SCHEMA_VERSION),
+    TELEMETRY_U16(TELEMETRY_KEY_CO2),           // Offset 3
+    TELEMETRY_U16(TELEMETRY_KEY_CO2_MIN),       // Offset 7
+    TELEMETRY_U16(TELEMETRY_KEY_CO2_MAX),       // Offset 11
+    TELEMETRY_U16(TELEMETRY_KEY_CO2_STD),       // Offset 15
+    TELEMETRY_U16(TELEMETRY_KEY_CO2_P95),       // Offset 19
+    TELEMETRY_U32(TELEMETRY_KEY_TS),            // Offset 23
+    CBOR_UINT(TELEMETRY_KEY_ESP_ID),            // Offset 29, text string follows
+};
+#define CO2_OFFSET_MEAN     3
+#define CO2_OFFSET_MIN      7
+#define CO2_OFFSET_MAX      11
+#define CO2_OFFSET_STD      15
+#define CO2_OFFSET_P95      19
+#define CO2_OFFSET_TS       23
+
+static const uint8_t telemetry_ble_template[] = {
+    CBOR_MAP(4),
+    CBOR_UINT(TELEMETRY_KEY_VERSION), CBOR_UINT(TELEMETRY_SCHEMA_VERSION),
+    TELEMETRY_U16(TELEMETRY_KEY_BLE_PEOPLE),    // Offset 3
+    TELEMETRY_U32(TELEMETRY_KEY_TS),            // Offset 7
+    CBOR_UINT(TELEMETRY_KEY_ESP_ID),            // Offset 13, text string follows
+};
+#define BLE_OFFSET_PEOPLE   3
+#define BLE_OFFSET_TS       7
+
+
+/* ----- Patching ----- */
+
+/* Writes the value of a TELEMETRY_U16/U32 entry, "offset" points to its key */
+static void telemetry_patch_u16 (uint8_t *buf, size_t offset, uint16_t value) {
+    buf[offset + 2] = value >> 8;
+    buf[offset + 3] = value;
+}
+
+static void telemetry_patch_u32 (uint8_t *buf, size_t offset, uint32_t value) {
+    buf[offset + 2] = value >> 24;
+    buf[offset + 3] = value >> 16;
+    buf[offset + 4] = value >> 8;
+    buf[offset + 5] = value;
+}
+
+/* Copies a template followed by the ESP_ID, returns the length (0 if it does not fit) */
+static size_t telemetry_copy (uint8_t *buf, size_t len, const uint8_t *template, size_t template_len, const telemetry_id_t *id) {
+    if (template_len + id->len > len) return 0;
+
+    memcpy(buf, template, template_len);
+    memcpy(buf + template_len, id->bytes, id->len);
+
+    return template_len + id->len;
+}
+
+
+bool telemetry_id_init (telemetry_id_t *id, const char *esp_id) {
+    size_t id_len = strlen(esp_id);
+    if (id_len > TELEMETRY_ESP_ID_MAX) return false;
+
+    id->bytes[0] = CBOR_TEXT(id_len);
+    memcpy(id->bytes + 1, esp_id, id_len);
+    id->len = 1 + id_len;
+
+    return true;
+}
+
+
+size_t telemetry_encode_co2 (uint8_t *buf, size_t len, const telemetry_id_t *id, const window_stats_result_t *co2, uint32_t ts) {
+    size_t used = telemetry_copy(buf, len, telemetry_co2_template, sizeof(telemetry_co2_template), id);
+    if (used == 0) return 0;
+
+    telemetry_patch_u16(buf, CO2_OFFSET_MEAN, co2->mean);
+    telemetry_patch_u16(buf, CO2_OFFSET_MIN, co2->min);
+    telemetry_patch_u16(buf, CO2_OFFSET_MAX, co2->max);
+    telemetry_patch_u16(buf, CO2_OFFSET_STD, co2->stddev);
+    telemetry_patch_u16(buf, CO2_OFFSET_P95, co2->quantile);
+    telemetry_patch_u32(buf, CO2_OFFSET_TS, ts);
+
+    return used;
+}
+
+size_t telemetry_encode_ble (uint8_t *buf, size_t len, const telemetry_id_t *id, uint8_t people, uint32_t ts) {
+    size_t used = telemetry_copy(buf, len, telemetry_ble_template, sizeof(telemetry_ble_template), id);
+    if (used == 0) return 0;
+
+    telemetry_patch_u16(buf, BLE_OFFSET_PEOPLE, people);
+    telemetry_patch_u32(buf, BLE_OFFSET_TS, ts);
+
+    return used;
+}
+
+
+/* ----- Batches ----- */
+
+/* Writes "key" followed by the head of a typed array of "n" values of "width" bytes */
+static void telemetry_put_column_head (cbor_writer_t *writer, uint8_t key, size_t n, size_t width) {
+    uint8_t tag = width == 1 ? CBOR_TAG_UINT8 : width == 2 ? CBOR_TAG_UINT16_BE : CBOR_TAG_UINT32_BE;
+
+    cbor_writer_byte(writer, CBOR_UINT(key));
+    cbor_writer_head(writer, CBOR_MAJOR_TAG, tag);
+    cbor_writer_head(writer, CBOR_MAJOR_BYTES, n * width);
+}
+
+static void telemetry_put_column_u8 (cbor_writer_t *writer, uint8_t key, const uint8_t *values, size_t n) {
+    telemetry_put_column_head(writer, key, n, sizeof(uint8_t));
+    cbor_writer_put(writer, values, n);
+}
+
+static void telemetry_put_column_u16 (cbor_writer_t *writer, uint8_t key, const uint16_t *values, size_t n) {
+    telemetry_put_column_head(writer, key, n, sizeof(uint16_t));
+    for (size_t i = 0; i < n; i++) cbor_writer_uint_be(writer, values[i], sizeof(uint16_t));
+}
+
+/* Writes "key": secs from "base_ts" of each timestamp, in the narrowest width that fits */
+static void telemetry_put_column_ts (cbor_writer_t *writer, uint8_t key, const uint32_t *ts, size_t n, uint32_t base_ts) {
+    uint32_t max_offset = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (ts[i] - base_ts > max_offset) max_offset = ts[i] - base_ts;
+    }
+
+    size_t width = max_offset <= UINT16_MAX ? sizeof(uint16_t) : sizeof(uint32_t);
+    telemetry_put_column_head(writer, key, n, width);
+    for (size_t i = 0; i < n; i++) cbor_writer_uint_be(writer, ts[i] - base_ts, width);
+}
+
+void telemetry_batch_reset (telemetry_batch_t *batch) {
+    batch->co2_count = 0;
+    batch->ble_count = 0;
+    batch->co2_stats = false;
+}
+
+bool telemetry_batch_add_co2 (telemetry_batch_t *batch, uint32_t ts, const window_stats_result_t *co2) {
+    if (batch->co2_count == TELEMETRY_BATCH_MAX || ts == 0) return false;
+
+    uint16_t i = batch->co2_count++;
+    batch->co2_ts[i] = ts;
+    batch->co2_mean[i] = co2->mean;
+    batch->co2_min[i] = co2->min;
+    batch->co2_max[i] = co2->max;
+    batch->co2_std[i] = co2->stddev;
+    batch->co2_p95[i] = co2->quantile;
+    batch->co2_stats = true;
+
+    return true;
+}
+
+bool telemetry_batch_add_co2_value (telemetry_batch_t *batch, uint32_t ts, uint16_t co2_ppm) {
+    if (batch->co2_count == TELEMETRY_BATCH_MAX || ts == 0) return false;
+
+    uint16_t i = batch->co2_count++;
+    batch->co2_ts[i] = ts;
+    batch->co2_mean[i] = co2_ppm;
+    batch->co2_min[i] = co2_ppm;
+    batch->co2_max[i] = co2_ppm;
+    batch->co2_std[i] = 0;
+    batch->co2_p95[i] = co2_ppm;
+
+    return true;
+}
+
+bool telemetry_batch_add_ble (telemetry_batch_t *batch, uint32_t ts, uint8_t people) {
+    if (batch->ble_count == TELEMETRY_BATCH_MAX || ts == 0) return false;
+
+    batch->ble_ts[batch->ble_count] = ts;
+    batch->ble_people[batch->ble_count] = people;
+    batch->ble_count++;
+
+    return true;
+}
+
+/* Byte string heads of the columns take 2 bytes, as counted in TELEMETRY_BATCH_COLUMN_LEN */
+_Static_assert(TELEMETRY_BATCH_MAX * sizeof(uint32_t) <= UINT8_MAX, "A batch column does not fit in a short byte string");
+
+size_t telemetry_batch_len (const telemetry_batch_t *batch) {
+    size_t co2_len = batch->co2_stats ? TELEMETRY_BATCH_CO2_LEN : TELEMETRY_BATCH_TS_LEN + sizeof(uint16_t);
+
+    return TELEMETRY_BATCH_FIXED_LEN + batch->co2_count * co2_len + batch->ble_count * TELEMETRY_BATCH_BLE_LEN;
+}
+
+size_t telemetry_encode_batch (uint8_t *buf, size_t len, const telemetry_id_t *id, const telemetry_batch_t *batch) {
+    if (batch->co2_count == 0 && batch->ble_count == 0) return 0;
+
+    /* Base timestamp, the oldest one of the batch */
+    uint32_t base_ts = UINT32_MAX;
+    for (size_t i = 0; i < batch->co2_count; i++) {
+        if (batch->co2_ts[i] < base_ts) base_ts = batch->co2_ts[i];
+    }
+    for (size_t i = 0; i < batch->ble_count; i++) {
+        if (batch->ble_ts[i] < base_ts) base_ts = batch->ble_ts[i];
+    }
+
+    uint8_t pairs = 3;  // Version, TS and ESP_ID
+    if (batch->co2_count) pairs += batch->co2_stats ? 6 : 2;
+    if (batch->ble_count) pairs += 2;
+
+    cbor_writer_t writer;
+    cbor_writer_init(&writer, buf, len);
+    uint8_t header[] = {
+        CBOR_MAP(pairs),
+        CBOR_UINT(TELEMETRY_KEY_VERSION), CBOR_UINT(TELEMETRY_SCHEMA_VERSION),
+        TELEMETRY_U32(TELEMETRY_KEY_TS),
+    };
+    _Static_assert(sizeof(header) == TELEMETRY_BATCH_HEADER_LEN, "TELEMETRY_BATCH_HEADER_LEN does not match the header");
+    telemetry_patch_u32(header, 3, base_ts);
+    cbor_writer_put(&writer, header, sizeof(header));
+
+    if (batch->co2_count) {
+        size_t n = batch->co2_count;
+        telemetry_put_column_ts(&writer, TELEMETRY_KEY_CO2_TS, batch->co2_ts, n, base_ts);
+        telemetry_put_column_u16(&writer, TELEMETRY_KEY_CO2, batch->co2_mean, n);
+        if (batch->co2_stats) {
+            telemetry_put_column_u16(&writer, TELEMETRY_KEY_CO2_MIN, batch->co2_min, n);
+            telemetry_put_column_u16(&writer, TELEMETRY_KEY_CO2_MAX, batch->co2_max, n);
+            telemetry_put_column_u16(&writer, TELEMETRY_KEY_CO2_STD, batch->co2_std, n);
+            telemetry_put_column_u16(&writer, TELEMETRY_KEY_CO2_P95, batch->co2_p95, n);
+        }
+    }
+
+    if (batch->ble_count) {
+        size_t n = batch->ble_count;
+        telemetry_put_column_ts(&writer, TELEMETRY_KEY_BLE_TS, batch->ble_ts, n, base_ts);
+        telemetry_put_column_u8(&writer, TELEMETRY_KEY_BLE_PEOPLE, batch->ble_people, n);
+    }
+
+    cbor_writer_byte(&writer, CBOR_UINT(TELEMETRY_KEY_ESP_ID));
+    cbor_writer_put(&writer, id->bytes, id->len);
+
+    return cbor_writer_finish(&writer);
+}
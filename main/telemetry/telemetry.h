@@ -0,0 +1,144 @@
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../processing/window_stats.h"
+
+/**
+ *  CBOR payloads sent over MQTT
+ *  Each message is a map with small integer keys (see the schema below). The maps
+ *  are precompiled templates with fixed-width values, so a message is built by
+ *  copying the template and patching the value bytes in place. The ESP_ID goes
+ *  last, as it is the only field whose length may change.
+ *  Several measurements can be sent together in a batch, a map whose values are
+ *  columns (CBOR typed arrays) instead of single values.
+ *  The builders do not depend on the ESP-IDF, so host tools (e.g. a virtual fleet)
+ *  can produce exactly the same bytes as the firmware
+ */
+
+/* Version of the schema, sent in every message. Increase it when the keys change */
+#define TELEMETRY_SCHEMA_VERSION    1
+
+/* Keys of the schema (the Node-RED flow maps them back to the names) */
+#define TELEMETRY_KEY_VERSION       0
+#define TELEMETRY_KEY_ESP_ID        1
+#define TELEMETRY_KEY_TS            2   // Epoch secs, 0 if the time was not set
+#define TELEMETRY_KEY_CO2           3   // Mean of the window
+#define TELEMETRY_KEY_CO2_MIN       4
+#define TELEMETRY_KEY_CO2_MAX       5
+#define TELEMETRY_KEY_CO2_STD       6
+#define TELEMETRY_KEY_CO2_P95       7
+#define TELEMETRY_KEY_BLE_PEOPLE    8
+#define TELEMETRY_KEY_CO2_TS        9   // Batches: secs from TS of each CO2 measurement
+#define TELEMETRY_KEY_BLE_TS        10  // Batches: secs from TS of each BLE measurement
+
+/* Longest ESP_ID (its length fits in the initial byte of the text string) */
+#define TELEMETRY_ESP_ID_MAX        23
+
+/* ESP_ID encoded once as a CBOR text string, appended as is to every message */
+typedef struct {
+    uint8_t len;
+    uint8_t bytes[1 + TELEMETRY_ESP_ID_MAX];
+} telemetry_id_t;
+
+/* Room needed by a single CO2 window or BLE estimation */
+#define TELEMETRY_WINDOW_LEN        64
+
+/* Measurements of each kind held by a batch */
+#define TELEMETRY_BATCH_MAX         48
+
+/**
+ *  Room needed by a batch (a full one also fits in a journal record)
+ *  Fixed part: map head, version and base TS, the ESP_ID, and the head of each
+ *  column (key, typed array tag, byte string head). Each measurement adds its
+ *  timestamp offset (32 bits at most) and its values
+ */
+#define TELEMETRY_BATCH_HEADER_LEN  (1 + 2 + 6)
+#define TELEMETRY_BATCH_ID_LEN      (1 + 1 + TELEMETRY_ESP_ID_MAX)
+#define TELEMETRY_BATCH_COLUMNS     8
+#define TELEMETRY_BATCH_COLUMN_LEN  (1 + 2 + 2)
+#define TELEMETRY_BATCH_FIXED_LEN   (TELEMETRY_BATCH_HEADER_LEN + TELEMETRY_BATCH_ID_LEN + \
+                                     TELEMETRY_BATCH_COLUMNS * TELEMETRY_BATCH_COLUMN_LEN)
+#define TELEMETRY_BATCH_TS_LEN      4
+#define TELEMETRY_BATCH_CO2_LEN     (TELEMETRY_BATCH_TS_LEN + 5 * 2)   // Mean, min, max, std, p95
+#define TELEMETRY_BATCH_BLE_LEN     (TELEMETRY_BATCH_TS_LEN + 1)
+#define TELEMETRY_BATCH_LEN         (TELEMETRY_BATCH_FIXED_LEN + \
+                                     TELEMETRY_BATCH_MAX * (TELEMETRY_BATCH_CO2_LEN + TELEMETRY_BATCH_BLE_LEN))
+
+/* Measurements waiting to be sent together, stored by columns */
+typedef struct {
+    uint16_t co2_count;
+    uint16_t ble_count;
+    uint32_t co2_ts[TELEMETRY_BATCH_MAX];
+    uint16_t co2_mean[TELEMETRY_BATCH_MAX];
+    uint16_t co2_min[TELEMETRY_BATCH_MAX];
+    uint16_t co2_max[TELEMETRY_BATCH_MAX];
+    uint16_t co2_std[TELEMETRY_BATCH_MAX];
+    uint16_t co2_p95[TELEMETRY_BATCH_MAX];
+    bool co2_stats;                     // Some window has min/max/std/p95 besides the mean
+    uint32_t ble_ts[TELEMETRY_BATCH_MAX];
+    uint8_t ble_people[TELEMETRY_BATCH_MAX];
+} telemetry_batch_t;
+
+/**
+ * @brief   Encodes an ESP_ID for the builders below
+ *
+ * @return  false if it is longer than TELEMETRY_ESP_ID_MAX
+ */
+bool telemetry_id_init (telemetry_id_t *id, const char *esp_id);
+
+/**
+ * @brief   Encodes the statistics of a CO2 window
+ *          {version, CO2, CO2_min, CO2_max, CO2_std, CO2_p95, TS, ESP_ID}
+ *
+ * @return  Length of the payload, 0 if it does not fit in "len"
+ */
+size_t telemetry_encode_co2 (uint8_t *buf, size_t len, const telemetry_id_t *id, const window_stats_result_t *co2, uint32_t ts);
+
+/**
+ * @brief   Encodes a people estimation
+ *          {version, BLE_people, TS, ESP_ID}
+ *
+ * @return  Length of the payload, 0 if it does not fit in "len"
+ */
+size_t telemetry_encode_ble (uint8_t *buf, size_t len, const telemetry_id_t *id, uint8_t people, uint32_t ts);
+
+/* Empties a batch */
+void telemetry_batch_reset (telemetry_batch_t *batch);
+
+/**
+ *  Measurements are added with the time they were taken. One without time ("ts" 0,
+ *  the clock was not set yet) is not added, it would be taken as the base TS of
+ *  the batch and push the other offsets out of range
+ */
+
+/* Adds a CO2 window measured at "ts", returns false if the batch is full or "ts" is 0 */
+bool telemetry_batch_add_co2 (telemetry_batch_t *batch, uint32_t ts, const window_stats_result_t *co2);
+
+/* Adds a CO2 value without statistics (e.g. a buffered sample), as telemetry_batch_add_co2 */
+bool telemetry_batch_add_co2_value (telemetry_batch_t *batch, uint32_t ts, uint16_t co2_ppm);
+
+/* Adds a people estimation, as telemetry_batch_add_co2 */
+bool telemetry_batch_add_ble (telemetry_batch_t *batch, uint32_t ts, uint8_t people);
+
+/* Upper bound of the encoded length of a batch (e.g. to flush it before it grows too much) */
+size_t telemetry_batch_len (const telemetry_batch_t *batch);
+
+/**
+ * @brief   Encodes a batch
+ *          {version, TS, CO2_ts[], CO2[], CO2_min[], CO2_max[], CO2_std[], CO2_p95[],
+ *           BLE_ts[], BLE_people[], ESP_ID}
+ *
+ *          TS is the oldest timestamp of the batch, the timestamps of the columns are
+ *          secs from it (uint16 typed array, or uint32 if the batch spans more than
+ *          18 hours). Columns of a kind without measurements are left out, and so
+ *          are the CO2 statistics when no window carries them
+ *
+ * @return  Length of the payload, 0 if it does not fit in "len" or the batch is empty
+ */
+size_t telemetry_encode_batch (uint8_t *buf, size_t len, const telemetry_id_t *id, const telemetry_batch_t *batch);
+
+#endif
@@ -0,0 +1,80 @@
+#include <string.h>
+#include <time.h>
+
+#include "test_util.h"
+#include "trace.h"
+#include "processing/co2_filter.h"
+
+/**
+ *  Benchmark of the CO2 filter chain
+ *  It is built once for each stage configuration (see CMakeLists.txt) and reports
+ *  the cycles and nsecs per sample. The input is the CO2 trace with a glitched
+ *  read (0xFFFF) every 500 samples, which no configuration may let through
+ */
+
+#define BENCH_SAMPLES       (4 * 1024 * 1024)
+#define BENCH_GLITCH_EVERY  500
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES()      __rdtsc()
+#else
+#define BENCH_CYCLES()      0
+#endif
+
+static uint16_t input[BENCH_SAMPLES];
+
+
+static uint64_t now_ns (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void load_input (void) {
+    trace_t trace;
+    CHECK(trace_load(TRACE_CO2, TRACE_ALL_NODES, &trace));
+
+    for (size_t i = 0; i < BENCH_SAMPLES; i++) {
+        input[i] = trace.len ? trace.points[i % trace.len].value : 400 + i % 7;
+        if (i % BENCH_GLITCH_EVERY == BENCH_GLITCH_EVERY - 1) input[i] = 0xFFFF;
+    }
+
+    trace_free(&trace);
+}
+
+int main (void) {
+    co2_filter_t filter;
+    uint16_t out;
+    uint32_t accepted = 0, glitches = 0;
+    uint32_t dt_ms = 0;
+    uint32_t checksum = 0;
+
+    load_input();
+    co2_filter_init(&filter);
+
+    uint64_t start_ns = now_ns();
+    uint64_t start_cycles = BENCH_CYCLES();
+
+    for (size_t i = 0; i < BENCH_SAMPLES; i++) {
+        dt_ms += 1000;
+        if (co2_filter_apply(&filter, input[i], dt_ms, &out)) {
+            dt_ms = 0;
+            accepted++;
+            checksum += out;
+            if (out > CO2_FILTER_MAX_VALID_PPM) glitches++;
+        }
+    }
+
+    uint64_t cycles = BENCH_CYCLES() - start_cycles;
+    uint64_t ns = now_ns() - start_ns;
+
+    printf("%-12s %6.1f cycles/sample %6.2f ns/sample  %3u bytes of state  %.1f%% accepted  (%08x)\n",
+           FILTER_STAGES, (double)cycles / BENCH_SAMPLES, (double)ns / BENCH_SAMPLES,
+           (unsigned)sizeof(co2_filter_t), 100.0 * accepted / BENCH_SAMPLES, (unsigned)checksum);
+
+    CHECK_EQ(glitches, 0);
+    CHECK(accepted >= BENCH_SAMPLES - BENCH_SAMPLES / BENCH_GLITCH_EVERY - BENCH_SAMPLES / 100);
+
+    return TEST_RESULT();
+}
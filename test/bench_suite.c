@@ -0,0 +1,411 @@
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "test_util.h"
+#include "trace.h"
+#include "sleep_schedule.h"
+#include "communications/ble_addr_set.h"
+#include "communications/mqtt_topic.h"
+#include "telemetry/telemetry.h"
+
+/**
+ *  Benchmarks of the hot paths of the firmware
+ *  Each benchmark reports the nsecs, heap allocations and heap bytes per operation,
+ *  and the bytes it produces (e.g. the payload) per operation. The inputs come from
+ *  the traces and from a fixed-seed generator, so every run does the same work.
+ *  The results are compared with test/bench_baseline.txt: the allocations and the
+ *  bytes must match it exactly, the time must stay below BENCH_NS_TOLERANCE times
+ *  the baseline. "bench_suite --update" writes the current results as the baseline
+ *
+ *  The BLE set is built for 10,000 devices (see CMakeLists.txt), beyond the range
+ *  of CONFIG_MAX_BLE_DEVICES, to show how the deduplication scales. The list it
+ *  replaced (a node malloc'ed per advertisement, compared with every address found
+ *  before) runs on the same scans for reference
+ */
+
+/* A result is slower than its baseline if it takes longer than this factor */
+#define BENCH_NS_TOLERANCE      3.0
+
+/* Advertisements received from each device during a scan */
+#define BENCH_BLE_ADVERTS       8
+
+#define BENCH_MAX_RESULTS       32
+
+typedef struct {
+    char name[32];
+    double ns;              // Per operation
+    double allocs;
+    double heap_bytes;
+    double out_bytes;
+} bench_result_t;
+
+static bench_result_t results[BENCH_MAX_RESULTS];
+static size_t num_results;
+
+/* Sink, so the compiler keeps the work of the benchmarks */
+static volatile uint64_t bench_sink;
+
+
+/* ----------------- ALLOCATION COUNTER ---------------- */
+/* The bench is linked with --wrap for the allocator, every call from the code under test lands here */
+void *__real_malloc (size_t size);
+void *__real_calloc (size_t n, size_t size);
+void *__real_realloc (void *ptr, size_t size);
+
+static uint64_t heap_allocs, heap_bytes;
+
+void *__wrap_malloc (size_t size) {
+    heap_allocs++;
+    heap_bytes += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc (size_t n, size_t size) {
+    heap_allocs++;
+    heap_bytes += n * size;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc (void *ptr, size_t size) {
+    heap_allocs++;
+    heap_bytes += size;
+    return __real_realloc(ptr, size);
+}
+
+
+/* ------------------------ BENCH ---------------------- */
+static uint64_t now_ns (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* xorshift32, the same sequence on every run */
+static uint32_t bench_rand_state;
+
+static void bench_rand_seed (uint32_t seed) {
+    bench_rand_state = seed;
+}
+
+static uint32_t bench_rand (void) {
+    bench_rand_state ^= bench_rand_state << 13;
+    bench_rand_state ^= bench_rand_state >> 17;
+    bench_rand_state ^= bench_rand_state << 5;
+    return bench_rand_state;
+}
+
+typedef struct {
+    uint64_t start_ns;
+    uint64_t allocs;
+    uint64_t bytes;
+} bench_mark_t;
+
+static void bench_start (bench_mark_t *mark) {
+    mark->allocs = heap_allocs;
+    mark->bytes = heap_bytes;
+    mark->start_ns = now_ns();
+}
+
+static void bench_stop (const bench_mark_t *mark, const char *name, uint64_t ops, uint64_t out_bytes) {
+    uint64_t ns = now_ns() - mark->start_ns;
+    bench_result_t *result = &results[num_results++];
+
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->ns = (double)ns / ops;
+    result->allocs = (double)(heap_allocs - mark->allocs) / ops;
+    result->heap_bytes = (double)(heap_bytes - mark->bytes) / ops;
+    result->out_bytes = (double)out_bytes / ops;
+}
+
+
+/* ------------------------ CBOR ----------------------- */
+#define BENCH_CBOR_OPS      (1 << 20)
+
+static uint16_t co2_values[1024];
+
+static void bench_cbor (void) {
+    telemetry_id_t id;
+    uint8_t buf[TELEMETRY_BATCH_LEN];
+    uint64_t out = 0;
+    bench_mark_t mark;
+
+    telemetry_id_init(&id, "bench-node-01");
+
+    trace_t trace;
+    CHECK(trace_load(TRACE_CO2, TRACE_ALL_NODES, &trace));
+    for (size_t i = 0; i < 1024; i++) co2_values[i] = trace.len ? trace.points[i % trace.len].value : 400 + i % 64;
+    trace_free(&trace);
+
+    bench_start(&mark);
+    for (uint32_t i = 0; i < BENCH_CBOR_OPS; i++) {
+        uint16_t value = co2_values[i % 1024];
+        const window_stats_result_t window = {
+            .mean = value, .min = value - 7, .max = value + 9, .stddev = 3 + i % 5, .quantile = value + 6,
+        };
+        out += telemetry_encode_co2(buf, sizeof(buf), &id, &window, 1643887697 + i * 60);
+    }
+    bench_stop(&mark, "cbor_co2", BENCH_CBOR_OPS, out);
+
+    out = 0;
+    bench_start(&mark);
+    for (uint32_t i = 0; i < BENCH_CBOR_OPS; i++) {
+        out += telemetry_encode_ble(buf, sizeof(buf), &id, i % 40, 1643887697 + i * 900);
+    }
+    bench_stop(&mark, "cbor_ble", BENCH_CBOR_OPS, out);
+
+    /* A full batch, as the coalescer flushes it */
+    telemetry_batch_t batch;
+    telemetry_batch_reset(&batch);
+    for (uint32_t i = 0; i < TELEMETRY_BATCH_MAX; i++) {
+        uint16_t value = co2_values[i];
+        const window_stats_result_t window = {
+            .mean = value, .min = value - 7, .max = value + 9, .stddev = 3 + i % 5, .quantile = value + 6,
+        };
+        telemetry_batch_add_co2(&batch, 1643887697 + i * 60, &window);
+        telemetry_batch_add_ble(&batch, 1643887697 + i * 60, i % 40);
+    }
+
+    out = 0;
+    bench_start(&mark);
+    for (uint32_t i = 0; i < BENCH_CBOR_OPS / 64; i++) {
+        out += telemetry_encode_batch(buf, sizeof(buf), &id, &batch);
+    }
+    bench_stop(&mark, "cbor_batch", BENCH_CBOR_OPS / 64, out);
+    CHECK(out > 0);
+}
+
+
+/* ------------------------ TOPIC ---------------------- */
+#define BENCH_TOPIC_OPS     (1 << 20)
+#define BENCH_TOPICS        64
+
+static void bench_topic (void) {
+    static char locations[BENCH_TOPICS][95], ids[BENCH_TOPICS][24];
+    mqtt_topic_t topic;
+    uint64_t out = 0;
+    bench_mark_t mark;
+
+    /* Locations of 2 to 6 levels, as "building/floor/room/" */
+    bench_rand_seed(0x70C1C);
+    for (int i = 0; i < BENCH_TOPICS; i++) {
+        int levels = 2 + bench_rand() % 5, len = 0;
+        for (int l = 0; l < levels; l++) len += sprintf(locations[i] + len, "level%u/", (unsigned)(bench_rand() % 1000));
+        sprintf(ids[i], "ESP-%08X", (unsigned)bench_rand());
+    }
+
+    bench_start(&mark);
+    for (uint32_t i = 0; i < BENCH_TOPIC_OPS; i++) {
+        if (mqtt_topic_init(&topic, locations[i % BENCH_TOPICS], ids[i % BENCH_TOPICS]) == ESP_OK) {
+            out += strlen(topic.name);
+        }
+    }
+    bench_stop(&mark, "topic_init", BENCH_TOPIC_OPS, out);
+}
+
+
+/* ------------------------ RANGE ---------------------- */
+#define BENCH_RANGE_ROUNDS  256
+
+static void bench_range (void) {
+    struct tm node_time = {0};
+    uint64_t sum = 0, ops = 0;
+    bench_mark_t mark;
+
+    /* Every minute of the day, to every hour */
+    bench_start(&mark);
+    for (int round = 0; round < BENCH_RANGE_ROUNDS; round++) {
+        for (int minute = 0; minute < 24 * 60; minute++) {
+            node_time.tm_hour = minute / 60;
+            node_time.tm_min = minute % 60;
+            for (int limit_hr = 0; limit_hr < 24; limit_hr++) {
+                sum += calculate_range_us(node_time, limit_hr);
+                ops++;
+            }
+        }
+    }
+    bench_stop(&mark, "calculate_range_us", ops, 0);
+    bench_sink += sum;
+
+    /* Known values: the hour itself waits until its end */
+    node_time.tm_hour = 7;
+    node_time.tm_min = 59;
+    CHECK_EQ(calculate_range_us(node_time, 8), 60 * 1000000ll);
+    CHECK_EQ(calculate_range_us(node_time, 7), 1 * 60 * 1000000ll);
+    CHECK_EQ(calculate_range_us(node_time, 6), (22 * 60 + 1) * 60 * 1000000ll);
+}
+
+
+/* ------------------------ BLE ------------------------ */
+typedef struct ble_list_elem {
+    uint8_t addr[BLE_ADDR_LEN];
+    struct ble_list_elem *prev;
+} ble_list_elem_t;
+
+/* The list used before the set: a node per advertisement, a full walk to find duplicates */
+static int ble_list_add (ble_list_elem_t **list, const uint8_t addr[BLE_ADDR_LEN]) {
+    ble_list_elem_t *elem = malloc(sizeof(ble_list_elem_t));
+    memcpy(elem->addr, addr, BLE_ADDR_LEN);
+
+    for (ble_list_elem_t *found = *list; found; found = found->prev) {
+        if (memcmp(found->addr, addr, BLE_ADDR_LEN) == 0) {
+            free(elem);
+            return 0;
+        }
+    }
+
+    elem->prev = *list;
+    *list = elem;
+    return 1;
+}
+
+static void ble_list_clear (ble_list_elem_t **list) {
+    while (*list) {
+        ble_list_elem_t *elem = *list;
+        *list = elem->prev;
+        free(elem);
+    }
+}
+
+static void bench_ble (uint32_t devices) {
+    static ble_addr_set_t set;
+    uint8_t (*adverts)[BLE_ADDR_LEN] = malloc((size_t)devices * BENCH_BLE_ADVERTS * BLE_ADDR_LEN);
+    uint32_t num_adverts = devices * BENCH_BLE_ADVERTS;
+    char name[32];
+    bench_mark_t mark;
+
+    /* Each device advertises several times, in random order */
+    bench_rand_seed(0xB1E0 + devices);
+    for (uint32_t d = 0; d < devices; d++) {
+        uint8_t addr[BLE_ADDR_LEN];
+        for (int b = 0; b < BLE_ADDR_LEN; b++) addr[b] = bench_rand();
+        addr[0] = d;
+        addr[1] = d >> 8;
+        for (int a = 0; a < BENCH_BLE_ADVERTS; a++) memcpy(adverts[d * BENCH_BLE_ADVERTS + a], addr, BLE_ADDR_LEN);
+    }
+    for (uint32_t i = num_adverts - 1; i > 0; i--) {
+        uint32_t j = bench_rand() % (i + 1);
+        uint8_t tmp[BLE_ADDR_LEN];
+        memcpy(tmp, adverts[i], BLE_ADDR_LEN);
+        memcpy(adverts[i], adverts[j], BLE_ADDR_LEN);
+        memcpy(adverts[j], tmp, BLE_ADDR_LEN);
+    }
+
+    /* Enough scans to take some time, the quadratic list gets fewer */
+    uint32_t scans = 4000000 / num_adverts + 1;
+    uint32_t list_scans = 40000000 / ((uint64_t)num_adverts * devices) + 1;
+    uint32_t count = 0;
+
+    snprintf(name, sizeof(name), "ble_set_%u", (unsigned)devices);
+    bench_start(&mark);
+    for (uint32_t s = 0; s < scans; s++) {
+        ble_addr_set_clear(&set);
+        for (uint32_t i = 0; i < num_adverts; i++) ble_addr_set_add(&set, adverts[i]);
+        count = ble_addr_set_count(&set);
+    }
+    bench_stop(&mark, name, (uint64_t)scans * num_adverts, 0);
+    CHECK_EQ(count, devices);
+
+    ble_list_elem_t *list = NULL;
+    snprintf(name, sizeof(name), "ble_list_%u", (unsigned)devices);
+    bench_start(&mark);
+    for (uint32_t s = 0; s < list_scans; s++) {
+        count = 0;
+        for (uint32_t i = 0; i < num_adverts; i++) count += ble_list_add(&list, adverts[i]);
+        ble_list_clear(&list);
+    }
+    bench_stop(&mark, name, (uint64_t)list_scans * num_adverts, 0);
+    CHECK_EQ(count, devices);
+
+    free(adverts);
+}
+
+
+/* ---------------------- BASELINE --------------------- */
+static const bench_result_t *find_result (const bench_result_t *list, size_t n, const char *name) {
+    for (size_t i = 0; i < n; i++) {
+        if (strcmp(list[i].name, name) == 0) return &list[i];
+    }
+    return NULL;
+}
+
+static size_t load_baseline (bench_result_t *baseline) {
+    FILE *file = fopen(BENCH_BASELINE, "r");
+    char line[160];
+    size_t n = 0;
+    if (file == NULL) return 0;
+
+    while (n < BENCH_MAX_RESULTS && fgets(line, sizeof(line), file)) {
+        bench_result_t *b = &baseline[n];
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%31s %lf %lf %lf %lf", b->name, &b->ns, &b->allocs, &b->heap_bytes, &b->out_bytes) == 5) n++;
+    }
+    fclose(file);
+
+    return n;
+}
+
+static void store_baseline (void) {
+    FILE *file = fopen(BENCH_BASELINE, "w");
+    CHECK(file != NULL);
+    if (file == NULL) return;
+
+    fprintf(file, "# name ns/op allocs/op heap_bytes/op out_bytes/op (written by bench_suite --update)\n");
+    for (size_t i = 0; i < num_results; i++) {
+        const bench_result_t *r = &results[i];
+        fprintf(file, "%s %.2f %.2f %.2f %.2f\n", r->name, r->ns, r->allocs, r->heap_bytes, r->out_bytes);
+    }
+    fclose(file);
+    printf("Baseline written to %s\n", BENCH_BASELINE);
+}
+
+/* The allocations and bytes are exact, a difference is a change of behaviour */
+static bool same (double a, double b) {
+    return a - b < 0.005 && b - a < 0.005;
+}
+
+static void compare_baseline (void) {
+    static bench_result_t baseline[BENCH_MAX_RESULTS];
+    size_t n = load_baseline(baseline);
+
+    printf("%-20s %10s %10s %10s %12s %12s\n", "benchmark", "ns/op", "baseline", "allocs/op", "heap B/op", "out B/op");
+    for (size_t i = 0; i < num_results; i++) {
+        const bench_result_t *r = &results[i];
+        const bench_result_t *b = find_result(baseline, n, r->name);
+        const char *verdict = "";
+
+        if (b == NULL) {
+            verdict = "  (no baseline)";
+        } else if (!same(r->allocs, b->allocs) || !same(r->heap_bytes, b->heap_bytes) || !same(r->out_bytes, b->out_bytes)) {
+            verdict = "  CHANGED";
+            test_failures++;
+        } else if (r->ns > b->ns * BENCH_NS_TOLERANCE) {
+            verdict = "  SLOWER";
+            test_failures++;
+        }
+
+        printf("%-20s %10.2f %10.2f %10.2f %12.2f %12.2f%s\n", r->name, r->ns, b ? b->ns : 0.0,
+               r->allocs, r->heap_bytes, r->out_bytes, verdict);
+    }
+}
+
+int main (int argc, char **argv) {
+    bool update = argc > 1 && strcmp(argv[1], "--update") == 0;
+
+    bench_cbor();
+    bench_topic();
+    bench_range();
+    for (uint32_t devices = 10; devices <= 10000; devices *= 10) bench_ble(devices);
+
+    printf("BLE set of %u devices: %u bytes\n", CONFIG_MAX_BLE_DEVICES, (unsigned)sizeof(ble_addr_set_t));
+
+    /* Nothing on the hot paths of the firmware touches the heap */
+    for (size_t i = 0; i < num_results; i++) {
+        if (strncmp(results[i].name, "ble_list_", 9) != 0) CHECK_EQ(results[i].allocs * 100, 0);
+    }
+
+    if (update) store_baseline();
+    else compare_baseline();
+
+    return TEST_RESULT();
+}
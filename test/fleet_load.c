@@ -0,0 +1,407 @@
+#include <errno.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "sdkconfig.h"
+#include "trace.h"
+#include "mqtt_lite.h"
+#include "communications/mqtt_topic.h"
+#include "telemetry/telemetry.h"
+
+/**
+ *  Load generator of a virtual fleet
+ *  N nodes, each with its own MQTT connection to a local broker, publish the
+ *  telemetry of the traces with the builders of the firmware (telemetry.c and
+ *  mqtt_topic.c), so the broker and the ingest get exactly the bytes of real
+ *  nodes. Node i replays the CO2 and BLE traces from its own offset, one message
+ *  every CONFIG_MQTT_SENDING_PERIOD_SEC of virtual time, with a BLE estimation
+ *  every CONFIG_BLE_ESTIMATION_PERIOD_SEC. A subscriber on the fleet topics plays
+ *  the ingest (e.g. the Node-RED flow) and times every message from its publish
+ *  to its arrival, matched by the TS of the payload.
+ *  The offered rate doubles at every step. Each step reports the delivered rate
+ *  and the latency percentiles, and the fleet saturates the broker at the first
+ *  step where less than 95% of the offered messages arrive in time or the p99
+ *  goes beyond the limit. It is a tool, not a test: it needs a broker, e.g.
+ *      mosquitto -p 1883 &
+ *      build-test/fleet_load -n 200 -r 100 -m 50000
+ */
+
+#define FLEET_TOPIC_LOCATION    "fleet/"
+#define FLEET_BASE_TS           1643887697u
+
+/* Publish times kept per node, to match the arrivals */
+#define FLEET_RING              1024
+
+/* Time given to the last messages of a step to arrive */
+#define FLEET_DRAIN_MS          2000
+
+typedef struct {
+    int fd;
+    mqtt_topic_t topic;
+    telemetry_id_t id;
+    size_t co2_offset;
+    size_t ble_offset;
+    uint32_t seq;                       // Messages published
+    uint16_t packet_id;
+    uint64_t sent_ns[FLEET_RING];       // By seq
+} fleet_node_t;
+
+typedef struct {
+    const char *host;
+    const char *port;
+    uint32_t nodes;
+    uint32_t first_rate;
+    uint32_t max_rate;
+    uint32_t step_s;
+    int qos;
+    uint32_t max_p99_ms;
+} fleet_config_t;
+
+typedef struct {
+    uint64_t offered;
+    uint64_t sent;
+    uint64_t delivered;
+    uint64_t bytes;
+    uint32_t *latency_us;
+    size_t latency_len;
+    size_t latency_max;
+} fleet_step_t;
+
+static fleet_node_t *nodes;
+static uint32_t num_nodes;
+static trace_t co2_trace, ble_trace;
+static uint32_t ble_every;
+
+
+static uint64_t now_ns (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/* ------------------------ MQTT ----------------------- */
+static bool send_all (int fd, const uint8_t *data, size_t len) {
+    while (len) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Reads whole packets until one of type "type" arrives */
+static bool wait_packet (int fd, uint8_t type) {
+    uint8_t buf[64];
+    size_t len = 0;
+
+    while (1) {
+        ssize_t n = recv(fd, buf + len, sizeof(buf) - len, 0);
+        if (n <= 0) return false;
+        len += n;
+
+        mqtt_lite_packet_t packet;
+        size_t packet_len;
+        while ((packet_len = mqtt_lite_parse(buf, len, &packet)) > 0) {
+            if (packet.type == type) return true;
+            memmove(buf, buf + packet_len, len - packet_len);
+            len -= packet_len;
+        }
+        if (len == sizeof(buf)) return false;
+    }
+}
+
+static int mqtt_open (const fleet_config_t *config, const char *client_id) {
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM }, *addr;
+    if (getaddrinfo(config->host, config->port, &hints, &addr) != 0) return -1;
+
+    int fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    if (fd >= 0 && connect(fd, addr->ai_addr, addr->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addr);
+    if (fd < 0) return -1;
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    uint8_t buf[128];
+    if (!send_all(fd, buf, mqtt_lite_connect(buf, client_id)) || !wait_packet(fd, MQTT_LITE_CONNACK)) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+/* ------------------------ FLEET ---------------------- */
+/* Value of the TS key of a single (not batch) message, or 0 */
+static uint32_t payload_ts (const uint8_t *p, size_t len) {
+    const uint8_t *end = p + len;
+    if (len == 0 || (*p & 0xe0) != 0xa0) return 0;
+
+    for (int pairs = *p++ & 0x1f; pairs > 0 && p + 1 < end; pairs--) {
+        uint8_t key = *p++;
+        uint8_t major = *p >> 5, info = *p++ & 0x1f;
+        uint32_t value = info;
+
+        if (info >= 24 && info <= 26) {
+            size_t n = (size_t)1 << (info - 24);
+            if (p + n > end) return 0;
+            for (value = 0; n; n--) value = value << 8 | *p++;
+        }
+        if (major == 3) p += value;         // Text string (ESP_ID)
+        else if (major != 0) return 0;
+
+        if (key == TELEMETRY_KEY_TS) return value;
+    }
+
+    return 0;
+}
+
+/* Publishes the next message of a node, as its sgp30_task or ble_task would */
+static bool fleet_publish (const fleet_config_t *config, fleet_node_t *node, fleet_step_t *step) {
+    uint8_t payload[TELEMETRY_WINDOW_LEN];
+    uint32_t seq = node->seq;
+    uint32_t ts = FLEET_BASE_TS + seq * CONFIG_MQTT_SENDING_PERIOD_SEC;
+    size_t len;
+
+    if (seq % ble_every == ble_every - 1) {
+        uint8_t people = ble_trace.points[(node->ble_offset + seq / ble_every) % ble_trace.len].value;
+        len = telemetry_encode_ble(payload, sizeof(payload), &node->id, people, ts);
+    } else {
+        uint16_t co2 = co2_trace.points[(node->co2_offset + seq) % co2_trace.len].value;
+        const window_stats_result_t window = {
+            .mean = co2, .min = co2 - 4, .max = co2 + 6, .stddev = 3, .quantile = co2 + 5, .count = CONFIG_MQTT_SENDING_PERIOD_SEC,
+        };
+        len = telemetry_encode_co2(payload, sizeof(payload), &node->id, &window, ts);
+    }
+
+    if (++node->packet_id == 0) node->packet_id = 1;
+    uint8_t packet[MQTT_LITE_HEADER_MAX + TELEMETRY_WINDOW_LEN];
+    size_t header_len = mqtt_lite_publish_header(packet, node->topic.name, len, config->qos, node->packet_id);
+    memcpy(packet + header_len, payload, len);
+
+    node->sent_ns[seq % FLEET_RING] = now_ns();
+    if (!send_all(node->fd, packet, header_len + len)) return false;
+
+    node->seq++;
+    step->sent++;
+    step->bytes += len;
+    return true;
+}
+
+/* Matches a message received by the ingest with its publish */
+static void fleet_arrival (const mqtt_lite_packet_t *packet, fleet_step_t *step) {
+    const char *id = memchr(packet->topic, '-', packet->topic_len);
+    uint32_t ts = payload_ts(packet->payload, packet->payload_len);
+    if (id == NULL || ts < FLEET_BASE_TS) return;
+
+    uint32_t index = 0;
+    for (const char *c = id + 1; c < (const char *)packet->topic + packet->topic_len; c++) index = index * 10 + (*c - '0');
+    if (index >= num_nodes) return;
+
+    uint32_t seq = (ts - FLEET_BASE_TS) / CONFIG_MQTT_SENDING_PERIOD_SEC;
+
+    fleet_node_t *node = &nodes[index];
+    if (seq >= node->seq || node->seq - seq > FLEET_RING) return;
+
+    step->delivered++;
+    if (step->latency_len < step->latency_max) {
+        step->latency_us[step->latency_len++] = (now_ns() - node->sent_ns[seq % FLEET_RING]) / 1000;
+    }
+}
+
+/* Reads what the ingest got, returns false if the connection was lost */
+static bool fleet_ingest (int fd, const fleet_config_t *config, fleet_step_t *step) {
+    static uint8_t buf[256 * 1024];
+    static size_t len;
+
+    ssize_t n = recv(fd, buf + len, sizeof(buf) - len, MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) return false;
+    if (n > 0) len += n;
+
+    mqtt_lite_packet_t packet;
+    size_t packet_len, used = 0;
+    while ((packet_len = mqtt_lite_parse(buf + used, len - used, &packet)) > 0) {
+        if (packet.type == MQTT_LITE_PUBLISH) {
+            fleet_arrival(&packet, step);
+            if (config->qos) {
+                uint8_t ack[4];
+                send_all(fd, ack, mqtt_lite_puback(ack, packet.packet_id));
+            }
+        }
+        used += packet_len;
+    }
+    memmove(buf, buf + used, len - used);
+    len -= used;
+
+    return true;
+}
+
+/* PUBACKs of the nodes (qos 1) are read and dropped, so their sockets never fill up */
+static void fleet_drain_acks (const fleet_config_t *config) {
+    uint8_t buf[4096];
+
+    for (uint32_t i = 0; i < config->nodes; i++) {
+        while (recv(nodes[i].fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) {}
+    }
+}
+
+static int cmp_u32 (const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile_ms (const fleet_step_t *step, double p) {
+    if (step->latency_len == 0) return 0;
+    return step->latency_us[(size_t)(p * (step->latency_len - 1))] / 1000.0;
+}
+
+/* Offers "rate" msgs/s for "secs", spread over the nodes in turns */
+static bool fleet_step (const fleet_config_t *config, int ingest_fd, uint32_t rate, fleet_step_t *step) {
+    uint64_t start = now_ns(), last_drain = start;
+    uint64_t duration = (uint64_t)config->step_s * 1000000000;
+    uint64_t end = start + duration + (uint64_t)FLEET_DRAIN_MS * 1000000;
+    struct pollfd pfd = { .fd = ingest_fd, .events = POLLIN };
+
+    uint64_t now;
+    while ((now = now_ns()) < end) {
+        if (now - start < duration) {
+            uint64_t due = (uint64_t)rate * (now - start) / 1000000000;
+            while (step->offered < due) {
+                fleet_node_t *node = &nodes[step->offered++ % config->nodes];
+                if (!fleet_publish(config, node, step)) return false;
+
+                /* A late schedule is sent in slices, the ingest is read in between */
+                if (now_ns() - now > 1000000) break;
+            }
+        }
+
+        if (poll(&pfd, 1, 1) > 0 && !fleet_ingest(ingest_fd, config, step)) return false;
+
+        if (config->qos && now - last_drain > 100000000) {
+            fleet_drain_acks(config);
+            last_drain = now;
+        }
+    }
+
+    /* Messages offered by the schedule, whether the generator could send them or not */
+    step->offered = (uint64_t)rate * config->step_s;
+    qsort(step->latency_us, step->latency_len, sizeof(uint32_t), cmp_u32);
+    return true;
+}
+
+static void usage (void) {
+    printf("fleet_load [-h host] [-p port] [-n nodes] [-r first rate] [-m max rate] [-d step secs] [-q qos] [-l max p99 ms]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main (int argc, char **argv) {
+    fleet_config_t config = {
+        .host = "localhost", .port = "1883", .nodes = 100, .first_rate = 100, .max_rate = 100000,
+        .step_s = 10, .qos = 0, .max_p99_ms = 1000,
+    };
+    int opt;
+
+    while ((opt = getopt(argc, argv, "h:p:n:r:m:d:q:l:")) != -1) {
+        switch (opt) {
+            case 'h': config.host = optarg; break;
+            case 'p': config.port = optarg; break;
+            case 'n': config.nodes = atoi(optarg); break;
+            case 'r': config.first_rate = atoi(optarg); break;
+            case 'm': config.max_rate = atoi(optarg); break;
+            case 'd': config.step_s = atoi(optarg); break;
+            case 'q': config.qos = atoi(optarg) ? 1 : 0; break;
+            case 'l': config.max_p99_ms = atoi(optarg); break;
+            default: usage();
+        }
+    }
+    if (config.nodes == 0 || config.first_rate == 0 || config.step_s == 0) usage();
+
+    if (!trace_load(TRACE_CO2, TRACE_ALL_NODES, &co2_trace) || !trace_load(TRACE_BLE, TRACE_ALL_NODES, &ble_trace) ||
+        co2_trace.len == 0 || ble_trace.len == 0) {
+        printf("Traces not found in %s\n", TRACES_DIR);
+        return EXIT_FAILURE;
+    }
+    ble_every = CONFIG_BLE_ESTIMATION_PERIOD_SEC / CONFIG_MQTT_SENDING_PERIOD_SEC;
+    if (ble_every < 1) ble_every = 1;
+
+    /* The ingest subscribes before any node publishes */
+    int ingest_fd = mqtt_open(&config, "fleet-ingest");
+    uint8_t buf[MQTT_LITE_HEADER_MAX];
+    if (ingest_fd < 0 || !send_all(ingest_fd, buf, mqtt_lite_subscribe(buf, FLEET_TOPIC_LOCATION "#", config.qos, 1)) ||
+        !wait_packet(ingest_fd, MQTT_LITE_SUBACK)) {
+        printf("Cannot subscribe at %s:%s\n", config.host, config.port);
+        return EXIT_FAILURE;
+    }
+
+    num_nodes = config.nodes;
+    nodes = calloc(config.nodes, sizeof(fleet_node_t));
+    for (uint32_t i = 0; i < config.nodes; i++) {
+        char esp_id[24];
+        snprintf(esp_id, sizeof(esp_id), "node-%05u", (unsigned)i);
+        telemetry_id_init(&nodes[i].id, esp_id);
+        mqtt_topic_init(&nodes[i].topic, FLEET_TOPIC_LOCATION, esp_id);
+        nodes[i].co2_offset = (size_t)i * 7919 % co2_trace.len;
+        nodes[i].ble_offset = (size_t)i * 131 % ble_trace.len;
+
+        if ((nodes[i].fd = mqtt_open(&config, esp_id)) < 0) {
+            printf("Connection %u refused by the broker\n", (unsigned)i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("%u nodes, qos %d, steps of %u s, saturated below 95%% delivered or p99 above %u ms\n",
+           (unsigned)config.nodes, config.qos, (unsigned)config.step_s, (unsigned)config.max_p99_ms);
+    printf("%10s %10s %10s %8s %10s %10s %10s %10s\n", "offered/s", "sent/s", "ingest/s", "lost", "p50 ms", "p90 ms", "p99 ms", "bytes/msg");
+
+    uint32_t last_ok = 0, saturation = 0;
+    for (uint64_t rate = config.first_rate; rate <= config.max_rate; rate *= 2) {
+        fleet_step_t step = { .latency_max = rate * config.step_s + 1024 };
+        step.latency_us = malloc(step.latency_max * sizeof(uint32_t));
+
+        bool ok = fleet_step(&config, ingest_fd, rate, &step);
+        double p99 = percentile_ms(&step, 0.99);
+        printf("%10u %10.0f %10.0f %8llu %10.2f %10.2f %10.2f %10.1f\n", (unsigned)rate,
+               (double)step.sent / config.step_s, (double)step.delivered / config.step_s,
+               (unsigned long long)(step.sent - step.delivered), percentile_ms(&step, 0.5),
+               percentile_ms(&step, 0.9), p99, step.sent ? (double)step.bytes / step.sent : 0);
+        free(step.latency_us);
+
+        if (!ok) {
+            printf("Connection lost at %u msgs/s\n", (unsigned)rate);
+            saturation = rate;
+            break;
+        }
+        if (step.delivered * 100 < step.offered * 95 || p99 > config.max_p99_ms) {
+            saturation = rate;
+            break;
+        }
+        last_ok = rate;
+    }
+
+    if (saturation) printf("Saturation between %u and %u msgs/s (%u nodes)\n", (unsigned)last_ok, (unsigned)saturation, (unsigned)config.nodes);
+    else printf("Not saturated up to %u msgs/s\n", (unsigned)last_ok);
+
+    for (uint32_t i = 0; i < config.nodes; i++) close(nodes[i].fd);
+    close(ingest_fd);
+    free(nodes);
+    trace_free(&co2_trace);
+    trace_free(&ble_trace);
+
+    return EXIT_SUCCESS;
+}
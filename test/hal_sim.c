@@ -0,0 +1,49 @@
+#include "hal_sim.h"
+
+
+hal_sim_stats_t hal_sim_stats;
+
+static int64_t sim_time_us;
+static uint32_t sim_boot_epoch_s;
+static hal_sim_ble_source_t sim_ble_source;
+
+
+void hal_sim_reset (uint32_t epoch_s, hal_sim_ble_source_t ble_source) {
+    sim_time_us = 0;
+    sim_boot_epoch_s = epoch_s;
+    sim_ble_source = ble_source;
+    hal_sim_stats = (hal_sim_stats_t){0};
+}
+
+void hal_sim_advance_to (int64_t us) {
+    if (us > sim_time_us) sim_time_us = us;
+}
+
+int64_t hal_time_us (void) {
+    return sim_time_us;
+}
+
+uint32_t hal_epoch_s (void) {
+    return sim_boot_epoch_s ? sim_boot_epoch_s + (uint32_t)(sim_time_us / 1000000) : 0;
+}
+
+void hal_delay_us (int64_t us) {
+    if (us > 0) sim_time_us += us;
+}
+
+int hal_publish (const uint8_t *data, size_t len) {
+    (void)data;
+
+    hal_sim_stats.messages++;
+    hal_sim_stats.bytes += len;
+    if (len > hal_sim_stats.max_len) hal_sim_stats.max_len = len;
+
+    return 0;
+}
+
+/* The scan runs in its own task on the node, so it does not take simulated time here */
+uint8_t hal_ble_scan (int duration_s) {
+    (void)duration_s;
+
+    return sim_ble_source ? sim_ble_source(hal_epoch_s()) : 0;
+}
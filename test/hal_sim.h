@@ -0,0 +1,33 @@
+#ifndef HAL_SIM_H_
+#define HAL_SIM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hal/hal.h"
+
+/**
+ *  Host backend of the HAL (see hal/hal.h)
+ *  Time is simulated: it only moves forward with hal_delay_us() and
+ *  hal_sim_advance_to(), so a trace is replayed as fast as the code runs.
+ *  Published messages are counted and dropped
+ */
+
+typedef struct {
+    uint32_t messages;
+    uint64_t bytes;
+    size_t max_len;
+} hal_sim_stats_t;
+
+/* Source of the people estimations, by wall time */
+typedef uint8_t (*hal_sim_ble_source_t)(uint32_t epoch_s);
+
+extern hal_sim_stats_t hal_sim_stats;
+
+/* Restarts the clock at 0 usecs since boot, "epoch_s" of wall time (0: not set) */
+void hal_sim_reset (uint32_t epoch_s, hal_sim_ble_source_t ble_source);
+
+/* Moves the clock forward to "us" since boot */
+void hal_sim_advance_to (int64_t us);
+
+#endif
@@ -0,0 +1,88 @@
+#include "mock_bus.h"
+
+#include <string.h>
+
+
+static void mock_bus_log (mock_bus_t *mock, uint8_t addr, bool write, const uint8_t *data, size_t len) {
+    if (mock->num_ops < MOCK_BUS_MAX_LOG) {
+        mock_bus_op_t *op = &mock->log[mock->num_ops];
+        op->addr = addr;
+        op->write = write;
+        op->len = len;
+        if (len) memcpy(op->data, data, len < MOCK_BUS_MAX_DATA ? len : MOCK_BUS_MAX_DATA);
+    }
+    mock->num_ops++;
+}
+
+/* Device answering at "addr" with the current mux selection, if any */
+static mock_bus_device_t *mock_bus_find (mock_bus_t *mock, uint8_t addr) {
+    for (size_t i = 0; i < mock->num_devices; i++) {
+        mock_bus_device_t *device = &mock->devices[i];
+        if (device->addr != addr) continue;
+
+        if (device->channel == SENSOR_BUS_NO_MUX || mock->mux_mask & (1 << device->channel)) return device;
+    }
+
+    return NULL;
+}
+
+static bool mock_bus_fails (mock_bus_t *mock) {
+    return mock->fail_countdown != 0 && --mock->fail_countdown == 0;
+}
+
+static esp_err_t mock_bus_write (void *ctx, uint8_t addr, const uint8_t *data, size_t len) {
+    mock_bus_t *mock = ctx;
+
+    mock_bus_log(mock, addr, true, data, len);
+    if (mock_bus_fails(mock)) return ESP_FAIL;
+
+    if (mock->mux_addr != 0 && addr == mock->mux_addr) {
+        if (len != 1) return ESP_FAIL;
+        mock->mux_mask = data[0];
+        return ESP_OK;
+    }
+
+    return mock_bus_find(mock, addr) ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t mock_bus_read (void *ctx, uint8_t addr, uint8_t *data, size_t len) {
+    mock_bus_t *mock = ctx;
+
+    mock_bus_log(mock, addr, false, NULL, 0);
+    if (mock_bus_fails(mock)) return ESP_FAIL;
+
+    mock_bus_device_t *device = mock_bus_find(mock, addr);
+    if (device == NULL || len > device->response_len) return ESP_FAIL;
+
+    memcpy(data, device->response, len);
+
+    return ESP_OK;
+}
+
+const sensor_bus_ops_t mock_bus_ops = {
+    .write = mock_bus_write,
+    .read = mock_bus_read,
+};
+
+mock_bus_device_t *mock_bus_add_device (mock_bus_t *mock, int8_t channel, uint8_t addr) {
+    if (mock->num_devices >= MOCK_BUS_MAX_DEVICES) return NULL;
+
+    mock_bus_device_t *device = &mock->devices[mock->num_devices++];
+    memset(device, 0, sizeof(*device));
+    device->channel = channel;
+    device->addr = addr;
+
+    return device;
+}
+
+void mock_bus_set_response (mock_bus_device_t *device, const uint8_t *data, size_t len) {
+    memcpy(device->response, data, len);
+    device->response_len = len;
+}
+
+void mock_bus_attach (mock_bus_t *mock, sensor_bus_t *bus) {
+    bus->ops = &mock_bus_ops;
+    bus->ctx = mock;
+    bus->mux_addr = mock->mux_addr;
+    bus->mux_channel = SENSOR_BUS_NO_MUX;
+}
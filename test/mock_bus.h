@@ -0,0 +1,56 @@
+#ifndef MOCK_BUS_H_
+#define MOCK_BUS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sensors/sensor_bus.h"
+
+/**
+ *  I2C bus backend for the host tests
+ *  It simulates a TCA9548A-like mux and the devices behind it: a device answers
+ *  only while its channel is selected, and a read returns the response set for
+ *  it. Every transaction is logged
+ */
+
+#define MOCK_BUS_MAX_DEVICES    8
+#define MOCK_BUS_MAX_LOG        64
+#define MOCK_BUS_MAX_DATA       8
+
+typedef struct {
+    uint8_t addr;
+    bool write;
+    uint8_t data[MOCK_BUS_MAX_DATA];
+    size_t len;
+} mock_bus_op_t;
+
+typedef struct {
+    int8_t channel;                         // SENSOR_BUS_NO_MUX if attached directly
+    uint8_t addr;
+    uint8_t response[MOCK_BUS_MAX_DATA];
+    size_t response_len;
+} mock_bus_device_t;
+
+typedef struct {
+    uint8_t mux_addr;                       // 0 if there is no mux
+    uint8_t mux_mask;                       // Channels selected on the mux
+    mock_bus_device_t devices[MOCK_BUS_MAX_DEVICES];
+    size_t num_devices;
+    size_t fail_countdown;                  // The transaction number "fail_countdown" fails (0: none)
+    mock_bus_op_t log[MOCK_BUS_MAX_LOG];
+    size_t num_ops;                         // Every transaction, even the ones not logged
+} mock_bus_t;
+
+extern const sensor_bus_ops_t mock_bus_ops;
+
+/* Attaches a device, returns it to set its responses */
+mock_bus_device_t *mock_bus_add_device (mock_bus_t *mock, int8_t channel, uint8_t addr);
+
+/* Sets the bytes returned by the next reads of a device */
+void mock_bus_set_response (mock_bus_device_t *device, const uint8_t *data, size_t len);
+
+/* Bus using the mock backend */
+void mock_bus_attach (mock_bus_t *mock, sensor_bus_t *bus);
+
+#endif
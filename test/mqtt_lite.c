@@ -0,0 +1,114 @@
+#include "mqtt_lite.h"
+
+#include <string.h>
+
+
+static size_t put_remaining_len (uint8_t *buf, size_t len) {
+    size_t n = 0;
+
+    do {
+        uint8_t byte = len % 128;
+        len /= 128;
+        buf[n++] = len ? byte | 0x80 : byte;
+    } while (len);
+
+    return n;
+}
+
+static size_t put_string (uint8_t *buf, const char *str) {
+    size_t len = strlen(str);
+
+    buf[0] = len >> 8;
+    buf[1] = len;
+    memcpy(buf + 2, str, len);
+
+    return 2 + len;
+}
+
+size_t mqtt_lite_connect (uint8_t *buf, const char *client_id) {
+    static const uint8_t variable_header[] = {
+        0, 4, 'M', 'Q', 'T', 'T',
+        4,              // Level 3.1.1
+        0x02,           // Clean session
+        0, 0,           // No keep alive
+    };
+    size_t id_len = strlen(client_id);
+
+    buf[0] = MQTT_LITE_CONNECT << 4;
+    size_t n = 1 + put_remaining_len(buf + 1, sizeof(variable_header) + 2 + id_len);
+    memcpy(buf + n, variable_header, sizeof(variable_header));
+    n += sizeof(variable_header);
+
+    return n + put_string(buf + n, client_id);
+}
+
+size_t mqtt_lite_publish_header (uint8_t *buf, const char *topic, size_t payload_len, int qos, uint16_t packet_id) {
+    size_t remaining = 2 + strlen(topic) + (qos ? 2 : 0) + payload_len;
+
+    buf[0] = MQTT_LITE_PUBLISH << 4 | (qos ? 0x02 : 0);
+    size_t n = 1 + put_remaining_len(buf + 1, remaining);
+    n += put_string(buf + n, topic);
+    if (qos) {
+        buf[n++] = packet_id >> 8;
+        buf[n++] = packet_id;
+    }
+
+    return n;
+}
+
+size_t mqtt_lite_subscribe (uint8_t *buf, const char *filter, int qos, uint16_t packet_id) {
+    buf[0] = MQTT_LITE_SUBSCRIBE << 4 | 0x02;
+    size_t n = 1 + put_remaining_len(buf + 1, 2 + 2 + strlen(filter) + 1);
+    buf[n++] = packet_id >> 8;
+    buf[n++] = packet_id;
+    n += put_string(buf + n, filter);
+    buf[n++] = qos;
+
+    return n;
+}
+
+size_t mqtt_lite_puback (uint8_t *buf, uint16_t packet_id) {
+    buf[0] = MQTT_LITE_PUBACK << 4;
+    buf[1] = 2;
+    buf[2] = packet_id >> 8;
+    buf[3] = packet_id;
+
+    return 4;
+}
+
+size_t mqtt_lite_parse (const uint8_t *buf, size_t len, mqtt_lite_packet_t *packet) {
+    size_t remaining = 0, n = 1;
+    int shift = 0;
+
+    /* Remaining length, up to 4 bytes */
+    do {
+        if (n >= len || n > 4) return 0;
+        remaining |= (size_t)(buf[n] & 0x7f) << shift;
+        shift += 7;
+    } while (buf[n++] & 0x80);
+
+    if (len < n + remaining) return 0;
+
+    const uint8_t *body = buf + n;
+    memset(packet, 0, sizeof(*packet));
+    packet->type = buf[0] >> 4;
+    packet->flags = buf[0] & 0x0f;
+    packet->payload = body;
+    packet->payload_len = remaining;
+
+    if (packet->type == MQTT_LITE_PUBLISH && remaining >= 2) {
+        size_t topic_len = (size_t)body[0] << 8 | body[1];
+        size_t header = 2 + topic_len + ((packet->flags & 0x06) ? 2 : 0);
+        if (header <= remaining) {
+            packet->topic = body + 2;
+            packet->topic_len = topic_len;
+            if (packet->flags & 0x06) packet->packet_id = body[2 + topic_len] << 8 | body[3 + topic_len];
+            packet->payload = body + header;
+            packet->payload_len = remaining - header;
+        }
+    } else if ((packet->type == MQTT_LITE_PUBACK || packet->type == MQTT_LITE_SUBACK) && remaining >= 2) {
+        packet->packet_id = body[0] << 8 | body[1];
+    }
+
+    return n + remaining;
+}
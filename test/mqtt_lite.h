@@ -0,0 +1,58 @@
+#ifndef MQTT_LITE_H_
+#define MQTT_LITE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *  Minimal MQTT 3.1.1 packets for the host tools
+ *  Only what a publisher and a subscriber need: CONNECT, PUBLISH (qos 0 and 1),
+ *  SUBSCRIBE, and the parsing of the packets coming back from the broker. The
+ *  buffers are given by the caller, nothing is allocated
+ */
+
+#define MQTT_LITE_CONNECT       1
+#define MQTT_LITE_CONNACK       2
+#define MQTT_LITE_PUBLISH       3
+#define MQTT_LITE_PUBACK        4
+#define MQTT_LITE_SUBSCRIBE     8
+#define MQTT_LITE_SUBACK        9
+
+typedef struct {
+    uint8_t type;
+    uint8_t flags;
+    uint16_t packet_id;         // PUBLISH with qos > 0, PUBACK, SUBACK
+    const uint8_t *topic;       // PUBLISH
+    size_t topic_len;
+    const uint8_t *payload;     // PUBLISH payload, or the rest of other packets
+    size_t payload_len;
+} mqtt_lite_packet_t;
+
+/* Longest header of a packet built below (fixed header plus topic of up to 255 bytes) */
+#define MQTT_LITE_HEADER_MAX    (5 + 2 + 255 + 2)
+
+/* CONNECT with a clean session and no keep alive, returns its length */
+size_t mqtt_lite_connect (uint8_t *buf, const char *client_id);
+
+/**
+ * @brief   Builds the header of a PUBLISH, the payload follows it as is
+ *          (so it can be sent from its own buffer)
+ *
+ * @return  Length of the header
+ */
+size_t mqtt_lite_publish_header (uint8_t *buf, const char *topic, size_t payload_len, int qos, uint16_t packet_id);
+
+/* SUBSCRIBE to a single filter, returns its length */
+size_t mqtt_lite_subscribe (uint8_t *buf, const char *filter, int qos, uint16_t packet_id);
+
+/* PUBACK of a received PUBLISH with qos 1, returns its length */
+size_t mqtt_lite_puback (uint8_t *buf, uint16_t packet_id);
+
+/**
+ * @brief   Parses the packet at the start of "buf"
+ *
+ * @return  Length of the packet, 0 if "buf" does not hold it whole yet
+ */
+size_t mqtt_lite_parse (const uint8_t *buf, size_t len, mqtt_lite_packet_t *packet);
+
+#endif
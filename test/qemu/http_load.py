@@ -0,0 +1,249 @@
+#!/usr/bin/env python3
+"""
+Load and latency run of the HTTPS REST server
+
+N clients poll /system/info, /node/info and /node/capture in turns, as dashboards
+would, for a given time. With --new-session every request opens its own TLS
+session (the worst case for the node), otherwise each client keeps its session.
+It reports:
+  - TLS handshakes per second and their p50/p99
+  - p50/p99 latency of each endpoint, and the failed requests
+  - socket exhaustion: more idle sessions than CONFIG_HTTP_MAX_OPEN_SOCKETS are
+    held open, then a new client is timed, and the held sessions the server
+    closed (least recently used first) are counted
+  - heap before the run and heap low-water after it, from /system/stats
+
+The node is either reachable at --url, or booted here in QEMU from the image of a
+run_e2e.py build (--boot), with its HTTPS port forwarded to the host. Without a
+broker the node keeps trying to connect, which does not get in the way.
+
+    test/qemu/http_load.py --boot build-qemu --clients 8 --duration 60
+    test/qemu/http_load.py --url https://192.168.1.45 --clients 4
+"""
+
+import argparse
+import http.client
+import json
+import os
+import socket
+import ssl
+import subprocess
+import sys
+import threading
+import time
+import urllib.parse
+
+import run_e2e
+
+ENDPOINTS = ["/system/info", "/node/info", "/node/capture"]
+HOST_PORT = 8443
+
+# The certificate of the node is self-signed (main/communications/certs), it is not checked
+TLS = ssl.create_default_context()
+TLS.check_hostname = False
+TLS.verify_mode = ssl.CERT_NONE
+
+
+def percentile(values, p):
+    if not values:
+        return float("nan")
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p * len(values)))]
+
+
+class Target:
+    def __init__(self, url):
+        parsed = urllib.parse.urlparse(url)
+        self.host = parsed.hostname
+        self.port = parsed.port or 443
+
+    def connect(self, timeout=10):
+        """New TLS session, returns it with the time of its handshake (secs)"""
+        conn = http.client.HTTPSConnection(self.host, self.port, context=TLS, timeout=timeout)
+        start = time.monotonic()
+        conn.connect()
+        return conn, time.monotonic() - start
+
+    def get(self, conn, path):
+        conn.request("GET", path, headers={"Accept": "application/json"})
+        response = conn.getresponse()
+        body = response.read()
+        return response.status, body
+
+
+# --------------------------- LOAD ----------------------------
+class Client(threading.Thread):
+    def __init__(self, target, index, deadline, new_session, results, lock):
+        super().__init__(daemon=True)
+        self.target, self.index, self.deadline = target, index, deadline
+        self.new_session, self.results, self.lock = new_session, results, lock
+
+    def run(self):
+        conn = None
+        n = self.index
+        while time.monotonic() < self.deadline:
+            path = ENDPOINTS[n % len(ENDPOINTS)]
+            n += 1
+            try:
+                if conn is None:
+                    conn, handshake = self.target.connect()
+                    with self.lock:
+                        self.results["handshakes"].append(handshake)
+                start = time.monotonic()
+                status, _ = self.target.get(conn, path)
+                latency = time.monotonic() - start
+                with self.lock:
+                    self.results[path].append(latency)
+                    if status != 200:
+                        self.results["failed"] += 1
+            except (OSError, http.client.HTTPException):
+                with self.lock:
+                    self.results["failed"] += 1
+                if conn:
+                    conn.close()
+                conn = None
+                time.sleep(0.1)
+                continue
+
+            if self.new_session:
+                conn.close()
+                conn = None
+
+
+def load(target, clients, duration, new_session):
+    results = {"handshakes": [], "failed": 0}
+    for path in ENDPOINTS:
+        results[path] = []
+    lock = threading.Lock()
+
+    start = time.monotonic()
+    threads = [Client(target, i, start + duration, new_session, results, lock) for i in range(clients)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = time.monotonic() - start
+
+    handshakes = results["handshakes"]
+    print("\n%d clients for %.0f s, %s" % (clients, elapsed, "a TLS session per request" if new_session else "one TLS session per client"))
+    print("  TLS handshakes: %d (%.2f/s), p50 %.1f ms, p99 %.1f ms" % (
+        len(handshakes), len(handshakes) / elapsed, percentile(handshakes, 0.5) * 1000, percentile(handshakes, 0.99) * 1000))
+    print("  %-16s %8s %8s %10s %10s" % ("endpoint", "requests", "req/s", "p50 ms", "p99 ms"))
+    for path in ENDPOINTS:
+        latencies = results[path]
+        print("  %-16s %8d %8.2f %10.1f %10.1f" % (path, len(latencies), len(latencies) / elapsed,
+                                                   percentile(latencies, 0.5) * 1000, percentile(latencies, 0.99) * 1000))
+    print("  failed requests: %d" % results["failed"])
+
+
+# ------------------------ EXHAUSTION -------------------------
+def is_closed(conn):
+    """A session closed by the server reads as EOF (or a reset) without blocking"""
+    sock = conn.sock
+    try:
+        sock.setblocking(False)
+        return sock.recv(1) == b""
+    except (ssl.SSLWantReadError, BlockingIOError):
+        return False
+    except OSError:
+        return True
+
+
+def exhaustion(target, held):
+    print("\nSocket exhaustion: %d idle sessions held open" % held)
+    sessions = []
+    for i in range(held):
+        try:
+            conn, _ = target.connect(timeout=5)
+            target.get(conn, "/system/info")
+            sessions.append(conn)
+        except (OSError, http.client.HTTPException) as e:
+            print("  session %d not opened: %s" % (i + 1, e))
+
+    start = time.monotonic()
+    try:
+        conn, _ = target.connect(timeout=10)
+        status, _ = target.get(conn, "/node/info")
+        conn.close()
+        print("  new client served (%d) in %.0f ms" % (status, (time.monotonic() - start) * 1000))
+    except (OSError, http.client.HTTPException) as e:
+        print("  new client not served after %.0f ms: %s" % ((time.monotonic() - start) * 1000, e))
+
+    time.sleep(0.5)
+    closed = sum(is_closed(conn) for conn in sessions)
+    print("  %d of the %d held sessions closed by the server" % (closed, len(sessions)))
+    for conn in sessions:
+        conn.close()
+
+
+def heap_stats(target):
+    try:
+        conn, _ = target.connect()
+        status, body = target.get(conn, "/system/stats")
+        conn.close()
+        return json.loads(body) if status == 200 else {}
+    except (OSError, http.client.HTTPException, ValueError):
+        return {}
+
+
+# --------------------------- BOOT ----------------------------
+def boot(build_dir):
+    """Boots the image of a run_e2e.py build in QEMU, with the HTTPS port forwarded"""
+    workdir = os.path.join(build_dir, "e2e")
+    os.makedirs(workdir, exist_ok=True)
+    flash = run_e2e.make_flash_image(build_dir, workdir)
+    run_e2e.SntpServer().start()
+
+    log = open(os.path.join(workdir, "serial-http.log"), "w")
+    qemu = subprocess.Popen(["qemu-system-xtensa", "-nographic", "-machine", "esp32",
+                             "-drive", "file=%s,if=mtd,format=raw" % flash,
+                             "-nic", "user,model=open_eth,hostfwd=tcp:127.0.0.1:%d-:443" % HOST_PORT],
+                            stdout=log, stderr=subprocess.STDOUT)
+
+    # The server starts once the time is set
+    deadline = time.monotonic() + 120
+    while time.monotonic() < deadline:
+        try:
+            conn = http.client.HTTPSConnection("127.0.0.1", HOST_PORT, context=TLS, timeout=5)
+            conn.request("GET", "/system/info")
+            conn.getresponse().read()
+            conn.close()
+            return qemu
+        except (OSError, http.client.HTTPException):
+            time.sleep(2)
+
+    qemu.terminate()
+    sys.exit("The HTTPS server did not start, see " + log.name)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Load and latency run of the HTTPS REST server")
+    parser.add_argument("--url", default="https://127.0.0.1:%d" % HOST_PORT)
+    parser.add_argument("--boot", metavar="BUILD_DIR", help="boot the image of a run_e2e.py build in QEMU")
+    parser.add_argument("--clients", type=int, default=8)
+    parser.add_argument("--duration", type=int, default=30, help="secs of each load phase")
+    parser.add_argument("--max-sockets", type=int, default=4, help="CONFIG_HTTP_MAX_OPEN_SOCKETS of the node")
+    args = parser.parse_args()
+
+    qemu = boot(args.boot) if args.boot else None
+    target = Target(args.url)
+
+    try:
+        before = heap_stats(target)
+        load(target, args.clients, args.duration, new_session=False)
+        load(target, args.clients, args.duration, new_session=True)
+        exhaustion(target, args.max_sockets + 2)
+        after = heap_stats(target)
+    finally:
+        if qemu:
+            qemu.terminate()
+
+    if before and after:
+        print("\nHeap: %d bytes free before the run, low-water %d, largest block %d after it (%d requests served)" % (
+            before["heap_free"], after["heap_min_free"], after["heap_largest_block"], after.get("requests", 0)))
+    else:
+        print("\n/system/stats not available, heap not reported")
+
+
+if __name__ == "__main__":
+    main()
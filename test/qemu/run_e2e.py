@@ -0,0 +1,258 @@
+#!/usr/bin/env python3
+"""
+End-to-end run of the firmware in the ESP32 QEMU machine against a local broker
+
+The firmware is built with sdkconfig.qemu over the project sdkconfig: stub sensor
+and BLE inputs, emulated Ethernet (openeth) instead of Wi-Fi, and a local mosquitto
+with a CA generated for the run instead of test.mosquitto.org. The harness also
+answers SNTP, so the node sets its time without internet.
+
+From the TIMING lines of the serial output (CONFIG_MQTT_TIMING_LOG) and the
+messages seen by a subscriber it reports:
+  - boot_to_connect_ms, boot_to_first_publish_ms
+  - ack_latency_p50_ms, ack_latency_p99_ms: from the publish call to the PUBACK
+    of the broker (qos 1). The time spent in the publisher queue before the call
+    is not included
+  - messages_per_s: messages received by the subscriber after the first one
+  - lost_messages: acknowledged by the broker but never received by the subscriber
+and fails when any of them is beyond its limit in thresholds.txt.
+
+Requirements: ESP-IDF (IDF_PATH, idf.py), qemu-system-xtensa with the esp32
+machine (Espressif fork), mosquitto and mosquitto_sub, openssl. SNTP needs UDP
+port 123 on the host: run as root or lower net.ipv4.ip_unprivileged_port_start.
+
+    test/qemu/run_e2e.py [--duration 120] [--build-dir build-qemu] [--skip-build]
+"""
+
+import argparse
+import os
+import re
+import socket
+import struct
+import subprocess
+import sys
+import threading
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+PROJECT = os.path.abspath(os.path.join(HERE, "..", ".."))
+
+BROKER_PORT = 8883
+FLASH_SIZE = 2 * 1024 * 1024                # CONFIG_ESPTOOLPY_FLASHSIZE
+NTP_EPOCH_OFFSET = 2208988800               # 1900 to 1970
+
+
+def run(cmd, **kwargs):
+    print("$ " + " ".join(cmd))
+    subprocess.run(cmd, check=True, **kwargs)
+
+
+# --------------------------- SETUP ---------------------------
+def make_certs(workdir):
+    """CA of the run and a certificate of the broker for 10.0.2.2, as the node sees the host"""
+    ca_key, ca_crt = os.path.join(workdir, "ca.key"), os.path.join(workdir, "ca.crt")
+    key, csr, crt = (os.path.join(workdir, "broker." + ext) for ext in ("key", "csr", "crt"))
+    if os.path.exists(crt):
+        return ca_crt, crt, key
+
+    run(["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes", "-days", "365",
+         "-subj", "/CN=miot e2e CA", "-keyout", ca_key, "-out", ca_crt])
+    run(["openssl", "req", "-newkey", "rsa:2048", "-nodes", "-subj", "/CN=10.0.2.2",
+         "-keyout", key, "-out", csr])
+    run(["openssl", "x509", "-req", "-in", csr, "-CA", ca_crt, "-CAkey", ca_key,
+         "-CAcreateserial", "-days", "365", "-out", crt])
+    return ca_crt, crt, key
+
+
+def write_cert_overlay(workdir, ca_crt):
+    """BROKER_CERTIFICATE_OVERRIDE takes the base64 body of the PEM on a single line"""
+    with open(ca_crt) as f:
+        body = "".join(line.strip() for line in f if not line.startswith("-----"))
+    path = os.path.join(workdir, "sdkconfig.cert")
+    with open(path, "w") as f:
+        f.write('CONFIG_BROKER_CERTIFICATE_OVERRIDE="%s"\n' % body)
+    return path
+
+
+def build(build_dir, cert_overlay):
+    defaults = ";".join([os.path.join(PROJECT, "sdkconfig"), os.path.join(HERE, "sdkconfig.qemu"), cert_overlay])
+    run(["idf.py", "-C", PROJECT, "-B", build_dir,
+         "-D", "SDKCONFIG=" + os.path.join(build_dir, "sdkconfig"),
+         "-D", "SDKCONFIG_DEFAULTS=" + defaults, "build"])
+
+
+def make_flash_image(build_dir, workdir):
+    """Bootloader, partition table and app at their offsets (flash_args of the build), as esptool would write them"""
+    image = bytearray(b"\xff" * FLASH_SIZE)
+    with open(os.path.join(build_dir, "flash_args")) as f:
+        for line in f:
+            parts = line.split()
+            if len(parts) != 2 or not parts[0].startswith("0x"):
+                continue
+            offset = int(parts[0], 16)
+            with open(os.path.join(build_dir, parts[1]), "rb") as binary:
+                data = binary.read()
+            image[offset:offset + len(data)] = data
+
+    path = os.path.join(workdir, "flash.bin")
+    with open(path, "wb") as f:
+        f.write(image)
+    return path
+
+
+# --------------------------- SERVICES ------------------------
+def start_broker(workdir, ca_crt, crt, key):
+    conf = os.path.join(workdir, "mosquitto.conf")
+    with open(conf, "w") as f:
+        f.write("listener %d\nallow_anonymous true\ncafile %s\ncertfile %s\nkeyfile %s\n"
+                % (BROKER_PORT, ca_crt, crt, key))
+    broker = subprocess.Popen(["mosquitto", "-c", conf], stdout=subprocess.DEVNULL, stderr=subprocess.STDOUT)
+    time.sleep(1)
+    if broker.poll() is not None:
+        sys.exit("mosquitto did not start (port %d in use?)" % BROKER_PORT)
+    return broker
+
+
+class Subscriber(threading.Thread):
+    """Counts the messages reaching the broker, with their arrival time"""
+
+    def __init__(self, ca_crt):
+        super().__init__(daemon=True)
+        # The certificate is for 10.0.2.2, only the hostname check is skipped
+        self.proc = subprocess.Popen(["mosquitto_sub", "-h", "localhost", "-p", str(BROKER_PORT),
+                                      "--cafile", ca_crt, "--insecure", "-q", "1", "-t", "#", "-F", "%t %l"],
+                                     stdout=subprocess.PIPE, text=True)
+        self.arrivals = []
+
+    def run(self):
+        for line in self.proc.stdout:
+            self.arrivals.append((time.monotonic(), line.split()[0]))
+
+
+class SntpServer(threading.Thread):
+    """Answers every SNTP request with the time of the host"""
+
+    def __init__(self):
+        super().__init__(daemon=True)
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        try:
+            self.sock.bind(("0.0.0.0", 123))
+        except PermissionError:
+            sys.exit("SNTP needs UDP port 123: run as root or lower net.ipv4.ip_unprivileged_port_start")
+
+    def run(self):
+        while True:
+            request, addr = self.sock.recvfrom(64)
+            if len(request) < 48:
+                continue
+            now = time.time() + NTP_EPOCH_OFFSET
+            secs, frac = int(now), int((now % 1) * (1 << 32))
+            # Server (mode 4), version 4, stratum 1, the transmit time of the client as origin
+            reply = struct.pack("!BBbb11I", 0x24, 1, 0, -20, 0, 0, 0x4C4F434C,
+                                secs, frac, *struct.unpack("!2I", request[40:48]), secs, frac, secs, frac)
+            self.sock.sendto(reply, addr)
+
+
+# --------------------------- RUN -----------------------------
+TIMING = re.compile(r"TIMING (\w+)(?: msg_id=(\d+))?(?: latency_us=(\d+))?(?:=(\d+))?")
+
+
+def run_qemu(flash, duration, log_path):
+    """Boots the image and collects the TIMING lines until "duration" secs after the first publish"""
+    qemu = subprocess.Popen(["qemu-system-xtensa", "-nographic", "-machine", "esp32",
+                             "-drive", "file=%s,if=mtd,format=raw" % flash,
+                             "-nic", "user,model=open_eth"],
+                            stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True, errors="replace")
+    timings = {"ack_us": []}
+    start = time.monotonic()
+    first_publish = None
+
+    with open(log_path, "w") as log:
+        for line in qemu.stdout:
+            log.write(line)
+            match = TIMING.search(line)
+            if match:
+                name, msg_id, latency_us, value = match.groups()
+                if name == "ack":
+                    timings["ack_us"].append(int(latency_us))
+                elif value is not None:
+                    timings[name] = int(value)
+                    if name == "first_publish_ms" and first_publish is None:
+                        first_publish = time.monotonic()
+
+            now = time.monotonic()
+            if (first_publish and now - first_publish > duration) or now - start > duration + 120:
+                break
+
+    qemu.terminate()
+    qemu.wait()
+    return timings
+
+
+def percentile(values, p):
+    if not values:
+        return float("inf")
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p * len(values)))]
+
+
+def report(timings, subscriber):
+    arrivals = [t for t, topic in subscriber.arrivals]
+    metrics = {
+        "boot_to_connect_ms": timings.get("connected_ms", float("inf")),
+        "boot_to_first_publish_ms": timings.get("first_publish_ms", float("inf")),
+        "ack_latency_p50_ms": percentile(timings["ack_us"], 0.50) / 1000,
+        "ack_latency_p99_ms": percentile(timings["ack_us"], 0.99) / 1000,
+        "messages_per_s": (len(arrivals) - 1) / (arrivals[-1] - arrivals[0]) if len(arrivals) > 1 else 0.0,
+        "lost_messages": max(0, len(timings["ack_us"]) - len(arrivals)),
+    }
+
+    failed = 0
+    with open(os.path.join(HERE, "thresholds.txt")) as f:
+        limits = [line.split() for line in f if line.strip() and not line.startswith("#")]
+
+    print("\n%-26s %12s %6s %10s" % ("metric", "value", "kind", "limit"))
+    for name, kind, limit in limits:
+        value = metrics[name]
+        bad = value > float(limit) if kind == "max" else value < float(limit)
+        failed += bad
+        print("%-26s %12.2f %6s %10s%s" % (name, value, kind, limit, "  REGRESSION" if bad else ""))
+    print("%d messages received, %d acknowledged" % (len(arrivals), len(timings["ack_us"])))
+
+    return failed
+
+
+def main():
+    parser = argparse.ArgumentParser(description="End-to-end run in QEMU against a local broker")
+    parser.add_argument("--duration", type=int, default=120, help="secs measured after the first publish")
+    parser.add_argument("--build-dir", default=os.path.join(PROJECT, "build-qemu"))
+    parser.add_argument("--skip-build", action="store_true", help="reuse the image of a previous run")
+    args = parser.parse_args()
+
+    workdir = os.path.join(args.build_dir, "e2e")
+    os.makedirs(workdir, exist_ok=True)
+
+    ca_crt, crt, key = make_certs(workdir)
+    if not args.skip_build:
+        build(args.build_dir, write_cert_overlay(workdir, ca_crt))
+    flash = make_flash_image(args.build_dir, workdir)
+
+    broker = start_broker(workdir, ca_crt, crt, key)
+    subscriber = Subscriber(ca_crt)
+    subscriber.start()
+    SntpServer().start()
+
+    try:
+        timings = run_qemu(flash, args.duration, os.path.join(workdir, "serial.log"))
+        time.sleep(1)           # Last messages on their way to the subscriber
+    finally:
+        subscriber.proc.terminate()
+        broker.terminate()
+
+    failed = report(timings, subscriber)
+    print("Serial output in " + os.path.join(workdir, "serial.log"))
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,282 @@
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "test_util.h"
+#include "trace.h"
+#include "hal_sim.h"
+#include "sensors/sensor_sched.h"
+#include "processing/co2_pipeline.h"
+#include "processing/deadband.h"
+#include "storage/ts_store.h"
+#include "telemetry/telemetry.h"
+
+/**
+ *  Trace replay simulator
+ *  The sensing, aggregation and encoding pipeline of the node runs on the host
+ *  against the simulated HAL (hal_sim.c): the sampling loop of sgp30_task and
+ *  the BLE loop of ble_task, with the config of sdkconfig. The primary sensor
+ *  replays node-red/esp-co2.csv (interpolated between the recorded values) and
+ *  the BLE scans return node-red/esp-ble.csv. Every node of the traces is
+ *  replayed from its first to its last record, as fast as the code runs, and
+ *  the throughput and memory are reported
+ */
+
+#define SIM_READING_PERIOD_MS   1000        // SGP30_READING_PERIOD_SEC
+#define SIM_WINDOW_QUANTILE     0.95f       // SGP30_WINDOW_QUANTILE
+#define SIM_CONVERSION_US       12000       // SGP30 measurement
+
+typedef struct {
+    const trace_t *trace;
+    size_t cursor;
+} trace_sensor_t;
+
+typedef struct {
+    uint64_t readings;
+    uint32_t windows;
+    uint32_t co2_reported;
+    uint32_t ble_scans;
+    uint32_t ble_reported;
+    uint32_t encode_errors;
+    uint64_t sim_us;
+} sim_stats_t;
+
+static trace_t ble_trace;
+static int ble_node;
+
+/* The node keeps its recent history, as history.c does */
+static ts_store_t store;
+
+
+/* ------------------- TRACE SENSOR -------------------- */
+static esp_err_t trace_sensor_init (void *ctx) {
+    ((trace_sensor_t *)ctx)->cursor = 0;
+    return ESP_OK;
+}
+
+static esp_err_t trace_sensor_trigger (void *ctx) {
+    (void)ctx;
+    return ESP_OK;
+}
+
+/* Value of the trace at the current time, interpolated between two records */
+static esp_err_t trace_sensor_collect (void *ctx, sensor_reading_t *reading) {
+    trace_sensor_t *sensor = ctx;
+    const trace_point_t *points = sensor->trace->points;
+    uint32_t now = hal_epoch_s();
+
+    while (sensor->cursor + 1 < sensor->trace->len && points[sensor->cursor + 1].ts <= now) sensor->cursor++;
+
+    const trace_point_t *p = &points[sensor->cursor];
+    int32_t value = p->value;
+    if (sensor->cursor + 1 < sensor->trace->len && now > p->ts) {
+        const trace_point_t *next = p + 1;
+        value += ((int32_t)next->value - p->value) * (int32_t)(now - p->ts) / (int32_t)(next->ts - p->ts);
+    }
+
+    reading->fields = SENSOR_FIELD_CO2;
+    reading->co2_ppm = value;
+
+    return ESP_OK;
+}
+
+static const sensor_driver_t trace_sensor_driver = {
+    .name = "TRACE",
+    .init = trace_sensor_init,
+    .trigger = trace_sensor_trigger,
+    .collect = trace_sensor_collect,
+    .conversion_us = SIM_CONVERSION_US,
+};
+
+/* Last people estimation recorded for the node */
+static uint8_t trace_ble_source (uint32_t epoch_s) {
+    uint8_t people = 0;
+
+    for (size_t i = 0; i < ble_trace.len && ble_trace.points[i].ts <= epoch_s; i++) {
+        if (ble_trace.points[i].node == ble_node) people = ble_trace.points[i].value;
+    }
+
+    return people;
+}
+
+
+/* --------------------- SIMULATOR --------------------- */
+/* Reports a result unless the deadband suppresses it, as the tasks do */
+static void sim_report (uint16_t value, deadband_t *deadband, bool co2, const window_stats_result_t *window,
+                        const telemetry_id_t *id, sim_stats_t *stats) {
+#ifdef CONFIG_DEADBAND_REPORTING
+    if (!deadband_check(deadband, value, hal_time_us() / 1000000)) return;
+#else
+    (void)deadband;
+#endif
+
+    uint8_t buf[TELEMETRY_WINDOW_LEN];
+    size_t len = co2 ? telemetry_encode_co2(buf, sizeof(buf), id, window, hal_epoch_s())
+                     : telemetry_encode_ble(buf, sizeof(buf), id, value, hal_epoch_s());
+    if (len == 0) {
+        stats->encode_errors++;
+        return;
+    }
+
+    hal_publish(buf, len);
+    if (co2) stats->co2_reported++;
+    else stats->ble_reported++;
+}
+
+/* Replays the records of a node, as sgp30_task and ble_task would process them */
+static void sim_node (const trace_t *co2_trace, int node, sim_stats_t *stats) {
+    telemetry_id_t id;
+    char esp_id[16];
+    snprintf(esp_id, sizeof(esp_id), "sim-%d", node);
+    telemetry_id_init(&id, esp_id);
+
+    uint32_t start_ts = co2_trace->points[0].ts;
+    uint32_t end_ts = co2_trace->points[co2_trace->len - 1].ts;
+    ble_node = node;
+    hal_sim_reset(start_ts, trace_ble_source);
+
+    trace_sensor_t sensor = { .trace = co2_trace };
+    sensor_sched_t sched = {0};
+    sensor_sched_add(&sched, &trace_sensor_driver, &sensor);
+    sensor_sched_init(&sched);
+
+    uint32_t max_period_ms = SIM_READING_PERIOD_MS;
+#ifdef CONFIG_SAMPLING_ADAPTIVE
+    max_period_ms = CONFIG_SAMPLING_MAX_PERIOD_SEC * 1000;
+    if (CONFIG_SGP30_MAX_MEASURE_PERIOD_SEC * 1000 < max_period_ms) max_period_ms = CONFIG_SGP30_MAX_MEASURE_PERIOD_SEC * 1000;
+#endif
+    const co2_pipeline_config_t pipeline_config = {
+        .rate = {
+            .min_period_ms = SIM_READING_PERIOD_MS,
+            .max_period_ms = max_period_ms,
+#ifdef CONFIG_SAMPLING_ADAPTIVE
+            .stable_delta = CONFIG_SAMPLING_STABLE_DELTA_PPM,
+            .slope_delta = CONFIG_SAMPLING_SLOPE_DELTA_PPM * 1000,
+            .stable_samples = CONFIG_SAMPLING_STABLE_SAMPLES,
+#endif
+        },
+        .window_ms = CONFIG_MQTT_SENDING_PERIOD_SEC * 1000,
+        .quantile = SIM_WINDOW_QUANTILE,
+    };
+    co2_pipeline_t pipeline;
+    co2_pipeline_init(&pipeline, &pipeline_config, hal_time_us());
+
+    deadband_t co2_deadband = {0}, ble_deadband = {0};
+#ifdef CONFIG_DEADBAND_REPORTING
+    const deadband_config_t co2_deadband_config = {
+        .abs = CONFIG_DEADBAND_CO2_ABS_PPM,
+        .rel_pct = CONFIG_DEADBAND_CO2_REL_PCT,
+        .heartbeat_s = CONFIG_DEADBAND_HEARTBEAT_SEC,
+    };
+    const deadband_config_t ble_deadband_config = {
+        .abs = CONFIG_DEADBAND_BLE_ABS,
+        .heartbeat_s = CONFIG_DEADBAND_HEARTBEAT_SEC,
+    };
+    deadband_init(&co2_deadband, &co2_deadband_config);
+    deadband_init(&ble_deadband, &ble_deadband_config);
+#endif
+
+    int64_t next_reading_us = 0;
+    int64_t next_ble_us = 0;
+
+    while (hal_epoch_s() < end_ts) {
+        /* The BLE task runs every CONFIG_BLE_ESTIMATION_PERIOD_SEC */
+        if (hal_time_us() >= next_ble_us) {
+            next_ble_us += (int64_t)CONFIG_BLE_ESTIMATION_PERIOD_SEC * 1000000;
+            uint8_t people = hal_ble_scan(CONFIG_BLE_SCANNING_DURATION_SEC);
+            ts_store_add(&store, TS_SERIES_BLE, hal_epoch_s(), people);
+            stats->ble_scans++;
+            sim_report(people, &ble_deadband, false, NULL, &id, stats);
+        }
+
+        /* Sampling cycle, the next one is scheduled first as the timer of sgp30_task */
+        next_reading_us += co2_pipeline_period_ms(&pipeline) * 1000;
+
+        int64_t next_us;
+        sensor_sched_start_cycle(&sched, hal_time_us());
+        while ((next_us = sensor_sched_poll(&sched, hal_time_us())) != SENSOR_SCHED_DONE) {
+            hal_delay_us(next_us - hal_time_us());
+        }
+        stats->readings++;
+
+        uint16_t filtered;
+        if (sched.slots[0].result != ESP_OK) {
+            co2_pipeline_missed(&pipeline);
+        } else if (co2_pipeline_sample(&pipeline, sched.slots[0].reading.co2_ppm, &filtered)) {
+            ts_store_add(&store, TS_SERIES_CO2, hal_epoch_s(), filtered);
+        }
+
+        window_stats_result_t window;
+        if (co2_pipeline_window(&pipeline, hal_time_us(), &window)) {
+            stats->windows++;
+            sim_report(window.mean, &co2_deadband, true, &window, &id, stats);
+        }
+
+        hal_sim_advance_to(next_reading_us);
+    }
+
+    stats->sim_us += hal_time_us();
+}
+
+static uint64_t now_ns (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main (void) {
+    trace_t co2_trace;
+    sim_stats_t stats = {0};
+    uint64_t messages = 0, bytes = 0;
+    size_t max_len = 0;
+
+    CHECK(trace_load(TRACE_BLE, TRACE_ALL_NODES, &ble_trace));
+    ts_store_init(&store);
+
+    uint64_t start_ns = now_ns();
+    for (int node = 1; node <= 9; node++) {
+        if (!trace_load(TRACE_CO2, node, &co2_trace)) {
+            trace_free(&co2_trace);
+            continue;
+        }
+
+        sim_node(&co2_trace, node, &stats);
+        messages += hal_sim_stats.messages;
+        bytes += hal_sim_stats.bytes;
+        if (hal_sim_stats.max_len > max_len) max_len = hal_sim_stats.max_len;
+
+        trace_free(&co2_trace);
+    }
+    uint64_t wall_ns = now_ns() - start_ns;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    double sim_h = stats.sim_us / 3.6e9;
+    printf("Simulated %.1f h in %.3f s (%.0fx real time)\n", sim_h, wall_ns / 1e9, stats.sim_us * 1e3 / wall_ns);
+    printf("  %llu readings (%.0f/s), %u windows, %u BLE scans\n", (unsigned long long)stats.readings,
+           stats.readings / (wall_ns / 1e9), (unsigned)stats.windows, (unsigned)stats.ble_scans);
+    printf("  %llu messages (%u CO2, %u BLE), %llu bytes, %.1f bytes/h, largest %u bytes\n",
+           (unsigned long long)messages, (unsigned)stats.co2_reported, (unsigned)stats.ble_reported,
+           (unsigned long long)bytes, bytes / sim_h, (unsigned)max_len);
+    printf("  State: pipeline %u bytes, scheduler %u bytes, history %u bytes; peak RSS %ld KB\n",
+           (unsigned)sizeof(co2_pipeline_t), (unsigned)sizeof(sensor_sched_t), (unsigned)sizeof(ts_store_t),
+           usage.ru_maxrss);
+
+    /* Every result went through the encoder, and every message sent fits a single window buffer */
+    CHECK(stats.windows > 0);
+    CHECK_EQ(stats.encode_errors, 0);
+    CHECK_EQ(messages, stats.co2_reported + stats.ble_reported);
+    CHECK(max_len <= TELEMETRY_WINDOW_LEN);
+#ifndef CONFIG_DEADBAND_REPORTING
+    CHECK_EQ(stats.co2_reported, stats.windows);
+    CHECK_EQ(stats.ble_reported, stats.ble_scans);
+#endif
+
+    /* Regression bound, far below what any host reaches */
+    CHECK(stats.sim_us * 1e3 / wall_ns > 1000);
+
+    trace_free(&ble_trace);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,10 @@
+#ifndef ESP_LOG_H_
+#define ESP_LOG_H_
+
+/* Logs of the modules built on the host are dropped */
+#define ESP_LOGE(tag, ...)      ((void)(tag))
+#define ESP_LOGW(tag, ...)      ((void)(tag))
+#define ESP_LOGI(tag, ...)      ((void)(tag))
+#define ESP_LOGD(tag, ...)      ((void)(tag))
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef ESP_SYSTEM_H_
+#define ESP_SYSTEM_H_
+
+#include "esp_err.h"
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef FREERTOS_H_
+#define FREERTOS_H_
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+/* FreeRTOS types and macros used by the modules built on the host (single task) */
+typedef uint32_t TickType_t;
+typedef int32_t BaseType_t;
+
+#define pdTRUE                      1
+#define pdFALSE                     0
+#define pdMS_TO_TICKS(ms)           ((TickType_t)(ms))
+#define portMAX_DELAY               UINT32_MAX
+
+typedef struct {
+    int locked;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    { 0 }
+#define portENTER_CRITICAL(mux)     ((mux)->locked++)
+#define portEXIT_CRITICAL(mux)      ((mux)->locked--)
+
+#define BIT0                        (1 << 0)
+
+#endif
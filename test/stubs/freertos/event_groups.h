@@ -0,0 +1,34 @@
+#ifndef EVENT_GROUPS_H_
+#define EVENT_GROUPS_H_
+
+#include "freertos/FreeRTOS.h"
+
+/* Event group of a single task: waiting never blocks, the bits are returned as they are */
+typedef uint32_t EventBits_t;
+typedef struct {
+    EventBits_t bits;
+} *EventGroupHandle_t;
+
+static inline EventGroupHandle_t xEventGroupCreate (void) {
+    static struct { EventBits_t bits; } groups[8];
+    static int used;
+    return used < 8 ? (EventGroupHandle_t)&groups[used++] : NULL;
+}
+
+static inline EventBits_t xEventGroupSetBits (EventGroupHandle_t group, EventBits_t bits) {
+    return group->bits |= bits;
+}
+
+static inline EventBits_t xEventGroupClearBits (EventGroupHandle_t group, EventBits_t bits) {
+    EventBits_t old = group->bits;
+    group->bits &= ~bits;
+    return old;
+}
+
+static inline EventBits_t xEventGroupWaitBits (EventGroupHandle_t group, EventBits_t bits, BaseType_t clear,
+                                               BaseType_t all, TickType_t timeout) {
+    (void)bits; (void)clear; (void)all; (void)timeout;
+    return group->bits;
+}
+
+#endif
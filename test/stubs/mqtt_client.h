@@ -0,0 +1,54 @@
+#ifndef MQTT_CLIENT_H_
+#define MQTT_CLIENT_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ *  API of the ESP-MQTT client used by comm_mqtt.c
+ *  A host test links its own client (e.g. one recording what is published)
+ */
+
+typedef const char *esp_event_base_t;
+typedef void (*esp_event_handler_t)(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data);
+
+#define ESP_EVENT_ANY_ID    -1
+
+typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+
+typedef enum {
+    MQTT_EVENT_ERROR = 0,
+    MQTT_EVENT_CONNECTED,
+    MQTT_EVENT_DISCONNECTED,
+    MQTT_EVENT_SUBSCRIBED,
+    MQTT_EVENT_UNSUBSCRIBED,
+    MQTT_EVENT_PUBLISHED,
+    MQTT_EVENT_DATA,
+} esp_mqtt_event_id_t;
+
+typedef struct {
+    esp_mqtt_event_id_t event_id;
+    esp_mqtt_client_handle_t client;
+    char *data;
+    int data_len;
+    char *topic;
+    int topic_len;
+    int msg_id;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t *esp_mqtt_event_handle_t;
+
+typedef struct {
+    const char *uri;
+    const char *cert_pem;
+} esp_mqtt_client_config_t;
+
+esp_mqtt_client_handle_t esp_mqtt_client_init (const esp_mqtt_client_config_t *config);
+esp_err_t esp_mqtt_client_register_event (esp_mqtt_client_handle_t client, int32_t event, esp_event_handler_t handler, void *arg);
+esp_err_t esp_mqtt_client_start (esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_stop (esp_mqtt_client_handle_t client);
+
+/* "len" 0 means a NUL-terminated "data" (its strlen is sent) */
+int esp_mqtt_client_publish (esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain);
+
+#endif
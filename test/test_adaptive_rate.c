@@ -0,0 +1,242 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+#include "trace.h"
+#include "processing/adaptive_rate.h"
+#include "processing/co2_pipeline.h"
+
+/**
+ *  Trace-driven test of the adaptive sampling rate
+ *  The recorded CO2 (one value every ~31 secs) is interpolated into a signal
+ *  sampled every second, which the pipeline reads whenever it asks for it. The
+ *  energy proxy is the number of wake-ups per hour, the error is the one of the
+ *  signal rebuilt from the readings (linear interpolation) and of the window means
+ */
+
+/* Longer gaps split the trace (the node was off) */
+#define TRACE_MAX_GAP_S     300
+
+typedef struct {
+    uint64_t seconds;
+    uint64_t wakeups;
+    double error_sum;               // Rebuilt signal vs real one, every second
+    uint64_t error_count;
+    uint32_t error_max;
+    double window_error_sum;        // Window mean vs mean of the real signal
+    uint32_t window_count;
+    uint32_t window_error_max;
+} sim_result_t;
+
+static uint32_t abs_diff (int32_t a, int32_t b) {
+    return a > b ? a - b : b - a;
+}
+
+static void sim_error (sim_result_t *result, int32_t rebuilt, int32_t real) {
+    uint32_t error = abs_diff(rebuilt, real);
+    result->error_sum += error;
+    result->error_count++;
+    if (error > result->error_max) result->error_max = error;
+}
+
+/* Replays the part of the trace between "first" and "last" (both included) */
+static void sim_segment (const trace_point_t *first, const trace_point_t *last,
+                         const co2_pipeline_config_t *config, sim_result_t *result) {
+    uint32_t duration = last->ts - first->ts;
+    uint16_t *signal = malloc((duration + 1) * sizeof(uint16_t));
+
+    for (const trace_point_t *p = first; p < last; p++) {
+        uint32_t dt = p[1].ts - p->ts;
+        for (uint32_t s = 0; s < dt; s++) {
+            signal[p->ts - first->ts + s] = p->value + ((int32_t)p[1].value - p->value) * (int32_t)s / (int32_t)dt;
+        }
+    }
+    signal[duration] = last->value;
+
+    co2_pipeline_t pipeline;
+    co2_pipeline_init(&pipeline, config, 0);
+
+    uint32_t t = 0, last_t = 0, window_start = 0;
+    uint16_t last_value = 0;
+    bool has_last = false;
+
+    while (t <= duration) {
+        uint16_t filtered;
+        result->wakeups++;
+
+        if (co2_pipeline_sample(&pipeline, signal[t], &filtered)) {
+            if (has_last) {
+                for (uint32_t s = last_t + 1; s <= t; s++) {
+                    int32_t rebuilt = last_value + ((int32_t)filtered - last_value) * (int32_t)(s - last_t) / (int32_t)(t - last_t);
+                    sim_error(result, rebuilt, signal[s]);
+                }
+            } else {
+                sim_error(result, filtered, signal[t]);
+            }
+            last_t = t;
+            last_value = filtered;
+            has_last = true;
+        }
+
+        window_stats_result_t window;
+        if (co2_pipeline_window(&pipeline, (int64_t)t * 1000000, &window)) {
+            uint64_t sum = 0;
+            for (uint32_t s = window_start + 1; s <= t; s++) sum += signal[s];
+            int32_t real_mean = (sum + (t - window_start) / 2) / (t - window_start);
+
+            uint32_t error = abs_diff(window.mean, real_mean);
+            result->window_error_sum += error;
+            result->window_count++;
+            if (error > result->window_error_max) result->window_error_max = error;
+            window_start = t;
+        }
+
+        t += co2_pipeline_period_ms(&pipeline) / 1000;
+    }
+
+    result->seconds += duration;
+    free(signal);
+}
+
+static void sim_trace (const trace_t *trace, const co2_pipeline_config_t *config, sim_result_t *result) {
+    memset(result, 0, sizeof(*result));
+
+    for (int node = 1; node <= 255; node++) {
+        const trace_point_t *first = NULL, *prev = NULL;
+
+        for (size_t i = 0; i < trace->len; i++) {
+            const trace_point_t *p = &trace->points[i];
+            if (p->node != node) continue;
+
+            if (prev && (p->ts <= prev->ts || p->ts - prev->ts > TRACE_MAX_GAP_S)) {
+                if (prev != first) sim_segment(first, prev, config, result);
+                first = NULL;
+            }
+            if (first == NULL) first = p;
+            prev = p;
+        }
+        if (first && prev != first) sim_segment(first, prev, config, result);
+    }
+}
+
+static void sim_print (const char *name, const sim_result_t *result) {
+    printf("  %-10s %9.0f %12.2f %10u %14.2f %11u\n", name,
+           (double)result->wakeups * 3600 / result->seconds,
+           result->error_sum / result->error_count, (unsigned)result->error_max,
+           result->window_error_sum / result->window_count, (unsigned)result->window_error_max);
+}
+
+/* The same configs as sgp30_task */
+static void test_trace (void) {
+    trace_t trace;
+    CHECK(trace_load(TRACE_CO2, TRACE_ALL_NODES, &trace));
+    if (trace.len == 0) return;
+
+    co2_pipeline_config_t fixed = {
+        .rate = { .min_period_ms = 1000, .max_period_ms = 1000 },
+        .window_ms = CONFIG_MQTT_SENDING_PERIOD_SEC * 1000,
+        .quantile = 0.95f,
+    };
+
+    uint32_t max_period_s = CONFIG_SAMPLING_MAX_PERIOD_SEC;
+    if (CONFIG_SGP30_MAX_MEASURE_PERIOD_SEC < max_period_s) max_period_s = CONFIG_SGP30_MAX_MEASURE_PERIOD_SEC;
+
+    co2_pipeline_config_t adaptive = fixed;
+    adaptive.rate.max_period_ms = max_period_s * 1000;
+    adaptive.rate.stable_delta = CONFIG_SAMPLING_STABLE_DELTA_PPM;
+    adaptive.rate.slope_delta = CONFIG_SAMPLING_SLOPE_DELTA_PPM * 1000;
+    adaptive.rate.stable_samples = CONFIG_SAMPLING_STABLE_SAMPLES;
+
+    sim_result_t fixed_result, adaptive_result;
+    sim_trace(&trace, &fixed, &fixed_result);
+    sim_trace(&trace, &adaptive, &adaptive_result);
+
+    printf("  %.1f hours of trace, max period %u s\n", fixed_result.seconds / 3600.0, (unsigned)max_period_s);
+    printf("  %-10s %9s %12s %10s %14s %11s\n", "rate", "wakeups/h", "error (ppm)", "max (ppm)", "window (ppm)", "max (ppm)");
+    sim_print("fixed", &fixed_result);
+    sim_print("adaptive", &adaptive_result);
+
+    /* Every second is covered by a reading */
+    CHECK_EQ(fixed_result.wakeups * 3600 / fixed_result.seconds, 3600);
+
+    /* Most wake-ups are saved on these mostly stable rooms, the reported means barely move */
+    CHECK(adaptive_result.wakeups * 4 < fixed_result.wakeups);
+    CHECK(adaptive_result.window_error_sum / adaptive_result.window_count < 2.0);
+    CHECK(adaptive_result.error_sum / adaptive_result.error_count < 2.0);
+
+    trace_free(&trace);
+}
+
+/* Synthetic signal: flat, slow drift, then a change of slope */
+static void test_slope_change (void) {
+    const adaptive_rate_config_t config = {
+        .min_period_ms = 1000,
+        .max_period_ms = 16000,
+        .stable_delta = 2,
+        .slope_delta = 3000,
+        .stable_samples = 5,
+    };
+    adaptive_rate_t rate;
+    adaptive_rate_init(&rate, &config);
+
+    /* Stable: the period doubles every 5 readings up to the max */
+    uint32_t period = 0;
+    for (int i = 0; i < 40; i++) period = adaptive_rate_update(&rate, 402 + i % 2);
+    CHECK_EQ(period, 16000);
+
+    /* A drift of 1 ppm/s is not a change of slope */
+    CHECK_EQ(adaptive_rate_update(&rate, 402 + 16), 16000);
+
+    /* 80 ppm in one period (5 ppm/s, 4 ppm/s more than the drift): full rate */
+    CHECK_EQ(adaptive_rate_update(&rate, 402 + 16 + 80), 1000);
+
+    /* It stays at full rate while the slope changes */
+    CHECK_EQ(adaptive_rate_update(&rate, 402 + 16 + 80 + 10), 1000);
+
+    adaptive_rate_reset(&rate);
+    CHECK_EQ(rate.period_ms, 1000);
+
+    /* max < min: fixed rate */
+    adaptive_rate_config_t fixed = config;
+    fixed.max_period_ms = 500;
+    adaptive_rate_init(&rate, &fixed);
+    for (int i = 0; i < 40; i++) period = adaptive_rate_update(&rate, 402);
+    CHECK_EQ(period, 1000);
+}
+
+/* Each reading weighs the period it was taken after, so the weights of a window add up to its length */
+static void test_window_weights (void) {
+    const co2_pipeline_config_t config = {
+        .rate = { .min_period_ms = 1000, .max_period_ms = 16000, .stable_delta = 2,
+                  .slope_delta = 3000, .stable_samples = 5 },
+        .window_ms = 60000,
+        .quantile = 0.5f,
+    };
+    co2_pipeline_t pipeline;
+    co2_pipeline_init(&pipeline, &config, 0);
+
+    uint32_t t = 0, window_start = 0, windows = 0;
+    while (windows < 20) {
+        t += co2_pipeline_period_ms(&pipeline);
+
+        /* Stable with slow ramps, so the period changes */
+        uint16_t value = 600 + (t / 1000 % 600 < 300 ? 0 : (t / 1000 % 600 - 300) / 4);
+        CHECK(co2_pipeline_sample(&pipeline, value, NULL));
+
+        float weight_ms = pipeline.window.weight_sum;
+        window_stats_result_t window;
+        if (co2_pipeline_window(&pipeline, (int64_t)t * 1000, &window)) {
+            CHECK_EQ((int64_t)weight_ms, t - window_start);
+            window_start = t;
+            windows++;
+        }
+    }
+}
+
+int main (void) {
+    RUN(test_slope_change);
+    RUN(test_window_weights);
+    RUN(test_trace);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,229 @@
+#include <string.h>
+
+#include "test_util.h"
+#include "storage/journal.h"
+
+/**
+ *  Journal over a RAM flash with the NOR rules: writes only clear bits, erases
+ *  set whole sectors back to 0xFF. Each message carries its sequence number, so
+ *  the order and the content of what comes back can be checked
+ */
+
+#define FLASH_SECTORS   4
+#define FLASH_SIZE      (FLASH_SECTORS * JOURNAL_SECTOR_SIZE)
+
+/* Fills a sector exactly: 7 records of 8 + 576 bytes after the 8 byte sector header */
+#define EXACT_LEN       576
+
+static struct {
+    uint8_t data[FLASH_SIZE];
+    long write_budget;          // Bytes written before a simulated reset (< 0: no limit)
+    int out_of_range;
+} flash;
+
+static journal_t journal;
+
+
+static esp_err_t ram_read (void *ctx, uint32_t addr, void *data, size_t len) {
+    (void)ctx;
+    if (addr + len > FLASH_SIZE) {
+        flash.out_of_range++;
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(data, &flash.data[addr], len);
+    return ESP_OK;
+}
+
+static esp_err_t ram_write (void *ctx, uint32_t addr, const void *data, size_t len) {
+    (void)ctx;
+    if (addr + len > FLASH_SIZE) {
+        flash.out_of_range++;
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (flash.write_budget == 0) return ESP_FAIL;
+        if (flash.write_budget > 0) flash.write_budget--;
+        flash.data[addr + i] &= ((const uint8_t *)data)[i];
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ram_erase (void *ctx, uint32_t addr, size_t len) {
+    (void)ctx;
+    if (addr % JOURNAL_SECTOR_SIZE || addr + len > FLASH_SIZE) {
+        flash.out_of_range++;
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(&flash.data[addr], 0xFF, len);
+    return ESP_OK;
+}
+
+static const journal_flash_ops_t ram_ops = {
+    .read = ram_read,
+    .write = ram_write,
+    .erase = ram_erase,
+};
+
+
+static void reset_flash (void) {
+    memset(flash.data, 0xFF, sizeof(flash.data));
+    flash.write_budget = -1;
+    flash.out_of_range = 0;
+    CHECK_EQ(journal_mount(&journal, &ram_ops, NULL, FLASH_SIZE), ESP_OK);
+}
+
+/* Message "seq": its number, then bytes derived from it */
+static size_t make_message (uint32_t seq, size_t len, uint8_t *buf) {
+    for (size_t i = 0; i < len; i++) buf[i] = (uint8_t)(seq * 31 + i);
+    if (len >= sizeof(seq)) memcpy(buf, &seq, sizeof(seq));
+    return len;
+}
+
+static void append (uint32_t seq, size_t len) {
+    uint8_t buf[JOURNAL_MAX_RECORD];
+    CHECK_EQ(journal_append(&journal, buf, make_message(seq, len, buf)), ESP_OK);
+}
+
+/* Peeks the oldest message, checks it is "seq" of "len" bytes and consumes it */
+static void consume (uint32_t seq, size_t len) {
+    uint8_t buf[JOURNAL_MAX_RECORD], expected[JOURNAL_MAX_RECORD];
+    size_t read_len = 0;
+    journal_pos_t pos;
+
+    CHECK_EQ(journal_peek(&journal, buf, sizeof(buf), &read_len, &pos), ESP_OK);
+    CHECK_EQ(read_len, len);
+    if (read_len == len && memcmp(buf, expected, make_message(seq, len, expected)) != 0) {
+        uint32_t got;
+        memcpy(&got, buf, sizeof(got));
+        CHECK_EQ(got, seq);
+    }
+    CHECK_EQ(journal_consume(&journal, &pos), ESP_OK);
+}
+
+static void test_wrap_around (void) {
+    reset_flash();
+
+    /* Records that end exactly at the end of a sector, including the last one of the area */
+    uint32_t head = 0, tail = 0;
+    while (head < 10) append(head++, EXACT_LEN);
+    while (head < 200) {
+        append(head++, EXACT_LEN);
+        consume(tail++, EXACT_LEN);
+        CHECK_EQ(journal_pending(&journal), 10);
+    }
+    while (tail < head) consume(tail++, EXACT_LEN);
+    CHECK_EQ(journal_pending(&journal), 0);
+    CHECK_EQ(journal_peek(&journal, NULL, 0, NULL, NULL), ESP_ERR_NOT_FOUND);
+
+    /* Every length, several times around the area */
+    for (uint32_t seq = 0; seq < 3000; seq++) {
+        append(seq, seq % (JOURNAL_MAX_RECORD + 1));
+        if (seq >= 5) consume(seq - 5, (seq - 5) % (JOURNAL_MAX_RECORD + 1));
+    }
+    CHECK_EQ(journal_pending(&journal), 5);
+    CHECK_EQ(journal.dropped, 0);
+    CHECK_EQ(flash.out_of_range, 0);
+}
+
+static void test_full_drops_oldest (void) {
+    reset_flash();
+
+    for (uint32_t seq = 0; seq < 100; seq++) append(seq, EXACT_LEN);
+
+    /* The sector being opened is dropped whole: the last 3 or 4 sectors are kept */
+    uint32_t pending = journal_pending(&journal);
+    CHECK(pending > (FLASH_SECTORS - 1) * 7 - 7 && pending <= FLASH_SECTORS * 7);
+    CHECK_EQ(journal.dropped + pending, 100);
+    CHECK_EQ(journal.dropped % 7, 0);
+
+    for (uint32_t seq = journal.dropped; seq < 100; seq++) consume(seq, EXACT_LEN);
+    CHECK_EQ(journal_pending(&journal), 0);
+    CHECK_EQ(flash.out_of_range, 0);
+}
+
+/**
+ *  The journal fills up while a peeked message is being published (the replay does
+ *  not hold the journal meanwhile): consuming it afterwards must not take the next
+ *  pending message, which has not been sent
+ */
+static void test_wrap_during_replay (void) {
+    uint8_t buf[JOURNAL_MAX_RECORD];
+    journal_pos_t pos;
+    size_t len;
+
+    reset_flash();
+    uint32_t seq = 0;
+    while (seq < 10) append(seq++, EXACT_LEN);
+
+    CHECK_EQ(journal_peek(&journal, buf, sizeof(buf), &len, &pos), ESP_OK);
+    while (journal.dropped == 0) append(seq++, EXACT_LEN);
+
+    uint32_t pending = journal_pending(&journal);
+    CHECK_EQ(journal_consume(&journal, &pos), ESP_ERR_NOT_FOUND);
+    CHECK_EQ(journal_pending(&journal), pending);
+
+    /* Nor once its address holds a newer record, after going around the whole area */
+    journal_pos_t old;
+    CHECK_EQ(journal_peek(&journal, buf, sizeof(buf), &len, &old), ESP_OK);
+    do {
+        append(seq++, EXACT_LEN);
+        CHECK_EQ(journal_peek(&journal, buf, sizeof(buf), &len, &pos), ESP_OK);
+    } while ((pos.addr != old.addr || pos.seq == old.seq) && seq < 1000);
+    CHECK_EQ(pos.addr, old.addr);
+
+    pending = journal_pending(&journal);
+    CHECK_EQ(journal_consume(&journal, &old), ESP_ERR_NOT_FOUND);
+    CHECK_EQ(journal_pending(&journal), pending);
+
+    /* The oldest pending message is still there, none has been consumed */
+    consume(journal.dropped, EXACT_LEN);
+
+    /* A message consumed twice (e.g. a late retry) does not take the next one */
+    CHECK_EQ(journal_peek(&journal, buf, sizeof(buf), &len, &pos), ESP_OK);
+    CHECK_EQ(journal_consume(&journal, &pos), ESP_OK);
+    pending = journal_pending(&journal);
+    CHECK_EQ(journal_consume(&journal, &pos), ESP_ERR_NOT_FOUND);
+    CHECK_EQ(journal_pending(&journal), pending);
+    CHECK_EQ(flash.out_of_range, 0);
+}
+
+static void test_remount (void) {
+    reset_flash();
+
+    /* Around the area, so the newest sector is not the last one */
+    for (uint32_t seq = 0; seq < 40; seq++) {
+        append(seq, EXACT_LEN / 2);
+        if (seq < 30) consume(seq, EXACT_LEN / 2);
+    }
+    CHECK_EQ(journal_mount(&journal, &ram_ops, NULL, FLASH_SIZE), ESP_OK);
+    CHECK_EQ(journal_pending(&journal), 10);
+
+    /* A record torn by a reset is not recovered, the ones before it are */
+    flash.write_budget = 100;
+    uint8_t buf[JOURNAL_MAX_RECORD];
+    CHECK(journal_append(&journal, buf, make_message(40, EXACT_LEN, buf)) != ESP_OK);
+    flash.write_budget = -1;
+
+    CHECK_EQ(journal_mount(&journal, &ram_ops, NULL, FLASH_SIZE), ESP_OK);
+    CHECK_EQ(journal_pending(&journal), 10);
+
+    /* Writing goes on after it, and nothing is lost */
+    append(41, EXACT_LEN);
+    for (uint32_t seq = 30; seq < 40; seq++) consume(seq, EXACT_LEN / 2);
+    CHECK_EQ(journal_mount(&journal, &ram_ops, NULL, FLASH_SIZE), ESP_OK);
+    CHECK_EQ(journal_pending(&journal), 1);
+    consume(41, EXACT_LEN);
+
+    CHECK_EQ(journal_mount(&journal, &ram_ops, NULL, FLASH_SIZE), ESP_OK);
+    CHECK_EQ(journal_pending(&journal), 0);
+    CHECK_EQ(flash.out_of_range, 0);
+}
+
+int main (void) {
+    RUN(test_wrap_around);
+    RUN(test_full_drops_oldest);
+    RUN(test_wrap_during_replay);
+    RUN(test_remount);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,252 @@
+#include <string.h>
+
+#include "mqtt_client.h"
+
+#include "test_util.h"
+#include "node_config.h"
+#include "communications/comm_mqtt.h"
+#include "communications/comm_journal.h"
+#include "storage/msg_queue.h"
+#include "telemetry/telemetry.h"
+
+/**
+ *  Binary payloads through the publish path
+ *  comm_mqtt.c runs against a fake MQTT client that records what it is given (and,
+ *  as the real one, takes a length of 0 as a NUL-terminated string). Payloads with
+ *  NUL bytes anywhere must reach the client, the journal and the publisher queue
+ *  byte for byte
+ */
+
+#define TEST_TOPIC  "test/location/node-1"
+
+/* Certificate of the firmware image, not used on the host */
+const uint8_t test_broker_pem_start[] asm("_binary_mqtt_test_broker_pem_start") = "";
+const uint8_t test_broker_pem_end[] asm("_binary_mqtt_test_broker_pem_end") = "";
+
+static node_config_t config;
+static int config_held;         // Snapshots acquired and not released
+
+static esp_event_handler_t client_handler;
+static uint8_t sent[MSG_QUEUE_DATA_LEN];
+static int sent_len;
+static int next_msg_id = 1;
+static uint8_t stored[MSG_QUEUE_DATA_LEN];
+static size_t stored_len;
+
+
+/* ------------------- FAKE CLIENT --------------------- */
+esp_mqtt_client_handle_t esp_mqtt_client_init (const esp_mqtt_client_config_t *config) {
+    (void)config;
+    return (esp_mqtt_client_handle_t)&client_handler;
+}
+
+esp_err_t esp_mqtt_client_register_event (esp_mqtt_client_handle_t client, int32_t event, esp_event_handler_t handler, void *arg) {
+    (void)client; (void)event; (void)arg;
+    client_handler = handler;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start (esp_mqtt_client_handle_t client) {
+    (void)client;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop (esp_mqtt_client_handle_t client) {
+    (void)client;
+    return ESP_OK;
+}
+
+int esp_mqtt_client_publish (esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain) {
+    (void)client; (void)retain;
+    CHECK(strcmp(topic, TEST_TOPIC) == 0);
+
+    if (len <= 0) len = strlen(data);
+    memcpy(sent, data, len);
+    sent_len = len;
+
+    return qos > 0 ? next_msg_id++ : 0;
+}
+
+static void client_event (esp_mqtt_event_id_t id, int msg_id) {
+    esp_mqtt_event_t event = { .event_id = id, .msg_id = msg_id };
+    client_handler(NULL, "MQTT_EVENTS", id, &event);
+}
+
+
+/* ---------------- OTHER DEPENDENCIES ----------------- */
+const node_config_t *node_config_acquire (void) {
+    config_held++;
+    return &config;
+}
+
+void node_config_release (const node_config_t *released) {
+    CHECK(released == &config);
+    config_held--;
+}
+
+int64_t hal_time_us (void) {
+    return 0;
+}
+
+bool journal_store (const uint8_t *data, size_t len) {
+    memcpy(stored, data, len);
+    stored_len = len;
+    return true;
+}
+
+void journal_replay_notify (void) {}
+
+void publisher_acked (int msg_id) {
+    (void)msg_id;
+}
+
+
+/* ----------------------- TESTS ----------------------- */
+/* Payload with NUL bytes at the start, in the middle and at the end */
+static size_t make_payload (uint8_t *buf, size_t len) {
+    for (size_t i = 0; i < len; i++) buf[i] = (uint8_t)(i * 7);
+    buf[len / 2] = 0x00;
+    buf[len - 1] = 0x00;
+    return len;
+}
+
+static void test_publish (void) {
+    uint8_t payload[MSG_QUEUE_DATA_LEN];
+
+    /* Every length up to the largest message, with qos 0 and 1 */
+    for (size_t len = 1; len <= sizeof(payload); len += len < 64 ? 1 : 61) {
+        for (int qos = 0; qos <= 1; qos++) {
+            make_payload(payload, len);
+            sent_len = -1;
+
+            int msg_id = mqtt_publish_to(&config.topic, payload, len, qos, MQTT_PUBLISH_NO_JOURNAL);
+            CHECK(msg_id >= 0);
+            if (sent_len != (int)len || memcmp(sent, payload, len) != 0) {
+                printf("  %zu bytes, qos %d\n", len, qos);
+                CHECK_EQ(sent_len, len);
+                CHECK(memcmp(sent, payload, len) == 0);
+                return;
+            }
+            if (qos > 0) client_event(MQTT_EVENT_PUBLISHED, msg_id);
+        }
+    }
+}
+
+/* A CBOR telemetry message has zeros (e.g. small integers, the ID length) */
+static void test_telemetry (void) {
+    uint8_t buf[TELEMETRY_WINDOW_LEN];
+    window_stats_result_t window = { .mean = 0, .min = 0, .max = 256, .count = 0 };
+
+    size_t len = telemetry_encode_co2(buf, sizeof(buf), &config.id_cbor, &window, 0);
+    CHECK(len > 0);
+    CHECK(memchr(buf, 0x00, len) != NULL);
+
+    CHECK(mqtt_publish(buf, len) >= 0);
+    CHECK_EQ(sent_len, len);
+    CHECK(memcmp(sent, buf, len) == 0);
+}
+
+/* Without connection the message goes to the journal as it is */
+static void test_journal (void) {
+    uint8_t payload[300];
+    make_payload(payload, sizeof(payload));
+    payload[0] = 0x00;
+
+    client_event(MQTT_EVENT_DISCONNECTED, 0);
+    sent_len = -1;
+    CHECK_EQ(mqtt_publish(payload, sizeof(payload)), 0);
+    CHECK_EQ(sent_len, -1);
+    CHECK_EQ(stored_len, sizeof(payload));
+    CHECK(memcmp(stored, payload, sizeof(payload)) == 0);
+
+    client_event(MQTT_EVENT_CONNECTED, 0);
+}
+
+/**
+ *  A live message that finds the inflight window full is handed back to the caller
+ *  (the publisher keeps it queued and sends the higher classes first), it is not
+ *  stored in the journal while connected
+ */
+static void test_backpressure (void) {
+    uint8_t payload[100];
+    int msg_ids[CONFIG_MQTT_MAX_INFLIGHT];
+
+    make_payload(payload, sizeof(payload));
+    for (int i = 0; i < CONFIG_MQTT_MAX_INFLIGHT; i++) {
+        msg_ids[i] = mqtt_publish_to(&config.topic, payload, sizeof(payload), 1, 0);
+        CHECK(msg_ids[i] > 0);
+    }
+
+    sent_len = -1;
+    stored_len = 0;
+    CHECK_EQ(mqtt_publish_to(&config.topic, payload, sizeof(payload), 1, 0), MQTT_PUBLISH_ERR_BACKPRESSURE);
+    CHECK_EQ(sent_len, -1);
+    CHECK_EQ(stored_len, 0);
+
+    /* An ACK makes room for the message held back */
+    client_event(MQTT_EVENT_PUBLISHED, msg_ids[0]);
+    int msg_id = mqtt_publish_to(&config.topic, payload, sizeof(payload), 1, 0);
+    CHECK(msg_id > 0);
+    CHECK_EQ(sent_len, sizeof(payload));
+    CHECK_EQ(stored_len, 0);
+
+    client_event(MQTT_EVENT_PUBLISHED, msg_id);
+    for (int i = 1; i < CONFIG_MQTT_MAX_INFLIGHT; i++) client_event(MQTT_EVENT_PUBLISHED, msg_ids[i]);
+}
+
+/* The publisher copies the messages through its queue */
+static void test_queue (void) {
+    static msg_queue_cell_t cells[4];
+    static uint8_t out[MSG_QUEUE_DATA_LEN];
+    uint8_t payload[MSG_QUEUE_DATA_LEN];
+    msg_queue_t queue;
+    size_t len;
+    uint8_t flags;
+
+    CHECK(msg_queue_init(&queue, cells, 4));
+    for (size_t n = 1; n <= sizeof(payload); n *= 2) {
+        make_payload(payload, n);
+        CHECK(msg_queue_push(&queue, payload, n, 0));
+        CHECK(msg_queue_pop(&queue, out, &len, &flags));
+        CHECK_EQ(len, n);
+        CHECK(memcmp(out, payload, n) == 0);
+    }
+
+    /* A message peeked (e.g. held back by backpressure) stays the oldest until it is popped */
+    make_payload(payload, sizeof(payload));
+    CHECK(msg_queue_push(&queue, payload, sizeof(payload), 0));
+    CHECK(msg_queue_push(&queue, payload, 1, 0));
+    for (int i = 0; i < 2; i++) {
+        CHECK(msg_queue_peek(&queue, out, &len, &flags));
+        CHECK_EQ(len, sizeof(payload));
+        CHECK(memcmp(out, payload, len) == 0);
+    }
+    CHECK(msg_queue_pop(&queue, NULL, NULL, NULL));
+    CHECK(msg_queue_peek(&queue, out, &len, &flags));
+    CHECK_EQ(len, 1);
+    CHECK(msg_queue_pop(&queue, out, &len, &flags));
+    CHECK(!msg_queue_peek(&queue, out, &len, &flags));
+}
+
+int main (void) {
+    strcpy(config.location, "test/location/");
+    strcpy(config.id, "node-1");
+    CHECK_EQ(mqtt_topic_init(&config.topic, config.location, config.id), ESP_OK);
+    CHECK(strcmp(config.topic.name, TEST_TOPIC) == 0);
+    telemetry_id_init(&config.id_cbor, config.id);
+
+    mqtt_app_start();
+    CHECK(client_handler != NULL);
+    client_event(MQTT_EVENT_CONNECTED, 0);
+
+    RUN(test_publish);
+    RUN(test_telemetry);
+    RUN(test_journal);
+    RUN(test_backpressure);
+    RUN(test_queue);
+
+    /* Every snapshot taken by the publish path has been released */
+    CHECK_EQ(config_held, 0);
+
+    return TEST_RESULT();
+}
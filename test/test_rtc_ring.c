@@ -0,0 +1,181 @@
+#include <string.h>
+
+#include "test_util.h"
+#include "storage/rtc_ring.h"
+
+
+#define BASE_TS     1643887697u
+
+static rtc_ring_t ring;
+
+
+static void push (uint32_t timestamp, uint16_t value, uint8_t kind) {
+    const rtc_ring_sample_t sample = { .timestamp = timestamp, .value = value, .kind = kind };
+    rtc_ring_push(&ring, &sample);
+}
+
+/* Checks that the ring holds "n" samples pushed by fill(), starting at "first" */
+static void check_samples (uint32_t first, size_t n) {
+    static rtc_ring_sample_t samples[RTC_RING_CAPACITY];
+
+    CHECK_EQ(rtc_ring_count(&ring), n);
+    CHECK_EQ(rtc_ring_peek(&ring, samples, RTC_RING_CAPACITY), n);
+
+    for (size_t i = 0; i < n; i++) {
+        if (samples[i].value != (uint16_t)(first + i) || samples[i].timestamp != BASE_TS + 30 * (first + i)) {
+            CHECK_EQ(samples[i].value, first + i);
+            CHECK_EQ(samples[i].timestamp, BASE_TS + 30 * (first + i));
+            return;
+        }
+    }
+}
+
+/* Pushes the samples "first" to "first + n - 1", one every 30 s */
+static void fill (uint32_t first, size_t n) {
+    for (size_t i = 0; i < n; i++) push(BASE_TS + 30 * (first + i), first + i, (first + i) % 2);
+}
+
+static void test_push_peek_drop (void) {
+    rtc_ring_reset(&ring);
+    CHECK_EQ(rtc_ring_count(&ring), 0);
+
+    fill(0, 10);
+    check_samples(0, 10);
+
+    /* Peek does not remove anything */
+    rtc_ring_sample_t samples[4];
+    CHECK_EQ(rtc_ring_peek(&ring, samples, 4), 4);
+    CHECK_EQ(samples[3].kind, 1);
+    check_samples(0, 10);
+
+    rtc_ring_drop(&ring, 3);
+    check_samples(3, 7);
+    CHECK_EQ(rtc_ring_head_seq(&ring), 3);
+
+    rtc_ring_drop(&ring, 100);
+    CHECK_EQ(rtc_ring_count(&ring), 0);
+    CHECK_EQ(rtc_ring_head_seq(&ring), 10);
+
+    /* Empty: the next sample sets the base timestamp again */
+    fill(20, 2);
+    check_samples(20, 2);
+}
+
+static void test_wrap_around (void) {
+    rtc_ring_reset(&ring);
+
+    /* The oldest samples are overwritten */
+    fill(0, RTC_RING_CAPACITY + 25);
+    check_samples(25, RTC_RING_CAPACITY);
+    CHECK_EQ(rtc_ring_head_seq(&ring), 25);
+
+    rtc_ring_drop(&ring, RTC_RING_CAPACITY - 5);
+    fill(RTC_RING_CAPACITY + 25, 10);
+    check_samples(RTC_RING_CAPACITY + 20, 15);
+}
+
+static void test_timestamps (void) {
+    rtc_ring_sample_t samples[3];
+    rtc_ring_reset(&ring);
+
+    /* Gaps longer than a delta saturate, samples out of order keep the last time */
+    push(BASE_TS, 1, 0);
+    push(BASE_TS + 100000, 2, 0);
+    push(BASE_TS + 10, 3, 0);
+    CHECK_EQ(rtc_ring_peek(&ring, samples, 3), 3);
+    CHECK_EQ(samples[1].timestamp, BASE_TS + UINT16_MAX);
+    CHECK_EQ(samples[2].timestamp, BASE_TS + UINT16_MAX);
+}
+
+/* A burst publishes a chunk while the sampling keeps pushing on a full ring */
+static void test_drop_until (void) {
+    rtc_ring_sample_t samples[10];
+    rtc_ring_reset(&ring);
+    fill(0, RTC_RING_CAPACITY);
+
+    uint32_t seq = rtc_ring_head_seq(&ring);
+    size_t n = rtc_ring_peek(&ring, samples, 10);
+    CHECK_EQ(samples[0].value, 0);
+
+    /* 4 of the samples being published are overwritten in the meantime */
+    fill(RTC_RING_CAPACITY, 4);
+
+    /* Dropping 10 would lose 4 samples never sent */
+    rtc_ring_drop_until(&ring, seq + n);
+    check_samples(10, RTC_RING_CAPACITY - 6);
+
+    /* Everything was overwritten: nothing else is dropped */
+    seq = rtc_ring_head_seq(&ring);
+    n = rtc_ring_peek(&ring, samples, 10);
+    fill(RTC_RING_CAPACITY + 4, RTC_RING_CAPACITY);
+    rtc_ring_drop_until(&ring, seq + n);
+    check_samples(RTC_RING_CAPACITY + 4, RTC_RING_CAPACITY);
+}
+
+static void test_restore (void) {
+    rtc_ring_reset(&ring);
+    fill(0, 50);
+
+    CHECK(rtc_ring_restore(&ring));
+    check_samples(0, 50);
+
+    /* Corrupted entry: kept up to it */
+    ring.entries[(ring.head + 20) % RTC_RING_CAPACITY].value ^= 0x0100;
+    CHECK(rtc_ring_restore(&ring));
+    check_samples(0, 20);
+
+    /* It goes on from there */
+    fill(20, 5);
+    check_samples(0, 25);
+
+    /* Corrupted header: cleared */
+    ring.base_ts++;
+    CHECK(!rtc_ring_restore(&ring));
+    CHECK_EQ(rtc_ring_count(&ring), 0);
+
+    /* Random memory (power-on) */
+    memset(&ring, 0xA5, sizeof(ring));
+    CHECK(!rtc_ring_restore(&ring));
+    CHECK_EQ(rtc_ring_count(&ring), 0);
+}
+
+/* Claims "count" samples with a valid header check (the same as rtc_ring.c) */
+static void forge_count (uint16_t count) {
+    ring.count = count;
+    ring.check = ring.magic ^ ((uint32_t)ring.head << 16 | ring.count) ^ (ring.head_seq * 0x9E3779B1) ^
+                 ring.base_ts ^ (ring.last_ts * 31);
+}
+
+/* Valid header over entries of a previous lap: none of them is taken */
+static void test_stale_entries (void) {
+    rtc_ring_reset(&ring);
+    fill(0, 30);
+    rtc_ring_drop(&ring, 30);
+
+    /* E.g. a header written without its entries */
+    forge_count(10);
+    CHECK(rtc_ring_restore(&ring));
+    CHECK_EQ(rtc_ring_count(&ring), 0);
+
+    /* The entries of the first lap do not match the sequence numbers of the next one */
+    rtc_ring_reset(&ring);
+    fill(0, RTC_RING_CAPACITY);
+    rtc_ring_drop(&ring, RTC_RING_CAPACITY);
+    fill(RTC_RING_CAPACITY, 3);
+    forge_count(6);
+    CHECK(rtc_ring_restore(&ring));
+    check_samples(RTC_RING_CAPACITY, 3);
+}
+
+int main (void) {
+    RUN(test_push_peek_drop);
+    RUN(test_wrap_around);
+    RUN(test_timestamps);
+    RUN(test_drop_until);
+    RUN(test_restore);
+    RUN(test_stale_entries);
+
+    printf("  %u bytes of RTC memory for %u samples\n", (unsigned)sizeof(rtc_ring_t), RTC_RING_CAPACITY);
+
+    return TEST_RESULT();
+}
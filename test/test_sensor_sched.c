@@ -0,0 +1,243 @@
+#include <string.h>
+
+#include "test_util.h"
+#include "mock_bus.h"
+#include "sensors/sensirion_common.h"
+#include "sensors/sensor_sched.h"
+
+
+#define MUX_ADDR        0x70
+#define MEASURE_CMD     0x2008
+
+
+/* Sensirion-like sensor: a command starts the conversion, a word with its CRC is read */
+typedef struct {
+    sensor_dev_t dev;
+    uint8_t not_finished;           // Collects answering ESP_ERR_NOT_FINISHED first
+    uint8_t triggers;
+    uint8_t collects;
+    int64_t collected_us;
+} mock_sensor_t;
+
+static int64_t now_us;
+
+static esp_err_t mock_sensor_init (void *ctx) {
+    mock_sensor_t *sensor = ctx;
+    return sensor_dev_write(&sensor->dev, NULL, 0);
+}
+
+static esp_err_t mock_sensor_trigger (void *ctx) {
+    mock_sensor_t *sensor = ctx;
+    sensor->triggers++;
+    return sensor_dev_command(&sensor->dev, MEASURE_CMD, NULL, 0);
+}
+
+static esp_err_t mock_sensor_collect (void *ctx, sensor_reading_t *reading) {
+    mock_sensor_t *sensor = ctx;
+    uint8_t frame[SENSIRION_FRAME_SIZE];
+    uint16_t word;
+
+    sensor->collects++;
+    sensor->collected_us = now_us;
+    if (sensor->not_finished) {
+        sensor->not_finished--;
+        return ESP_ERR_NOT_FINISHED;
+    }
+
+    if (sensor_dev_read(&sensor->dev, frame, sizeof(frame)) != ESP_OK) return ESP_FAIL;
+    if (!sensirion_unpack_words(frame, 1, &word)) return ESP_ERR_INVALID_CRC;
+
+    reading->fields = SENSOR_FIELD_CO2;
+    reading->co2_ppm = word;
+
+    return ESP_OK;
+}
+
+#define MOCK_DRIVER(conversion) {                   \
+    .name = "mock",                                 \
+    .init = mock_sensor_init,                       \
+    .trigger = mock_sensor_trigger,                 \
+    .collect = mock_sensor_collect,                 \
+    .conversion_us = (conversion),                  \
+}
+
+static const sensor_driver_t driver_12ms = MOCK_DRIVER(12000);
+static const sensor_driver_t driver_20ms = MOCK_DRIVER(20000);
+static const sensor_driver_t driver_5ms = MOCK_DRIVER(5000);
+
+
+static void set_word (mock_bus_device_t *device, uint16_t word) {
+    uint8_t frame[SENSIRION_FRAME_SIZE];
+    sensirion_pack_word(word, frame);
+    mock_bus_set_response(device, frame, sizeof(frame));
+}
+
+/* Runs a cycle as the sampling task does, returns the number of wake-ups */
+static int run_cycle (sensor_sched_t *sched) {
+    int wakeups = 0;
+    int64_t next_us;
+
+    now_us = 0;
+    sensor_sched_start_cycle(sched, now_us);
+    while ((next_us = sensor_sched_poll(sched, now_us)) != SENSOR_SCHED_DONE) {
+        CHECK(next_us > now_us);
+        now_us = next_us;
+        wakeups++;
+    }
+
+    return wakeups;
+}
+
+
+static void test_bus_mux (void) {
+    mock_bus_t mock = { .mux_addr = MUX_ADDR };
+    sensor_bus_t bus;
+    mock_bus_attach(&mock, &bus);
+    mock_bus_add_device(&mock, 0, 0x58);
+    mock_bus_add_device(&mock, 1, 0x58);
+    mock_bus_add_device(&mock, SENSOR_BUS_NO_MUX, 0x61);
+
+    sensor_dev_t first = { .bus = &bus, .addr = 0x58, .mux_channel = 0 };
+    sensor_dev_t second = { .bus = &bus, .addr = 0x58, .mux_channel = 1 };
+    sensor_dev_t direct = { .bus = &bus, .addr = 0x61, .mux_channel = SENSOR_BUS_NO_MUX };
+
+    /* The channel is selected only when it changes */
+    CHECK_EQ(sensor_dev_command(&first, MEASURE_CMD, NULL, 0), ESP_OK);
+    CHECK_EQ(sensor_dev_command(&first, MEASURE_CMD, NULL, 0), ESP_OK);
+    CHECK_EQ(sensor_dev_command(&direct, MEASURE_CMD, NULL, 0), ESP_OK);
+    CHECK_EQ(sensor_dev_command(&second, MEASURE_CMD, NULL, 0), ESP_OK);
+    CHECK_EQ(mock.num_ops, 6);
+    CHECK_EQ(mock.log[0].addr, MUX_ADDR);
+    CHECK_EQ(mock.log[0].data[0], 1 << 0);
+    CHECK_EQ(mock.log[1].addr, 0x58);
+    CHECK_EQ(mock.log[1].len, 2);
+    CHECK_EQ(mock.log[1].data[0], MEASURE_CMD >> 8);
+    CHECK_EQ(mock.log[1].data[1], MEASURE_CMD & 0xFF);
+    CHECK_EQ(mock.log[3].addr, 0x61);
+    CHECK_EQ(mock.log[4].addr, MUX_ADDR);
+    CHECK_EQ(mock.log[4].data[0], 1 << 1);
+
+    /* After a failed selection the mux state is unknown: selected again */
+    mock.fail_countdown = 1;
+    CHECK(sensor_dev_command(&first, MEASURE_CMD, NULL, 0) != ESP_OK);
+    CHECK_EQ(sensor_dev_command(&first, MEASURE_CMD, NULL, 0), ESP_OK);
+    CHECK_EQ(mock.num_ops, 9);
+    CHECK_EQ(mock.log[7].addr, MUX_ADDR);
+
+    /* Arguments longer than any command */
+    uint8_t args[8] = {0};
+    CHECK_EQ(sensor_dev_command(&first, MEASURE_CMD, args, sizeof(args)), ESP_ERR_INVALID_SIZE);
+}
+
+/* Two sensors behind the mux and one attached directly, with different conversion times */
+static void test_sched_interleaving (void) {
+    mock_bus_t mock = { .mux_addr = MUX_ADDR };
+    sensor_bus_t bus;
+    mock_bus_attach(&mock, &bus);
+    set_word(mock_bus_add_device(&mock, 0, 0x58), 410);
+    set_word(mock_bus_add_device(&mock, 1, 0x58), 420);
+    set_word(mock_bus_add_device(&mock, SENSOR_BUS_NO_MUX, 0x61), 430);
+
+    mock_sensor_t first = { .dev = { &bus, 0x58, 0 } };
+    mock_sensor_t second = { .dev = { &bus, 0x58, 1 } };
+    mock_sensor_t ndir = { .dev = { &bus, 0x61, SENSOR_BUS_NO_MUX } };
+
+    sensor_sched_t sched = {0};
+    CHECK_EQ(sensor_sched_add(&sched, &driver_12ms, &first), ESP_OK);
+    CHECK_EQ(sensor_sched_add(&sched, &driver_20ms, &second), ESP_OK);
+    CHECK_EQ(sensor_sched_add(&sched, &driver_5ms, &ndir), ESP_OK);
+    CHECK_EQ(sensor_sched_init(&sched), ESP_OK);
+
+    int wakeups = run_cycle(&sched);
+
+    /* The cycle lasts the longest conversion, not the sum (37 ms) */
+    printf("  cycle of %lld us, %d wake-ups\n", (long long)now_us, wakeups);
+    CHECK_EQ(now_us, 20000);
+    CHECK_EQ(wakeups, 3);
+
+    /* Each one is collected as soon as its own conversion is completed */
+    CHECK_EQ(ndir.collected_us, 5000);
+    CHECK_EQ(first.collected_us, 12000);
+    CHECK_EQ(second.collected_us, 20000);
+
+    CHECK_EQ(sched.slots[0].result, ESP_OK);
+    CHECK_EQ(sched.slots[0].reading.co2_ppm, 410);
+    CHECK_EQ(sched.slots[1].result, ESP_OK);
+    CHECK_EQ(sched.slots[1].reading.co2_ppm, 420);
+    CHECK_EQ(sched.slots[2].result, ESP_OK);
+    CHECK_EQ(sched.slots[2].reading.co2_ppm, 430);
+
+    /* The next cycle works the same */
+    CHECK_EQ(run_cycle(&sched), 3);
+    CHECK_EQ(first.triggers, 2);
+    CHECK_EQ(first.collects, 2);
+}
+
+static void test_sched_collect_again (void) {
+    mock_bus_t mock = {0};
+    sensor_bus_t bus;
+    mock_bus_attach(&mock, &bus);
+    set_word(mock_bus_add_device(&mock, SENSOR_BUS_NO_MUX, 0x58), 500);
+    set_word(mock_bus_add_device(&mock, SENSOR_BUS_NO_MUX, 0x59), 600);
+
+    mock_sensor_t retried = { .dev = { &bus, 0x58, SENSOR_BUS_NO_MUX }, .not_finished = 1 };
+    mock_sensor_t stuck = { .dev = { &bus, 0x59, SENSOR_BUS_NO_MUX }, .not_finished = 100 };
+
+    sensor_sched_t sched = {0};
+    sensor_sched_add(&sched, &driver_12ms, &retried);
+    sensor_sched_add(&sched, &driver_5ms, &stuck);
+    run_cycle(&sched);
+
+    /* Collected again a conversion later */
+    CHECK_EQ(sched.slots[0].result, ESP_OK);
+    CHECK_EQ(sched.slots[0].reading.co2_ppm, 500);
+    CHECK_EQ(retried.collects, 2);
+    CHECK_EQ(retried.collected_us, 24000);
+
+    /* Given up after SENSOR_SCHED_MAX_COLLECTS */
+    CHECK_EQ(sched.slots[1].result, ESP_ERR_TIMEOUT);
+    CHECK_EQ(stuck.collects, SENSOR_SCHED_MAX_COLLECTS);
+}
+
+static void test_sched_errors (void) {
+    mock_bus_t mock = {0};
+    sensor_bus_t bus;
+    mock_bus_attach(&mock, &bus);
+    set_word(mock_bus_add_device(&mock, SENSOR_BUS_NO_MUX, 0x58), 500);
+
+    /* Nothing answers at 0x40 */
+    mock_sensor_t present = { .dev = { &bus, 0x58, SENSOR_BUS_NO_MUX } };
+    mock_sensor_t missing = { .dev = { &bus, 0x40, SENSOR_BUS_NO_MUX } };
+
+    sensor_sched_t sched = {0};
+    sensor_sched_add(&sched, &driver_5ms, &present);
+    sensor_sched_add(&sched, &driver_20ms, &missing);
+    CHECK(sensor_sched_init(&sched) != ESP_OK);
+
+    /* A sensor that was not triggered does not delay the cycle */
+    run_cycle(&sched);
+    CHECK_EQ(now_us, 5000);
+    CHECK_EQ(sched.slots[0].result, ESP_OK);
+    CHECK(sched.slots[1].result != ESP_OK);
+    CHECK_EQ(missing.collects, 0);
+
+    /* Corrupted frame */
+    mock.devices[0].response[1] ^= 0x01;
+    run_cycle(&sched);
+    CHECK_EQ(sched.slots[0].result, ESP_ERR_INVALID_CRC);
+
+    /* Full scheduler */
+    for (size_t i = sched.num_sensors; i < SENSOR_SCHED_MAX_SENSORS; i++) {
+        CHECK_EQ(sensor_sched_add(&sched, &driver_5ms, &present), ESP_OK);
+    }
+    CHECK_EQ(sensor_sched_add(&sched, &driver_5ms, &present), ESP_ERR_NO_MEM);
+}
+
+int main (void) {
+    RUN(test_bus_mux);
+    RUN(test_sched_interleaving);
+    RUN(test_sched_collect_again);
+    RUN(test_sched_errors);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,148 @@
+#include <string.h>
+
+#include "test_util.h"
+#include "sensors/sensirion_common.h"
+#include "sensors/sgp30_baseline.h"
+
+
+#define DAY_S       (24 * 3600)
+#define NOW_S       1600000000u
+
+static const sgp30_baseline_policy_t policy = {
+    .warmup_s = 12 * 3600,
+    .min_interval_s = 3600,
+    .refresh_s = DAY_S,
+    .min_delta = 16,
+};
+
+
+/* Sample of the SGP30 datasheet */
+static void test_crc (void) {
+    const uint8_t word[] = {0xBE, 0xEF};
+    CHECK_EQ(sensirion_crc8(word, sizeof(word)), 0x92);
+
+    uint8_t frame[SENSIRION_FRAME_SIZE];
+    sensirion_pack_word(0xBEEF, frame);
+    CHECK_EQ(frame[2], 0x92);
+
+    uint16_t decoded;
+    CHECK(sensirion_unpack_words(frame, 1, &decoded));
+    CHECK_EQ(decoded, 0xBEEF);
+
+    frame[1] ^= 0x01;
+    CHECK(!sensirion_unpack_words(frame, 1, &decoded));
+}
+
+static void test_encode_decode (void) {
+    const sgp30_baseline_t baseline = { .co2_eq = 0x8a3c, .tvoc = 0x91f2, .timestamp = NOW_S };
+    uint8_t blob[SGP30_BASELINE_BLOB_LEN];
+    sgp30_baseline_t decoded;
+
+    sgp30_baseline_encode(&baseline, blob);
+    CHECK(sgp30_baseline_decode(blob, sizeof(blob), &decoded));
+    CHECK_EQ(decoded.co2_eq, baseline.co2_eq);
+    CHECK_EQ(decoded.tvoc, baseline.tvoc);
+    CHECK_EQ(decoded.timestamp, baseline.timestamp);
+
+    /* Wrong size, version or CRC */
+    CHECK(!sgp30_baseline_decode(blob, sizeof(blob) - 1, &decoded));
+
+    uint8_t corrupted[SGP30_BASELINE_BLOB_LEN];
+    for (size_t i = 0; i < sizeof(blob); i++) {
+        memcpy(corrupted, blob, sizeof(blob));
+        corrupted[i] ^= 0x10;
+        CHECK(!sgp30_baseline_decode(corrupted, sizeof(corrupted), &decoded));
+    }
+}
+
+static void test_freshness (void) {
+    sgp30_baseline_t baseline = { .co2_eq = 1, .tvoc = 2, .timestamp = NOW_S };
+
+    CHECK(sgp30_baseline_is_fresh(&baseline, NOW_S, 7 * DAY_S));
+    CHECK(sgp30_baseline_is_fresh(&baseline, NOW_S + 7 * DAY_S, 7 * DAY_S));
+    CHECK(!sgp30_baseline_is_fresh(&baseline, NOW_S + 7 * DAY_S + 1, 7 * DAY_S));
+
+    /* From the future: the clock was wrong when it was stored */
+    CHECK(!sgp30_baseline_is_fresh(&baseline, NOW_S - 1, 7 * DAY_S));
+
+    /* Its age cannot be checked without both times */
+    CHECK(!sgp30_baseline_is_fresh(&baseline, 0, 7 * DAY_S));
+    baseline.timestamp = 0;
+    CHECK(!sgp30_baseline_is_fresh(&baseline, NOW_S, 7 * DAY_S));
+}
+
+/* Learnt from scratch: nothing is written before the warm-up */
+static void test_store_from_scratch (void) {
+    sgp30_baseline_state_t state = {0};
+    sgp30_baseline_t candidate = { .co2_eq = 100, .tvoc = 100, .timestamp = NOW_S };
+
+    CHECK(!sgp30_baseline_should_store(&policy, &state, &candidate, policy.warmup_s - 1));
+    CHECK(sgp30_baseline_should_store(&policy, &state, &candidate, policy.warmup_s));
+
+    /* Without the time it would never be restored */
+    candidate.timestamp = 0;
+    CHECK(!sgp30_baseline_should_store(&policy, &state, &candidate, policy.warmup_s));
+}
+
+static void test_store_throttling (void) {
+    sgp30_baseline_state_t state = {0};
+    sgp30_baseline_t restored = { .co2_eq = 100, .tvoc = 100, .timestamp = NOW_S };
+    sgp30_baseline_mark_restored(&state, &restored);
+
+    /* Restored: no warm-up, only the min interval since boot */
+    sgp30_baseline_t candidate = restored;
+    candidate.co2_eq = 100 + policy.min_delta;
+    CHECK(!sgp30_baseline_should_store(&policy, &state, &candidate, policy.min_interval_s - 1));
+
+    /* The same value is not written again */
+    CHECK(!sgp30_baseline_should_store(&policy, &state, &restored, policy.min_interval_s));
+
+    uint32_t uptime_s = policy.min_interval_s;
+    CHECK(sgp30_baseline_should_store(&policy, &state, &candidate, uptime_s));
+    sgp30_baseline_mark_stored(&state, &candidate, uptime_s);
+
+    /* Min interval between writes, even for large changes */
+    candidate.tvoc = 1000;
+    CHECK(!sgp30_baseline_should_store(&policy, &state, &candidate, uptime_s + policy.min_interval_s - 1));
+    CHECK(sgp30_baseline_should_store(&policy, &state, &candidate, uptime_s + policy.min_interval_s));
+
+    /* Small changes wait for the refresh */
+    candidate = state.last;
+    candidate.tvoc += policy.min_delta - 1;
+    CHECK(!sgp30_baseline_should_store(&policy, &state, &candidate, uptime_s + policy.refresh_s - 1));
+    CHECK(sgp30_baseline_should_store(&policy, &state, &candidate, uptime_s + policy.refresh_s));
+}
+
+/* A week of readouts every 10 minutes: the writes stay bounded */
+static void test_store_rate (void) {
+    sgp30_baseline_state_t state = {0};
+    uint32_t writes = 0;
+
+    for (uint32_t uptime_s = 0; uptime_s <= 7 * DAY_S; uptime_s += 600) {
+        /* Drifting baseline with some noise */
+        sgp30_baseline_t candidate = {
+            .co2_eq = 30000 + uptime_s / 60 + (uptime_s / 600) % 7,
+            .tvoc = 40000 + (uptime_s / 600) % 5,
+            .timestamp = NOW_S + uptime_s,
+        };
+        if (sgp30_baseline_should_store(&policy, &state, &candidate, uptime_s)) {
+            sgp30_baseline_mark_stored(&state, &candidate, uptime_s);
+            writes++;
+        }
+    }
+
+    printf("  %u writes in a week\n", (unsigned)writes);
+    CHECK(writes > 0);
+    CHECK(writes <= 7 * DAY_S / policy.min_interval_s);
+}
+
+int main (void) {
+    RUN(test_crc);
+    RUN(test_encode_decode);
+    RUN(test_freshness);
+    RUN(test_store_from_scratch);
+    RUN(test_store_throttling);
+    RUN(test_store_rate);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,266 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "test_util.h"
+#include "telemetry/telemetry.h"
+
+/**
+ *  Round trip of the batches: the payload is decoded with a small CBOR reader,
+ *  independent of the encoder, and the base TS and every column (typed arrays of
+ *  uint8/uint16/uint32 big endian) must give back the samples that were added
+ */
+
+#define TEST_ID     "node-batch-1"
+#define BASE_TS     1643887697
+
+/* Typed arrays (RFC 8746) */
+#define TAG_UINT8       64
+#define TAG_UINT16_BE   65
+#define TAG_UINT32_BE   66
+
+#define KEYS            (TELEMETRY_KEY_BLE_TS + 1)
+
+typedef struct {
+    bool present;
+    unsigned tag;
+    size_t n;
+    uint32_t values[TELEMETRY_BATCH_MAX];
+} column_t;
+
+typedef struct {
+    unsigned pairs;
+    uint32_t version;
+    uint32_t ts;
+    column_t columns[KEYS];
+    char id[TELEMETRY_ESP_ID_MAX + 1];
+} decoded_t;
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    bool error;
+} reader_t;
+
+
+/* ------------------- CBOR READER --------------------- */
+static uint64_t read_be (reader_t *reader, size_t width) {
+    uint64_t value = 0;
+
+    if ((size_t)(reader->end - reader->p) < width) {
+        reader->error = true;
+        return 0;
+    }
+    while (width--) value = value << 8 | *reader->p++;
+    return value;
+}
+
+/* Initial byte and argument of an item, returns its major type */
+static unsigned read_head (reader_t *reader, uint64_t *arg) {
+    unsigned initial = read_be(reader, 1);
+    unsigned info = initial & 0x1F;
+
+    if (info < 24) *arg = info;
+    else if (info <= 27) *arg = read_be(reader, 1u << (info - 24));
+    else reader->error = true;
+
+    return initial >> 5;
+}
+
+static void read_column (reader_t *reader, column_t *column) {
+    uint64_t tag, len;
+
+    if (read_head(reader, &tag) != 6 || read_head(reader, &len) != 2) {
+        reader->error = true;
+        return;
+    }
+
+    size_t width = tag == TAG_UINT8 ? 1 : tag == TAG_UINT16_BE ? 2 : tag == TAG_UINT32_BE ? 4 : 0;
+    if (width == 0 || len % width || len / width > TELEMETRY_BATCH_MAX) {
+        reader->error = true;
+        return;
+    }
+
+    column->present = true;
+    column->tag = tag;
+    column->n = len / width;
+    for (size_t i = 0; i < column->n; i++) column->values[i] = read_be(reader, width);
+}
+
+/* Decodes a batch, returns false if it is not well-formed */
+static bool decode (const uint8_t *buf, size_t len, decoded_t *out) {
+    reader_t reader = { .p = buf, .end = buf + len };
+    uint64_t pairs, key, value;
+
+    memset(out, 0, sizeof(*out));
+    if (read_head(&reader, &pairs) != 5) return false;
+    out->pairs = pairs;
+
+    for (uint64_t i = 0; i < pairs && !reader.error; i++) {
+        if (read_head(&reader, &key) != 0) return false;
+
+        if (key == TELEMETRY_KEY_VERSION || key == TELEMETRY_KEY_TS) {
+            if (read_head(&reader, &value) != 0) return false;
+            if (key == TELEMETRY_KEY_VERSION) out->version = value;
+            else out->ts = value;
+        } else if (key == TELEMETRY_KEY_ESP_ID) {
+            if (read_head(&reader, &value) != 3 || value > TELEMETRY_ESP_ID_MAX) return false;
+            if ((size_t)(reader.end - reader.p) < value) return false;
+            memcpy(out->id, reader.p, value);
+            reader.p += value;
+        } else if (key < KEYS && !out->columns[key].present) {
+            read_column(&reader, &out->columns[key]);
+        } else {
+            return false;
+        }
+    }
+
+    /* Nothing is left after the map */
+    return !reader.error && reader.p == reader.end;
+}
+
+
+/* ----------------------- CHECKS ---------------------- */
+static void check_column (const column_t *column, unsigned tag, const void *expected, size_t width, size_t n) {
+    CHECK(column->present);
+    CHECK_EQ(column->tag, tag);
+    CHECK_EQ(column->n, n);
+    if (!column->present || column->n != n) return;
+
+    for (size_t i = 0; i < n; i++) {
+        uint32_t value = width == 1 ? ((const uint8_t *)expected)[i] :
+                         width == 2 ? ((const uint16_t *)expected)[i] : ((const uint32_t *)expected)[i];
+        if (column->values[i] != value) {
+            printf("  item %zu\n", i);
+            CHECK_EQ(column->values[i], value);
+            return;
+        }
+    }
+}
+
+/* The timestamps of a column are the offsets from the base TS, as narrow as they fit */
+static void check_ts_column (const column_t *column, uint32_t base_ts, const uint32_t *ts, size_t n) {
+    uint32_t offsets[TELEMETRY_BATCH_MAX];
+    uint32_t max_offset = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        offsets[i] = ts[i] - base_ts;
+        if (offsets[i] > max_offset) max_offset = offsets[i];
+    }
+    check_column(column, max_offset <= UINT16_MAX ? TAG_UINT16_BE : TAG_UINT32_BE, offsets, sizeof(uint32_t), n);
+}
+
+/* Encodes a batch, decodes it back and compares every field with the input */
+static void round_trip (const telemetry_batch_t *batch) {
+    static uint8_t buf[TELEMETRY_BATCH_LEN];
+    telemetry_id_t id;
+    decoded_t decoded;
+
+    CHECK(telemetry_id_init(&id, TEST_ID));
+    size_t len = telemetry_encode_batch(buf, sizeof(buf), &id, batch);
+    CHECK(len > 0);
+    CHECK(len <= telemetry_batch_len(batch));
+    CHECK(decode(buf, len, &decoded));
+
+    uint32_t base_ts = UINT32_MAX;
+    for (size_t i = 0; i < batch->co2_count; i++) if (batch->co2_ts[i] < base_ts) base_ts = batch->co2_ts[i];
+    for (size_t i = 0; i < batch->ble_count; i++) if (batch->ble_ts[i] < base_ts) base_ts = batch->ble_ts[i];
+
+    CHECK_EQ(decoded.version, TELEMETRY_SCHEMA_VERSION);
+    CHECK_EQ(decoded.ts, base_ts);
+    CHECK(strcmp(decoded.id, TEST_ID) == 0);
+
+    const column_t *columns = decoded.columns;
+    unsigned pairs = 3;
+    if (batch->co2_count) {
+        size_t n = batch->co2_count;
+        check_ts_column(&columns[TELEMETRY_KEY_CO2_TS], base_ts, batch->co2_ts, n);
+        check_column(&columns[TELEMETRY_KEY_CO2], TAG_UINT16_BE, batch->co2_mean, sizeof(uint16_t), n);
+        pairs += 2;
+        if (batch->co2_stats) {
+            check_column(&columns[TELEMETRY_KEY_CO2_MIN], TAG_UINT16_BE, batch->co2_min, sizeof(uint16_t), n);
+            check_column(&columns[TELEMETRY_KEY_CO2_MAX], TAG_UINT16_BE, batch->co2_max, sizeof(uint16_t), n);
+            check_column(&columns[TELEMETRY_KEY_CO2_STD], TAG_UINT16_BE, batch->co2_std, sizeof(uint16_t), n);
+            check_column(&columns[TELEMETRY_KEY_CO2_P95], TAG_UINT16_BE, batch->co2_p95, sizeof(uint16_t), n);
+            pairs += 4;
+        } else {
+            CHECK(!columns[TELEMETRY_KEY_CO2_MIN].present);
+            CHECK(!columns[TELEMETRY_KEY_CO2_P95].present);
+        }
+    } else {
+        CHECK(!columns[TELEMETRY_KEY_CO2_TS].present);
+        CHECK(!columns[TELEMETRY_KEY_CO2].present);
+    }
+    if (batch->ble_count) {
+        size_t n = batch->ble_count;
+        check_ts_column(&columns[TELEMETRY_KEY_BLE_TS], base_ts, batch->ble_ts, n);
+        check_column(&columns[TELEMETRY_KEY_BLE_PEOPLE], TAG_UINT8, batch->ble_people, sizeof(uint8_t), n);
+        pairs += 2;
+    } else {
+        CHECK(!columns[TELEMETRY_KEY_BLE_TS].present);
+    }
+    CHECK_EQ(decoded.pairs, pairs);
+}
+
+
+/* ----------------------- TESTS ----------------------- */
+/* Windows and estimations out of order, the oldest one (a BLE estimation) is the base TS */
+static void test_short_span (void) {
+    telemetry_batch_t batch;
+    telemetry_batch_reset(&batch);
+
+    for (int i = 0; i < 10; i++) {
+        window_stats_result_t window = {
+            .mean = 400 + i * 37, .min = 380 + i, .max = 900 + i * 3, .stddev = i * 5, .quantile = 800 + i,
+        };
+        CHECK(telemetry_batch_add_co2(&batch, BASE_TS + 600 - i * 60, &window));
+    }
+    for (int i = 0; i < 5; i++) CHECK(telemetry_batch_add_ble(&batch, BASE_TS - 30 + i * 900, 250 - i));
+
+    round_trip(&batch);
+}
+
+/* Offsets at the limit of uint16, and past it (more than 18 hours in the batch) */
+static void test_long_span (void) {
+    telemetry_batch_t batch;
+
+    telemetry_batch_reset(&batch);
+    CHECK(telemetry_batch_add_co2_value(&batch, BASE_TS, 410));
+    CHECK(telemetry_batch_add_co2_value(&batch, BASE_TS + UINT16_MAX, 0xFFFF));
+    round_trip(&batch);
+
+    CHECK(telemetry_batch_add_co2_value(&batch, BASE_TS + 20 * 3600, 1));
+    CHECK(telemetry_batch_add_ble(&batch, BASE_TS + 1, 0));
+    round_trip(&batch);
+
+    /* Only BLE estimations */
+    telemetry_batch_reset(&batch);
+    CHECK(telemetry_batch_add_ble(&batch, BASE_TS + 70000, 3));
+    CHECK(telemetry_batch_add_ble(&batch, BASE_TS, 4));
+    round_trip(&batch);
+}
+
+/* A full batch fits in TELEMETRY_BATCH_LEN */
+static void test_full (void) {
+    telemetry_batch_t batch;
+    telemetry_batch_reset(&batch);
+
+    for (uint32_t i = 0; i < TELEMETRY_BATCH_MAX; i++) {
+        window_stats_result_t window = {
+            .mean = 0xFFFF - i, .min = i, .max = 0xFF00 + i, .stddev = i << 8, .quantile = 0x8000 + i,
+        };
+        CHECK(telemetry_batch_add_co2(&batch, BASE_TS + i * 2000, &window));
+        CHECK(telemetry_batch_add_ble(&batch, BASE_TS + i * 2000 + 1, i));
+    }
+    CHECK(!telemetry_batch_add_co2_value(&batch, BASE_TS, 400));
+    CHECK(!telemetry_batch_add_ble(&batch, BASE_TS, 1));
+
+    round_trip(&batch);
+}
+
+int main (void) {
+    RUN(test_short_span);
+    RUN(test_long_span);
+    RUN(test_full);
+
+    return TEST_RESULT();
+}
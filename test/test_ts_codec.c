@@ -0,0 +1,212 @@
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "test_util.h"
+#include "trace.h"
+#include "storage/ts_codec.h"
+
+/**
+ *  Round trip of the block codec, with the deltas at the limits of its codes,
+ *  and its compression ratio and throughput on the CO2 trace: the recorded
+ *  points of every node and the 1 Hz series the sensor task stores between them
+ */
+
+#define MAX_SAMPLES     (2 * 1024 * 1024)
+#define MAX_BLOCKS      (MAX_SAMPLES / 16)
+
+/* Raw sample: 32 bit timestamp and 16 bit value */
+#define RAW_SAMPLE_BYTES    6
+/* A packed block also needs its first sample, count and bits */
+#define BLOCK_HEADER_BYTES  (RAW_SAMPLE_BYTES + 4)
+
+static uint32_t ts_in[MAX_SAMPLES], ts_out[MAX_SAMPLES];
+static uint16_t value_in[MAX_SAMPLES], value_out[MAX_SAMPLES];
+static ts_block_t blocks[MAX_BLOCKS];
+
+
+static uint64_t now_ns (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Encodes the "n" samples of the input in as many blocks as needed, as ts_store does */
+static size_t encode (size_t n) {
+    size_t used = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (used == 0 || !ts_block_append(&blocks[used - 1], ts_in[i], value_in[i])) {
+            if (used == MAX_BLOCKS) return 0;
+            ts_block_init(&blocks[used], 0);
+            CHECK(ts_block_append(&blocks[used++], ts_in[i], value_in[i]));
+        }
+    }
+
+    return used;
+}
+
+static size_t decode (size_t used) {
+    size_t n = 0;
+    ts_block_iter_t iter;
+
+    for (size_t b = 0; b < used; b++) {
+        ts_block_iter_init(&iter, &blocks[b]);
+        while (n < MAX_SAMPLES && ts_block_iter_next(&iter, &ts_out[n], &value_out[n])) n++;
+    }
+
+    return n;
+}
+
+/* Encodes and decodes the input, checks every sample, returns the blocks used */
+static size_t round_trip (size_t n) {
+    size_t used = encode(n);
+    CHECK(used > 0);
+    CHECK_EQ(decode(used), n);
+
+    for (size_t i = 0; i < n; i++) {
+        if (ts_out[i] != ts_in[i] || value_out[i] != value_in[i]) {
+            printf("  sample %zu of %zu\n", i, n);
+            CHECK_EQ(ts_out[i], ts_in[i]);
+            CHECK_EQ(value_out[i], value_in[i]);
+            break;
+        }
+    }
+
+    return used;
+}
+
+static size_t packed_bytes (size_t used) {
+    size_t bytes = 0;
+
+    for (size_t b = 0; b < used; b++) bytes += BLOCK_HEADER_BYTES + (blocks[b].bits + 7) / 8;
+
+    return bytes;
+}
+
+static void test_steady (void) {
+    for (size_t i = 0; i < 1000; i++) {
+        ts_in[i] = 1643887697u + i;
+        value_in[i] = 415;
+    }
+
+    /* Two bits per sample once the period is known */
+    CHECK_EQ(round_trip(1000), 1);
+    CHECK_EQ(blocks[0].bits, (2 + 7) + 1 + 2 * 998);
+}
+
+static void test_extreme_deltas (void) {
+    static const uint32_t ts[] = {
+        1000, 1000u + INT32_MAX,                    // Largest forward delta
+        1000,                                       // Largest backward one: its delta of delta does not fit in int32_t
+        1000u + INT32_MAX, 1000, 1000, 999,         // Same second, one back
+        0, UINT32_MAX,                              // Beyond int32_t: new block
+        UINT32_MAX, 0,                              // Same the other way
+        5, 10, 15, 15 + 63, 15 + 63 + 2048, 100     // Every code of the delta of delta
+    };
+    static const uint16_t values[] = {
+        0, UINT16_MAX, 0, UINT16_MAX, 1, 0, 32768,
+        400, 401, 399, 400 + 31, 400 - 32, UINT16_MAX, 0, 7, 7, 8
+    };
+    size_t n = sizeof(ts) / sizeof(ts[0]);
+
+    CHECK_EQ(sizeof(values) / sizeof(values[0]), n);
+    memcpy(ts_in, ts, sizeof(ts));
+    memcpy(value_in, values, sizeof(values));
+
+    CHECK_EQ(round_trip(n), 3);
+    CHECK_EQ(blocks[0].count, 8);
+    CHECK_EQ(blocks[1].count, 2);
+    CHECK_EQ(blocks[2].count, n - 10);
+
+    /* Rejected samples leave the block as it was */
+    ts_block_t block;
+    ts_block_init(&block, 0);
+    CHECK(ts_block_append(&block, 0, 1));
+    CHECK(!ts_block_append(&block, (uint32_t)INT32_MAX + 1, 2));
+    CHECK_EQ(block.count, 1);
+    CHECK_EQ(block.bits, 0);
+    CHECK(ts_block_append(&block, INT32_MAX, 2));
+}
+
+/* Worst case input: every sample takes the raw codes, a block fills up and the next one goes on */
+static void test_full_block (void) {
+    uint32_t state = 2463534242u;
+    for (size_t i = 0; i < 500; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        ts_in[i] = state >> 1;
+        value_in[i] = state;
+    }
+
+    size_t used = round_trip(500);
+    CHECK(used > 1);
+    for (size_t b = 0; b + 1 < used; b++) CHECK(blocks[b].bits > (TS_BLOCK_BYTES - 7) * 8);
+}
+
+/* Compression ratio against the raw samples and throughput of a series of the input */
+static void measure (const char *name, size_t n, double min_ratio) {
+    uint64_t start_ns = now_ns();
+    size_t used = encode(n);
+    uint64_t encode_ns = now_ns() - start_ns;
+
+    start_ns = now_ns();
+    CHECK_EQ(decode(used), n);
+    uint64_t decode_ns = now_ns() - start_ns;
+
+    round_trip(n);
+
+    size_t bytes = packed_bytes(used);
+    double ratio = (double)n * RAW_SAMPLE_BYTES / bytes;
+    printf("  %-12s %8zu samples, %6zu blocks, %.2f bytes/sample, ratio %.1f, encode %.1f M/s, decode %.1f M/s\n",
+           name, n, used, (double)bytes / n, ratio, n * 1e3 / (encode_ns + 1), n * 1e3 / (decode_ns + 1));
+    CHECK(ratio >= min_ratio);
+}
+
+static void test_trace (void) {
+    trace_t trace;
+    CHECK(trace_load(TRACE_CO2, TRACE_ALL_NODES, &trace));
+    CHECK(trace.len > 0);
+
+    /* Recorded points of each node, one series after the other */
+    size_t n = 0;
+    for (int node = 1; node <= 9; node++) {
+        for (size_t i = 0; i < trace.len && n < MAX_SAMPLES; i++) {
+            if (trace.points[i].node != node) continue;
+            ts_in[n] = trace.points[i].ts;
+            value_in[n++] = trace.points[i].value;
+        }
+    }
+    measure("recorded", n, 4.0);
+
+    /* 1 Hz between the points of each node, interpolated */
+    n = 0;
+    for (int node = 1; node <= 9; node++) {
+        const trace_point_t *prev = NULL;
+        for (size_t i = 0; i < trace.len; i++) {
+            const trace_point_t *p = &trace.points[i];
+            if (p->node != node) continue;
+            if (prev && p->ts > prev->ts) {
+                for (uint32_t ts = prev->ts; ts < p->ts && n < MAX_SAMPLES; ts++) {
+                    ts_in[n] = ts;
+                    value_in[n++] = prev->value + ((int32_t)p->value - prev->value) * (int32_t)(ts - prev->ts)
+                                                  / (int32_t)(p->ts - prev->ts);
+                }
+            }
+            prev = p;
+        }
+    }
+    measure("1 Hz", n, 10.0);
+
+    trace_free(&trace);
+}
+
+int main (void) {
+    RUN(test_steady);
+    RUN(test_extreme_deltas);
+    RUN(test_full_block);
+    RUN(test_trace);
+
+    return TEST_RESULT();
+}
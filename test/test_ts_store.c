@@ -0,0 +1,137 @@
+#include <string.h>
+
+#include "test_util.h"
+#include "storage/ts_store.h"
+
+/**
+ *  Raw samples of the time-series store: one per second, the samples of the same
+ *  second averaged into it, and every sample in the rollups
+ */
+
+#define BASE_TS     1643886900u     // Start of a quarter-hour
+
+static ts_store_t store;
+static ts_bucket_t out[4096];
+
+
+/* First page of a series from "from_ts" */
+static size_t read_from (uint8_t series, ts_res_t res, uint32_t from_ts, size_t max) {
+    ts_cursor_t cursor = { .ts = from_ts, .skip = 0 };
+    return ts_store_read(&store, series, res, &cursor, out, max);
+}
+
+
+static void test_same_second (void) {
+    ts_store_init(&store);
+
+    /* Three samples in the first second, one in the next */
+    ts_store_add(&store, TS_SERIES_CO2, BASE_TS, 400);
+    ts_store_add(&store, TS_SERIES_CO2, BASE_TS, 410);
+    ts_store_add(&store, TS_SERIES_CO2, BASE_TS, 402);
+
+    /* The current second is returned as it is so far */
+    CHECK_EQ(read_from(TS_SERIES_CO2, TS_RES_RAW, 0, 16), 1);
+    CHECK_EQ(out[0].ts, BASE_TS);
+    CHECK_EQ(out[0].min, 400);
+    CHECK_EQ(out[0].max, 410);
+    CHECK_EQ(out[0].mean, 404);
+    CHECK_EQ(out[0].count, 3);
+
+    ts_store_add(&store, TS_SERIES_CO2, BASE_TS + 1, 500);
+
+    CHECK_EQ(read_from(TS_SERIES_CO2, TS_RES_RAW, 0, 16), 2);
+    CHECK_EQ(out[0].ts, BASE_TS);
+    CHECK_EQ(out[0].mean, 404);
+    CHECK_EQ(out[0].count, 1);
+    CHECK_EQ(out[1].ts, BASE_TS + 1);
+    CHECK_EQ(out[1].mean, 500);
+
+    /* Paging by time does not skip any of them */
+    CHECK_EQ(read_from(TS_SERIES_CO2, TS_RES_RAW, BASE_TS + 1, 16), 1);
+    CHECK_EQ(out[0].ts, BASE_TS + 1);
+
+    /* The rollups have every sample */
+    CHECK_EQ(read_from(TS_SERIES_CO2, TS_RES_MINUTE, 0, 16), 1);
+    CHECK_EQ(out[0].count, 4);
+    CHECK_EQ(out[0].min, 400);
+    CHECK_EQ(out[0].max, 500);
+
+    /* Other series are apart */
+    CHECK_EQ(read_from(TS_SERIES_BLE, TS_RES_RAW, 0, 16), 0);
+}
+
+static void test_series (void) {
+    ts_store_init(&store);
+
+    /* Two samples per second for an hour, CO2 and BLE interleaved */
+    for (uint32_t i = 0; i < 3600; i++) {
+        ts_store_add(&store, TS_SERIES_CO2, BASE_TS + i, 400 + i % 50);
+        ts_store_add(&store, TS_SERIES_CO2, BASE_TS + i, 402 + i % 50);
+        if (i % 30 == 0) ts_store_add(&store, TS_SERIES_BLE, BASE_TS + i, i / 30 % 7);
+    }
+
+    size_t n = read_from(TS_SERIES_CO2, TS_RES_RAW, 0, 4096);
+    CHECK_EQ(n, 3600);
+    for (size_t i = 0; i < n; i++) {
+        if (out[i].ts != BASE_TS + i || out[i].mean != 401 + i % 50) {
+            CHECK_EQ(out[i].ts, BASE_TS + i);
+            CHECK_EQ(out[i].mean, 401 + i % 50);
+            break;
+        }
+    }
+
+    CHECK_EQ(read_from(TS_SERIES_BLE, TS_RES_RAW, 0, 4096), 120);
+    CHECK_EQ(read_from(TS_SERIES_CO2, TS_RES_MINUTE, 0, 4096), 60);
+    CHECK_EQ(out[59].count, 120);
+    CHECK_EQ(read_from(TS_SERIES_CO2, TS_RES_QUARTER, 0, 4096), 4);
+    CHECK_EQ(out[0].count, 2 * 900);
+}
+
+/* Reads a series page by page, checks it matches the read in one go */
+static void check_pages (ts_res_t res, size_t total) {
+    static ts_bucket_t all[16];
+    CHECK_EQ(read_from(TS_SERIES_CO2, res, BASE_TS, 16), total);
+    memcpy(all, out, total * sizeof(out[0]));
+
+    for (size_t page = 1; page <= total; page++) {
+        ts_cursor_t cursor = { .ts = BASE_TS, .skip = 0 };
+        size_t n = 0, got;
+        while (n < total && (got = ts_store_read(&store, TS_SERIES_CO2, res, &cursor, out, page)) > 0) {
+            for (size_t i = 0; i < got && n + i < total; i++) {
+                CHECK_EQ(out[i].ts, all[n + i].ts);
+                CHECK_EQ(out[i].mean, all[n + i].mean);
+            }
+            n += got;
+        }
+        CHECK_EQ(n, total);
+        CHECK_EQ(ts_store_read(&store, TS_SERIES_CO2, res, &cursor, out, page), 0);
+    }
+}
+
+/* The cursor neither skips nor repeats the samples/buckets that share a timestamp */
+static void test_paging (void) {
+    ts_store_init(&store);
+
+    /* A full raw slot and minute bucket are closed, the rest goes to new ones at the same time */
+    for (uint32_t i = 0; i < UINT16_MAX; i++) ts_store_add(&store, TS_SERIES_CO2, BASE_TS, 400);
+    for (uint32_t i = 0; i < 100; i++) ts_store_add(&store, TS_SERIES_CO2, BASE_TS, 500);
+    ts_store_add(&store, TS_SERIES_CO2, BASE_TS + 1, 600);
+
+    check_pages(TS_RES_RAW, 3);
+    check_pages(TS_RES_MINUTE, 2);
+
+    /* The open bucket read last is not repeated once it is closed */
+    ts_cursor_t cursor = { .ts = BASE_TS, .skip = 0 };
+    CHECK_EQ(ts_store_read(&store, TS_SERIES_CO2, TS_RES_RAW, &cursor, out, 16), 3);
+    ts_store_add(&store, TS_SERIES_CO2, BASE_TS + 2, 700);
+    CHECK_EQ(ts_store_read(&store, TS_SERIES_CO2, TS_RES_RAW, &cursor, out, 16), 1);
+    CHECK_EQ(out[0].ts, BASE_TS + 2);
+}
+
+int main (void) {
+    RUN(test_same_second);
+    RUN(test_series);
+    RUN(test_paging);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,39 @@
+#ifndef TEST_UTIL_H_
+#define TEST_UTIL_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ *  Checks of the host tests
+ *  A failed check is reported and the test goes on, the exit code of the test
+ *  tells ctest if any of them failed
+ */
+
+static int test_failures;
+
+#define CHECK(cond) do {                                                    \
+    if (!(cond)) {                                                          \
+        test_failures++;                                                    \
+        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);     \
+    }                                                                       \
+} while (0)
+
+#define CHECK_EQ(actual, expected) do {                                     \
+    long long _actual = (actual), _expected = (expected);                   \
+    if (_actual != _expected) {                                             \
+        test_failures++;                                                    \
+        printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__,    \
+               #actual, _actual, _expected);                                \
+    }                                                                       \
+} while (0)
+
+#define RUN(test) do {                                                      \
+    printf("- %s\n", #test);                                                \
+    test();                                                                 \
+} while (0)
+
+#define TEST_RESULT() (test_failures == 0 ? EXIT_SUCCESS :                  \
+                       (printf("%d checks failed\n", test_failures), EXIT_FAILURE))
+
+#endif
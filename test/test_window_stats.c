@@ -0,0 +1,182 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+#include "processing/window_stats.h"
+
+/**
+ *  Statistics of a window against a reference computed with all the samples in
+ *  double precision: the time-weighted mean and standard deviation, and the P²
+ *  quantile, which is per sample (the weights do not move it)
+ */
+
+#define MAX_SAMPLES     20000
+
+static uint16_t values[MAX_SAMPLES];
+static uint32_t weights[MAX_SAMPLES];
+static uint32_t rng = 12345;
+
+
+/* Deterministic LCG, so a failure can be reproduced */
+static uint32_t next_random (void) {
+    rng = rng * 1103515245 + 12345;
+    return rng >> 8;
+}
+
+/* Roughly normal samples (sum of uniforms) around "center" */
+static uint16_t random_value (uint16_t center, uint16_t spread) {
+    int32_t sum = 0;
+    for (int i = 0; i < 4; i++) sum += next_random() % (2 * spread + 1);
+    return center + sum / 4 - spread;
+}
+
+static int compare_u16 (const void *a, const void *b) {
+    return *(const uint16_t *)a - *(const uint16_t *)b;
+}
+
+/* Nearest rank of the sorted samples, the same definition used below 5 samples */
+static uint16_t reference_quantile (size_t n, float p) {
+    static uint16_t sorted[MAX_SAMPLES];
+
+    memcpy(sorted, values, n * sizeof(*values));
+    qsort(sorted, n, sizeof(*sorted), compare_u16);
+
+    size_t rank = (size_t)ceil(p * n);
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/* Fraction of the samples below "value" */
+static double fraction_below (size_t n, uint16_t value) {
+    size_t below = 0;
+
+    for (size_t i = 0; i < n; i++) below += values[i] < value;
+    return (double)below / n;
+}
+
+/**
+ *  Adds the first "n" samples and compares the results with the reference. The
+ *  quantile is exact up to 5 samples, then the estimate must be at a rank within
+ *  "rank_tolerance" of p (a value error says little where the samples are sparse)
+ */
+static void check_window (size_t n, float p, double rank_tolerance) {
+    window_stats_t stats;
+    window_stats_result_t result;
+    double weight_sum = 0, mean = 0, m2 = 0;
+    uint16_t min = UINT16_MAX, max = 0;
+
+    window_stats_init(&stats, p);
+    for (size_t i = 0; i < n; i++) {
+        window_stats_add(&stats, values[i], weights[i]);
+
+        if (values[i] < min) min = values[i];
+        if (values[i] > max) max = values[i];
+        weight_sum += weights[i];
+        mean += (double)values[i] * weights[i];
+    }
+    mean /= weight_sum;
+    for (size_t i = 0; i < n; i++) m2 += weights[i] * (values[i] - mean) * (values[i] - mean);
+
+    window_stats_get(&stats, &result);
+    CHECK_EQ(result.count, n);
+    CHECK_EQ(result.min, min);
+    CHECK_EQ(result.max, max);
+    CHECK(fabs(result.mean - mean) <= 1);
+    CHECK(fabs(result.stddev - sqrt(m2 / weight_sum)) <= 1);
+
+    if (n <= WINDOW_STATS_MARKERS) {
+        CHECK_EQ(result.quantile, reference_quantile(n, p));
+        return;
+    }
+
+    double below = fraction_below(n, result.quantile);
+    double above = 1 - fraction_below(n, result.quantile + 1);
+    if (below > p + rank_tolerance || above > 1 - p + rank_tolerance) {
+        printf("  %zu samples, p %.2f: quantile %u, reference %u, %.3f below, %.3f above\n",
+               n, p, result.quantile, reference_quantile(n, p), below, above);
+        CHECK(below <= p + rank_tolerance && above <= 1 - p + rank_tolerance);
+    }
+}
+
+
+/* ----------------------- TESTS ----------------------- */
+/* Periods of an adaptive rate (1 s to 5 min), so the weighted mean differs from the plain one */
+static void test_weighted (void) {
+    for (size_t i = 0; i < MAX_SAMPLES; i++) {
+        weights[i] = 1000 * (1 + next_random() % 300);
+        values[i] = random_value(weights[i] > 150000 ? 600 : 1200, 200);
+    }
+
+    check_window(2, 0.95f, 0);
+    check_window(100, 0.95f, 0.03);
+    check_window(MAX_SAMPLES, 0.95f, 0.01);
+    check_window(MAX_SAMPLES, 0.5f, 0.01);
+}
+
+/* The same weight for all: the mean and stddev of the samples */
+static void test_equal_weights (void) {
+    window_stats_t stats;
+    window_stats_result_t result;
+
+    window_stats_init(&stats, 0.95f);
+    for (uint16_t v = 401; v <= 409; v++) window_stats_add(&stats, v, 5000);
+    window_stats_get(&stats, &result);
+    CHECK_EQ(result.mean, 405);
+    CHECK_EQ(result.stddev, 3);     // sqrt(60 / 9) = 2.58
+    CHECK_EQ(result.min, 401);
+    CHECK_EQ(result.max, 409);
+
+    /* Without weights the mean is the min, and there is no stddev */
+    window_stats_reset(&stats);
+    window_stats_add(&stats, 700, 0);
+    window_stats_add(&stats, 900, 0);
+    window_stats_get(&stats, &result);
+    CHECK_EQ(result.count, 2);
+    CHECK_EQ(result.mean, 700);
+    CHECK_EQ(result.stddev, 0);
+
+    /* Empty window */
+    window_stats_reset(&stats);
+    window_stats_get(&stats, &result);
+    CHECK_EQ(result.count, 0);
+    CHECK_EQ(result.quantile, 0);
+}
+
+/* Up to 5 samples the quantile is the exact nearest rank */
+static void test_few_samples (void) {
+    for (size_t n = 1; n <= WINDOW_STATS_MARKERS; n++) {
+        for (size_t i = 0; i < n; i++) {
+            values[i] = random_value(800, 300);
+            weights[i] = 1000;
+        }
+        check_window(n, 0.95f, 0);
+        check_window(n, 0.5f, 0);
+    }
+}
+
+/**
+ *  The quantile counts samples, not time: a long low reading weighs on the mean,
+ *  but the p95 is still the level exceeded by 5% of the readings
+ */
+static void test_quantile_per_sample (void) {
+    window_stats_t stats;
+    window_stats_result_t result;
+
+    window_stats_init(&stats, 0.95f);
+    window_stats_add(&stats, 400, 3600000);
+    for (int i = 0; i < 99; i++) window_stats_add(&stats, 1000 + i, 1000);
+    window_stats_get(&stats, &result);
+
+    CHECK(result.mean < 430);
+    CHECK(abs(result.quantile - 1093) <= 3);
+}
+
+int main (void) {
+    RUN(test_weighted);
+    RUN(test_equal_weights);
+    RUN(test_few_samples);
+    RUN(test_quantile_per_sample);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,76 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+static const char *months[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+static bool trace_parse (const char *line, trace_point_t *point) {
+    unsigned node, value, day, year, hour, min, sec;
+    char month[4];
+
+    if (sscanf(line, "%u,%u,%3s-%u-%u,%u:%u:%u", &node, &value, month, &day, &year, &hour, &min, &sec) != 8) {
+        return false;
+    }
+
+    struct tm tm = {
+        .tm_year = year - 1900,
+        .tm_mday = day,
+        .tm_hour = hour,
+        .tm_min = min,
+        .tm_sec = sec,
+        .tm_mon = -1,
+    };
+    for (int i = 0; i < 12; i++) {
+        if (strcmp(month, months[i]) == 0) tm.tm_mon = i;
+    }
+    if (tm.tm_mon < 0) return false;
+
+    point->node = node;
+    point->value = value;
+    point->ts = (uint32_t)timegm(&tm);
+
+    return true;
+}
+
+bool trace_load (const char *name, int node, trace_t *trace) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", TRACES_DIR, name);
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        printf("Trace %s not found\n", path);
+        return false;
+    }
+
+    size_t capacity = 1024;
+    trace->points = malloc(capacity * sizeof(trace_point_t));
+    trace->len = 0;
+
+    char line[128];
+    trace_point_t point;
+    while (fgets(line, sizeof(line), file)) {
+        if (!trace_parse(line, &point)) continue;
+        if (node != TRACE_ALL_NODES && point.node != node) continue;
+
+        if (trace->len == capacity) {
+            capacity *= 2;
+            trace->points = realloc(trace->points, capacity * sizeof(trace_point_t));
+        }
+        trace->points[trace->len++] = point;
+    }
+    fclose(file);
+
+    return trace->len > 0;
+}
+
+void trace_free (trace_t *trace) {
+    free(trace->points);
+    trace->points = NULL;
+    trace->len = 0;
+}
@@ -0,0 +1,35 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *  Traces recorded by the Node-RED flow (node-red/esp-co2.csv and esp-ble.csv)
+ *  Each line is "node,value,Mon-DD-YYYY,HH:MM:SS"
+ */
+
+#define TRACE_CO2   "esp-co2.csv"
+#define TRACE_BLE   "esp-ble.csv"
+
+/* Any node of the trace */
+#define TRACE_ALL_NODES     0
+
+typedef struct {
+    uint8_t node;
+    uint16_t value;
+    uint32_t ts;                // Epoch (secs, UTC)
+} trace_point_t;
+
+typedef struct {
+    trace_point_t *points;
+    size_t len;
+} trace_t;
+
+/* Loads the points of a node (or every node) of a trace of TRACES_DIR, in file order */
+bool trace_load (const char *name, int node, trace_t *trace);
+
+void trace_free (trace_t *trace);
+
+#endif